@@ -92,13 +92,22 @@ int __init parse_acpi_topology(void)
 		if (topology_id < 0)
 			return topology_id;
 
+		/*
+		 * The PPTT node right above the core is the cluster. On
+		 * machines without a cluster level this resolves to the
+		 * package, which cpu_clustergroup_mask() then ignores.
+		 */
 		if (acpi_cpu_is_threaded(cpu)) {
 			cpu_topology[cpu].thread_id = topology_id;
 			topology_id = find_acpi_cpu_topology(cpu, 1);
 			cpu_topology[cpu].core_id   = topology_id;
+			topology_id = find_acpi_cpu_topology(cpu, 2);
+			cpu_topology[cpu].cluster_id = topology_id;
 		} else {
 			cpu_topology[cpu].thread_id  = -1;
 			cpu_topology[cpu].core_id    = topology_id;
+			topology_id = find_acpi_cpu_topology(cpu, 1);
+			cpu_topology[cpu].cluster_id = topology_id;
 		}
 		topology_id = find_acpi_cpu_topology_package(cpu);
 		cpu_topology[cpu].package_id = topology_id;
@@ -47,6 +47,7 @@
 #include "blk-mq-sched.h"
 #include "blk-pm.h"
 #include "blk-rq-qos.h"
+#include "blk-crypto-internal.h"
 
 #ifdef CONFIG_DEBUG_FS
 struct dentry *blk_debugfs_root;
@@ -638,6 +639,8 @@ bool bio_attempt_front_merge(struct request *req, struct bio *bio,
 	req->__sector = bio->bi_iter.bi_sector;
 	req->__data_len += bio->bi_iter.bi_size;
 
+	bio_crypt_do_front_merge(req, bio);
+
 	blk_account_io_start(req, false);
 	return true;
 }
@@ -667,14 +670,96 @@ bool bio_attempt_discard_merge(struct request_queue *q, struct request *req,
 	return false;
 }
 
+/*
+ * Mergeable requests on a plug list are indexed like on an elevator: hashed
+ * by end sector for back merges, and sorted by queue and start sector for
+ * front merges.  This keeps merge lookups cheap for deep plugs.
+ */
+#define rq_plug_hash_key(rq)	(blk_rq_pos(rq) + blk_rq_sectors(rq))
+
+static void blk_plug_tree_add(struct blk_plug *plug, struct request *rq)
+{
+	struct rb_node **p = &plug->merge_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct request *__rq;
+
+	while (*p) {
+		parent = *p;
+		__rq = rb_entry_rq(parent);
+
+		if (rq->q < __rq->q ||
+		    (rq->q == __rq->q && blk_rq_pos(rq) < blk_rq_pos(__rq)))
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+
+	rb_link_node(&rq->rb_node, parent, p);
+	rb_insert_color(&rq->rb_node, &plug->merge_tree);
+}
+
+static struct request *blk_plug_tree_find(struct blk_plug *plug,
+					  struct request_queue *q,
+					  sector_t sector)
+{
+	struct rb_node *n = plug->merge_tree.rb_node;
+	struct request *rq;
+
+	while (n) {
+		rq = rb_entry_rq(n);
+
+		if (q < rq->q || (q == rq->q && sector < blk_rq_pos(rq)))
+			n = n->rb_left;
+		else if (q > rq->q || sector > blk_rq_pos(rq))
+			n = n->rb_right;
+		else
+			return rq;
+	}
+
+	return NULL;
+}
+
+void blk_plug_merge_add(struct blk_plug *plug, struct request *rq)
+{
+	if (!rq_mergeable(rq))
+		return;
+
+	hash_add(plug->merge_hash, &rq->hash, rq_plug_hash_key(rq));
+	blk_plug_tree_add(plug, rq);
+}
+
+void blk_plug_merge_del(struct blk_plug *plug, struct request *rq)
+{
+	hash_del(&rq->hash);
+	if (!RB_EMPTY_NODE(&rq->rb_node)) {
+		rb_erase(&rq->rb_node, &plug->merge_tree);
+		RB_CLEAR_NODE(&rq->rb_node);
+	}
+}
+
+static bool blk_attempt_plug_discard_merge(struct blk_plug *plug,
+					   struct request_queue *q,
+					   struct bio *bio)
+{
+	struct request *rq;
+
+	list_for_each_entry_reverse(rq, &plug->mq_list, queuelist) {
+		if (rq->q != q || !blk_rq_merge_ok(rq, bio))
+			continue;
+
+		if (blk_try_merge(rq, bio) == ELEVATOR_DISCARD_MERGE &&
+		    bio_attempt_discard_merge(q, rq, bio))
+			return true;
+	}
+
+	return false;
+}
+
 /**
  * blk_attempt_plug_merge - try to merge with %current's plugged list
  * @q: request_queue new bio is being queued at
  * @bio: new bio being queued
  * @nr_segs: number of segments in @bio
- * @same_queue_rq: pointer to &struct request that gets filled in when
- * another request associated with @q is found on the plug list
- * (optional, may be %NULL)
  *
  * Determine whether @bio being queued on @q can be merged with a request
  * on %current's plugged list.  Returns %true if merge was successful,
@@ -687,52 +772,50 @@ bool bio_attempt_discard_merge(struct request_queue *q, struct request *req,
  * reliable access to the elevator outside queue lock.  Only check basic
  * merging parameters without querying the elevator.
  *
+ * Candidates are looked up in the plug's merge index rather than by walking
+ * the whole plug list, except for discards which may merge with any discard
+ * request when the queue supports multiple discard ranges.
+ *
  * Caller must ensure !blk_queue_nomerges(q) beforehand.
  */
 bool blk_attempt_plug_merge(struct request_queue *q, struct bio *bio,
-		unsigned int nr_segs, struct request **same_queue_rq)
+		unsigned int nr_segs)
 {
+	sector_t sector = bio->bi_iter.bi_sector;
 	struct blk_plug *plug;
 	struct request *rq;
-	struct list_head *plug_list;
 
 	plug = blk_mq_plug(q, bio);
-	if (!plug)
+	if (!plug || list_empty(&plug->mq_list))
 		return false;
 
-	plug_list = &plug->mq_list;
-
-	list_for_each_entry_reverse(rq, plug_list, queuelist) {
-		bool merged = false;
-
-		if (rq->q == q && same_queue_rq) {
-			/*
-			 * Only blk-mq multiple hardware queues case checks the
-			 * rq in the same queue, there should be only one such
-			 * rq in a queue
-			 **/
-			*same_queue_rq = rq;
-		}
+	if (bio_op(bio) == REQ_OP_DISCARD &&
+	    blk_attempt_plug_discard_merge(plug, q, bio))
+		return true;
 
-		if (rq->q != q || !blk_rq_merge_ok(rq, bio))
+	/* a request ending where the bio starts */
+	hash_for_each_possible(plug->merge_hash, rq, hash, sector) {
+		if (rq->q != q || rq_plug_hash_key(rq) != sector ||
+		    !blk_rq_merge_ok(rq, bio))
 			continue;
 
-		switch (blk_try_merge(rq, bio)) {
-		case ELEVATOR_BACK_MERGE:
-			merged = bio_attempt_back_merge(rq, bio, nr_segs);
-			break;
-		case ELEVATOR_FRONT_MERGE:
-			merged = bio_attempt_front_merge(rq, bio, nr_segs);
-			break;
-		case ELEVATOR_DISCARD_MERGE:
-			merged = bio_attempt_discard_merge(q, rq, bio);
-			break;
-		default:
-			break;
+		if (blk_try_merge(rq, bio) == ELEVATOR_BACK_MERGE &&
+		    bio_attempt_back_merge(rq, bio, nr_segs)) {
+			hash_del(&rq->hash);
+			hash_add(plug->merge_hash, &rq->hash,
+				 rq_plug_hash_key(rq));
+			return true;
 		}
+	}
 
-		if (merged)
-			return true;
+	/* a request starting where the bio ends */
+	rq = blk_plug_tree_find(plug, q, bio_end_sector(bio));
+	if (rq && blk_rq_merge_ok(rq, bio) &&
+	    blk_try_merge(rq, bio) == ELEVATOR_FRONT_MERGE &&
+	    bio_attempt_front_merge(rq, bio, nr_segs)) {
+		rb_erase(&rq->rb_node, &plug->merge_tree);
+		blk_plug_tree_add(plug, rq);
+		return true;
 	}
 
 	return false;
@@ -1064,7 +1147,8 @@ blk_qc_t generic_make_request(struct bio *bio)
 			/* Create a fresh bio_list for all subordinate requests */
 			bio_list_on_stack[1] = bio_list_on_stack[0];
 			bio_list_init(&bio_list_on_stack[0]);
-			ret = q->make_request_fn(q, bio);
+			if (blk_crypto_bio_prep(&bio))
+				ret = q->make_request_fn(q, bio);
 
 			blk_queue_exit(q);
 
@@ -1126,6 +1210,11 @@ blk_qc_t direct_make_request(struct bio *bio)
 		return BLK_QC_T_NONE;
 	}
 
+	if (!blk_crypto_bio_prep(&bio)) {
+		blk_queue_exit(q);
+		return BLK_QC_T_NONE;
+	}
+
 	ret = q->make_request_fn(q, bio);
 	blk_queue_exit(q);
 	return ret;
@@ -1256,6 +1345,9 @@ blk_status_t blk_insert_cloned_request(struct request_queue *q, struct request *
 	    should_fail_request(&rq->rq_disk->part0, blk_rq_bytes(rq)))
 		return BLK_STS_IOERR;
 
+	if (blk_crypto_insert_cloned_request(rq))
+		return BLK_STS_IOERR;
+
 	if (blk_queue_io_stat(q))
 		blk_account_io_start(rq, true);
 
@@ -1643,6 +1735,12 @@ int blk_rq_prep_clone(struct request *rq, struct request *rq_src,
 
 	__blk_rq_prep_clone(rq, rq_src);
 
+	if (rq->bio && blk_crypto_rq_bio_prep(rq, rq->bio, gfp_mask) < 0) {
+		/* all clones are linked into @rq by now */
+		bio = NULL;
+		goto free_and_out;
+	}
+
 	return 0;
 
 free_and_out:
@@ -1710,6 +1808,7 @@ void blk_start_plug(struct blk_plug *plug)
 	INIT_LIST_HEAD(&plug->cb_list);
 	plug->rq_count = 0;
 	plug->multiple_queues = false;
+	blk_plug_merge_init(plug);
 
 	/*
 	 * Store ordering should not be needed here, since a potential
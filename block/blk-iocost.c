@@ -49,6 +49,15 @@
  * If needed, tools/cgroup/iocost_coef_gen.py can be used to generate
  * device-specific coefficients.
  *
+ * Alternatively, "model=auto" makes the kernel calibrate the linear model
+ * itself.  Whenever an IO is serviced with nothing else in flight on the
+ * device, its service time is recorded.  Per direction, a least squares
+ * fit of the sequential IOs' service time against their size gives the
+ * per-page cost and the sequential base cost, and the random IOs' service
+ * times less their size cost give the random base cost.  The results are
+ * folded into the coefficients every period once enough samples exist.
+ * Until then, the defaults for the device class are used.
+ *
  * 2. Control Strategy
  *
  * The device virtual time (vtime) is used as the primary control metric.
@@ -302,6 +311,16 @@ enum {
 
 	/* if apart further than 16M, consider randio for linear model */
 	LCOEF_RANDIO_PAGES	= 4096,
+
+	/*
+	 * Auto calibration of the linear model: the number of samples
+	 * needed for a fit and the number after which old samples are
+	 * aged out, and the longest service time considered.
+	 */
+	CALIB_MIN_SEQ_SAMPLES	= 64,
+	CALIB_MIN_RAND_SAMPLES	= 16,
+	CALIB_MAX_SAMPLES	= 1024,
+	CALIB_MAX_NSEC		= NSEC_PER_SEC,
 };
 
 enum ioc_running {
@@ -388,6 +407,33 @@ struct ioc_pcpu_stat {
 	u64				last_rq_wait_ns;
 };
 
+/* service times of IOs that ran alone on the device, per direction */
+struct ioc_calib_stat {
+	/* sequential IOs: size in pages (x) against service time (y) */
+	u64				seq_n;
+	u64				seq_sx;
+	u64				seq_sy;
+	u64				seq_sxx;
+	u64				seq_sxy;
+
+	/* random IOs */
+	u64				rand_n;
+	u64				rand_sx;
+	u64				rand_sy;
+
+	sector_t			cursor;		/* to detect randio */
+};
+
+struct ioc_calib {
+	spinlock_t			lock;
+	atomic_t			nr_inflight;
+	u64				last_done_at;
+	struct ioc_calib_stat		stat[2];
+
+	/* fitted rbps, rseqiops, ..., 0 if not known yet */
+	u64				i_lcoefs[NR_I_LCOEFS];
+};
+
 /* per device */
 struct ioc {
 	struct rq_qos			rqos;
@@ -424,6 +470,9 @@ struct ioc {
 	int				autop_idx;
 	bool				user_qos_params:1;
 	bool				user_cost_model:1;
+	bool				auto_cost_model:1;
+
+	struct ioc_calib		calib;
 };
 
 /* per device-cgroup pair */
@@ -813,6 +862,172 @@ static void ioc_refresh_lcoefs(struct ioc *ioc)
 		    &c[LCOEF_WPAGE], &c[LCOEF_WSEQIO], &c[LCOEF_WRANDIO]);
 }
 
+/* override the default coefficients with the calibrated ones known so far */
+static void ioc_apply_calib(struct ioc *ioc)
+{
+	int i;
+
+	for (i = 0; i < NR_I_LCOEFS; i++)
+		if (ioc->calib.i_lcoefs[i])
+			ioc->params.i_lcoefs[i] = ioc->calib.i_lcoefs[i];
+}
+
+static void ioc_calib_reset(struct ioc *ioc)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ioc->calib.lock, flags);
+	memset(ioc->calib.stat, 0, sizeof(ioc->calib.stat));
+	ioc->calib.last_done_at = ktime_get_ns();
+	spin_unlock_irqrestore(&ioc->calib.lock, flags);
+
+	memset(ioc->calib.i_lcoefs, 0, sizeof(ioc->calib.i_lcoefs));
+}
+
+/*
+ * Record the service time of an IO, if it had the device to itself: nothing
+ * else was in flight when it completed and nothing completed since it was
+ * issued.
+ */
+static void ioc_calib_done(struct ioc *ioc, struct request *rq, int rw,
+			   u64 now)
+{
+	struct ioc_calib *calib = &ioc->calib;
+	struct ioc_calib_stat *st;
+	u64 pages = max_t(u64, blk_rq_sectors(rq) >> IOC_SECT_TO_PAGE_SHIFT, 1);
+	u64 seek_pages = 0, nsecs;
+	unsigned long flags;
+	bool alone;
+
+	alone = atomic_dec_return(&calib->nr_inflight) == 0;
+	if (!ioc->auto_cost_model)
+		return;
+
+	spin_lock_irqsave(&calib->lock, flags);
+
+	alone = alone && rq->io_start_time_ns > calib->last_done_at;
+	calib->last_done_at = now;
+
+	if (!alone || rw < 0 || now <= rq->io_start_time_ns)
+		goto out;
+
+	st = &calib->stat[rw];
+	nsecs = now - rq->io_start_time_ns;
+	if (nsecs > CALIB_MAX_NSEC || pages > LCOEF_RANDIO_PAGES)
+		goto out;
+
+	if (st->cursor) {
+		seek_pages = abs(blk_rq_pos(rq) - st->cursor);
+		seek_pages >>= IOC_SECT_TO_PAGE_SHIFT;
+	}
+	st->cursor = blk_rq_pos(rq) + blk_rq_sectors(rq);
+
+	if (seek_pages > LCOEF_RANDIO_PAGES) {
+		st->rand_n++;
+		st->rand_sx += pages;
+		st->rand_sy += nsecs;
+		if (st->rand_n >= CALIB_MAX_SAMPLES) {
+			st->rand_n /= 2;
+			st->rand_sx /= 2;
+			st->rand_sy /= 2;
+		}
+	} else {
+		st->seq_n++;
+		st->seq_sx += pages;
+		st->seq_sy += nsecs;
+		st->seq_sxx += pages * pages;
+		st->seq_sxy += pages * nsecs;
+		if (st->seq_n >= CALIB_MAX_SAMPLES) {
+			st->seq_n /= 2;
+			st->seq_sx /= 2;
+			st->seq_sy /= 2;
+			st->seq_sxx /= 2;
+			st->seq_sxy /= 2;
+		}
+	}
+out:
+	spin_unlock_irqrestore(&calib->lock, flags);
+}
+
+static u64 calib_blend(u64 old, u64 new)
+{
+	return old ? (old * 3 + new) / 4 : new;
+}
+
+/*
+ * Fit the linear model of one direction to the recorded service times and
+ * fold the result into ioc->calib.i_lcoefs.  Returns whether anything
+ * changed.
+ */
+static bool ioc_calib_fit(struct ioc *ioc, int rw)
+{
+	u64 *fit = &ioc->calib.i_lcoefs[rw == READ ? I_LCOEF_RBPS : I_LCOEF_WBPS];
+	u64 *dfl = &ioc->params.i_lcoefs[rw == READ ? I_LCOEF_RBPS : I_LCOEF_WBPS];
+	struct ioc_calib_stat st;
+	s64 den, slope, seqio, randio;
+
+	spin_lock(&ioc->calib.lock);
+	st = ioc->calib.stat[rw];
+	spin_unlock(&ioc->calib.lock);
+
+	if (st.seq_n < CALIB_MIN_SEQ_SAMPLES)
+		return false;
+
+	/*
+	 * The per-page cost is the slope of service time over size.  If the
+	 * IOs were too uniform in size to tell, keep the current bps.
+	 */
+	den = st.seq_n * st.seq_sxx - st.seq_sx * st.seq_sx;
+	if (den >= (s64)(st.seq_n * st.seq_n))
+		slope = div64_s64((s64)(st.seq_n * st.seq_sxy) -
+				  (s64)(st.seq_sx * st.seq_sy), den);
+	else if (dfl[0])
+		slope = div64_u64((u64)NSEC_PER_SEC * IOC_PAGE_SIZE, dfl[0]);
+	else
+		return false;
+
+	if (slope <= 0)
+		return false;
+
+	seqio = div64_s64((s64)st.seq_sy - slope * (s64)st.seq_sx,
+			  st.seq_n);
+	seqio = max_t(s64, seqio, 0);
+
+	fit[0] = calib_blend(fit[0], div64_u64((u64)NSEC_PER_SEC * IOC_PAGE_SIZE,
+					       slope));
+	fit[1] = calib_blend(fit[1], div64_u64(NSEC_PER_SEC, seqio + slope));
+
+	if (st.rand_n >= CALIB_MIN_RAND_SAMPLES) {
+		randio = div64_s64((s64)st.rand_sy - slope * (s64)st.rand_sx,
+				   st.rand_n);
+		randio = max_t(s64, randio, 0);
+		fit[2] = calib_blend(fit[2], div64_u64(NSEC_PER_SEC,
+						       randio + slope));
+	}
+
+	trace_iocost_ioc_calib(ioc, rw, fit[0], fit[1], fit[2], st.seq_n,
+			       st.rand_n);
+	return true;
+}
+
+static void ioc_calib_update(struct ioc *ioc)
+{
+	bool updated;
+
+	lockdep_assert_held(&ioc->lock);
+
+	if (!ioc->auto_cost_model || ioc->user_cost_model)
+		return;
+
+	updated = ioc_calib_fit(ioc, READ);
+	updated |= ioc_calib_fit(ioc, WRITE);
+
+	if (updated) {
+		ioc_apply_calib(ioc);
+		ioc_refresh_lcoefs(ioc);
+	}
+}
+
 static bool ioc_refresh_params(struct ioc *ioc, bool force)
 {
 	const struct ioc_params *p;
@@ -835,8 +1050,11 @@ static bool ioc_refresh_params(struct ioc *ioc, bool force)
 
 	if (!ioc->user_qos_params)
 		memcpy(ioc->params.qos, p->qos, sizeof(p->qos));
-	if (!ioc->user_cost_model)
+	if (!ioc->user_cost_model) {
 		memcpy(ioc->params.i_lcoefs, p->i_lcoefs, sizeof(p->i_lcoefs));
+		if (ioc->auto_cost_model)
+			ioc_apply_calib(ioc);
+	}
 
 	ioc_refresh_period_us(ioc);
 	ioc_refresh_lcoefs(ioc);
@@ -1608,6 +1826,7 @@ static void ioc_timer_fn(struct timer_list *timer)
 	}
 
 	ioc_refresh_params(ioc, false);
+	ioc_calib_update(ioc);
 
 	/*
 	 * This period is done.  Move onto the next one.  If nothing's
@@ -1842,15 +2061,27 @@ static void ioc_rqos_done_bio(struct rq_qos *rqos, struct bio *bio)
 		atomic64_add(bio->bi_iocost_cost, &iocg->done_vtime);
 }
 
+static void ioc_rqos_issue(struct rq_qos *rqos, struct request *rq)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+
+	atomic_inc(&ioc->calib.nr_inflight);
+}
+
+static void ioc_rqos_requeue(struct rq_qos *rqos, struct request *rq)
+{
+	struct ioc *ioc = rqos_to_ioc(rqos);
+
+	if (rq->rq_flags & RQF_STATS)
+		atomic_dec(&ioc->calib.nr_inflight);
+}
+
 static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 {
 	struct ioc *ioc = rqos_to_ioc(rqos);
-	u64 on_q_ns, rq_wait_ns;
+	u64 now, on_q_ns, rq_wait_ns;
 	int pidx, rw;
 
-	if (!ioc->enabled || !rq->alloc_time_ns || !rq->start_time_ns)
-		return;
-
 	switch (req_op(rq) & REQ_OP_MASK) {
 	case REQ_OP_READ:
 		pidx = QOS_RLAT;
@@ -1861,10 +2092,22 @@ static void ioc_rqos_done(struct rq_qos *rqos, struct request *rq)
 		rw = WRITE;
 		break;
 	default:
-		return;
+		pidx = -1;
+		rw = -1;
+		break;
 	}
 
-	on_q_ns = ktime_get_ns() - rq->alloc_time_ns;
+	now = ktime_get_ns();
+
+	/* issued requests are counted in ioc_rqos_issue() */
+	if (rq->rq_flags & RQF_STATS)
+		ioc_calib_done(ioc, rq, rw, now);
+
+	if (!ioc->enabled || !rq->alloc_time_ns || !rq->start_time_ns ||
+	    rw < 0)
+		return;
+
+	on_q_ns = now - rq->alloc_time_ns;
 	rq_wait_ns = rq->start_time_ns - rq->alloc_time_ns;
 
 	if (on_q_ns <= ioc->params.qos[pidx] * NSEC_PER_USEC)
@@ -1902,6 +2145,8 @@ static void ioc_rqos_exit(struct rq_qos *rqos)
 static struct rq_qos_ops ioc_rqos_ops = {
 	.throttle = ioc_rqos_throttle,
 	.merge = ioc_rqos_merge,
+	.issue = ioc_rqos_issue,
+	.requeue = ioc_rqos_requeue,
 	.done_bio = ioc_rqos_done_bio,
 	.done = ioc_rqos_done,
 	.queue_depth_changed = ioc_rqos_queue_depth_changed,
@@ -1930,6 +2175,7 @@ static int blk_iocost_init(struct request_queue *q)
 	rqos->q = q;
 
 	spin_lock_init(&ioc->lock);
+	spin_lock_init(&ioc->calib.lock);
 	timer_setup(&ioc->timer, ioc_timer_fn, 0);
 	INIT_LIST_HEAD(&ioc->active_iocgs);
 
@@ -2311,10 +2557,11 @@ static u64 ioc_cost_model_prfill(struct seq_file *sf,
 	if (!dname)
 		return 0;
 
-	seq_printf(sf, "%s ctrl=%s model=linear "
+	seq_printf(sf, "%s ctrl=%s model=%s "
 		   "rbps=%llu rseqiops=%llu rrandiops=%llu "
 		   "wbps=%llu wseqiops=%llu wrandiops=%llu\n",
 		   dname, ioc->user_cost_model ? "user" : "auto",
+		   ioc->auto_cost_model ? "auto" : "linear",
 		   u[I_LCOEF_RBPS], u[I_LCOEF_RSEQIOPS], u[I_LCOEF_RRANDIOPS],
 		   u[I_LCOEF_WBPS], u[I_LCOEF_WSEQIOPS], u[I_LCOEF_WRANDIOPS]);
 	return 0;
@@ -2351,7 +2598,7 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	struct gendisk *disk;
 	struct ioc *ioc;
 	u64 u[NR_I_LCOEFS];
-	bool user;
+	bool user, calib;
 	char *p;
 	int ret;
 
@@ -2370,6 +2617,7 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	spin_lock_irq(&ioc->lock);
 	memcpy(u, ioc->params.i_lcoefs, sizeof(u));
 	user = ioc->user_cost_model;
+	calib = ioc->auto_cost_model;
 	spin_unlock_irq(&ioc->lock);
 
 	while ((p = strsep(&input, " \t\n"))) {
@@ -2393,7 +2641,11 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 			continue;
 		case COST_MODEL:
 			match_strlcpy(buf, &args[0], sizeof(buf));
-			if (strcmp(buf, "linear"))
+			if (!strcmp(buf, "auto"))
+				calib = true;
+			else if (!strcmp(buf, "linear"))
+				calib = false;
+			else
 				goto einval;
 			continue;
 		}
@@ -2407,6 +2659,14 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 		user = true;
 	}
 
+	/* the auto model determines the coefficients itself */
+	if (user && calib)
+		goto einval;
+
+	/* service times are measured from the issue time */
+	if (calib)
+		blk_stat_enable_accounting(disk->queue);
+
 	spin_lock_irq(&ioc->lock);
 	if (user) {
 		memcpy(ioc->params.i_lcoefs, u, sizeof(u));
@@ -2414,6 +2674,9 @@ static ssize_t ioc_cost_model_write(struct kernfs_open_file *of, char *input,
 	} else {
 		ioc->user_cost_model = false;
 	}
+	if (calib && !ioc->auto_cost_model)
+		ioc_calib_reset(ioc);
+	ioc->auto_cost_model = calib;
 	ioc_refresh_params(ioc, true);
 	spin_unlock_irq(&ioc->lock);
 
@@ -544,6 +544,70 @@ static ssize_t hctx_io_poll_write(void *data, const char __user *buf,
 	return count;
 }
 
+static void print_poll_hist(struct seq_file *m, struct blk_mq_poll_hist *ph,
+			    int bucket)
+{
+	seq_printf(m, "samples=%u, p10=%llu, p50=%llu, p90=%llu, p99=%llu",
+		   ph->nr_samples[bucket], blk_mq_poll_hist_pct(ph, bucket, 10),
+		   blk_mq_poll_hist_pct(ph, bucket, 50),
+		   blk_mq_poll_hist_pct(ph, bucket, 90),
+		   blk_mq_poll_hist_pct(ph, bucket, 99));
+}
+
+static int hctx_poll_hist_show(void *data, struct seq_file *m)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+	struct blk_mq_poll_hist *ph = READ_ONCE(hctx->poll_hist);
+	unsigned long invoked = hctx->poll_invoked;
+	unsigned long success = hctx->poll_success;
+	int bucket;
+
+	seq_printf(m, "polls_per_100_completions=%lu\n",
+		   success ? invoked * 100 / success : 0);
+
+	if (!ph)
+		return 0;
+
+	spin_lock_irq(&ph->lock);
+	seq_printf(m, "percentile=%u\n", ph->pct);
+	seq_printf(m, "sleeps=%lu\n", ph->sleeps);
+	seq_printf(m, "early=%lu\n", ph->early);
+	seq_printf(m, "sleep_ns=%llu\n", ph->sleep_ns);
+	seq_printf(m, "oversleep_ns=%llu\n", ph->oversleep_ns);
+
+	for (bucket = 0; bucket < (BLK_MQ_POLL_STATS_BKTS / 2); bucket++) {
+		seq_printf(m, "read  (%d Bytes): ", 1 << (9 + bucket));
+		print_poll_hist(m, ph, 2 * bucket);
+		seq_puts(m, "\n");
+
+		seq_printf(m, "write (%d Bytes): ",  1 << (9 + bucket));
+		print_poll_hist(m, ph, 2 * bucket + 1);
+		seq_puts(m, "\n");
+	}
+	spin_unlock_irq(&ph->lock);
+
+	return 0;
+}
+
+static ssize_t hctx_poll_hist_write(void *data, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+	struct blk_mq_poll_hist *ph = READ_ONCE(hctx->poll_hist);
+
+	if (!ph)
+		return count;
+
+	spin_lock_irq(&ph->lock);
+	memset(ph->nr_samples, 0, sizeof(ph->nr_samples));
+	memset(ph->bins, 0, sizeof(ph->bins));
+	ph->sleeps = ph->early = 0;
+	ph->sleep_ns = ph->oversleep_ns = 0;
+	spin_unlock_irq(&ph->lock);
+
+	return count;
+}
+
 static int hctx_dispatched_show(void *data, struct seq_file *m)
 {
 	struct blk_mq_hw_ctx *hctx = data;
@@ -786,6 +850,7 @@ static const struct blk_mq_debugfs_attr blk_mq_debugfs_hctx_attrs[] = {
 	{"sched_tags", 0400, hctx_sched_tags_show},
 	{"sched_tags_bitmap", 0400, hctx_sched_tags_bitmap_show},
 	{"io_poll", 0600, hctx_io_poll_show, hctx_io_poll_write},
+	{"poll_hist", 0600, hctx_poll_hist_show, hctx_poll_hist_write},
 	{"dispatched", 0600, hctx_dispatched_show, hctx_dispatched_write},
 	{"queued", 0600, hctx_queued_show, hctx_queued_write},
 	{"run", 0600, hctx_run_show, hctx_run_write},
@@ -44,6 +44,7 @@ static void blk_mq_hw_sysfs_release(struct kobject *kobj)
 	sbitmap_free(&hctx->ctx_map);
 	free_cpumask_var(hctx->cpumask);
 	kfree(hctx->ctxs);
+	kfree(hctx->poll_hist);
 	kfree(hctx);
 }
 
@@ -39,9 +39,19 @@
 #include "blk-stat.h"
 #include "blk-mq-sched.h"
 #include "blk-rq-qos.h"
+#include "blk-crypto-internal.h"
+
+/* Adaptive hybrid polling, see blk_mq_poll_adaptive_account() */
+#define BLK_MQ_POLL_HIST_MIN_SAMPLES	16
+#define BLK_MQ_POLL_HIST_DECAY		1024
+#define BLK_MQ_POLL_PCT_INIT		25
+#define BLK_MQ_POLL_PCT_MIN		1
+#define BLK_MQ_POLL_PCT_MAX		50
+#define BLK_MQ_POLL_PCT_DOWN		4
 
 static void blk_mq_poll_stats_start(struct request_queue *q);
 static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb);
+static void blk_mq_poll_hist_add(struct request *rq, u64 now);
 
 static int blk_mq_poll_stats_bkt(const struct request *rq)
 {
@@ -326,6 +336,7 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 	RB_CLEAR_NODE(&rq->rb_node);
 	rq->rq_disk = NULL;
 	rq->part = NULL;
+	blk_crypto_rq_set_defaults(rq);
 #ifdef CONFIG_BLK_RQ_ALLOC_TIME
 	rq->alloc_time_ns = alloc_time_ns;
 #endif
@@ -496,6 +507,7 @@ static void __blk_mq_free_request(struct request *rq)
 	struct blk_mq_hw_ctx *hctx = rq->mq_hctx;
 	const int sched_tag = rq->internal_tag;
 
+	blk_crypto_free_request(rq);
 	blk_pm_mark_last_busy(rq);
 	rq->mq_hctx = NULL;
 	if (rq->tag != -1)
@@ -547,6 +559,8 @@ inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
 	if (rq->rq_flags & RQF_STATS) {
 		blk_mq_poll_stats_start(rq->q);
 		blk_stat_add(rq, now);
+		if (rq->mq_hctx->poll_hist)
+			blk_mq_poll_hist_add(rq, now);
 	}
 
 	if (rq->internal_tag != -1)
@@ -1736,6 +1750,7 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	unsigned int depth;
 
 	list_splice_init(&plug->mq_list, &list);
+	blk_plug_merge_init(plug);
 
 	if (plug->rq_count > 2 && plug->multiple_queues)
 		list_sort(NULL, &list, plug_rq_cmp);
@@ -1750,6 +1765,9 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	while (!list_empty(&list)) {
 		rq = list_entry_rq(list.next);
 		list_del_init(&rq->queuelist);
+		/* The plug's merge index is gone, and the elevator wants these */
+		INIT_HLIST_NODE(&rq->hash);
+		RB_CLEAR_NODE(&rq->rb_node);
 		BUG_ON(!rq->q);
 		if (rq->mq_hctx != this_hctx || rq->mq_ctx != this_ctx) {
 			if (this_hctx) {
@@ -1783,6 +1801,8 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 static void blk_mq_bio_to_request(struct request *rq, struct bio *bio,
 		unsigned int nr_segs)
 {
+	int err;
+
 	if (bio->bi_opf & REQ_RAHEAD)
 		rq->cmd_flags |= REQ_FAILFAST_MASK;
 
@@ -1790,6 +1810,10 @@ static void blk_mq_bio_to_request(struct request *rq, struct bio *bio,
 	rq->write_hint = bio->bi_write_hint;
 	blk_rq_bio_prep(rq, bio, nr_segs);
 
+	/* This can't fail, since GFP_NOIO includes __GFP_DIRECT_RECLAIM. */
+	err = blk_crypto_rq_bio_prep(rq, bio, GFP_NOIO);
+	WARN_ON_ONCE(err);
+
 	blk_account_io_start(rq, true);
 }
 
@@ -1939,6 +1963,7 @@ void blk_mq_try_issue_list_directly(struct blk_mq_hw_ctx *hctx,
 static void blk_add_rq_to_plug(struct blk_plug *plug, struct request *rq)
 {
 	list_add_tail(&rq->queuelist, &plug->mq_list);
+	blk_plug_merge_add(plug, rq);
 	plug->rq_count++;
 	if (!plug->multiple_queues && !list_is_singular(&plug->mq_list)) {
 		struct request *tmp;
@@ -1950,6 +1975,33 @@ static void blk_add_rq_to_plug(struct blk_plug *plug, struct request *rq)
 	}
 }
 
+/*
+ * Find the request for @q on a plug list used for limited plugging, where
+ * there is at most one request per queue.
+ */
+static struct request *blk_mq_plug_queue_rq(struct blk_plug *plug,
+					    struct request_queue *q)
+{
+	struct request *rq;
+
+	list_for_each_entry(rq, &plug->mq_list, queuelist)
+		if (rq->q == q)
+			return rq;
+
+	return NULL;
+}
+
+/*
+ * Let bios without an explicit I/O priority inherit the one the submitting
+ * task set with ioprio_set(), so that I/O schedulers can act on it.  This is
+ * done before merging since requests of different priorities don't merge.
+ */
+static inline void blk_mq_bio_set_ioprio(struct bio *bio)
+{
+	if (!ioprio_valid(bio_prio(bio)))
+		bio_set_prio(bio, get_current_ioprio());
+}
+
 static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 {
 	const int is_sync = op_is_sync(bio->bi_opf);
@@ -1960,6 +2012,7 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	struct request *same_queue_rq = NULL;
 	unsigned int nr_segs;
 	blk_qc_t cookie;
+	blk_status_t ret;
 
 	blk_queue_bounce(q, &bio);
 	__blk_queue_split(q, &bio, &nr_segs);
@@ -1967,8 +2020,10 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 	if (!bio_integrity_prep(bio))
 		return BLK_QC_T_NONE;
 
+	blk_mq_bio_set_ioprio(bio);
+
 	if (!is_flush_fua && !blk_queue_nomerges(q) &&
-	    blk_attempt_plug_merge(q, bio, nr_segs, &same_queue_rq))
+	    blk_attempt_plug_merge(q, bio, nr_segs))
 		return BLK_QC_T_NONE;
 
 	if (blk_mq_sched_bio_merge(q, bio, nr_segs))
@@ -1993,6 +2048,14 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 
 	blk_mq_bio_to_request(rq, bio, nr_segs);
 
+	ret = blk_crypto_init_request(rq);
+	if (ret != BLK_STS_OK) {
+		bio->bi_status = ret;
+		bio_endio(bio);
+		blk_mq_free_request(rq);
+		return BLK_QC_T_NONE;
+	}
+
 	plug = blk_mq_plug(q, bio);
 	if (unlikely(is_flush_fua)) {
 		/* bypass scheduler for flush rq */
@@ -2029,13 +2092,11 @@ static blk_qc_t blk_mq_make_request(struct request_queue *q, struct bio *bio)
 		 * We do limited plugging. If the bio can be merged, do that.
 		 * Otherwise the existing request in the plug list will be
 		 * issued. So the plug list will have one request at most
-		 * The plug list might get flushed before this. If that happens,
-		 * the plug list is empty, and same_queue_rq is invalid.
 		 */
-		if (list_empty(&plug->mq_list))
-			same_queue_rq = NULL;
+		same_queue_rq = blk_mq_plug_queue_rq(plug, q);
 		if (same_queue_rq) {
 			list_del_init(&same_queue_rq->queuelist);
+			blk_plug_merge_del(plug, same_queue_rq);
 			plug->rq_count--;
 		}
 		blk_add_rq_to_plug(plug, rq);
@@ -3373,6 +3434,178 @@ static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb)
 	}
 }
 
+static unsigned int blk_mq_poll_hist_bin(u64 nsecs)
+{
+	unsigned int order, bin;
+
+	if (nsecs < (1ULL << BLK_MQ_POLL_HIST_SHIFT))
+		return 0;
+
+	order = ilog2(nsecs);
+	bin = 2 * (order - BLK_MQ_POLL_HIST_SHIFT) + ((nsecs >> (order - 1)) & 1);
+
+	return min_t(unsigned int, bin, BLK_MQ_POLL_HIST_BINS - 1);
+}
+
+static u64 blk_mq_poll_hist_bin_start(unsigned int bin)
+{
+	unsigned int order = BLK_MQ_POLL_HIST_SHIFT + bin / 2;
+
+	if (!bin)
+		return 0;
+
+	return (1ULL << order) + (bin & 1) * (1ULL << (order - 1));
+}
+
+/*
+ * Return the lower bound of the @pct percentile of the completion times in
+ * @bucket, or 0 if there are too few samples.  Called with ph->lock held.
+ */
+u64 blk_mq_poll_hist_pct(struct blk_mq_poll_hist *ph, int bucket,
+			 unsigned int pct)
+{
+	u32 want, sum = 0;
+	int i;
+
+	if (ph->nr_samples[bucket] < BLK_MQ_POLL_HIST_MIN_SAMPLES)
+		return 0;
+
+	want = DIV_ROUND_UP(ph->nr_samples[bucket] * pct, 100);
+	for (i = 0; i < BLK_MQ_POLL_HIST_BINS; i++) {
+		sum += ph->bins[bucket][i];
+		if (sum >= want)
+			return blk_mq_poll_hist_bin_start(i);
+	}
+
+	return 0;
+}
+
+static void blk_mq_poll_hist_add(struct request *rq, u64 now)
+{
+	struct blk_mq_poll_hist *ph = rq->mq_hctx->poll_hist;
+	int bucket = blk_mq_poll_stats_bkt(rq);
+	unsigned long flags;
+	u32 *bins;
+	int i;
+
+	if (bucket < 0 || now < rq->io_start_time_ns)
+		return;
+
+	bins = ph->bins[bucket];
+
+	spin_lock_irqsave(&ph->lock, flags);
+	bins[blk_mq_poll_hist_bin(now - rq->io_start_time_ns)]++;
+
+	/* Age old samples so that the histogram follows the workload */
+	if (++ph->nr_samples[bucket] >= BLK_MQ_POLL_HIST_DECAY) {
+		ph->nr_samples[bucket] = 0;
+		for (i = 0; i < BLK_MQ_POLL_HIST_BINS; i++) {
+			bins[i] >>= 1;
+			ph->nr_samples[bucket] += bins[i];
+		}
+	}
+	spin_unlock_irqrestore(&ph->lock, flags);
+}
+
+static struct blk_mq_poll_hist *blk_mq_poll_hist_get(struct blk_mq_hw_ctx *hctx)
+{
+	struct blk_mq_poll_hist *ph = READ_ONCE(hctx->poll_hist);
+
+	if (ph)
+		return ph;
+
+	ph = kzalloc_node(sizeof(*ph), GFP_NOWAIT | __GFP_NOWARN,
+			  hctx->numa_node);
+	if (!ph)
+		return NULL;
+
+	spin_lock_init(&ph->lock);
+	ph->pct = BLK_MQ_POLL_PCT_INIT;
+
+	if (cmpxchg(&hctx->poll_hist, NULL, ph)) {
+		kfree(ph);
+		ph = hctx->poll_hist;
+	}
+
+	return ph;
+}
+
+/*
+ * Pick the sleep time from a low percentile of the completion times seen on
+ * this hardware queue for this type of request, less the time the request
+ * has already been in flight.  Unlike the mean, this isn't thrown off by a
+ * tail of slow completions in mixed workloads.
+ */
+static unsigned long blk_mq_poll_adaptive_nsecs(struct request_queue *q,
+						struct blk_mq_hw_ctx *hctx,
+						struct request *rq)
+{
+	struct blk_mq_poll_hist *ph;
+	unsigned long flags;
+	u64 target, now;
+	int bucket;
+
+	if (!blk_poll_stats_enable(q))
+		return 0;
+
+	ph = blk_mq_poll_hist_get(hctx);
+	if (!ph || !(rq->rq_flags & RQF_STATS))
+		return 0;
+
+	bucket = blk_mq_poll_stats_bkt(rq);
+	if (bucket < 0)
+		return 0;
+
+	spin_lock_irqsave(&ph->lock, flags);
+	target = blk_mq_poll_hist_pct(ph, bucket, ph->pct);
+	spin_unlock_irqrestore(&ph->lock, flags);
+
+	now = ktime_get_ns();
+	if (target <= now - rq->io_start_time_ns)
+		return 0;
+
+	return target - (now - rq->io_start_time_ns);
+}
+
+/*
+ * Account an adaptive poll sleep and steer the percentile used for the next
+ * ones.  If a completion is found straight after waking up, the device was
+ * done before we woke and we slept too long: back off quickly.  Otherwise
+ * creep towards longer sleeps, so that roughly one sleep in
+ * BLK_MQ_POLL_PCT_DOWN + 1 ends up being too long.
+ */
+static void blk_mq_poll_adaptive_account(struct request_queue *q,
+					 struct blk_mq_hw_ctx *hctx,
+					 struct request *rq, u64 slept,
+					 u64 oversleep)
+{
+	struct blk_mq_poll_hist *ph = hctx->poll_hist;
+	unsigned long flags;
+	bool early;
+
+	early = blk_mq_rq_state(rq) == MQ_RQ_COMPLETE;
+	if (!early) {
+		hctx->poll_invoked++;
+		if (q->mq_ops->poll(hctx) > 0) {
+			hctx->poll_success++;
+			early = true;
+		}
+	}
+
+	spin_lock_irqsave(&ph->lock, flags);
+	ph->sleeps++;
+	ph->sleep_ns += slept;
+	ph->oversleep_ns += oversleep;
+	if (early) {
+		ph->early++;
+		ph->pct = max_t(int, ph->pct - BLK_MQ_POLL_PCT_DOWN,
+				BLK_MQ_POLL_PCT_MIN);
+	} else {
+		ph->pct = min_t(unsigned int, ph->pct + 1, BLK_MQ_POLL_PCT_MAX);
+	}
+	spin_unlock_irqrestore(&ph->lock, flags);
+}
+
 static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
 				       struct blk_mq_hw_ctx *hctx,
 				       struct request *rq)
@@ -3413,6 +3646,7 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 	struct hrtimer_sleeper hs;
 	enum hrtimer_mode mode;
 	unsigned int nsecs;
+	u64 start, end;
 	ktime_t kt;
 
 	if (rq->rq_flags & RQF_MQ_POLL_SLEPT)
@@ -3421,11 +3655,14 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 	/*
 	 * If we get here, hybrid polling is enabled. Hence poll_nsec can be:
 	 *
+	 * -2:	use a percentile of this hctx's completion times
 	 *  0:	use half of prev avg
 	 * >0:	use this specific value
 	 */
 	if (q->poll_nsec > 0)
 		nsecs = q->poll_nsec;
+	else if (q->poll_nsec == BLK_MQ_POLL_ADAPTIVE)
+		nsecs = blk_mq_poll_adaptive_nsecs(q, hctx, rq);
 	else
 		nsecs = blk_mq_poll_nsecs(q, hctx, rq);
 
@@ -3444,6 +3681,8 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 	hrtimer_init_sleeper_on_stack(&hs, CLOCK_MONOTONIC, mode);
 	hrtimer_set_expires(&hs.timer, kt);
 
+	start = ktime_get_ns();
+
 	do {
 		if (blk_mq_rq_state(rq) == MQ_RQ_COMPLETE)
 			break;
@@ -3457,6 +3696,12 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 
 	__set_current_state(TASK_RUNNING);
 	destroy_hrtimer_on_stack(&hs.timer);
+
+	if (q->poll_nsec == BLK_MQ_POLL_ADAPTIVE && hctx->poll_hist) {
+		end = ktime_get_ns();
+		blk_mq_poll_adaptive_account(q, hctx, rq, end - start,
+				end > start + nsecs ? end - start - nsecs : 0);
+	}
 	return true;
 }
 
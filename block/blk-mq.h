@@ -37,6 +37,33 @@ struct blk_mq_ctx {
 	struct kobject		kobj;
 } ____cacheline_aligned_in_smp;
 
+/*
+ * Completion time histogram for adaptive hybrid polling, one per hardware
+ * queue.  Bins are half a power of two wide, starting at
+ * 1 << BLK_MQ_POLL_HIST_SHIFT nsecs, and kept separately for every poll
+ * stats bucket.
+ */
+#define BLK_MQ_POLL_HIST_SHIFT	8
+#define BLK_MQ_POLL_HIST_BINS	32
+
+struct blk_mq_poll_hist {
+	spinlock_t		lock;
+	/* percentile of the completion time to sleep for */
+	unsigned int		pct;
+
+	u32			nr_samples[BLK_MQ_POLL_STATS_BKTS];
+	u32			bins[BLK_MQ_POLL_STATS_BKTS][BLK_MQ_POLL_HIST_BINS];
+
+	/* poll efficiency */
+	unsigned long		sleeps;
+	unsigned long		early;
+	u64			sleep_ns;
+	u64			oversleep_ns;
+};
+
+u64 blk_mq_poll_hist_pct(struct blk_mq_poll_hist *ph, int bucket,
+			 unsigned int pct);
+
 void blk_mq_exit_queue(struct request_queue *q);
 int blk_mq_update_nr_requests(struct request_queue *q, unsigned int nr);
 void blk_mq_wake_waiters(struct request_queue *q);
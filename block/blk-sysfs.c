@@ -360,8 +360,8 @@ static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
 {
 	int val;
 
-	if (q->poll_nsec == BLK_MQ_POLL_CLASSIC)
-		val = BLK_MQ_POLL_CLASSIC;
+	if (q->poll_nsec < 0)
+		val = q->poll_nsec;
 	else
 		val = q->poll_nsec / 1000;
 
@@ -380,8 +380,8 @@ static ssize_t queue_poll_delay_store(struct request_queue *q, const char *page,
 	if (err < 0)
 		return err;
 
-	if (val == BLK_MQ_POLL_CLASSIC)
-		q->poll_nsec = BLK_MQ_POLL_CLASSIC;
+	if (val == BLK_MQ_POLL_CLASSIC || val == BLK_MQ_POLL_ADAPTIVE)
+		q->poll_nsec = val;
 	else if (val >= 0)
 		q->poll_nsec = val * 1000;
 	else
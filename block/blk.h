@@ -183,7 +183,15 @@ bool bio_attempt_back_merge(struct request *req, struct bio *bio,
 bool bio_attempt_discard_merge(struct request_queue *q, struct request *req,
 		struct bio *bio);
 bool blk_attempt_plug_merge(struct request_queue *q, struct bio *bio,
-		unsigned int nr_segs, struct request **same_queue_rq);
+		unsigned int nr_segs);
+void blk_plug_merge_add(struct blk_plug *plug, struct request *rq);
+void blk_plug_merge_del(struct blk_plug *plug, struct request *rq);
+
+static inline void blk_plug_merge_init(struct blk_plug *plug)
+{
+	hash_init(plug->merge_hash);
+	plug->merge_tree = RB_ROOT;
+}
 
 void blk_account_io_start(struct request *req, bool new_io);
 void blk_account_io_completion(struct request *req, unsigned int bytes);
@@ -12,6 +12,22 @@
 #include <linux/configfs.h>
 #include <linux/badblocks.h>
 #include <linux/fault-inject.h>
+#include <linux/random.h>
+
+enum {
+	NULL_IRQ_NONE		= 0,
+	NULL_IRQ_SOFTIRQ	= 1,
+	NULL_IRQ_TIMER		= 2,
+};
+
+enum {
+	NULL_Q_BIO		= 0,
+	NULL_Q_RQ		= 1,
+	NULL_Q_MQ		= 2,
+};
+
+/* Upper bound on nullb_device->parallelism. */
+#define NULLB_MODEL_MAX_CHANNELS	64
 
 struct nullb_cmd {
 	struct list_head list;
@@ -23,6 +39,7 @@ struct nullb_cmd {
 	blk_status_t error;
 	struct nullb_queue *nq;
 	struct hrtimer timer;
+	u64 model_nsec; /* completion delay picked by the device model */
 };
 
 struct nullb_queue {
@@ -67,6 +84,34 @@ struct nullb_device {
 	bool memory_backed; /* if data is stored in memory */
 	bool discard; /* if support discard */
 	bool zoned; /* if device is zoned */
+
+	/* Device model, see null_blk_model.c */
+	bool model; /* complete requests per the device model */
+	unsigned int model_seed; /* seed for jitter and tail latency */
+	unsigned long read_lat_nsec; /* base read latency */
+	unsigned long write_lat_nsec; /* base write latency */
+	unsigned long flush_lat_nsec; /* base flush latency */
+	unsigned long discard_lat_nsec; /* base discard latency */
+	unsigned long zone_reset_lat_nsec; /* base zone reset latency */
+	unsigned int read_mbps; /* media read bandwidth (in MB/s) */
+	unsigned int write_mbps; /* media write bandwidth (in MB/s) */
+	unsigned int lat_jitter; /* +/- uniform latency jitter (in %) */
+	unsigned int lat_tail_permille; /* share of requests hitting the tail */
+	unsigned int lat_tail_mult; /* tail latency multiplier */
+	unsigned int parallelism; /* number of internal channels */
+	unsigned long wcache_size; /* volatile write cache size (in MB) */
+	unsigned long wcache_lat_nsec; /* latency of a cached write */
+	unsigned int stall_interval_msec; /* period of background stalls */
+	unsigned long stall_usec; /* length of each background stall */
+};
+
+struct nullb_model {
+	spinlock_t lock;
+	u64 epoch; /* ns, origin of the stall schedule */
+	u64 chan_free[NULLB_MODEL_MAX_CHANNELS]; /* ns each channel is idle */
+	u64 wcache_dirty; /* bytes not yet written back from the cache */
+	u64 wcache_ts; /* ns of the last wcache_dirty update */
+	struct rnd_state rnd;
 };
 
 struct nullb {
@@ -85,9 +130,15 @@ struct nullb {
 
 	struct nullb_queue *queues;
 	unsigned int nr_queues;
+	struct nullb_model *model;
 	char disk_name[DISK_NAME_LEN];
 };
 
+int null_model_init(struct nullb *nullb);
+void null_model_exit(struct nullb *nullb);
+u64 null_model_delay(struct nullb_cmd *cmd, enum req_opf op,
+		     sector_t nr_sectors);
+
 #ifdef CONFIG_BLK_DEV_ZONED
 int null_zone_init(struct nullb_device *dev);
 void null_zone_exit(struct nullb_device *dev);
@@ -71,18 +71,6 @@ static int null_major;
 static DEFINE_IDA(nullb_indexes);
 static struct blk_mq_tag_set tag_set;
 
-enum {
-	NULL_IRQ_NONE		= 0,
-	NULL_IRQ_SOFTIRQ	= 1,
-	NULL_IRQ_TIMER		= 2,
-};
-
-enum {
-	NULL_Q_BIO		= 0,
-	NULL_Q_RQ		= 1,
-	NULL_Q_MQ		= 2,
-};
-
 static int g_no_sched;
 module_param_named(no_sched, g_no_sched, int, 0444);
 MODULE_PARM_DESC(no_sched, "No io scheduler");
@@ -299,6 +287,23 @@ NULLB_DEVICE_ATTR(cache_size, ulong);
 NULLB_DEVICE_ATTR(zoned, bool);
 NULLB_DEVICE_ATTR(zone_size, ulong);
 NULLB_DEVICE_ATTR(zone_nr_conv, uint);
+NULLB_DEVICE_ATTR(model, bool);
+NULLB_DEVICE_ATTR(model_seed, uint);
+NULLB_DEVICE_ATTR(read_lat_nsec, ulong);
+NULLB_DEVICE_ATTR(write_lat_nsec, ulong);
+NULLB_DEVICE_ATTR(flush_lat_nsec, ulong);
+NULLB_DEVICE_ATTR(discard_lat_nsec, ulong);
+NULLB_DEVICE_ATTR(zone_reset_lat_nsec, ulong);
+NULLB_DEVICE_ATTR(read_mbps, uint);
+NULLB_DEVICE_ATTR(write_mbps, uint);
+NULLB_DEVICE_ATTR(lat_jitter, uint);
+NULLB_DEVICE_ATTR(lat_tail_permille, uint);
+NULLB_DEVICE_ATTR(lat_tail_mult, uint);
+NULLB_DEVICE_ATTR(parallelism, uint);
+NULLB_DEVICE_ATTR(wcache_size, ulong);
+NULLB_DEVICE_ATTR(wcache_lat_nsec, ulong);
+NULLB_DEVICE_ATTR(stall_interval_msec, uint);
+NULLB_DEVICE_ATTR(stall_usec, ulong);
 
 static ssize_t nullb_device_power_show(struct config_item *item, char *page)
 {
@@ -415,6 +420,23 @@ static struct configfs_attribute *nullb_device_attrs[] = {
 	&nullb_device_attr_zoned,
 	&nullb_device_attr_zone_size,
 	&nullb_device_attr_zone_nr_conv,
+	&nullb_device_attr_model,
+	&nullb_device_attr_model_seed,
+	&nullb_device_attr_read_lat_nsec,
+	&nullb_device_attr_write_lat_nsec,
+	&nullb_device_attr_flush_lat_nsec,
+	&nullb_device_attr_discard_lat_nsec,
+	&nullb_device_attr_zone_reset_lat_nsec,
+	&nullb_device_attr_read_mbps,
+	&nullb_device_attr_write_mbps,
+	&nullb_device_attr_lat_jitter,
+	&nullb_device_attr_lat_tail_permille,
+	&nullb_device_attr_lat_tail_mult,
+	&nullb_device_attr_parallelism,
+	&nullb_device_attr_wcache_size,
+	&nullb_device_attr_wcache_lat_nsec,
+	&nullb_device_attr_stall_interval_msec,
+	&nullb_device_attr_stall_usec,
 	NULL,
 };
 
@@ -467,7 +489,7 @@ nullb_group_drop_item(struct config_group *group, struct config_item *item)
 
 static ssize_t memb_group_features_show(struct config_item *item, char *page)
 {
-	return snprintf(page, PAGE_SIZE, "memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size\n");
+	return snprintf(page, PAGE_SIZE, "memory_backed,discard,bandwidth,cache,badblocks,zoned,zone_size,model\n");
 }
 
 CONFIGFS_ATTR_RO(memb_group_, features);
@@ -529,6 +551,8 @@ static struct nullb_device *null_alloc_dev(void)
 	dev->zoned = g_zoned;
 	dev->zone_size = g_zone_size;
 	dev->zone_nr_conv = g_zone_nr_conv;
+	dev->lat_tail_mult = 1;
+	dev->parallelism = 1;
 	return dev;
 }
 
@@ -640,7 +664,8 @@ static enum hrtimer_restart null_cmd_timer_expired(struct hrtimer *timer)
 
 static void null_cmd_end_timer(struct nullb_cmd *cmd)
 {
-	ktime_t kt = cmd->nq->dev->completion_nsec;
+	struct nullb_device *dev = cmd->nq->dev;
+	ktime_t kt = dev->model ? cmd->model_nsec : dev->completion_nsec;
 
 	hrtimer_start(&cmd->timer, kt, HRTIMER_MODE_REL);
 }
@@ -1240,6 +1265,8 @@ static blk_status_t null_handle_cmd(struct nullb_cmd *cmd, sector_t sector,
 		cmd->error = null_handle_zoned(cmd, op, sector, nr_sectors);
 
 out:
+	if (dev->model)
+		cmd->model_nsec = null_model_delay(cmd, op, nr_sectors);
 	nullb_complete_cmd(cmd);
 	return BLK_STS_OK;
 }
@@ -1404,6 +1431,7 @@ static void null_del_dev(struct nullb *nullb)
 	}
 
 	blk_cleanup_queue(nullb->q);
+	null_model_exit(nullb);
 	if (dev->queue_mode == NULL_Q_MQ &&
 	    nullb->tag_set == &nullb->__tag_set)
 		blk_mq_free_tag_set(nullb->tag_set);
@@ -1602,6 +1630,21 @@ static void null_validate_conf(struct nullb_device *dev)
 	/* can not stop a queue */
 	if (dev->queue_mode == NULL_Q_BIO)
 		dev->mbps = 0;
+
+	/* The device model completes every command from its own timer */
+	if (dev->model)
+		dev->irqmode = NULL_IRQ_TIMER;
+	dev->parallelism = clamp_t(unsigned int, dev->parallelism, 1,
+				   NULLB_MODEL_MAX_CHANNELS);
+	dev->lat_jitter = min_t(unsigned int, dev->lat_jitter, 100);
+	dev->lat_tail_permille = min_t(unsigned int, dev->lat_tail_permille,
+				       1000);
+	dev->lat_tail_mult = max_t(unsigned int, dev->lat_tail_mult, 1);
+	dev->wcache_size = min_t(unsigned long, ULONG_MAX / 1024 / 1024,
+				 dev->wcache_size);
+	/* a device stalled for more than half of the time makes no progress */
+	dev->stall_usec = min_t(unsigned long, dev->stall_usec,
+				(u64)dev->stall_interval_msec * USEC_PER_MSEC / 2);
 }
 
 #ifdef CONFIG_BLK_DEV_NULL_BLK_FAULT_INJECTION
@@ -1694,6 +1737,14 @@ static int null_add_dev(struct nullb_device *dev)
 		blk_queue_write_cache(nullb->q, true, true);
 	}
 
+	if (dev->model) {
+		rv = null_model_init(nullb);
+		if (rv)
+			goto out_cleanup_blk_queue;
+		if (dev->wcache_size)
+			blk_queue_write_cache(nullb->q, true, true);
+	}
+
 	if (dev->zoned) {
 		rv = null_zone_init(dev);
 		if (rv)
@@ -1736,6 +1787,7 @@ static int null_add_dev(struct nullb_device *dev)
 		null_zone_exit(dev);
 out_cleanup_blk_queue:
 	blk_cleanup_queue(nullb->q);
+	null_model_exit(nullb);
 out_cleanup_tags:
 	if (dev->queue_mode == NULL_Q_MQ && nullb->tag_set == &nullb->__tag_set)
 		blk_mq_free_tag_set(nullb->tag_set);
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Device model for null_blk.
+ *
+ * When nullb_device->model is set, every command is completed from a timer
+ * after a delay derived from a small model of a flash device instead of the
+ * flat completion_nsec:
+ *
+ *  - Each op type has its own base latency, and reads and writes add a
+ *    transfer time at their own media bandwidth.  Bandwidths are in decimal
+ *    MB/s, as storage datasheets quote them.
+ *  - The base latency can be spread uniformly by +/- lat_jitter percent, and
+ *    lat_tail_permille of the commands see it multiplied by lat_tail_mult.
+ *    The random stream is seeded from model_seed, so a given workload sees
+ *    the same latencies across runs.
+ *  - The device has 'parallelism' internal channels.  A command occupies the
+ *    channel that frees up first, so latency grows with queue depth once
+ *    more commands are in flight than there are channels.
+ *  - An optional volatile write cache of wcache_size MB absorbs writes at
+ *    wcache_lat_nsec while it has room.  It drains in the background at
+ *    write_mbps, and a flush waits for whatever is still dirty.  FUA writes
+ *    bypass it.
+ *  - Every stall_interval_msec the device stalls for stall_usec, modelling
+ *    garbage collection or thermal throttling.  Commands that would start
+ *    during a stall wait for it to end.
+ */
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include "null_blk.h"
+
+static u64 null_model_xfer_nsec(unsigned int mbps, u64 bytes)
+{
+	if (!mbps)
+		return 0;
+	return div_u64(bytes * NSEC_PER_USEC, mbps);
+}
+
+static u64 null_model_vary(struct nullb_device *dev, struct nullb_model *m,
+			   u64 lat)
+{
+	if (dev->lat_jitter && lat) {
+		u64 span = div_u64(lat * dev->lat_jitter, 100);
+
+		lat = lat - span +
+			mul_u64_u32_shr(2 * span, prandom_u32_state(&m->rnd),
+					32);
+	}
+
+	if (dev->lat_tail_permille &&
+	    prandom_u32_state(&m->rnd) % 1000 < dev->lat_tail_permille)
+		lat *= dev->lat_tail_mult;
+
+	return lat;
+}
+
+/* Push @start past the background stall it falls into, if any. */
+static u64 null_model_stall(struct nullb_device *dev, struct nullb_model *m,
+			    u64 start)
+{
+	u64 interval = (u64)dev->stall_interval_msec * NSEC_PER_MSEC;
+	u64 stall = (u64)dev->stall_usec * NSEC_PER_USEC;
+	u64 phase;
+
+	if (!interval || !stall)
+		return start;
+
+	div64_u64_rem(start - m->epoch, interval, &phase);
+	if (phase < stall)
+		start += stall - phase;
+	return start;
+}
+
+static void null_model_drain_wcache(struct nullb_device *dev,
+				    struct nullb_model *m, u64 now)
+{
+	u64 drained;
+
+	if (!dev->write_mbps) {
+		m->wcache_dirty = 0;
+	} else if (m->wcache_dirty) {
+		/* bytes/us == MB/s; clamp so the multiply can't overflow */
+		drained = min_t(u64, now - m->wcache_ts, NSEC_PER_SEC * 60);
+		drained = div_u64(drained * dev->write_mbps, NSEC_PER_USEC);
+		m->wcache_dirty -= min(m->wcache_dirty, drained);
+	}
+	m->wcache_ts = now;
+}
+
+static bool null_model_cmd_fua(struct nullb_cmd *cmd)
+{
+	if (cmd->nq->dev->queue_mode == NULL_Q_BIO)
+		return cmd->bio->bi_opf & REQ_FUA;
+	return cmd->rq->cmd_flags & REQ_FUA;
+}
+
+/**
+ * null_model_delay - pick the completion delay of a command
+ * @cmd: the command being completed
+ * @op: operation of @cmd
+ * @nr_sectors: size of @cmd
+ *
+ * Returns the delay in nanoseconds after which @cmd should complete, and
+ * accounts @cmd against the model state.
+ */
+u64 null_model_delay(struct nullb_cmd *cmd, enum req_opf op,
+		     sector_t nr_sectors)
+{
+	struct nullb_device *dev = cmd->nq->dev;
+	struct nullb_model *m = dev->nullb->model;
+	u64 bytes = (u64)nr_sectors << SECTOR_SHIFT;
+	u64 base, xfer = 0;
+	u64 now, start, done;
+	unsigned long flags;
+	unsigned int i, chan = 0;
+
+	switch (op) {
+	case REQ_OP_READ:
+		base = dev->read_lat_nsec;
+		xfer = null_model_xfer_nsec(dev->read_mbps, bytes);
+		break;
+	case REQ_OP_WRITE:
+	case REQ_OP_WRITE_SAME:
+		base = dev->write_lat_nsec;
+		xfer = null_model_xfer_nsec(dev->write_mbps, bytes);
+		break;
+	case REQ_OP_WRITE_ZEROES:
+		base = dev->write_lat_nsec;
+		break;
+	case REQ_OP_FLUSH:
+		base = dev->flush_lat_nsec;
+		break;
+	case REQ_OP_DISCARD:
+	case REQ_OP_SECURE_ERASE:
+		base = dev->discard_lat_nsec;
+		break;
+	case REQ_OP_ZONE_RESET:
+	case REQ_OP_ZONE_RESET_ALL:
+		base = dev->zone_reset_lat_nsec;
+		break;
+	default:
+		base = dev->completion_nsec;
+		break;
+	}
+
+	spin_lock_irqsave(&m->lock, flags);
+	now = ktime_get_ns();
+
+	if (dev->wcache_size) {
+		null_model_drain_wcache(dev, m, now);
+
+		if (op == REQ_OP_FLUSH) {
+			xfer = null_model_xfer_nsec(dev->write_mbps,
+						    m->wcache_dirty);
+			m->wcache_dirty = 0;
+			done = null_model_stall(dev, m, now) +
+				null_model_vary(dev, m, base) + xfer;
+			goto out;
+		}
+
+		if (op == REQ_OP_WRITE && !null_model_cmd_fua(cmd) &&
+		    m->wcache_dirty + bytes <= (u64)dev->wcache_size << 20) {
+			m->wcache_dirty += bytes;
+			done = now + null_model_vary(dev, m,
+						     dev->wcache_lat_nsec);
+			goto out;
+		}
+	}
+
+	for (i = 1; i < dev->parallelism; i++)
+		if (m->chan_free[i] < m->chan_free[chan])
+			chan = i;
+
+	start = null_model_stall(dev, m, max(now, m->chan_free[chan]));
+	done = start + null_model_vary(dev, m, base) + xfer;
+	m->chan_free[chan] = done;
+out:
+	spin_unlock_irqrestore(&m->lock, flags);
+	return done - now;
+}
+
+int null_model_init(struct nullb *nullb)
+{
+	struct nullb_device *dev = nullb->dev;
+	struct nullb_model *m;
+
+	m = kzalloc_node(sizeof(*m), GFP_KERNEL, dev->home_node);
+	if (!m)
+		return -ENOMEM;
+
+	spin_lock_init(&m->lock);
+	m->epoch = ktime_get_ns();
+	m->wcache_ts = m->epoch;
+	prandom_seed_state(&m->rnd, dev->model_seed);
+
+	nullb->model = m;
+	return 0;
+}
+
+void null_model_exit(struct nullb *nullb)
+{
+	kfree(nullb->model);
+	nullb->model = NULL;
+}
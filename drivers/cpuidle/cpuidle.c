@@ -262,6 +262,7 @@ int cpuidle_enter_state(struct cpuidle_device *dev, struct cpuidle_driver *drv,
 		dev->last_residency = (int)diff;
 		dev->states_usage[entered_state].time += dev->last_residency;
 		dev->states_usage[entered_state].usage++;
+		dev->gov_usage++;
 
 		if (diff < drv->states[entered_state].target_residency) {
 			for (i = entered_state - 1; i >= 0; i--) {
@@ -271,6 +272,7 @@ int cpuidle_enter_state(struct cpuidle_device *dev, struct cpuidle_driver *drv,
 
 				/* Shallower states are enabled, so update. */
 				dev->states_usage[entered_state].above++;
+				dev->gov_above++;
 				break;
 			}
 		} else if (diff > delay) {
@@ -283,8 +285,10 @@ int cpuidle_enter_state(struct cpuidle_device *dev, struct cpuidle_driver *drv,
 				 * Update if a deeper state would have been a
 				 * better match for the observed idle duration.
 				 */
-				if (diff - delay >= drv->states[i].target_residency)
+				if (diff - delay >= drv->states[i].target_residency) {
 					dev->states_usage[entered_state].below++;
+					dev->gov_below++;
+				}
 
 				break;
 			}
@@ -492,6 +496,10 @@ int cpuidle_enable_device(struct cpuidle_device *dev)
 	if (ret)
 		return ret;
 
+	dev->gov_usage = 0;
+	dev->gov_above = 0;
+	dev->gov_below = 0;
+
 	if (cpuidle_curr_governor->enable) {
 		ret = cpuidle_curr_governor->enable(drv, dev);
 		if (ret)
@@ -0,0 +1,417 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Wakeup source predicting CPU idle governor
+ *
+ * The timer events oriented governor treats everything that is not a timer as
+ * noise around the time till the closest timer.  That works where timers
+ * dominate, but on systems where most wakeups come from device interrupts
+ * arriving at a regular rate (network RX, for example) the sleep length is
+ * mostly irrelevant and deep states get picked for idle periods that the next
+ * interrupt is going to cut short.
+ *
+ * This governor predicts the idle duration of a CPU separately for each kind
+ * of wakeup source:
+ *
+ * - Timer: the time till the closest timer event (sleep length).
+ *
+ * - IRQ: the earliest next interrupt predicted by the IRQ timings code, which
+ *   tracks the intervals between occurrences of every (non-timer) interrupt
+ *   on each CPU and detects repeating patterns in them.
+ *
+ * - Recent: the average of the most recent idle durations that ended before
+ *   the closest timer, for wakeups that neither of the above can explain
+ *   (IPIs, interrupts without a stable pattern).
+ *
+ * After every wakeup, each prediction that was available is checked against
+ * the measured idle duration.  A prediction "hits" if it would have led to
+ * the same idle state as the measured duration, otherwise it "misses".  The
+ * hits and misses metrics of every source decay over time, so that a source
+ * can lose and regain the governor's trust as the workload changes.
+ *
+ * The idle duration used for state selection is the sleep length, unless a
+ * trusted source predicts an earlier wakeup, in which case the earliest such
+ * prediction is used.  A source is trusted if it has hit more often than it
+ * has missed recently.
+ */
+
+#include <linux/atomic.h>
+#include <linux/cpuidle.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/kernel.h>
+#include <linux/sched/clock.h>
+#include <linux/tick.h>
+
+/*
+ * The PULSE value is added to metrics when they grow and the DECAY_SHIFT value
+ * is used for decreasing metrics on a regular basis.
+ */
+#define PULSE		1024
+#define DECAY_SHIFT	3
+
+/*
+ * Number of the most recent idle duration values to take into consideration for
+ * the "recent" prediction.
+ */
+#define INTERVALS	8
+
+enum pred_source {
+	PRED_TIMER,
+	PRED_IRQ,
+	PRED_RECENT,
+	NR_PRED_SOURCES,
+};
+
+/**
+ * struct pred_source_data - Prediction accuracy of one wakeup source.
+ * @hits: Predictions that matched the idle state of the measured duration.
+ * @misses: Predictions that led to a different idle state.
+ */
+struct pred_source_data {
+	unsigned int hits;
+	unsigned int misses;
+};
+
+/**
+ * struct pred_cpu - CPU data used by the predict cpuidle governor.
+ * @time_span_ns: Time between idle state selection and post-wakeup update.
+ * @sleep_length_ns: Time till the closest timer event (at the selection time).
+ * @predicted_us: Idle duration predicted by each source, UINT_MAX if none.
+ * @sources: Accuracy metrics of each source.
+ * @interval_idx: Index of the most recent saved idle interval.
+ * @intervals: Saved idle duration values.
+ */
+struct pred_cpu {
+	u64 time_span_ns;
+	u64 sleep_length_ns;
+	unsigned int predicted_us[NR_PRED_SOURCES];
+	struct pred_source_data sources[NR_PRED_SOURCES];
+	int interval_idx;
+	unsigned int intervals[INTERVALS];
+};
+
+static DEFINE_PER_CPU(struct pred_cpu, pred_cpus);
+
+/* Number of CPUs using this governor, IRQ timings are needed while nonzero */
+static atomic_t pred_users = ATOMIC_INIT(0);
+
+/**
+ * pred_state_idx - Find the idle state matching a given idle duration.
+ * @drv: cpuidle driver containing state data.
+ * @dev: Target CPU.
+ * @duration_us: Idle duration value to match.
+ *
+ * Return the deepest enabled idle state whose target residency does not
+ * exceed @duration_us, or the shallowest enabled state if there is none.
+ */
+static int pred_state_idx(struct cpuidle_driver *drv,
+			  struct cpuidle_device *dev, unsigned int duration_us)
+{
+	int i, idx = -1;
+
+	for (i = 0; i < drv->state_count; i++) {
+		if (drv->states[i].disabled || dev->states_usage[i].disable)
+			continue;
+
+		if (idx >= 0 && drv->states[i].target_residency > duration_us)
+			break;
+
+		idx = i;
+	}
+	return idx;
+}
+
+/**
+ * pred_update - Update CPU data after wakeup.
+ * @drv: cpuidle driver containing state data.
+ * @dev: Target CPU.
+ */
+static void pred_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
+{
+	struct pred_cpu *cpu_data = per_cpu_ptr(&pred_cpus, dev->cpu);
+	unsigned int measured_us;
+	int i, idx_measured;
+
+	if (cpu_data->time_span_ns >= cpu_data->sleep_length_ns) {
+		/*
+		 * One of the safety nets has triggered or the wakeup was close
+		 * enough to the closest timer event expected at the idle state
+		 * selection time to be treated as a timer wakeup.
+		 */
+		measured_us = UINT_MAX;
+		idx_measured = pred_state_idx(drv, dev,
+				ktime_to_us(cpu_data->sleep_length_ns));
+	} else {
+		unsigned int lat;
+
+		lat = drv->states[dev->last_state_idx].exit_latency;
+
+		measured_us = ktime_to_us(cpu_data->time_span_ns);
+		/*
+		 * Take 1/2 of the exit latency as a rough approximation of the
+		 * average delay between the wakeup and the first instruction
+		 * executed by the CPU, like the TEO governor does.
+		 */
+		if (measured_us >= lat)
+			measured_us -= lat / 2;
+		else
+			measured_us /= 2;
+
+		idx_measured = pred_state_idx(drv, dev, measured_us);
+	}
+
+	for (i = 0; i < NR_PRED_SOURCES; i++) {
+		struct pred_source_data *src = &cpu_data->sources[i];
+		unsigned int predicted_us = cpu_data->predicted_us[i];
+
+		src->hits -= src->hits >> DECAY_SHIFT;
+		src->misses -= src->misses >> DECAY_SHIFT;
+
+		if (predicted_us == UINT_MAX)
+			continue;
+
+		if (pred_state_idx(drv, dev, predicted_us) == idx_measured)
+			src->hits += PULSE;
+		else
+			src->misses += PULSE;
+	}
+
+	/*
+	 * Save idle duration values corresponding to non-timer wakeups for
+	 * the "recent" prediction.
+	 */
+	cpu_data->intervals[cpu_data->interval_idx++] = measured_us;
+	if (cpu_data->interval_idx >= INTERVALS)
+		cpu_data->interval_idx = 0;
+}
+
+static bool pred_trusted(struct pred_cpu *cpu_data, enum pred_source source)
+{
+	struct pred_source_data *src = &cpu_data->sources[source];
+
+	return src->hits >= src->misses;
+}
+
+/**
+ * pred_irq_us - Idle duration predicted by the IRQ timings code.
+ * @now: Current time (local_clock()).
+ * @sleep_length_ns: Time till the closest timer event.
+ *
+ * Return UINT_MAX if no interrupt is expected before the closest timer.
+ */
+static unsigned int pred_irq_us(u64 now, u64 sleep_length_ns)
+{
+	u64 next = irq_timings_next_event(now);
+
+	if (next == U64_MAX)
+		return UINT_MAX;
+
+	next = next > now ? next - now : 0;
+	if (next >= sleep_length_ns)
+		return UINT_MAX;
+
+	return div_u64(next, NSEC_PER_USEC);
+}
+
+/**
+ * pred_recent_us - Idle duration predicted from the recent idle periods.
+ * @cpu_data: Governor data for the target CPU.
+ * @sleep_length_us: Time till the closest timer event.
+ *
+ * Return UINT_MAX unless the majority of the most recent idle periods ended
+ * before the closest timer.
+ */
+static unsigned int pred_recent_us(struct pred_cpu *cpu_data,
+				   unsigned int sleep_length_us)
+{
+	unsigned int count = 0;
+	u64 sum = 0;
+	int i;
+
+	for (i = 0; i < INTERVALS; i++) {
+		unsigned int val = cpu_data->intervals[i];
+
+		if (val >= sleep_length_us)
+			continue;
+
+		count++;
+		sum += val;
+	}
+
+	if (count <= INTERVALS / 2)
+		return UINT_MAX;
+
+	return div64_u64(sum, count);
+}
+
+/**
+ * pred_select - Selects the next idle state to enter.
+ * @drv: cpuidle driver containing state data.
+ * @dev: Target CPU.
+ * @stop_tick: Indication on whether or not to stop the scheduler tick.
+ */
+static int pred_select(struct cpuidle_driver *drv, struct cpuidle_device *dev,
+		       bool *stop_tick)
+{
+	struct pred_cpu *cpu_data = per_cpu_ptr(&pred_cpus, dev->cpu);
+	int latency_req = cpuidle_governor_latency_req(dev->cpu);
+	unsigned int duration_us, predicted_us;
+	ktime_t delta_tick;
+	u64 now;
+	int idx, i;
+
+	if (dev->last_state_idx >= 0) {
+		pred_update(drv, dev);
+		dev->last_state_idx = -1;
+	}
+
+	now = local_clock();
+	cpu_data->time_span_ns = now;
+
+	cpu_data->sleep_length_ns = tick_nohz_get_sleep_length(&delta_tick);
+	duration_us = ktime_to_us(cpu_data->sleep_length_ns);
+
+	cpu_data->predicted_us[PRED_TIMER] = duration_us;
+	cpu_data->predicted_us[PRED_IRQ] = pred_irq_us(now,
+						cpu_data->sleep_length_ns);
+	cpu_data->predicted_us[PRED_RECENT] = pred_recent_us(cpu_data,
+							     duration_us);
+
+	/* Use the earliest wakeup predicted by a trusted source */
+	for (i = PRED_TIMER + 1; i < NR_PRED_SOURCES; i++) {
+		predicted_us = cpu_data->predicted_us[i];
+
+		if (predicted_us < duration_us && pred_trusted(cpu_data, i))
+			duration_us = predicted_us;
+	}
+
+	/*
+	 * Avoid spending too much time in an idle state that would be too
+	 * shallow if the tick has been stopped already.
+	 */
+	if (tick_nohz_tick_stopped() && duration_us < TICK_USEC)
+		duration_us = min_t(unsigned int, TICK_USEC,
+				    cpu_data->predicted_us[PRED_TIMER]);
+
+	idx = -1;
+	for (i = 0; i < drv->state_count; i++) {
+		struct cpuidle_state *s = &drv->states[i];
+		struct cpuidle_state_usage *su = &dev->states_usage[i];
+
+		if (s->disabled || su->disable)
+			continue;
+
+		if (idx < 0) {
+			idx = i; /* first enabled state */
+			continue;
+		}
+
+		if (s->target_residency > duration_us ||
+		    s->exit_latency > latency_req)
+			break;
+
+		idx = i;
+	}
+
+	if (idx < 0)
+		idx = 0; /* No states enabled. Must use 0. */
+
+	/*
+	 * Don't stop the tick if the selected state is a polling one or if the
+	 * expected idle duration is shorter than the tick period length.
+	 */
+	if (((drv->states[idx].flags & CPUIDLE_FLAG_POLLING) ||
+	    duration_us < TICK_USEC) && !tick_nohz_tick_stopped()) {
+		unsigned int delta_tick_us = ktime_to_us(delta_tick);
+
+		*stop_tick = false;
+
+		/*
+		 * The tick is not going to be stopped, so if the target
+		 * residency of the state to be returned is not within the time
+		 * till the closest timer including the tick, try to correct
+		 * that.
+		 */
+		if (idx > 0 && drv->states[idx].target_residency > delta_tick_us)
+			idx = pred_state_idx(drv, dev, delta_tick_us);
+	}
+
+	return idx;
+}
+
+/**
+ * pred_reflect - Note that governor data for the CPU need to be updated.
+ * @dev: Target CPU.
+ * @state: Entered state.
+ */
+static void pred_reflect(struct cpuidle_device *dev, int state)
+{
+	struct pred_cpu *cpu_data = per_cpu_ptr(&pred_cpus, dev->cpu);
+
+	dev->last_state_idx = state;
+	/*
+	 * If the wakeup was not "natural", but triggered by one of the safety
+	 * nets, assume that the CPU might have been idle for the entire sleep
+	 * length time.
+	 */
+	if (dev->poll_time_limit ||
+	    (tick_nohz_idle_got_tick() && cpu_data->sleep_length_ns > TICK_NSEC)) {
+		dev->poll_time_limit = false;
+		cpu_data->time_span_ns = cpu_data->sleep_length_ns;
+	} else {
+		cpu_data->time_span_ns = local_clock() - cpu_data->time_span_ns;
+	}
+}
+
+/**
+ * pred_enable_device - Initialize the governor's data for the target CPU.
+ * @drv: cpuidle driver (not used).
+ * @dev: Target CPU.
+ */
+static int pred_enable_device(struct cpuidle_driver *drv,
+			      struct cpuidle_device *dev)
+{
+	struct pred_cpu *cpu_data = per_cpu_ptr(&pred_cpus, dev->cpu);
+	int i;
+
+	memset(cpu_data, 0, sizeof(*cpu_data));
+
+	for (i = 0; i < INTERVALS; i++)
+		cpu_data->intervals[i] = UINT_MAX;
+
+	for (i = 0; i < NR_PRED_SOURCES; i++)
+		cpu_data->predicted_us[i] = UINT_MAX;
+
+	if (atomic_inc_return(&pred_users) == 1)
+		irq_timings_enable();
+
+	return 0;
+}
+
+/**
+ * pred_disable_device - Stop collecting IRQ timings when no longer needed.
+ * @drv: cpuidle driver (not used).
+ * @dev: Target CPU (not used).
+ */
+static void pred_disable_device(struct cpuidle_driver *drv,
+				struct cpuidle_device *dev)
+{
+	if (atomic_dec_and_test(&pred_users))
+		irq_timings_disable();
+}
+
+static struct cpuidle_governor pred_governor = {
+	.name =		"predict",
+	.rating =	18,
+	.enable =	pred_enable_device,
+	.disable =	pred_disable_device,
+	.select =	pred_select,
+	.reflect =	pred_reflect,
+};
+
+static int __init pred_governor_init(void)
+{
+	return cpuidle_register_governor(&pred_governor);
+}
+
+postcore_initcall(pred_governor_init);
@@ -15,6 +15,7 @@
 #include <linux/capability.h>
 #include <linux/device.h>
 #include <linux/kobject.h>
+#include <linux/math64.h>
 
 #include "cpuidle.h"
 
@@ -115,12 +116,48 @@ static ssize_t store_current_governor(struct device *dev,
 		return count;
 }
 
+/*
+ * Idle state selection quality of the current governor, summed over all
+ * CPUs since it was enabled: the number of idle periods and how many of them
+ * were spent in a state that was too deep (shorter than its target residency
+ * while a shallower state was enabled) or too shallow (long enough for an
+ * enabled deeper state), also given in parts per thousand.
+ */
+static ssize_t show_governor_stats(struct device *dev,
+				   struct device_attribute *attr,
+				   char *buf)
+{
+	unsigned long long usage = 0, above = 0, below = 0;
+	struct cpuidle_device *cpu_dev;
+	int cpu;
+
+	mutex_lock(&cpuidle_lock);
+	for_each_possible_cpu(cpu) {
+		cpu_dev = per_cpu(cpuidle_devices, cpu);
+		if (!cpu_dev || !cpu_dev->enabled)
+			continue;
+
+		usage += READ_ONCE(cpu_dev->gov_usage);
+		above += READ_ONCE(cpu_dev->gov_above);
+		below += READ_ONCE(cpu_dev->gov_below);
+	}
+	mutex_unlock(&cpuidle_lock);
+
+	return sprintf(buf, "usage %llu\nabove %llu\nbelow %llu\n"
+		       "above_permille %llu\nbelow_permille %llu\n",
+		       usage, above, below,
+		       usage ? div64_u64(above * 1000, usage) : 0,
+		       usage ? div64_u64(below * 1000, usage) : 0);
+}
+
 static DEVICE_ATTR(current_driver, 0444, show_current_driver, NULL);
 static DEVICE_ATTR(current_governor_ro, 0444, show_current_governor, NULL);
+static DEVICE_ATTR(governor_stats, 0444, show_governor_stats, NULL);
 
 static struct attribute *cpuidle_default_attrs[] = {
 	&dev_attr_current_driver.attr,
 	&dev_attr_current_governor_ro.attr,
+	&dev_attr_governor_stats.attr,
 	NULL
 };
 
@@ -132,6 +169,7 @@ static struct attribute *cpuidle_switch_attrs[] = {
 	&dev_attr_available_governors.attr,
 	&dev_attr_current_driver.attr,
 	&dev_attr_current_governor.attr,
+	&dev_attr_governor_stats.attr,
 	NULL
 };
 
@@ -347,9 +347,17 @@ struct cached_dev {
 	 * Order the write-half of writeback operations strongly in dispatch
 	 * order.  (Maintain LBA order; don't allow reads completing out of
 	 * order to re-order the writes...)
+	 *
+	 * Keys are spread over writeback_threads lanes by backing device
+	 * stripe, and ordering is only kept within a lane, so writes to
+	 * different stripes of a striped backing device proceed in parallel.
 	 */
-	struct closure_waitlist writeback_ordering_wait;
-	atomic_t		writeback_sequence_next;
+#define BCH_WRITEBACK_MAX_THREADS	8
+	struct writeback_lane {
+		struct closure_waitlist ordering_wait;
+		atomic_t		sequence_next;
+	}			writeback_lanes[BCH_WRITEBACK_MAX_THREADS];
+	unsigned int		writeback_threads;
 
 	/* For tracking sequential IO */
 #define RECENT_IO_BITS	7
@@ -477,6 +485,8 @@ struct gc_stat {
 	size_t			nkeys;
 	uint64_t		data;	/* sectors */
 	unsigned int		in_use; /* percent */
+
+	uint64_t		slice_start;	/* local_clock() */
 };
 
 /*
@@ -659,6 +669,20 @@ struct cache_set {
 
 	struct workqueue_struct	*moving_gc_wq;
 
+	/*
+	 * Reads ahead the btree nodes gc is about to walk, so that the time
+	 * gc holds the root locked goes to marking rather than to waiting on
+	 * node reads. gc_threads is the number of reads kept in flight, 0
+	 * disables read ahead.
+	 */
+	struct workqueue_struct	*gc_prefetch_wq;
+	unsigned int		gc_threads;
+	/*
+	 * While front side I/O is waiting, end a gc slice after this many
+	 * milliseconds even if it hasn't processed btree_gc_min_nodes() yet.
+	 */
+	unsigned int		gc_slice_ms;
+
 	struct btree		*root;
 
 #ifdef CONFIG_BCACHE_DEBUG
@@ -92,6 +92,7 @@
 #define MAX_SAVE_PRIO		72
 #define MAX_GC_TIMES		100
 #define MIN_GC_NODES		100
+#define MIN_GC_SLICE_NODES	10
 #define GC_SLEEP_MS		100
 
 #define PTR_DIRTY_BIT		(((uint64_t) 1 << 36))
@@ -1088,6 +1089,50 @@ static void btree_node_prefetch(struct btree *parent, struct bkey *k)
 	}
 }
 
+struct gc_prefetch {
+	struct work_struct	work;
+	struct btree		*parent;
+	BKEY_PADDED(key);
+};
+
+static void btree_gc_prefetch_fn(struct work_struct *work)
+{
+	struct gc_prefetch *p = container_of(work, struct gc_prefetch, work);
+	struct cache_set *c = p->parent->c;
+
+	btree_node_prefetch(p->parent, &p->key);
+	/* We may have taken the cannibalize lock, and we never unlock a root */
+	bch_cannibalize_unlock(c);
+	kfree(p);
+}
+
+/*
+ * Queue a read of the child node at @k on c->gc_prefetch_wq. gc walks the
+ * children of @parent one at a time with @parent write locked, and used to
+ * read each one in synchronously; with read ahead the reads of the next
+ * gc_threads * 2 children overlap with marking the current one.
+ *
+ * @parent must stay locked until the read completes, see the
+ * flush_workqueue() in btree_gc_recurse().
+ */
+static bool btree_gc_prefetch(struct btree *parent, struct bkey *k)
+{
+	struct gc_prefetch *p;
+
+	if (mca_find(parent->c, k))
+		return false;
+
+	p = kmalloc(sizeof(*p), GFP_NOIO|__GFP_NOWARN);
+	if (!p)
+		return false;
+
+	INIT_WORK(&p->work, btree_gc_prefetch_fn);
+	p->parent = parent;
+	bkey_copy(&p->key, k);
+	queue_work(parent->c->gc_prefetch_wq, &p->work);
+	return true;
+}
+
 /* Btree alloc */
 
 static void btree_node_free(struct btree *b)
@@ -1606,18 +1651,33 @@ static size_t btree_gc_min_nodes(struct cache_set *c)
 	return min_nodes;
 }
 
+/*
+ * The node count above doesn't bound how long a slice keeps front side I/O
+ * waiting: when the nodes have to be read from the cache device it can be
+ * far longer than the count suggests. So also end a slice once it has run
+ * for gc_slice_ms, provided it has made a little progress.
+ */
+static bool btree_gc_slice_expired(struct cache_set *c, struct gc_stat *gc)
+{
+	return c->gc_slice_ms &&
+	       gc->nodes >= gc->nodes_pre + MIN_GC_SLICE_NODES &&
+	       local_clock() - gc->slice_start >
+	       (uint64_t) c->gc_slice_ms * NSEC_PER_MSEC;
+}
 
 static int btree_gc_recurse(struct btree *b, struct btree_op *op,
 			    struct closure *writes, struct gc_stat *gc)
 {
 	int ret = 0;
-	bool should_rewrite;
-	struct bkey *k;
-	struct btree_iter iter;
+	bool should_rewrite, prefetched = false;
+	struct bkey *k, *p;
+	struct btree_iter iter, ahead;
+	size_t nr = 0, ahead_nr = 0;
 	struct gc_merge_info r[GC_MERGE_NODES];
 	struct gc_merge_info *i, *last = r + ARRAY_SIZE(r) - 1;
 
 	bch_btree_iter_init(&b->keys, &iter, &b->c->gc_done);
+	bch_btree_iter_init(&b->keys, &ahead, &b->c->gc_done);
 
 	for (i = r; i < r + ARRAY_SIZE(r); i++)
 		i->b = ERR_PTR(-EINTR);
@@ -1625,6 +1685,14 @@ static int btree_gc_recurse(struct btree *b, struct btree_op *op,
 	while (1) {
 		k = bch_btree_iter_next_filter(&iter, &b->keys, bch_ptr_bad);
 		if (k) {
+			nr++;
+			while (b->c->gc_threads &&
+			       ahead_nr < nr + b->c->gc_threads * 2 &&
+			       (p = bch_btree_iter_next_filter(&ahead, &b->keys,
+							       bch_ptr_bad)))
+				if (++ahead_nr > nr)
+					prefetched |= btree_gc_prefetch(b, p);
+
 			r->b = bch_btree_node_get(b->c, op, k, b->level - 1,
 						  true, b);
 			if (IS_ERR(r->b)) {
@@ -1673,7 +1741,8 @@ static int btree_gc_recurse(struct btree *b, struct btree_op *op,
 		r->b = NULL;
 
 		if (atomic_read(&b->c->search_inflight) &&
-		    gc->nodes >= gc->nodes_pre + btree_gc_min_nodes(b->c)) {
+		    (gc->nodes >= gc->nodes_pre + btree_gc_min_nodes(b->c) ||
+		     btree_gc_slice_expired(b->c, gc))) {
 			gc->nodes_pre =  gc->nodes;
 			ret = -EAGAIN;
 			break;
@@ -1694,6 +1763,10 @@ static int btree_gc_recurse(struct btree *b, struct btree_op *op,
 			rw_unlock(true, i->b);
 		}
 
+	/* Read ahead nodes may be freed once we drop the lock on b */
+	if (prefetched)
+		flush_workqueue(b->c->gc_prefetch_wq);
+
 	return ret;
 }
 
@@ -1832,6 +1905,7 @@ static void bch_btree_gc(struct cache_set *c)
 	struct closure writes;
 	struct btree_op op;
 	uint64_t start_time = local_clock();
+	size_t slice_nodes;
 
 	trace_bcache_gc_start(c);
 
@@ -1843,8 +1917,14 @@ static void bch_btree_gc(struct cache_set *c)
 
 	/* if CACHE_SET_IO_DISABLE set, gc thread should stop too */
 	do {
+		stats.slice_start = local_clock();
+		slice_nodes = stats.nodes;
+
 		ret = btree_root(gc_root, c, &op, &writes, &stats);
 		closure_sync(&writes);
+
+		trace_bcache_gc_slice(c, stats.nodes - slice_nodes,
+				      local_clock() - stats.slice_start, ret);
 		cond_resched();
 
 		if (ret == -EAGAIN)
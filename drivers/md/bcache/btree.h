@@ -257,6 +257,10 @@ int bch_btree_insert_check_key(struct btree *b, struct btree_op *op,
 int bch_btree_insert(struct cache_set *c, struct keylist *keys,
 		     atomic_t *journal_ref, struct bkey *replace_key);
 
+#define BCH_GC_THREADS_DEFAULT	4
+#define BCH_GC_THREADS_MAX	16
+#define BCH_GC_SLICE_MS_DEFAULT	20
+
 int bch_gc_thread_start(struct cache_set *c);
 void bch_initial_gc_finish(struct cache_set *c);
 void bch_moving_gc(struct cache_set *c);
@@ -1592,6 +1592,8 @@ static void cache_set_free(struct closure *cl)
 
 	if (c->moving_gc_wq)
 		destroy_workqueue(c->moving_gc_wq);
+	if (c->gc_prefetch_wq)
+		destroy_workqueue(c->gc_prefetch_wq);
 	bioset_exit(&c->bio_split);
 	mempool_exit(&c->fill_iter);
 	mempool_exit(&c->bio_meta);
@@ -1826,6 +1828,9 @@ struct cache_set *bch_cache_set_alloc(struct cache_sb *sb)
 	    !(c->uuids = alloc_bucket_pages(GFP_KERNEL, c)) ||
 	    !(c->moving_gc_wq = alloc_workqueue("bcache_gc",
 						WQ_MEM_RECLAIM, 0)) ||
+	    !(c->gc_prefetch_wq = alloc_workqueue("bcache_gc_prefetch",
+						  WQ_UNBOUND|WQ_MEM_RECLAIM,
+						  BCH_GC_THREADS_DEFAULT)) ||
 	    bch_journal_alloc(c) ||
 	    bch_btree_cache_alloc(c) ||
 	    bch_open_buckets_alloc(c) ||
@@ -1835,6 +1840,8 @@ struct cache_set *bch_cache_set_alloc(struct cache_sb *sb)
 	c->congested_read_threshold_us	= 2000;
 	c->congested_write_threshold_us	= 20000;
 	c->error_limit	= DEFAULT_IO_ERROR_LIMIT;
+	c->gc_threads	= BCH_GC_THREADS_DEFAULT;
+	c->gc_slice_ms	= BCH_GC_SLICE_MS_DEFAULT;
 	WARN_ON(test_and_clear_bit(CACHE_SET_IO_DISABLE, &c->flags));
 
 	return c;
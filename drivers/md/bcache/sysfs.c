@@ -112,6 +112,7 @@ rw_attribute(writeback_metadata);
 rw_attribute(writeback_running);
 rw_attribute(writeback_percent);
 rw_attribute(writeback_delay);
+rw_attribute(writeback_threads);
 rw_attribute(writeback_rate);
 
 rw_attribute(writeback_rate_update_seconds);
@@ -142,6 +143,8 @@ rw_attribute(cache_replacement_policy);
 rw_attribute(btree_shrinker_disabled);
 rw_attribute(copy_gc_enabled);
 rw_attribute(gc_after_writeback);
+rw_attribute(gc_threads);
+rw_attribute(gc_slice_ms);
 rw_attribute(size);
 
 static ssize_t bch_snprint_string_list(char *buf,
@@ -191,6 +194,7 @@ SHOW(__bch_cached_dev)
 	var_printf(writeback_metadata,	"%i");
 	var_printf(writeback_running,	"%i");
 	var_print(writeback_delay);
+	var_print(writeback_threads);
 	var_print(writeback_percent);
 	sysfs_hprint(writeback_rate,
 		     wb ? atomic_long_read(&dc->writeback_rate.rate) << 9 : 0);
@@ -299,6 +303,8 @@ STORE(__cached_dev)
 	sysfs_strtoul_bool(writeback_metadata, dc->writeback_metadata);
 	sysfs_strtoul_bool(writeback_running, dc->writeback_running);
 	sysfs_strtoul_clamp(writeback_delay, dc->writeback_delay, 0, UINT_MAX);
+	sysfs_strtoul_clamp(writeback_threads, dc->writeback_threads,
+			    1, BCH_WRITEBACK_MAX_THREADS);
 
 	sysfs_strtoul_clamp(writeback_percent, dc->writeback_percent,
 			    0, bch_cutoff_writeback);
@@ -492,6 +498,7 @@ static struct attribute *bch_cached_dev_files[] = {
 	&sysfs_writeback_metadata,
 	&sysfs_writeback_running,
 	&sysfs_writeback_delay,
+	&sysfs_writeback_threads,
 	&sysfs_writeback_percent,
 	&sysfs_writeback_rate,
 	&sysfs_writeback_rate_update_seconds,
@@ -770,6 +777,8 @@ SHOW(__bch_cache_set)
 	sysfs_printf(btree_shrinker_disabled,	"%i", c->shrinker_disabled);
 	sysfs_printf(copy_gc_enabled,		"%i", c->copy_gc_enabled);
 	sysfs_printf(gc_after_writeback,	"%i", c->gc_after_writeback);
+	sysfs_print(gc_threads,			c->gc_threads);
+	sysfs_print(gc_slice_ms,		c->gc_slice_ms);
 	sysfs_printf(io_disable,		"%i",
 		     test_bit(CACHE_SET_IO_DISABLE, &c->flags));
 
@@ -893,6 +902,19 @@ STORE(__bch_cache_set)
 	 */
 	sysfs_strtoul_clamp(gc_after_writeback, c->gc_after_writeback, 0, 1);
 
+	if (attr == &sysfs_gc_threads) {
+		v = strtoul_safe_clamp(buf, c->gc_threads,
+				       0, BCH_GC_THREADS_MAX);
+		if (v)
+			return v;
+
+		if (c->gc_threads)
+			workqueue_set_max_active(c->gc_prefetch_wq,
+						 c->gc_threads);
+	}
+
+	sysfs_strtoul_clamp(gc_slice_ms, c->gc_slice_ms, 0, MSEC_PER_SEC);
+
 	return size;
 }
 STORE_LOCKED(bch_cache_set)
@@ -977,6 +999,8 @@ static struct attribute *bch_cache_set_internal_files[] = {
 	&sysfs_btree_shrinker_disabled,
 	&sysfs_copy_gc_enabled,
 	&sysfs_gc_after_writeback,
+	&sysfs_gc_threads,
+	&sysfs_gc_slice_ms,
 	&sysfs_io_disable,
 	&sysfs_cutoff_writeback,
 	&sysfs_cutoff_writeback_sync,
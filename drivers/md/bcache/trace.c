@@ -37,6 +37,7 @@ EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_btree_node_free);
 EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_btree_gc_coalesce);
 EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_gc_start);
 EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_gc_end);
+EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_gc_slice);
 EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_gc_copy);
 EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_gc_copy_collision);
 
@@ -51,3 +52,5 @@ EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_alloc_fail);
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_writeback);
 EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_writeback_collision);
+EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_writeback_batch);
+EXPORT_TRACEPOINT_SYMBOL_GPL(bcache_writeback_done);
@@ -241,7 +241,10 @@ static unsigned int writeback_delay(struct cached_dev *dc,
 struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
+	struct writeback_lane	*lane;
 	uint16_t		sequence;
+	uint64_t		start_time;
+	uint64_t		write_time;
 	struct bio		bio;
 };
 
@@ -300,6 +303,10 @@ static void write_dirty_finish(struct closure *cl)
 				: &dc->disk.c->writeback_keys_done);
 	}
 
+	trace_bcache_writeback_done(&w->key,
+				    io->write_time - io->start_time,
+				    local_clock() - io->write_time);
+
 	bch_keybuf_del(&dc->writeback_keys, w);
 	up(&dc->in_flight);
 
@@ -323,20 +330,20 @@ static void write_dirty(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
 	struct keybuf_key *w = io->bio.bi_private;
-	struct cached_dev *dc = io->dc;
+	struct writeback_lane *lane = io->lane;
 
 	uint16_t next_sequence;
 
-	if (atomic_read(&dc->writeback_sequence_next) != io->sequence) {
+	if (atomic_read(&lane->sequence_next) != io->sequence) {
 		/* Not our turn to write; wait for a write to complete */
-		closure_wait(&dc->writeback_ordering_wait, cl);
+		closure_wait(&lane->ordering_wait, cl);
 
-		if (atomic_read(&dc->writeback_sequence_next) == io->sequence) {
+		if (atomic_read(&lane->sequence_next) == io->sequence) {
 			/*
 			 * Edge case-- it happened in indeterminate order
 			 * relative to when we were added to wait list..
 			 */
-			closure_wake_up(&dc->writeback_ordering_wait);
+			closure_wake_up(&lane->ordering_wait);
 		}
 
 		continue_at(cl, write_dirty, io->dc->writeback_write_wq);
@@ -344,6 +351,7 @@ static void write_dirty(struct closure *cl)
 	}
 
 	next_sequence = io->sequence + 1;
+	io->write_time = local_clock();
 
 	/*
 	 * IO errors are signalled using the dirty bit on the key.
@@ -362,8 +370,8 @@ static void write_dirty(struct closure *cl)
 		closure_bio_submit(io->dc->disk.c, &io->bio, cl);
 	}
 
-	atomic_set(&dc->writeback_sequence_next, next_sequence);
-	closure_wake_up(&dc->writeback_ordering_wait);
+	atomic_set(&lane->sequence_next, next_sequence);
+	closure_wake_up(&lane->ordering_wait);
 
 	continue_at(cl, write_dirty_finish, io->dc->writeback_write_wq);
 }
@@ -390,6 +398,22 @@ static void read_dirty_submit(struct closure *cl)
 	continue_at(cl, write_dirty, io->dc->writeback_write_wq);
 }
 
+/*
+ * Operations are eligible to be combined into one pass if they are
+ * contiguous, or if they fall in the same stripe of the backing device: a
+ * few non-contiguous writes in flight at once let the backing device's
+ * command queueing (or md, completing a stripe) sort them out.
+ */
+static bool writeback_can_combine(struct cached_dev *dc, struct bkey *prev,
+				  struct bkey *next)
+{
+	if (!bkey_cmp(prev, &START_KEY(next)))
+		return true;
+
+	return offset_to_stripe(&dc->disk, KEY_START(prev)) ==
+	       offset_to_stripe(&dc->disk, KEY_START(next));
+}
+
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned int delay = 0;
@@ -398,10 +422,16 @@ static void read_dirty(struct cached_dev *dc)
 	int nk, i;
 	struct dirty_io *io;
 	struct closure cl;
-	uint16_t sequence = 0;
+	uint16_t sequence[BCH_WRITEBACK_MAX_THREADS] = { 0 };
+	/* Sampled once, so a sysfs write can't reorder a lane mid-pass */
+	unsigned int lanes = dc->writeback_threads, lane;
 
-	BUG_ON(!llist_empty(&dc->writeback_ordering_wait.list));
-	atomic_set(&dc->writeback_sequence_next, sequence);
+	for (lane = 0; lane < lanes; lane++) {
+		struct writeback_lane *l = &dc->writeback_lanes[lane];
+
+		BUG_ON(!llist_empty(&l->ordering_wait.list));
+		atomic_set(&l->sequence_next, 0);
+	}
 	closure_init_stack(&cl);
 
 	/*
@@ -434,24 +464,23 @@ static void read_dirty(struct cached_dev *dc)
 			if (size >= MAX_WRITESIZE_IN_PASS)
 				break;
 
-			/*
-			 * Operations are only eligible to be combined
-			 * if they are contiguous.
-			 *
-			 * TODO: add a heuristic willing to fire a
-			 * certain amount of non-contiguous IO per pass,
-			 * so that we can benefit from backing device
-			 * command queueing.
-			 */
-			if ((nk != 0) && bkey_cmp(&keys[nk-1]->key,
-						&START_KEY(&next->key)))
+			if (nk != 0 &&
+			    !writeback_can_combine(dc, &keys[nk-1]->key,
+						   &next->key))
 				break;
 
 			size += KEY_SIZE(&next->key);
 			keys[nk++] = next;
 		} while ((next = bch_keybuf_next(&dc->writeback_keys)));
 
-		/* Now we have gathered a set of 1..5 keys to write back. */
+		/*
+		 * Now we have gathered a set of 1..5 keys to write back. They
+		 * share a stripe, so they all go down the same lane.
+		 */
+		lane = offset_to_stripe(&dc->disk, KEY_START(&keys[0]->key)) %
+			lanes;
+		trace_bcache_writeback_batch(&keys[0]->key, lane, nk, size);
+
 		for (i = 0; i < nk; i++) {
 			w = keys[i];
 
@@ -465,7 +494,9 @@ static void read_dirty(struct cached_dev *dc)
 
 			w->private	= io;
 			io->dc		= dc;
-			io->sequence    = sequence++;
+			io->lane	= &dc->writeback_lanes[lane];
+			io->sequence    = sequence[lane]++;
+			io->start_time	= local_clock();
 
 			dirty_init(w);
 			bio_set_op_attrs(&io->bio, REQ_OP_READ, 0);
@@ -814,6 +845,7 @@ void bch_cached_dev_writeback_init(struct cached_dev *dc)
 	dc->writeback_running		= false;
 	dc->writeback_percent		= 10;
 	dc->writeback_delay		= 30;
+	dc->writeback_threads		= WRITEBACK_THREADS_DEFAULT;
 	atomic_long_set(&dc->writeback_rate.rate, 1024);
 	dc->writeback_rate_minimum	= 8;
 
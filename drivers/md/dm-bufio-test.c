@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Self test for dm-bufio: parallel lookups of cached buffers.
+ *
+ * Populates a client with clean buffers (dm_bufio_new doesn't do any I/O,
+ * so no device is needed), then has several threads look up random
+ * buffers with dm_bufio_get and release them, checking that each lookup
+ * returns the right block, and reports the lookup rate.
+ */
+
+#include <linux/dm-bufio.h>
+
+#include <linux/device-mapper.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+
+#define DM_MSG_PREFIX "bufio test"
+
+static int blocks = 1024;
+module_param(blocks, int, 0);
+MODULE_PARM_DESC(blocks, "Number of cached blocks (default: 1024)");
+
+static int lookups = 1000000;
+module_param(lookups, int, 0);
+MODULE_PARM_DESC(lookups, "Lookups per thread (default: 1000000)");
+
+static int tcount;
+module_param(tcount, int, 0);
+MODULE_PARM_DESC(tcount, "Number of threads to spawn (default: online CPUs)");
+
+struct thread_data {
+	int id;
+	struct task_struct *task;
+	unsigned misses;
+	u64 duration;
+};
+
+static struct dm_bufio_client *client;
+static atomic_t startup_count;
+static DECLARE_WAIT_QUEUE_HEAD(startup_wait);
+
+static int __init populate(void)
+{
+	struct dm_buffer *b;
+	sector_t block;
+	u64 *data;
+
+	for (block = 0; block < blocks; block++) {
+		data = dm_bufio_new(client, block, &b);
+		if (IS_ERR(data))
+			return PTR_ERR(data);
+		*data = block;
+		dm_bufio_release(b);
+	}
+
+	return 0;
+}
+
+static int threadfunc(void *data)
+{
+	struct thread_data *tdata = data;
+	struct rnd_state rnd;
+	struct dm_buffer *b;
+	sector_t block;
+	u64 *p, start;
+	int i, err = 0;
+
+	prandom_seed_state(&rnd, tdata->id);
+
+	if (atomic_dec_and_test(&startup_count))
+		wake_up(&startup_wait);
+	if (wait_event_interruptible(startup_wait,
+				     atomic_read(&startup_count) == -1)) {
+		DMERR("thread[%d]: interrupted", tdata->id);
+		err = -EINTR;
+		goto out;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < lookups; i++) {
+		block = prandom_u32_state(&rnd) % blocks;
+
+		p = dm_bufio_get(client, block, &b);
+		if (!p) {
+			/* Evicted under memory pressure, that's fine */
+			tdata->misses++;
+			continue;
+		}
+		if (IS_ERR(p)) {
+			err = PTR_ERR(p);
+			DMERR("thread[%d]: block %llu returned %d", tdata->id,
+			      (unsigned long long)block, err);
+			goto out;
+		}
+		if (*p != block) {
+			DMERR("thread[%d]: block %llu has data of block %llu",
+			      tdata->id, (unsigned long long)block,
+			      (unsigned long long)*p);
+			dm_bufio_release(b);
+			err = -EINVAL;
+			goto out;
+		}
+		dm_bufio_release(b);
+
+		if (!(i & 1023))
+			cond_resched();
+	}
+	tdata->duration = ktime_get_ns() - start;
+
+out:
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		schedule();
+	}
+	return err;
+}
+
+static int __init dm_bufio_test_init(void)
+{
+	struct thread_data *tdata;
+	int i, err, started_threads = 0, failed_threads = 0;
+	u64 total_lookups = 0, max_duration = 0;
+
+	if (blocks <= 0 || lookups <= 0)
+		return -EINVAL;
+	if (tcount <= 0)
+		tcount = num_online_cpus();
+
+	client = dm_bufio_client_create(NULL, PAGE_SIZE, 1, 0, NULL, NULL);
+	if (IS_ERR(client))
+		return PTR_ERR(client);
+
+	err = populate();
+	if (err) {
+		DMERR("populating %d blocks failed: %d", blocks, err);
+		goto out_client;
+	}
+
+	tdata = vzalloc(array_size(tcount, sizeof(*tdata)));
+	if (!tdata) {
+		err = -ENOMEM;
+		goto out_client;
+	}
+
+	DMINFO("%d threads looking up %d cached blocks %d times each",
+	       tcount, blocks, lookups);
+	atomic_set(&startup_count, tcount);
+	for (i = 0; i < tcount; i++) {
+		tdata[i].id = i;
+		tdata[i].task = kthread_run(threadfunc, &tdata[i],
+					    "dm_bufio_test[%d]", i);
+		if (IS_ERR(tdata[i].task)) {
+			DMERR("kthread_run failed for thread %d", i);
+			atomic_dec(&startup_count);
+		} else {
+			started_threads++;
+		}
+	}
+	if (wait_event_interruptible(startup_wait,
+				     atomic_read(&startup_count) == 0))
+		DMERR("wait_event interruptible failed");
+	/* count is 0 now, set it to -1 and wake up all threads together */
+	atomic_dec(&startup_count);
+	wake_up_all(&startup_wait);
+
+	for (i = 0; i < tcount; i++) {
+		if (IS_ERR(tdata[i].task))
+			continue;
+		if ((err = kthread_stop(tdata[i].task))) {
+			DMERR("thread %d returned: %d", i, err);
+			failed_threads++;
+			continue;
+		}
+		total_lookups += lookups - tdata[i].misses;
+		max_duration = max(max_duration, tdata[i].duration);
+		if (tdata[i].misses)
+			DMINFO("thread[%d]: %u lookups missed", i,
+			       tdata[i].misses);
+	}
+	vfree(tdata);
+
+	if (max_duration)
+		DMINFO("%llu lookups in %llu us: %llu lookups/s",
+		       total_lookups, div_u64(max_duration, NSEC_PER_USEC),
+		       div64_u64(total_lookups * NSEC_PER_SEC, max_duration));
+	DMINFO("started %d threads, %d failed", started_threads,
+	       failed_threads);
+
+	err = failed_threads ? -EINVAL : 0;
+out_client:
+	dm_bufio_client_destroy(client);
+	return err;
+}
+
+static void __exit dm_bufio_test_exit(void)
+{
+}
+
+module_init(dm_bufio_test_init);
+module_exit(dm_bufio_test_exit);
+
+MODULE_DESCRIPTION(DM_NAME " buffered I/O library self test");
+MODULE_LICENSE("GPL");
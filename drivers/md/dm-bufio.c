@@ -17,6 +17,8 @@
 #include <linux/shrinker.h>
 #include <linux/module.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 #include <linux/stacktrace.h>
 
 #define DM_MSG_PREFIX "bufio"
@@ -64,9 +66,29 @@
 #define LIST_DIRTY	1
 #define LIST_SIZE	2
 
+/*
+ * Number of buffer trees per client, a power of 2.
+ */
+#define DM_BUFIO_TREE_SHARDS		16
+
+/*
+ * The buffer index is split into DM_BUFIO_TREE_SHARDS red/black trees by
+ * block number.  The trees are only modified with c->lock held; each one
+ * also has a seqlock that is write-locked around modifications, so that
+ * lookups of cached, clean buffers can walk a tree under RCU without
+ * c->lock (see dm_bufio_find_clean) and detect a concurrent change.
+ * Splitting the index means a change only disturbs the lockless lookups
+ * in one shard.
+ */
+struct buffer_tree {
+	seqlock_t lock;
+	struct rb_root root;
+} ____cacheline_aligned_in_smp;
+
 /*
  * Linking of buffers:
- *	All buffers are linked to buffer_tree with their node field.
+ *	All buffers are linked to one of the buffer_trees with their node
+ *	field.
  *
  *	Clean buffers that are not being written (B_WRITING not set)
  *	are linked to lru[LIST_CLEAN] with their lru_list field.
@@ -100,8 +122,10 @@ struct dm_bufio_client {
 
 	unsigned minimum_buffers;
 
-	struct rb_root buffer_tree;
+	struct buffer_tree trees[DM_BUFIO_TREE_SHARDS];
 	wait_queue_head_t free_buffer_wait;
+	atomic_t release_gen;
+	atomic_t release_waiters;
 
 	sector_t start;
 
@@ -141,7 +165,12 @@ struct dm_buffer {
 	blk_status_t read_error;
 	blk_status_t write_error;
 	unsigned accessed;
-	unsigned hold_count;
+	unsigned char referenced;		/* hit without c->lock */
+	/*
+	 * -1 while the buffer is being evicted or isn't linked, so that
+	 * dm_bufio_find_clean can't take a hold on it.
+	 */
+	atomic_t hold_count;
 	unsigned long state;
 	unsigned long last_accessed;
 	unsigned dirty_start;
@@ -243,11 +272,17 @@ static void buffer_record_stack(struct dm_buffer *b)
 #endif
 
 /*----------------------------------------------------------------
- * A red/black tree acts as an index for all the buffers.
+ * Red/black trees act as an index for all the buffers.
  *--------------------------------------------------------------*/
+static struct buffer_tree *block_tree(struct dm_bufio_client *c,
+				      sector_t block)
+{
+	return &c->trees[block & (DM_BUFIO_TREE_SHARDS - 1)];
+}
+
 static struct dm_buffer *__find(struct dm_bufio_client *c, sector_t block)
 {
-	struct rb_node *n = c->buffer_tree.rb_node;
+	struct rb_node *n = block_tree(c, block)->root.rb_node;
 	struct dm_buffer *b;
 
 	while (n) {
@@ -262,9 +297,33 @@ static struct dm_buffer *__find(struct dm_bufio_client *c, sector_t block)
 	return NULL;
 }
 
+/*
+ * Like __find, but walks the tree under RCU without c->lock.  The result
+ * is only meaningful if the tree's seqlock didn't change meanwhile.
+ */
+static struct dm_buffer *__find_rcu(struct buffer_tree *tree, sector_t block)
+{
+	struct rb_node *n = rcu_dereference_raw(tree->root.rb_node);
+	struct dm_buffer *b;
+
+	while (n) {
+		b = container_of(n, struct dm_buffer, node);
+
+		if (READ_ONCE(b->block) == block)
+			return b;
+
+		n = (READ_ONCE(b->block) < block) ?
+			rcu_dereference_raw(n->rb_left) :
+			rcu_dereference_raw(n->rb_right);
+	}
+
+	return NULL;
+}
+
 static void __insert(struct dm_bufio_client *c, struct dm_buffer *b)
 {
-	struct rb_node **new = &c->buffer_tree.rb_node, *parent = NULL;
+	struct buffer_tree *tree = block_tree(c, b->block);
+	struct rb_node **new = &tree->root.rb_node, *parent = NULL;
 	struct dm_buffer *found;
 
 	while (*new) {
@@ -280,13 +339,30 @@ static void __insert(struct dm_bufio_client *c, struct dm_buffer *b)
 			&((*new)->rb_left) : &((*new)->rb_right);
 	}
 
-	rb_link_node(&b->node, parent, new);
-	rb_insert_color(&b->node, &c->buffer_tree);
+	write_seqlock(&tree->lock);
+	rb_link_node_rcu(&b->node, parent, new);
+	rb_insert_color(&b->node, &tree->root);
+	write_sequnlock(&tree->lock);
 }
 
 static void __remove(struct dm_bufio_client *c, struct dm_buffer *b)
 {
-	rb_erase(&b->node, &c->buffer_tree);
+	struct buffer_tree *tree = block_tree(c, b->block);
+
+	write_seqlock(&tree->lock);
+	rb_erase(&b->node, &tree->root);
+	write_sequnlock(&tree->lock);
+}
+
+/*
+ * Claim an unheld buffer for eviction by moving its hold count from 0 to
+ * -1.  Once claimed, dm_bufio_find_clean can no longer take a hold on it.
+ * Must be called with c->lock held, and a claimed buffer must be unlinked
+ * before c->lock is dropped.
+ */
+static bool __claim_buffer(struct dm_buffer *b)
+{
+	return atomic_cmpxchg(&b->hold_count, 0, -1) == 0;
 }
 
 /*----------------------------------------------------------------*/
@@ -447,6 +523,11 @@ static struct dm_buffer *alloc_buffer(struct dm_bufio_client *c, gfp_t gfp_mask)
 		return NULL;
 
 	b->c = c;
+	/*
+	 * The slab is SLAB_TYPESAFE_BY_RCU: a lockless lookup may still be
+	 * looking at this buffer's previous life, keep it unholdable.
+	 */
+	atomic_set(&b->hold_count, -1);
 
 	b->data = alloc_buffer_data(c, gfp_mask, &b->data_mode);
 	if (!b->data) {
@@ -512,6 +593,7 @@ static void __relink_lru(struct dm_buffer *b, int dirty)
 	struct dm_bufio_client *c = b->c;
 
 	b->accessed = 1;
+	WRITE_ONCE(b->referenced, 0);
 
 	BUG_ON(!c->n_buffers[b->list_mode]);
 
@@ -522,6 +604,20 @@ static void __relink_lru(struct dm_buffer *b, int dirty)
 	b->last_accessed = jiffies;
 }
 
+/*
+ * Hits in dm_bufio_find_clean can't move the buffer to the head of its
+ * LRU queue, they only mark it referenced.  Give such a buffer a second
+ * chance before reclaiming it.
+ */
+static bool __lru_second_chance(struct dm_buffer *b)
+{
+	if (likely(!READ_ONCE(b->referenced)))
+		return false;
+
+	__relink_lru(b, b->list_mode);
+	return true;
+}
+
 /*----------------------------------------------------------------
  * Submit I/O on the buffer.
  *
@@ -746,7 +842,7 @@ static void __flush_write_list(struct list_head *write_list)
  */
 static void __make_buffer_clean(struct dm_buffer *b)
 {
-	BUG_ON(b->hold_count);
+	BUG_ON(atomic_read(&b->hold_count) != -1);
 
 	if (!b->state)	/* fast case */
 		return;
@@ -762,13 +858,16 @@ static void __make_buffer_clean(struct dm_buffer *b)
  */
 static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 {
-	struct dm_buffer *b;
+	struct dm_buffer *b, *tmp;
 
-	list_for_each_entry_reverse(b, &c->lru[LIST_CLEAN], lru_list) {
+	list_for_each_entry_safe_reverse(b, tmp, &c->lru[LIST_CLEAN], lru_list) {
 		BUG_ON(test_bit(B_WRITING, &b->state));
 		BUG_ON(test_bit(B_DIRTY, &b->state));
 
-		if (!b->hold_count) {
+		if (__lru_second_chance(b))
+			continue;
+
+		if (__claim_buffer(b)) {
 			__make_buffer_clean(b);
 			__unlink_buffer(b);
 			return b;
@@ -779,7 +878,7 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 	list_for_each_entry_reverse(b, &c->lru[LIST_DIRTY], lru_list) {
 		BUG_ON(test_bit(B_READING, &b->state));
 
-		if (!b->hold_count) {
+		if (__claim_buffer(b)) {
 			__make_buffer_clean(b);
 			__unlink_buffer(b);
 			return b;
@@ -790,14 +889,36 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 	return NULL;
 }
 
+/*
+ * dm_bufio_release drops holds without c->lock, and only bumps
+ * c->release_gen and wakes free_buffer_wait while someone is registered
+ * here, so that releases don't all write a cacheline shared by the client.
+ * Register before sampling c->release_gen and looking for an unheld buffer.
+ */
+static void __add_release_waiter(struct dm_bufio_client *c)
+{
+	atomic_inc(&c->release_waiters);
+	/* Pairs with the hold count decrement in dm_bufio_release */
+	smp_mb__after_atomic();
+}
+
+static void __remove_release_waiter(struct dm_bufio_client *c)
+{
+	atomic_dec(&c->release_waiters);
+}
+
 /*
  * Wait until some other threads free some buffer or release hold count on
  * some buffer.
  *
+ * The caller is registered with __add_release_waiter and passes
+ * c->release_gen as sampled before it last looked for an unheld buffer;
+ * if a hold was dropped since then, return without sleeping.
+ *
  * This function is entered with c->lock held, drops it and regains it
  * before exiting.
  */
-static void __wait_for_free_buffer(struct dm_bufio_client *c)
+static void __wait_for_free_buffer(struct dm_bufio_client *c, int gen)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
@@ -805,7 +926,9 @@ static void __wait_for_free_buffer(struct dm_bufio_client *c)
 	set_current_state(TASK_UNINTERRUPTIBLE);
 	dm_bufio_unlock(c);
 
-	io_schedule();
+	if (atomic_read(&c->release_gen) == gen)
+		io_schedule();
+	__set_current_state(TASK_RUNNING);
 
 	remove_wait_queue(&c->free_buffer_wait, &wait);
 
@@ -828,7 +951,8 @@ enum new_flag {
 static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client *c, enum new_flag nf)
 {
 	struct dm_buffer *b;
-	bool tried_noio_alloc = false;
+	bool tried_noio_alloc = false, waiting = false;
+	int gen;
 
 	/*
 	 * dm-bufio is resistant to allocation failures (it just keeps
@@ -847,7 +971,7 @@ static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client
 		if (dm_bufio_cache_size_latch != 1) {
 			b = alloc_buffer(c, GFP_NOWAIT | __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
 			if (b)
-				return b;
+				goto out;
 		}
 
 		if (nf == NF_PREFETCH)
@@ -858,25 +982,36 @@ static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client
 			b = alloc_buffer(c, GFP_NOIO | __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
 			dm_bufio_lock(c);
 			if (b)
-				return b;
+				goto out;
 			tried_noio_alloc = true;
 		}
 
+		if (!waiting) {
+			__add_release_waiter(c);
+			waiting = true;
+		}
+		gen = atomic_read(&c->release_gen);
+
 		if (!list_empty(&c->reserved_buffers)) {
 			b = list_entry(c->reserved_buffers.next,
 				       struct dm_buffer, lru_list);
 			list_del(&b->lru_list);
 			c->need_reserved_buffers++;
 
-			return b;
+			goto out;
 		}
 
 		b = __get_unclaimed_buffer(c);
 		if (b)
-			return b;
+			goto out;
 
-		__wait_for_free_buffer(c);
+		__wait_for_free_buffer(c, gen);
 	}
+
+out:
+	if (waiting)
+		__remove_release_waiter(c);
+	return b;
 }
 
 static struct dm_buffer *__alloc_buffer_wait(struct dm_bufio_client *c, enum new_flag nf)
@@ -979,18 +1114,24 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 	__check_watermark(c, write_list);
 
 	b = new_b;
-	b->hold_count = 1;
 	b->read_error = 0;
 	b->write_error = 0;
-	__link_buffer(b, block, LIST_CLEAN);
+	b->referenced = 0;
 
+	/*
+	 * B_READING must be set before __link_buffer() makes the buffer
+	 * visible to dm_bufio_find_clean(), which would otherwise hand out
+	 * data that hasn't been read.  rb_link_node_rcu() orders these stores
+	 * before the buffer can be found in the tree.
+	 */
 	if (nf == NF_FRESH) {
 		b->state = 0;
-		return b;
+	} else {
+		b->state = 1 << B_READING;
+		*need_submit = 1;
 	}
-
-	b->state = 1 << B_READING;
-	*need_submit = 1;
+	atomic_set(&b->hold_count, 1);
+	__link_buffer(b, block, LIST_CLEAN);
 
 	return b;
 
@@ -1007,12 +1148,61 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 	if (nf == NF_GET && unlikely(test_bit(B_READING, &b->state)))
 		return NULL;
 
-	b->hold_count++;
+	atomic_inc(&b->hold_count);
 	__relink_lru(b, test_bit(B_DIRTY, &b->state) ||
 		     test_bit(B_WRITING, &b->state));
 	return b;
 }
 
+/*
+ * Look up a cached, clean buffer and take a hold on it without c->lock,
+ * which is what most reads of dm-verity hashes and of dm-thin and
+ * dm-cache metadata come down to.
+ *
+ * The walk runs under RCU.  Buffer structures are SLAB_TYPESAFE_BY_RCU,
+ * so the one we find may be evicted and reused under us, but it remains a
+ * dm_buffer of this client.  Taking the hold fails if the buffer is being
+ * evicted, and once the hold is taken the buffer can't be evicted; we then
+ * check with the tree's seqlock that it really is the buffer for @block.
+ * Loading the state with acquire semantics pairs with the barrier in
+ * read_endio(), so that a buffer seen idle also has its data and read_error.
+ *
+ * Returns NULL if the buffer isn't there or isn't both clean and idle; the
+ * caller then takes the locked path.
+ */
+static struct dm_buffer *dm_bufio_find_clean(struct dm_bufio_client *c,
+					     sector_t block)
+{
+	struct buffer_tree *tree = block_tree(c, block);
+	struct dm_buffer *b;
+	unsigned seq;
+
+	rcu_read_lock();
+	seq = read_seqbegin(&tree->lock);
+	b = __find_rcu(tree, block);
+	if (b && !atomic_inc_unless_negative(&b->hold_count))
+		b = NULL;
+	rcu_read_unlock();
+
+	if (!b)
+		return NULL;
+
+	if (unlikely(read_seqretry(&tree->lock, seq) ||
+		     READ_ONCE(b->block) != block ||
+		     smp_load_acquire(&b->state) ||
+		     READ_ONCE(b->read_error))) {
+		dm_bufio_release(b);
+		return NULL;
+	}
+
+	if (!READ_ONCE(b->referenced))
+		WRITE_ONCE(b->referenced, 1);
+	if (READ_ONCE(b->last_accessed) != jiffies)
+		WRITE_ONCE(b->last_accessed, jiffies);
+
+	return b;
+}
+
 /*
  * The endio routine for reading: set the error, clear the bit and wake up
  * anyone waiting on the buffer.
@@ -1044,10 +1234,16 @@ static void *new_read(struct dm_bufio_client *c, sector_t block,
 
 	LIST_HEAD(write_list);
 
+	b = dm_bufio_find_clean(c, block);
+	if (b) {
+		*bp = b;
+		return b->data;
+	}
+
 	dm_bufio_lock(c);
 	b = __bufio_new(c, block, nf, &need_submit, &write_list);
 #ifdef CONFIG_DM_DEBUG_BLOCK_STACK_TRACING
-	if (b && b->hold_count == 1)
+	if (b && atomic_read(&b->hold_count) == 1)
 		buffer_record_stack(b);
 #endif
 	dm_bufio_unlock(c);
@@ -1149,30 +1345,39 @@ EXPORT_SYMBOL_GPL(dm_bufio_prefetch);
 void dm_bufio_release(struct dm_buffer *b)
 {
 	struct dm_bufio_client *c = b->c;
+	int hold_count = atomic_dec_return(&b->hold_count);
 
-	dm_bufio_lock(c);
-
-	BUG_ON(!b->hold_count);
-
-	b->hold_count--;
-	if (!b->hold_count) {
-		wake_up(&c->free_buffer_wait);
+	BUG_ON(hold_count < 0);
+	if (hold_count)
+		return;
 
-		/*
-		 * If there were errors on the buffer, and the buffer is not
-		 * to be written, free the buffer. There is no point in caching
-		 * invalid buffer.
-		 */
+	/*
+	 * If there were errors on the buffer, and the buffer is not
+	 * to be written, free the buffer. There is no point in caching
+	 * invalid buffer.
+	 */
+	if (unlikely(b->read_error || b->write_error)) {
+		dm_bufio_lock(c);
 		if ((b->read_error || b->write_error) &&
 		    !test_bit(B_READING, &b->state) &&
 		    !test_bit(B_WRITING, &b->state) &&
-		    !test_bit(B_DIRTY, &b->state)) {
+		    !test_bit(B_DIRTY, &b->state) &&
+		    __claim_buffer(b)) {
 			__unlink_buffer(b);
 			__free_buffer_wake(b);
 		}
+		dm_bufio_unlock(c);
 	}
 
-	dm_bufio_unlock(c);
+	/*
+	 * The hold count decrement is a full barrier, pairing with the one in
+	 * __add_release_waiter: either a waiter's scan saw the buffer unheld
+	 * or we see the waiter here.
+	 */
+	if (atomic_read(&c->release_waiters)) {
+		atomic_inc(&c->release_gen);
+		wake_up(&c->free_buffer_wait);
+	}
 }
 EXPORT_SYMBOL_GPL(dm_bufio_release);
 
@@ -1255,12 +1460,12 @@ int dm_bufio_write_dirty_buffers(struct dm_bufio_client *c)
 		if (test_bit(B_WRITING, &b->state)) {
 			if (buffers_processed < c->n_buffers[LIST_DIRTY]) {
 				dropped_lock = 1;
-				b->hold_count++;
+				atomic_inc(&b->hold_count);
 				dm_bufio_unlock(c);
 				wait_on_bit_io(&b->state, B_WRITING,
 					       TASK_UNINTERRUPTIBLE);
 				dm_bufio_lock(c);
-				b->hold_count--;
+				atomic_dec(&b->hold_count);
 			} else
 				wait_on_bit_io(&b->state, B_WRITING,
 					       TASK_UNINTERRUPTIBLE);
@@ -1341,16 +1546,19 @@ void dm_bufio_release_move(struct dm_buffer *b, sector_t new_block)
 {
 	struct dm_bufio_client *c = b->c;
 	struct dm_buffer *new;
+	int gen;
 
 	BUG_ON(dm_bufio_in_request());
 
 	dm_bufio_lock(c);
 
+	__add_release_waiter(c);
 retry:
+	gen = atomic_read(&c->release_gen);
 	new = __find(c, new_block);
 	if (new) {
-		if (new->hold_count) {
-			__wait_for_free_buffer(c);
+		if (!__claim_buffer(new)) {
+			__wait_for_free_buffer(c, gen);
 			goto retry;
 		}
 
@@ -1362,18 +1570,26 @@ void dm_bufio_release_move(struct dm_buffer *b, sector_t new_block)
 		__unlink_buffer(new);
 		__free_buffer_wake(new);
 	}
+	__remove_release_waiter(c);
 
-	BUG_ON(!b->hold_count);
+	BUG_ON(atomic_read(&b->hold_count) <= 0);
 	BUG_ON(test_bit(B_READING, &b->state));
 
 	__write_dirty_buffer(b, NULL);
-	if (b->hold_count == 1) {
+
+	/*
+	 * Unlink the buffer before checking whether we are its only holder,
+	 * so that dm_bufio_find_clean can't take a new hold on it in between.
+	 * The barrier pairs with the hold count increment there.
+	 */
+	__unlink_buffer(b);
+	smp_mb();
+	if (atomic_read(&b->hold_count) == 1) {
 		wait_on_bit_io(&b->state, B_WRITING,
 			       TASK_UNINTERRUPTIBLE);
 		set_bit(B_DIRTY, &b->state);
 		b->dirty_start = 0;
 		b->dirty_end = c->block_size;
-		__unlink_buffer(b);
 		__link_buffer(b, new_block, LIST_DIRTY);
 	} else {
 		sector_t old_block;
@@ -1387,7 +1603,6 @@ void dm_bufio_release_move(struct dm_buffer *b, sector_t new_block)
 		 * change isn't visible to other threads.
 		 */
 		old_block = b->block;
-		__unlink_buffer(b);
 		__link_buffer(b, new_block, b->list_mode);
 		submit_io(b, REQ_OP_WRITE, write_endio);
 		wait_on_bit_io(&b->state, B_WRITING,
@@ -1414,7 +1629,7 @@ void dm_bufio_forget(struct dm_bufio_client *c, sector_t block)
 	dm_bufio_lock(c);
 
 	b = __find(c, block);
-	if (b && likely(!b->hold_count) && likely(!b->state)) {
+	if (b && likely(!b->state) && likely(__claim_buffer(b))) {
 		__unlink_buffer(b);
 		__free_buffer_wake(b);
 	}
@@ -1492,12 +1707,13 @@ static void drop_buffers(struct dm_bufio_client *c)
 		list_for_each_entry(b, &c->lru[i], lru_list) {
 			WARN_ON(!warned);
 			warned = true;
-			DMERR("leaked buffer %llx, hold count %u, list %d",
-			      (unsigned long long)b->block, b->hold_count, i);
+			DMERR("leaked buffer %llx, hold count %d, list %d",
+			      (unsigned long long)b->block,
+			      atomic_read(&b->hold_count), i);
 #ifdef CONFIG_DM_DEBUG_BLOCK_STACK_TRACING
 			stack_trace_print(b->stack_entries, b->stack_len, 1);
 			/* mark unclaimed to avoid BUG_ON below */
-			b->hold_count = 0;
+			atomic_set(&b->hold_count, 0);
 #endif
 		}
 
@@ -1529,7 +1745,7 @@ static bool __try_evict_buffer(struct dm_buffer *b, gfp_t gfp)
 			return false;
 	}
 
-	if (b->hold_count)
+	if (!__claim_buffer(b))
 		return false;
 
 	__make_buffer_clean(b);
@@ -1561,7 +1777,8 @@ static unsigned long __scan(struct dm_bufio_client *c, unsigned long nr_to_scan,
 
 	for (l = 0; l < LIST_SIZE; l++) {
 		list_for_each_entry_safe_reverse(b, tmp, &c->lru[l], lru_list) {
-			if (__try_evict_buffer(b, gfp_mask))
+			if (!__lru_second_chance(b) &&
+			    __try_evict_buffer(b, gfp_mask))
 				freed++;
 			if (!--nr_to_scan || ((count - freed) <= retain_target))
 				return freed;
@@ -1623,7 +1840,10 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 		r = -ENOMEM;
 		goto bad_client;
 	}
-	c->buffer_tree = RB_ROOT;
+	for (i = 0; i < DM_BUFIO_TREE_SHARDS; i++) {
+		seqlock_init(&c->trees[i].lock);
+		c->trees[i].root = RB_ROOT;
+	}
 
 	c->bdev = bdev;
 	c->block_size = block_size;
@@ -1647,6 +1867,8 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 	dm_bufio_set_minimum_buffers(c, DM_BUFIO_MIN_BUFFERS);
 
 	init_waitqueue_head(&c->free_buffer_wait);
+	atomic_set(&c->release_gen, 0);
+	atomic_set(&c->release_waiters, 0);
 	c->async_write_error = 0;
 
 	c->dm_io = dm_io_client_create();
@@ -1671,7 +1893,8 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 	else
 		snprintf(slab_name, sizeof slab_name, "dm_bufio_buffer");
 	c->slab_buffer = kmem_cache_create(slab_name, sizeof(struct dm_buffer) + aux_size,
-					   0, SLAB_RECLAIM_ACCOUNT, NULL);
+					   0, SLAB_RECLAIM_ACCOUNT |
+					   SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!c->slab_buffer) {
 		r = -ENOMEM;
 		goto bad;
@@ -1741,7 +1964,8 @@ void dm_bufio_client_destroy(struct dm_bufio_client *c)
 
 	mutex_unlock(&dm_bufio_clients_lock);
 
-	BUG_ON(!RB_EMPTY_ROOT(&c->buffer_tree));
+	for (i = 0; i < DM_BUFIO_TREE_SHARDS; i++)
+		BUG_ON(!RB_EMPTY_ROOT(&c->trees[i].root));
 	BUG_ON(c->need_reserved_buffers);
 
 	while (!list_empty(&c->reserved_buffers)) {
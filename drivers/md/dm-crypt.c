@@ -19,7 +19,10 @@
 #include <linux/slab.h>
 #include <linux/crypto.h>
 #include <linux/workqueue.h>
+#include <linux/interrupt.h>
 #include <linux/kthread.h>
+#include <linux/llist.h>
+#include <linux/percpu.h>
 #include <linux/backing-dev.h>
 #include <linux/atomic.h>
 #include <linux/scatterlist.h>
@@ -50,6 +53,7 @@ struct convert_context {
 	struct bvec_iter iter_in;
 	struct bvec_iter iter_out;
 	u64 cc_sector;
+	unsigned int tag_offset;
 	atomic_t cc_pending;
 	union {
 		struct skcipher_request *req;
@@ -67,6 +71,7 @@ struct dm_crypt_io {
 	u8 *integrity_metadata;
 	bool integrity_metadata_from_pool;
 	struct work_struct work;
+	struct llist_node tasklet_node;
 
 	struct convert_context ctx;
 
@@ -120,7 +125,8 @@ struct iv_tcw_private {
  * and encrypts / decrypts at the same time.
  */
 enum flags { DM_CRYPT_SUSPENDED, DM_CRYPT_KEY_VALID,
-	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD };
+	     DM_CRYPT_SAME_CPU, DM_CRYPT_NO_OFFLOAD,
+	     DM_CRYPT_NO_READ_WORKQUEUE, DM_CRYPT_NO_WRITE_WORKQUEUE };
 
 enum cipher_flags {
 	CRYPT_MODE_INTEGRITY_AEAD,	/* Use authenticated mode for cihper */
@@ -901,6 +907,7 @@ static void crypt_convert_init(struct crypt_config *cc,
 	if (bio_out)
 		ctx->iter_out = bio_out->bi_iter;
 	ctx->cc_sector = sector + cc->iv_offset;
+	ctx->tag_offset = 0;
 	init_completion(&ctx->restart);
 }
 
@@ -1136,13 +1143,16 @@ static int crypt_convert_block_skcipher(struct crypt_config *cc,
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
 
-static void crypt_alloc_req_skcipher(struct crypt_config *cc,
-				     struct convert_context *ctx)
+static int crypt_alloc_req_skcipher(struct crypt_config *cc,
+				    struct convert_context *ctx, gfp_t gfp)
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
 
-	if (!ctx->r.req)
-		ctx->r.req = mempool_alloc(&cc->req_pool, GFP_NOIO);
+	if (!ctx->r.req) {
+		ctx->r.req = mempool_alloc(&cc->req_pool, gfp);
+		if (!ctx->r.req)
+			return -ENOMEM;
+	}
 
 	skcipher_request_set_tfm(ctx->r.req, cc->cipher_tfm.tfms[key_index]);
 
@@ -1153,13 +1163,18 @@ static void crypt_alloc_req_skcipher(struct crypt_config *cc,
 	skcipher_request_set_callback(ctx->r.req,
 	    CRYPTO_TFM_REQ_MAY_BACKLOG,
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req));
+
+	return 0;
 }
 
-static void crypt_alloc_req_aead(struct crypt_config *cc,
-				 struct convert_context *ctx)
+static int crypt_alloc_req_aead(struct crypt_config *cc,
+				struct convert_context *ctx, gfp_t gfp)
 {
-	if (!ctx->r.req_aead)
-		ctx->r.req_aead = mempool_alloc(&cc->req_pool, GFP_NOIO);
+	if (!ctx->r.req_aead) {
+		ctx->r.req_aead = mempool_alloc(&cc->req_pool, gfp);
+		if (!ctx->r.req_aead)
+			return -ENOMEM;
+	}
 
 	aead_request_set_tfm(ctx->r.req_aead, cc->cipher_tfm.tfms_aead[0]);
 
@@ -1170,15 +1185,21 @@ static void crypt_alloc_req_aead(struct crypt_config *cc,
 	aead_request_set_callback(ctx->r.req_aead,
 	    CRYPTO_TFM_REQ_MAY_BACKLOG,
 	    kcryptd_async_done, dmreq_of_req(cc, ctx->r.req_aead));
+
+	return 0;
 }
 
-static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+/*
+ * With GFP_NOIO this always succeeds, GFP_ATOMIC allocations (for reads
+ * decrypted in bio completion context) can fail.
+ */
+static int crypt_alloc_req(struct crypt_config *cc,
+			   struct convert_context *ctx, gfp_t gfp)
 {
 	if (crypt_integrity_aead(cc))
-		crypt_alloc_req_aead(cc, ctx);
+		return crypt_alloc_req_aead(cc, ctx, gfp);
 	else
-		crypt_alloc_req_skcipher(cc, ctx);
+		return crypt_alloc_req_skcipher(cc, ctx, gfp);
 }
 
 static void crypt_free_req_skcipher(struct crypt_config *cc,
@@ -1209,25 +1230,33 @@ static void crypt_free_req(struct crypt_config *cc, void *req, struct bio *base_
 
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
+ *
+ * In atomic context requests are allocated without sleeping. If that fails,
+ * BLK_STS_DEV_RESOURCE is returned and the conversion has to be continued
+ * from process context with reset_pending false.
  */
 static blk_status_t crypt_convert(struct crypt_config *cc,
-			 struct convert_context *ctx)
+			 struct convert_context *ctx, bool atomic,
+			 bool reset_pending)
 {
-	unsigned int tag_offset = 0;
 	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
 	int r;
 
-	atomic_set(&ctx->cc_pending, 1);
+	if (reset_pending)
+		atomic_set(&ctx->cc_pending, 1);
 
 	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
 
-		crypt_alloc_req(cc, ctx);
+		if (crypt_alloc_req(cc, ctx, atomic ? GFP_ATOMIC : GFP_NOIO))
+			return BLK_STS_DEV_RESOURCE;
 		atomic_inc(&ctx->cc_pending);
 
 		if (crypt_integrity_aead(cc))
-			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead, tag_offset);
+			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead,
+						     ctx->tag_offset);
 		else
-			r = crypt_convert_block_skcipher(cc, ctx, ctx->r.req, tag_offset);
+			r = crypt_convert_block_skcipher(cc, ctx, ctx->r.req,
+							 ctx->tag_offset);
 
 		switch (r) {
 		/*
@@ -1245,7 +1274,7 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		case -EINPROGRESS:
 			ctx->r.req = NULL;
 			ctx->cc_sector += sector_step;
-			tag_offset++;
+			ctx->tag_offset++;
 			continue;
 		/*
 		 * The request was already processed (synchronously).
@@ -1253,8 +1282,9 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		case 0:
 			atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector += sector_step;
-			tag_offset++;
-			cond_resched();
+			ctx->tag_offset++;
+			if (!atomic)
+				cond_resched();
 			continue;
 		/*
 		 * There was a data integrity error.
@@ -1580,7 +1610,8 @@ static void kcryptd_crypt_write_io_submit(struct dm_crypt_io *io, int async)
 
 	clone->bi_iter.bi_sector = cc->start + io->sector;
 
-	if (likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) {
+	if ((likely(!async) && test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags)) ||
+	    test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags)) {
 		generic_make_request(clone);
 		return;
 	}
@@ -1629,7 +1660,7 @@ static void kcryptd_crypt_write_convert(struct dm_crypt_io *io)
 	sector += bio_sectors(clone);
 
 	crypt_inc_pending(io);
-	r = crypt_convert(cc, &io->ctx);
+	r = crypt_convert(cc, &io->ctx, false, true);
 	if (r)
 		io->error = r;
 	crypt_finished = atomic_dec_and_test(&io->ctx.cc_pending);
@@ -1649,6 +1680,22 @@ static void kcryptd_crypt_read_done(struct dm_crypt_io *io)
 	crypt_dec_pending(io);
 }
 
+static void kcryptd_crypt_read_continue(struct work_struct *work)
+{
+	struct dm_crypt_io *io = container_of(work, struct dm_crypt_io, work);
+	struct crypt_config *cc = io->cc;
+	blk_status_t r;
+
+	r = crypt_convert(cc, &io->ctx, false, false);
+	if (r)
+		io->error = r;
+
+	if (atomic_dec_and_test(&io->ctx.cc_pending))
+		kcryptd_crypt_read_done(io);
+
+	crypt_dec_pending(io);
+}
+
 static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
@@ -1659,7 +1706,14 @@ static void kcryptd_crypt_read_convert(struct dm_crypt_io *io)
 	crypt_convert_init(cc, &io->ctx, io->base_bio, io->base_bio,
 			   io->sector);
 
-	r = crypt_convert(cc, &io->ctx);
+	/* Reads may be decrypted in bio completion context */
+	r = crypt_convert(cc, &io->ctx, in_interrupt(), true);
+	if (r == BLK_STS_DEV_RESOURCE) {
+		/* Out of atomic memory, finish the rest from kcryptd */
+		INIT_WORK(&io->work, kcryptd_crypt_read_continue);
+		queue_work(cc->crypt_queue, &io->work);
+		return;
+	}
 	if (r)
 		io->error = r;
 
@@ -1719,9 +1773,82 @@ static void kcryptd_crypt(struct work_struct *work)
 		kcryptd_crypt_write_convert(io);
 }
 
+/*
+ * Reads completed in hard IRQ context or with interrupts disabled are
+ * decrypted from a per-CPU tasklet.  The tasklet must not live in the per-bio
+ * data: completing the bio frees that, and tasklet_action_common() still
+ * unlocks the tasklet after its function returns.
+ */
+struct kcryptd_tasklet {
+	struct tasklet_struct tasklet;
+	struct llist_head list;
+};
+
+static DEFINE_PER_CPU(struct kcryptd_tasklet, kcryptd_tasklets);
+
+static void kcryptd_crypt_tasklet(unsigned long data)
+{
+	struct kcryptd_tasklet *kt = (struct kcryptd_tasklet *)data;
+	struct llist_node *list = llist_del_all(&kt->list);
+	struct dm_crypt_io *io, *next;
+
+	list = llist_reverse_order(list);
+	llist_for_each_entry_safe(io, next, list, tasklet_node)
+		kcryptd_crypt(&io->work);
+}
+
+static bool crypt_cipher_is_async(struct crypt_config *cc)
+{
+	u32 flags;
+
+	if (crypt_integrity_aead(cc))
+		flags = crypto_aead_alg(any_tfm_aead(cc))->base.cra_flags;
+	else
+		flags = crypto_skcipher_alg(any_tfm(cc))->base.cra_flags;
+
+	return flags & CRYPTO_ALG_ASYNC;
+}
+
 static void kcryptd_queue_crypt(struct dm_crypt_io *io)
 {
 	struct crypt_config *cc = io->cc;
+	bool inline_crypt;
+
+	/*
+	 * Writes can be encrypted in the context of the submitter. Reads can
+	 * be decrypted right in the bio completion, but only with synchronous
+	 * ciphers: a backlogged asynchronous request would have to be waited
+	 * for in crypt_convert().
+	 */
+	if (bio_data_dir(io->base_bio) == READ)
+		inline_crypt = test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags) &&
+			       !crypt_cipher_is_async(cc);
+	else
+		inline_crypt = test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
+
+	if (inline_crypt) {
+		/*
+		 * The crypto API refuses to walk scatterlists in hard IRQ
+		 * context or with interrupts disabled, so bounce completions
+		 * from there to a tasklet.  Encryption allocates pages for the
+		 * clone and may sleep, so only writes submitted from process
+		 * context are encrypted inline.
+		 */
+		if (in_irq() || irqs_disabled()) {
+			if (bio_data_dir(io->base_bio) == READ) {
+				struct kcryptd_tasklet *kt =
+					this_cpu_ptr(&kcryptd_tasklets);
+
+				if (llist_add(&io->tasklet_node, &kt->list))
+					tasklet_schedule(&kt->tasklet);
+				return;
+			}
+		} else if (bio_data_dir(io->base_bio) == READ ||
+			   !in_interrupt()) {
+			kcryptd_crypt(&io->work);
+			return;
+		}
+	}
 
 	INIT_WORK(&io->work, kcryptd_crypt);
 	queue_work(cc->crypt_queue, &io->work);
@@ -2483,7 +2610,7 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 	struct crypt_config *cc = ti->private;
 	struct dm_arg_set as;
 	static const struct dm_arg _args[] = {
-		{0, 6, "Invalid number of feature args"},
+		{0, 8, "Invalid number of feature args"},
 	};
 	unsigned int opt_params, val;
 	const char *opt_string, *sval;
@@ -2513,6 +2640,10 @@ static int crypt_ctr_optional(struct dm_target *ti, unsigned int argc, char **ar
 
 		else if (!strcasecmp(opt_string, "submit_from_crypt_cpus"))
 			set_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		else if (!strcasecmp(opt_string, "no_read_workqueue"))
+			set_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		else if (!strcasecmp(opt_string, "no_write_workqueue"))
+			set_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
 		else if (sscanf(opt_string, "integrity:%u:", &val) == 1) {
 			if (val == 0 || val > MAX_TAG_SIZE) {
 				ti->error = "Invalid integrity arguments";
@@ -2841,6 +2972,8 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 		num_feature_args += !!ti->num_discard_bios;
 		num_feature_args += test_bit(DM_CRYPT_SAME_CPU, &cc->flags);
 		num_feature_args += test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags);
+		num_feature_args += test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags);
 		num_feature_args += cc->sector_size != (1 << SECTOR_SHIFT);
 		num_feature_args += test_bit(CRYPT_IV_LARGE_SECTORS, &cc->cipher_flags);
 		if (cc->on_disk_tag_size)
@@ -2853,6 +2986,10 @@ static void crypt_status(struct dm_target *ti, status_type_t type,
 				DMEMIT(" same_cpu_crypt");
 			if (test_bit(DM_CRYPT_NO_OFFLOAD, &cc->flags))
 				DMEMIT(" submit_from_crypt_cpus");
+			if (test_bit(DM_CRYPT_NO_READ_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_read_workqueue");
+			if (test_bit(DM_CRYPT_NO_WRITE_WORKQUEUE, &cc->flags))
+				DMEMIT(" no_write_workqueue");
 			if (cc->on_disk_tag_size)
 				DMEMIT(" integrity:%u:%s", cc->on_disk_tag_size, cc->cipher_auth);
 			if (cc->sector_size != (1 << SECTOR_SHIFT))
@@ -2965,7 +3102,7 @@ static void crypt_io_hints(struct dm_target *ti, struct queue_limits *limits)
 
 static struct target_type crypt_target = {
 	.name   = "crypt",
-	.version = {1, 19, 0},
+	.version = {1, 20, 0},
 	.module = THIS_MODULE,
 	.ctr    = crypt_ctr,
 	.dtr    = crypt_dtr,
@@ -2981,7 +3118,15 @@ static struct target_type crypt_target = {
 
 static int __init dm_crypt_init(void)
 {
-	int r;
+	int cpu, r;
+
+	for_each_possible_cpu(cpu) {
+		struct kcryptd_tasklet *kt = per_cpu_ptr(&kcryptd_tasklets, cpu);
+
+		init_llist_head(&kt->list);
+		tasklet_init(&kt->tasklet, kcryptd_crypt_tasklet,
+			     (unsigned long)kt);
+	}
 
 	r = dm_register_target(&crypt_target);
 	if (r < 0)
@@ -2992,7 +3137,12 @@ static int __init dm_crypt_init(void)
 
 static void __exit dm_crypt_exit(void)
 {
+	int cpu;
+
 	dm_unregister_target(&crypt_target);
+
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu_ptr(&kcryptd_tasklets, cpu)->tasklet);
 }
 
 module_init(dm_crypt_init);
@@ -17,6 +17,7 @@
 #include "dm-verity-fec.h"
 #include "dm-verity-verify-sig.h"
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/reboot.h>
 
 #define DM_MSG_PREFIX			"verity"
@@ -32,10 +33,16 @@
 #define DM_VERITY_OPT_RESTART		"restart_on_corruption"
 #define DM_VERITY_OPT_IGN_ZEROES	"ignore_zero_blocks"
 #define DM_VERITY_OPT_AT_MOST_ONCE	"check_at_most_once"
+#define DM_VERITY_OPT_IN_COMPLETION	"try_verify_in_completion"
 
-#define DM_VERITY_OPTS_MAX		(2 + DM_VERITY_OPTS_FEC + \
+#define DM_VERITY_OPTS_MAX		(4 + DM_VERITY_OPTS_FEC + \
 					 DM_VERITY_ROOT_HASH_VERIFICATION_OPTS)
 
+#define DM_VERITY_HASH_CACHE_SIZE	4
+
+/* Largest I/O, in data blocks, to be verified in bio completion */
+#define DM_VERITY_COMPLETION_MAX_BLOCKS	16
+
 static unsigned dm_verity_prefetch_cluster = DM_VERITY_DEFAULT_PREFETCH_SIZE;
 
 module_param_named(prefetch_cluster, dm_verity_prefetch_cluster, uint, S_IRUGO | S_IWUSR);
@@ -63,6 +70,22 @@ struct buffer_aux {
 	int hash_verified;
 };
 
+/*
+ * Per-CPU copies of recently used bottom-level hash blocks that have been
+ * verified.  A hash block covers many consecutive data blocks, so sequential
+ * reads mostly find their digests here without going through dm-bufio, and
+ * the cache can be used where dm-bufio can't, in bio completion context.
+ *
+ * The hash device is read-only and only verified blocks are copied, so an
+ * entry never has to be invalidated.  Entries are only replaced from task
+ * context; lookups from softirq context on the same CPU are kept from seeing
+ * a half-copied block by invalidating the slot for the duration of the copy.
+ */
+struct dm_verity_hash_cache {
+	sector_t hash_block[DM_VERITY_HASH_CACHE_SIZE];
+	u8 *data;
+};
+
 /*
  * Initialize struct buffer_aux for a freshly created buffer.
  */
@@ -206,6 +229,51 @@ static void verity_hash_at_level(struct dm_verity *v, sector_t block, int level,
 		*offset = idx << (v->hash_dev_block_bits - v->hash_per_block_bits);
 }
 
+static bool verity_hash_cache_lookup(struct dm_verity *v, sector_t block,
+				     u8 *digest)
+{
+	struct dm_verity_hash_cache *cache;
+	sector_t hash_block;
+	unsigned offset, slot;
+	bool hit;
+
+	if (!v->hash_cache || !v->levels)
+		return false;
+
+	verity_hash_at_level(v, block, 0, &hash_block, &offset);
+	slot = hash_block & (DM_VERITY_HASH_CACHE_SIZE - 1);
+
+	cache = get_cpu_ptr(v->hash_cache);
+	hit = cache->hash_block[slot] == hash_block;
+	if (hit)
+		memcpy(digest, cache->data + (slot << v->hash_dev_block_bits) +
+		       offset, v->digest_size);
+	put_cpu_ptr(v->hash_cache);
+
+	return hit;
+}
+
+static void verity_hash_cache_insert(struct dm_verity *v, sector_t hash_block,
+				     const u8 *data)
+{
+	struct dm_verity_hash_cache *cache;
+	unsigned slot = hash_block & (DM_VERITY_HASH_CACHE_SIZE - 1);
+
+	if (!v->hash_cache)
+		return;
+
+	cache = get_cpu_ptr(v->hash_cache);
+	if (cache->hash_block[slot] != hash_block) {
+		cache->hash_block[slot] = (sector_t)-1;
+		barrier();
+		memcpy(cache->data + (slot << v->hash_dev_block_bits), data,
+		       1 << v->hash_dev_block_bits);
+		barrier();
+		cache->hash_block[slot] = hash_block;
+	}
+	put_cpu_ptr(v->hash_cache);
+}
+
 /*
  * Handle verification errors.
  */
@@ -314,6 +382,9 @@ static int verity_verify_level(struct dm_verity *v, struct dm_verity_io *io,
 		}
 	}
 
+	if (!level && aux->hash_verified)
+		verity_hash_cache_insert(v, hash_block, data);
+
 	data += offset;
 	memcpy(want_digest, data, v->digest_size);
 	r = 0;
@@ -332,6 +403,9 @@ int verity_hash_for_block(struct dm_verity *v, struct dm_verity_io *io,
 {
 	int r = 0, i;
 
+	if (verity_hash_cache_lookup(v, block, digest))
+		goto out;
+
 	if (likely(v->levels)) {
 		/*
 		 * First, we try to get the requested hash for
@@ -361,6 +435,68 @@ int verity_hash_for_block(struct dm_verity *v, struct dm_verity_io *io,
 	return r;
 }
 
+/*
+ * Find a hash for a given block without sleeping: only the per-CPU hash
+ * cache is consulted.  Returns false if the hash is not available this way.
+ */
+static bool verity_hash_for_block_cached(struct dm_verity *v, sector_t block,
+					 u8 *digest, bool *is_zero)
+{
+	if (likely(v->levels)) {
+		if (!verity_hash_cache_lookup(v, block, digest))
+			return false;
+	} else
+		memcpy(digest, v->root_digest, v->digest_size);
+
+	*is_zero = v->zero_digest &&
+		   !memcmp(v->zero_digest, digest, v->digest_size);
+
+	return true;
+}
+
+/*
+ * Calculates the digest of one data block of the bio with the synchronous
+ * hash.  The salted initial state is imported rather than recomputed, and the
+ * data is hashed straight from the bio pages.
+ */
+static int verity_shash_io_block(struct dm_verity *v, struct dm_verity_io *io,
+				 struct bvec_iter *iter, u8 *digest)
+{
+	SHASH_DESC_ON_STACK(desc, v->shash_tfm);
+	unsigned int todo = 1 << v->data_dev_block_bits;
+	struct bio *bio = dm_bio_from_per_bio_data(io, v->ti->per_io_data_size);
+	int r;
+
+	desc->tfm = v->shash_tfm;
+	r = crypto_shash_import(desc, v->initial_hashstate);
+	if (unlikely(r < 0))
+		return r;
+
+	do {
+		struct bio_vec bv = bio_iter_iovec(bio, *iter);
+		unsigned int len = min(bv.bv_len, todo);
+		u8 *page;
+
+		page = kmap_atomic(bv.bv_page);
+		r = crypto_shash_update(desc, page + bv.bv_offset, len);
+		kunmap_atomic(page);
+
+		if (unlikely(r < 0))
+			return r;
+
+		bio_advance_iter(bio, iter, len);
+		todo -= len;
+	} while (todo);
+
+	if (unlikely(v->salt_size && (!v->version))) {
+		r = crypto_shash_update(desc, v->salt, v->salt_size);
+		if (unlikely(r < 0))
+			return r;
+	}
+
+	return crypto_shash_final(desc, digest);
+}
+
 /*
  * Calculates the digest for the given bio
  */
@@ -483,11 +619,18 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
-		r = verity_hash_for_block(v, io, cur_block,
-					  verity_io_want_digest(v, io),
-					  &is_zero);
-		if (unlikely(r < 0))
-			return r;
+		if (io->in_completion) {
+			if (!verity_hash_for_block_cached(v, cur_block,
+						verity_io_want_digest(v, io),
+						&is_zero))
+				return -EAGAIN;
+		} else {
+			r = verity_hash_for_block(v, io, cur_block,
+						  verity_io_want_digest(v, io),
+						  &is_zero);
+			if (unlikely(r < 0))
+				return r;
+		}
 
 		if (is_zero) {
 			/*
@@ -502,19 +645,27 @@ static int verity_verify_io(struct dm_verity_io *io)
 			continue;
 		}
 
-		r = verity_hash_init(v, req, &wait);
-		if (unlikely(r < 0))
-			return r;
-
 		start = io->iter;
-		r = verity_for_io_block(v, io, &io->iter, &wait);
-		if (unlikely(r < 0))
-			return r;
+		if (v->shash_tfm) {
+			r = verity_shash_io_block(v, io, &io->iter,
+						  verity_io_real_digest(v, io));
+			if (unlikely(r < 0))
+				return r;
+		} else {
+			r = verity_hash_init(v, req, &wait);
+			if (unlikely(r < 0))
+				return r;
 
-		r = verity_hash_final(v, req, verity_io_real_digest(v, io),
-					&wait);
-		if (unlikely(r < 0))
-			return r;
+			r = verity_for_io_block(v, io, &io->iter, &wait);
+			if (unlikely(r < 0))
+				return r;
+
+			r = verity_hash_final(v, req,
+					      verity_io_real_digest(v, io),
+					      &wait);
+			if (unlikely(r < 0))
+				return r;
+		}
 
 		if (likely(memcmp(verity_io_real_digest(v, io),
 				  verity_io_want_digest(v, io), v->digest_size) == 0)) {
@@ -522,6 +673,9 @@ static int verity_verify_io(struct dm_verity_io *io)
 				set_bit(cur_block, v->validated_blocks);
 			continue;
 		}
+		/* Error correction and reporting may sleep */
+		else if (io->in_completion)
+			return -EAGAIN;
 		else if (verity_fec_decode(v, io, DM_VERITY_BLOCK_TYPE_DATA,
 					   cur_block, NULL, &start) == 0)
 			continue;
@@ -556,17 +710,82 @@ static void verity_work(struct work_struct *w)
 	verity_finish_io(io, errno_to_blk_status(verity_verify_io(io)));
 }
 
+/*
+ * Try to verify a small I/O right in its completion, which only works if the
+ * hash is synchronous and all the digests needed are in the per-CPU hash
+ * cache.  Anything else, including a digest mismatch, is (re)done from the
+ * workqueue, where errors can be corrected and reported.
+ */
+static void verity_verify_in_completion(struct dm_verity_io *io)
+{
+	struct bvec_iter start = io->iter;
+	int r;
+
+	io->in_completion = true;
+	r = verity_verify_io(io);
+	io->in_completion = false;
+
+	if (likely(!r)) {
+		verity_finish_io(io, BLK_STS_OK);
+		return;
+	}
+
+	io->iter = start;
+	INIT_WORK(&io->work, verity_work);
+	queue_work(io->v->verify_wq, &io->work);
+}
+
+/*
+ * I/Os completed in hard IRQ context are verified from a per-CPU tasklet.  It
+ * can't be part of the per-bio data: finishing the bio may free that, and
+ * tasklet_action_common() still unlocks the tasklet after its function returns.
+ */
+struct verity_tasklet {
+	struct tasklet_struct tasklet;
+	struct llist_head list;
+};
+
+static DEFINE_PER_CPU(struct verity_tasklet, verity_tasklets);
+
+static void verity_tasklet(unsigned long data)
+{
+	struct verity_tasklet *vt = (struct verity_tasklet *)data;
+	struct llist_node *list = llist_del_all(&vt->list);
+	struct dm_verity_io *io, *next;
+
+	list = llist_reverse_order(list);
+	llist_for_each_entry_safe(io, next, list, tasklet_node)
+		verity_verify_in_completion(io);
+}
+
 static void verity_end_io(struct bio *bio)
 {
 	struct dm_verity_io *io = bio->bi_private;
+	struct dm_verity *v = io->v;
 
-	if (bio->bi_status && !verity_fec_is_enabled(io->v)) {
+	if (bio->bi_status && !verity_fec_is_enabled(v)) {
 		verity_finish_io(io, bio->bi_status);
 		return;
 	}
 
+	if (!bio->bi_status && v->verify_in_completion && v->shash_tfm &&
+	    io->n_blocks <= DM_VERITY_COMPLETION_MAX_BLOCKS) {
+		/* Hashing isn't allowed in hard IRQ context, use a tasklet */
+		if (in_irq()) {
+			struct verity_tasklet *vt =
+				this_cpu_ptr(&verity_tasklets);
+
+			if (llist_add(&io->tasklet_node, &vt->list))
+				tasklet_schedule(&vt->tasklet);
+			return;
+		}
+
+		verity_verify_in_completion(io);
+		return;
+	}
+
 	INIT_WORK(&io->work, verity_work);
-	queue_work(io->v->verify_wq, &io->work);
+	queue_work(v->verify_wq, &io->work);
 }
 
 /*
@@ -658,6 +877,7 @@ static int verity_map(struct dm_target *ti, struct bio *bio)
 	io->orig_bi_end_io = bio->bi_end_io;
 	io->block = bio->bi_iter.bi_sector >> (v->data_dev_block_bits - SECTOR_SHIFT);
 	io->n_blocks = bio->bi_iter.bi_size >> v->data_dev_block_bits;
+	io->in_completion = false;
 
 	bio->bi_end_io = verity_end_io;
 	bio->bi_private = io;
@@ -714,6 +934,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 			args++;
 		if (v->validated_blocks)
 			args++;
+		if (v->verify_in_completion)
+			args++;
 		if (v->signature_key_desc)
 			args += DM_VERITY_ROOT_HASH_VERIFICATION_OPTS;
 		if (!args)
@@ -736,6 +958,8 @@ static void verity_status(struct dm_target *ti, status_type_t type,
 			DMEMIT(" " DM_VERITY_OPT_IGN_ZEROES);
 		if (v->validated_blocks)
 			DMEMIT(" " DM_VERITY_OPT_AT_MOST_ONCE);
+		if (v->verify_in_completion)
+			DMEMIT(" " DM_VERITY_OPT_IN_COMPLETION);
 		sz = verity_fec_status_table(v, sz, result, maxlen);
 		if (v->signature_key_desc)
 			DMEMIT(" " DM_VERITY_ROOT_HASH_VERIFICATION_OPT_SIG_KEY
@@ -777,6 +1001,95 @@ static void verity_io_hints(struct dm_target *ti, struct queue_limits *limits)
 	blk_limits_io_min(limits, limits->logical_block_size);
 }
 
+static void verity_free_hash_cache(struct dm_verity *v)
+{
+	int cpu;
+
+	if (!v->hash_cache)
+		return;
+
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(v->hash_cache, cpu)->data);
+
+	free_percpu(v->hash_cache);
+	v->hash_cache = NULL;
+}
+
+static int verity_alloc_hash_cache(struct dm_verity *v)
+{
+	int cpu, i;
+
+	/* Not worth it for hash blocks larger than a page */
+	if (v->hash_dev_block_bits > PAGE_SHIFT)
+		return 0;
+
+	v->hash_cache = alloc_percpu(struct dm_verity_hash_cache);
+	if (!v->hash_cache)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct dm_verity_hash_cache *cache = per_cpu_ptr(v->hash_cache, cpu);
+
+		for (i = 0; i < DM_VERITY_HASH_CACHE_SIZE; i++)
+			cache->hash_block[i] = (sector_t)-1;
+
+		cache->data = kmalloc_node(DM_VERITY_HASH_CACHE_SIZE <<
+					   v->hash_dev_block_bits,
+					   GFP_KERNEL, cpu_to_node(cpu));
+		if (!cache->data) {
+			verity_free_hash_cache(v);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * If the hash implementation is synchronous, also allocate it as a shash and
+ * precompute the state after hashing the salt, so that data blocks can be
+ * hashed without setting up and waiting for an ahash request each time.
+ */
+static int verity_alloc_shash(struct dm_verity *v)
+{
+	struct hash_alg_common *alg = crypto_hash_alg_common(v->tfm);
+	struct crypto_shash *tfm;
+	SHASH_DESC_ON_STACK(desc, tfm);
+	int r;
+
+	if (alg->base.cra_flags & CRYPTO_ALG_ASYNC)
+		return 0;
+
+	/* Not every synchronous ahash has a shash counterpart */
+	tfm = crypto_alloc_shash(alg->base.cra_driver_name, 0, 0);
+	if (IS_ERR(tfm))
+		return 0;
+
+	v->initial_hashstate = kmalloc(crypto_shash_statesize(tfm), GFP_KERNEL);
+	if (!v->initial_hashstate) {
+		crypto_free_shash(tfm);
+		return -ENOMEM;
+	}
+
+	desc->tfm = tfm;
+	r = crypto_shash_init(desc);
+	if (!r && v->salt_size && v->version >= 1)
+		r = crypto_shash_update(desc, v->salt, v->salt_size);
+	if (!r)
+		r = crypto_shash_export(desc, v->initial_hashstate);
+	shash_desc_zero(desc);
+
+	if (r) {
+		kfree(v->initial_hashstate);
+		v->initial_hashstate = NULL;
+		crypto_free_shash(tfm);
+		return r;
+	}
+
+	v->shash_tfm = tfm;
+	return 0;
+}
+
 static void verity_dtr(struct dm_target *ti)
 {
 	struct dm_verity *v = ti->private;
@@ -787,11 +1100,17 @@ static void verity_dtr(struct dm_target *ti)
 	if (v->bufio)
 		dm_bufio_client_destroy(v->bufio);
 
+	verity_free_hash_cache(v);
+
 	kvfree(v->validated_blocks);
 	kfree(v->salt);
 	kfree(v->root_digest);
 	kfree(v->zero_digest);
 
+	if (v->shash_tfm)
+		crypto_free_shash(v->shash_tfm);
+	kfree(v->initial_hashstate);
+
 	if (v->tfm)
 		crypto_free_ahash(v->tfm);
 
@@ -907,6 +1226,10 @@ static int verity_parse_opt_args(struct dm_arg_set *as, struct dm_verity *v,
 				return r;
 			continue;
 
+		} else if (!strcasecmp(arg_name, DM_VERITY_OPT_IN_COMPLETION)) {
+			v->verify_in_completion = true;
+			continue;
+
 		} else if (verity_is_fec_opt_arg(arg_name)) {
 			r = verity_fec_parse_opt_args(as, v, &argc, arg_name);
 			if (r)
@@ -1106,6 +1429,12 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 		}
 	}
 
+	r = verity_alloc_shash(v);
+	if (r) {
+		ti->error = "Cannot initialize synchronous hash";
+		goto bad;
+	}
+
 	argv += 10;
 	argc -= 10;
 
@@ -1175,6 +1504,12 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 		goto bad;
 	}
 
+	r = verity_alloc_hash_cache(v);
+	if (r) {
+		ti->error = "Cannot allocate hash block cache";
+		goto bad;
+	}
+
 	/* WQ_UNBOUND greatly improves performance when running on ramdisk */
 	v->verify_wq = alloc_workqueue("kverityd", WQ_CPU_INTENSIVE | WQ_MEM_RECLAIM | WQ_UNBOUND, num_online_cpus());
 	if (!v->verify_wq) {
@@ -1207,7 +1542,7 @@ static int verity_ctr(struct dm_target *ti, unsigned argc, char **argv)
 
 static struct target_type verity_target = {
 	.name		= "verity",
-	.version	= {1, 5, 0},
+	.version	= {1, 6, 0},
 	.module		= THIS_MODULE,
 	.ctr		= verity_ctr,
 	.dtr		= verity_dtr,
@@ -1220,7 +1555,14 @@ static struct target_type verity_target = {
 
 static int __init dm_verity_init(void)
 {
-	int r;
+	int cpu, r;
+
+	for_each_possible_cpu(cpu) {
+		struct verity_tasklet *vt = per_cpu_ptr(&verity_tasklets, cpu);
+
+		init_llist_head(&vt->list);
+		tasklet_init(&vt->tasklet, verity_tasklet, (unsigned long)vt);
+	}
 
 	r = dm_register_target(&verity_target);
 	if (r < 0)
@@ -1231,7 +1573,12 @@ static int __init dm_verity_init(void)
 
 static void __exit dm_verity_exit(void)
 {
+	int cpu;
+
 	dm_unregister_target(&verity_target);
+
+	for_each_possible_cpu(cpu)
+		tasklet_kill(&per_cpu_ptr(&verity_tasklets, cpu)->tasklet);
 }
 
 module_init(dm_verity_init);
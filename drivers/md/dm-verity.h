@@ -13,6 +13,8 @@
 
 #include <linux/dm-bufio.h>
 #include <linux/device-mapper.h>
+#include <linux/interrupt.h>
+#include <linux/llist.h>
 #include <crypto/hash.h>
 
 #define DM_VERITY_MAX_LEVELS		63
@@ -29,6 +31,7 @@ enum verity_block_type {
 };
 
 struct dm_verity_fec;
+struct dm_verity_hash_cache;
 
 struct dm_verity {
 	struct dm_dev *data_dev;
@@ -37,6 +40,8 @@ struct dm_verity {
 	struct dm_bufio_client *bufio;
 	char *alg_name;
 	struct crypto_ahash *tfm;
+	struct crypto_shash *shash_tfm;	/* set if tfm is synchronous */
+	u8 *initial_hashstate;	/* shash state after hashing the salt */
 	u8 *root_digest;	/* digest of the root block */
 	u8 *salt;		/* salt: its size is salt_size */
 	u8 *zero_digest;	/* digest for a zero block */
@@ -55,6 +60,7 @@ struct dm_verity {
 	int hash_failed;	/* set to 1 if hash of any block failed */
 	enum verity_mode mode;	/* mode for handling verification errors */
 	unsigned corrupted_errs;/* Number of errors for corrupted blocks */
+	bool verify_in_completion;	/* try to verify in bio completion */
 
 	struct workqueue_struct *verify_wq;
 
@@ -64,6 +70,9 @@ struct dm_verity {
 	struct dm_verity_fec *fec;	/* forward error correction */
 	unsigned long *validated_blocks; /* bitset blocks validated */
 
+	/* verified bottom-level hash blocks */
+	struct dm_verity_hash_cache __percpu *hash_cache;
+
 	char *signature_key_desc; /* signature keyring reference */
 };
 
@@ -78,7 +87,9 @@ struct dm_verity_io {
 
 	struct bvec_iter iter;
 
+	bool in_completion;
 	struct work_struct work;
+	struct llist_node tasklet_node;
 
 	/*
 	 * Three variably-size fields follow this struct:
@@ -26,6 +26,30 @@ struct z_erofs_decompress_req {
 	bool inplace_io, partial_decoding;
 };
 
+/*
+ * Stream decoders keep their own history window, so unlike LZ4 they don't
+ * need the output to be virtually contiguous and are fed page by page.
+ * Their state is too large to be per-CPU and decoding may sleep, so each
+ * algorithm keeps a pool of up to num_possible_cpus() decoders instead.
+ */
+struct z_erofs_stream_decompressor {
+	void *(*alloc)(void);
+	void (*free)(void *strm);
+	/* start decoding a new physical cluster */
+	int (*reset)(void *strm);
+	/*
+	 * decode in[*inpos, inlen) into out[*outpos, outlen), advancing both
+	 * positions.  Returns 1 at the end of the stream, 0 if more input or
+	 * output space is needed, or a negative errno.
+	 */
+	int (*decode)(void *strm, const u8 *in, unsigned int *inpos,
+		      unsigned int inlen, u8 *out, unsigned int *outpos,
+		      unsigned int outlen);
+};
+
+extern const struct z_erofs_stream_decompressor z_erofs_lzma_decompressor;
+extern const struct z_erofs_stream_decompressor z_erofs_deflate_decompressor;
+
 /*
  * - 0x5A110C8D ('sallocated', Z_EROFS_MAPPING_STAGING) -
  * used to mark temporary allocated pages from other
@@ -55,6 +79,8 @@ static inline bool z_erofs_put_stagingpage(struct list_head *pagepool,
 
 int z_erofs_decompress(struct z_erofs_decompress_req *rq,
 		       struct list_head *pagepool);
+void __init z_erofs_init_decompressor(void);
+void z_erofs_exit_decompressor(void);
 
 #endif
 
@@ -109,9 +109,83 @@ static int erofs_map_blocks_flatmode(struct inode *inode,
 	return err;
 }
 
+static int erofs_map_blocks_chunkmode(struct inode *inode,
+				      struct erofs_map_blocks *map,
+				      int flags)
+{
+	struct super_block *sb = inode->i_sb;
+	struct erofs_inode *vi = EROFS_I(inode);
+	struct erofs_inode_chunk_index *idx;
+	struct page *page;
+	unsigned int unit;
+	erofs_off_t pos, chunkofs;
+	erofs_blk_t blkaddr;
+	u64 chunknr;
+	int err = 0;
+
+	trace_erofs_map_blocks_flatmode_enter(inode, map, flags);
+
+	if (map->m_la >= inode->i_size) {
+		/* leave out-of-bound access unmapped */
+		map->m_flags = 0;
+		map->m_plen = 0;
+		goto out;
+	}
+
+	if (vi->chunkformat & EROFS_CHUNK_FORMAT_INDEXES)
+		unit = sizeof(struct erofs_inode_chunk_index);
+	else
+		unit = EROFS_BLOCK_MAP_ENTRY_SIZE;
+
+	chunknr = map->m_la >> vi->chunkbits;
+	chunkofs = map->m_la - (chunknr << vi->chunkbits);
+	pos = ALIGN(iloc(EROFS_SB(sb), vi->nid) + vi->inode_isize +
+		    vi->xattr_isize, unit) + unit * chunknr;
+
+	page = erofs_get_meta_page(sb, erofs_blknr(pos));
+	if (IS_ERR(page)) {
+		err = PTR_ERR(page);
+		goto err_out;
+	}
+
+	/* the rest of this chunk, the last one ends at the last block */
+	map->m_plen = min_t(erofs_off_t, 1ULL << vi->chunkbits,
+			    round_up(inode->i_size - (map->m_la - chunkofs),
+				     EROFS_BLKSIZ)) - chunkofs;
+
+	if (unit == EROFS_BLOCK_MAP_ENTRY_SIZE) {
+		blkaddr = le32_to_cpu(*(__le32 *)(page_address(page) +
+						  erofs_blkoff(pos)));
+	} else {
+		idx = page_address(page) + erofs_blkoff(pos);
+		blkaddr = le32_to_cpu(idx->blkaddr);
+		map->m_deviceid = le16_to_cpu(idx->device_id);
+	}
+	unlock_page(page);
+	put_page(page);
+
+	if (blkaddr == EROFS_NULL_ADDR) {
+		/* a hole, read as zeroes */
+		map->m_flags = 0;
+	} else {
+		map->m_pa = blknr_to_addr(blkaddr) + chunkofs;
+		map->m_flags = EROFS_MAP_MAPPED;
+	}
+out:
+	map->m_llen = map->m_plen;
+err_out:
+	trace_erofs_map_blocks_flatmode_exit(inode, map, flags, err);
+	return err;
+}
+
 int erofs_map_blocks(struct inode *inode,
 		     struct erofs_map_blocks *map, int flags)
 {
+	map->m_deviceid = 0;
+
+	if (EROFS_I(inode)->datalayout == EROFS_INODE_CHUNK_BASED)
+		return erofs_map_blocks_chunkmode(inode, map, flags);
+
 	if (erofs_inode_is_data_compressed(EROFS_I(inode)->datalayout)) {
 		int err = z_erofs_map_blocks_iter(inode, map, flags);
 
@@ -124,6 +198,50 @@ int erofs_map_blocks(struct inode *inode,
 	return erofs_map_blocks_flatmode(inode, map, flags);
 }
 
+/**
+ * erofs_map_dev - find the device a mapped extent lives on
+ * @sb: the superblock
+ * @map: m_deviceid and m_pa on input, m_bdev and m_pa on the device on output
+ *
+ * A non-zero device id selects an extra device directly, otherwise m_pa is
+ * looked up in the flat block address space of the extra devices which have
+ * a mapped_blkaddr, falling back to the primary device.
+ */
+int erofs_map_dev(struct super_block *sb, struct erofs_map_dev *map)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	struct erofs_device_info *dif;
+	erofs_blk_t blkaddr;
+	unsigned int i;
+
+	map->m_bdev = sb->s_bdev;
+
+	if (map->m_deviceid) {
+		if (map->m_deviceid > sbi->nr_devs) {
+			erofs_err(sb, "bad device id %u", map->m_deviceid);
+			DBG_BUGON(1);
+			return -EFSCORRUPTED;
+		}
+		map->m_bdev = sbi->devs[map->m_deviceid - 1].bdev;
+		return 0;
+	}
+
+	blkaddr = erofs_blknr(map->m_pa);
+	for (i = 0; i < sbi->nr_devs; ++i) {
+		dif = &sbi->devs[i];
+
+		if (!dif->mapped_blkaddr)
+			continue;
+		if (blkaddr >= dif->mapped_blkaddr &&
+		    blkaddr < dif->mapped_blkaddr + dif->blocks) {
+			map->m_pa -= blknr_to_addr(dif->mapped_blkaddr);
+			map->m_bdev = dif->bdev;
+			break;
+		}
+	}
+	return 0;
+}
+
 static inline struct bio *erofs_read_raw_page(struct bio *bio,
 					      struct address_space *mapping,
 					      struct page *page,
@@ -156,6 +274,7 @@ static inline struct bio *erofs_read_raw_page(struct bio *bio,
 		struct erofs_map_blocks map = {
 			.m_la = blknr_to_addr(current_block),
 		};
+		struct erofs_map_dev mdev;
 		erofs_blk_t blknr;
 		unsigned int blkoff;
 
@@ -212,6 +331,15 @@ static inline struct bio *erofs_read_raw_page(struct bio *bio,
 		/* pa must be block-aligned for raw reading */
 		DBG_BUGON(erofs_blkoff(map.m_pa));
 
+		mdev = (struct erofs_map_dev) {
+			.m_deviceid = map.m_deviceid,
+			.m_pa = map.m_pa,
+		};
+		err = erofs_map_dev(sb, &mdev);
+		if (err)
+			goto err_out;
+		blknr = erofs_blknr(mdev.m_pa);
+
 		/* max # of continuous pages */
 		if (nblocks > DIV_ROUND_UP(map.m_plen, PAGE_SIZE))
 			nblocks = DIV_ROUND_UP(map.m_plen, PAGE_SIZE);
@@ -221,7 +349,7 @@ static inline struct bio *erofs_read_raw_page(struct bio *bio,
 		bio = bio_alloc(GFP_NOIO, nblocks);
 
 		bio->bi_end_io = erofs_readendio;
-		bio_set_dev(bio, sb->s_bdev);
+		bio_set_dev(bio, mdev.m_bdev);
 		bio->bi_iter.bi_sector = (sector_t)blknr <<
 			LOG_SECTORS_PER_BLOCK;
 		bio->bi_opf = REQ_OP_READ;
@@ -329,14 +457,27 @@ static int erofs_get_block(struct inode *inode, sector_t iblock,
 	struct erofs_map_blocks map = {
 		.m_la = iblock << 9,
 	};
+	struct erofs_map_dev mdev;
 	int err;
 
 	err = erofs_map_blocks(inode, &map, EROFS_GET_BLOCKS_RAW);
 	if (err)
 		return err;
 
-	if (map.m_flags & EROFS_MAP_MAPPED)
-		bh->b_blocknr = erofs_blknr(map.m_pa);
+	if (!(map.m_flags & EROFS_MAP_MAPPED))
+		return 0;
+
+	mdev = (struct erofs_map_dev) {
+		.m_deviceid = map.m_deviceid,
+		.m_pa = map.m_pa,
+	};
+	err = erofs_map_dev(inode->i_sb, &mdev);
+	if (err)
+		return err;
+
+	/* blocks on extra devices can't be reported by bmap */
+	if (mdev.m_bdev == inode->i_sb->s_bdev)
+		bh->b_blocknr = erofs_blknr(mdev.m_pa);
 
 	return err;
 }
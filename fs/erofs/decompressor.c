@@ -7,6 +7,9 @@
 #include "compress.h"
 #include <linux/module.h>
 #include <linux/lz4.h>
+#include <linux/highmem.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
 
 #ifndef LZ4_DISTANCE_MAX	/* history window size */
 #define LZ4_DISTANCE_MAX 65535	/* set to maximum value by default */
@@ -25,7 +28,22 @@ struct z_erofs_decompressor {
 	int (*prepare_destpages)(struct z_erofs_decompress_req *rq,
 				 struct list_head *pagepool);
 	int (*decompress)(struct z_erofs_decompress_req *rq, u8 *out);
+	/* set instead of the two above for stream decoders */
+	const struct z_erofs_stream_decompressor *stream;
 	char *name;
+
+	/* idle stream decoders */
+	spinlock_t lock;
+	struct list_head streams;
+	unsigned int nr_streams;
+	wait_queue_head_t wait;
+};
+
+struct z_erofs_stream {
+	struct list_head list;
+	void *strm;
+	/* copy of the input for in-place decompression */
+	u8 *inbuf;
 };
 
 static int z_erofs_lz4_prepare_destpages(struct z_erofs_decompress_req *rq,
@@ -187,8 +205,31 @@ static struct z_erofs_decompressor decompressors[] = {
 		.decompress = z_erofs_lz4_decompress,
 		.name = "lz4"
 	},
+	[Z_EROFS_COMPRESSION_LZMA] = {
+#ifdef CONFIG_EROFS_FS_ZIP_LZMA
+		.stream = &z_erofs_lzma_decompressor,
+#endif
+		.name = "lzma"
+	},
+	[Z_EROFS_COMPRESSION_DEFLATE] = {
+#ifdef CONFIG_EROFS_FS_ZIP_DEFLATE
+		.stream = &z_erofs_deflate_decompressor,
+#endif
+		.name = "deflate"
+	},
 };
 
+bool z_erofs_algorithm_supported(unsigned int alg)
+{
+	return alg < Z_EROFS_COMPRESSION_MAX &&
+		(decompressors[alg].decompress || decompressors[alg].stream);
+}
+
+const char *z_erofs_algorithm_name(unsigned int alg)
+{
+	return decompressors[alg].name;
+}
+
 static void copy_from_pcpubuf(struct page **out, const char *dst,
 			      unsigned short pageofs_out,
 			      unsigned int outputsize)
@@ -236,9 +277,12 @@ static int z_erofs_decompress_generic(struct z_erofs_decompress_req *rq,
 	/*
 	 * For the case of small output size (especially much less
 	 * than PAGE_SIZE), memcpy the decompressed data rather than
-	 * compressed data is preferred.
+	 * compressed data is preferred.  Small pclusters also go through
+	 * the per-CPU buffer, which is cheaper than allocating bounce pages
+	 * for the holes and vm_map_ram() for the output.
 	 */
-	if (rq->outputsize <= PAGE_SIZE * 7 / 8) {
+	if (rq->outputsize <= PAGE_SIZE * 7 / 8 ||
+	    nrpages_out <= Z_EROFS_PCPUBUF_DST_PAGES) {
 		dst = erofs_get_pcpubuf(0);
 		if (IS_ERR(dst))
 			return PTR_ERR(dst);
@@ -326,11 +370,227 @@ static int z_erofs_shifted_transform(const struct z_erofs_decompress_req *rq,
 	return 0;
 }
 
+static void z_erofs_free_stream(const struct z_erofs_stream_decompressor *sd,
+				struct z_erofs_stream *strm)
+{
+	if (strm->strm)
+		sd->free(strm->strm);
+	if (strm->inbuf)
+		free_page((unsigned long)strm->inbuf);
+	kfree(strm);
+}
+
+static struct z_erofs_stream *
+z_erofs_alloc_stream(const struct z_erofs_stream_decompressor *sd)
+{
+	struct z_erofs_stream *strm = kmalloc(sizeof(*strm), GFP_KERNEL);
+
+	if (!strm)
+		return NULL;
+
+	strm->inbuf = (u8 *)__get_free_page(GFP_KERNEL);
+	strm->strm = sd->alloc();
+	if (!strm->inbuf || !strm->strm) {
+		z_erofs_free_stream(sd, strm);
+		return NULL;
+	}
+	return strm;
+}
+
+static bool z_erofs_stream_available(struct z_erofs_decompressor *alg)
+{
+	return !list_empty_careful(&alg->streams) ||
+		READ_ONCE(alg->nr_streams) < num_possible_cpus();
+}
+
+static struct z_erofs_stream *
+z_erofs_get_stream(struct z_erofs_decompressor *alg)
+{
+	struct z_erofs_stream *strm;
+
+	while (1) {
+		spin_lock(&alg->lock);
+		strm = list_first_entry_or_null(&alg->streams,
+						struct z_erofs_stream, list);
+		if (strm) {
+			list_del(&strm->list);
+			spin_unlock(&alg->lock);
+			return strm;
+		}
+		if (alg->nr_streams < num_possible_cpus())
+			break;
+		spin_unlock(&alg->lock);
+		wait_event(alg->wait, z_erofs_stream_available(alg));
+	}
+	++alg->nr_streams;
+	spin_unlock(&alg->lock);
+
+	/* the pool only grows up to what is actually decoded in parallel */
+	strm = z_erofs_alloc_stream(alg->stream);
+	if (strm)
+		return strm;
+
+	spin_lock(&alg->lock);
+	--alg->nr_streams;
+	spin_unlock(&alg->lock);
+	wake_up(&alg->wait);
+	return ERR_PTR(-ENOMEM);
+}
+
+static void z_erofs_put_stream(struct z_erofs_decompressor *alg,
+			       struct z_erofs_stream *strm)
+{
+	spin_lock(&alg->lock);
+	list_add(&strm->list, &alg->streams);
+	spin_unlock(&alg->lock);
+	wake_up(&alg->wait);
+}
+
+static int z_erofs_stream_decompress(struct z_erofs_decompress_req *rq,
+				     struct z_erofs_decompressor *alg,
+				     struct list_head *pagepool)
+{
+	const struct z_erofs_stream_decompressor *sd = alg->stream;
+	unsigned int inpos, outpos, outend, start, produced, i;
+	struct z_erofs_stream *strm;
+	struct page *bounce = NULL;
+	u8 *src, *dst;
+	int ret;
+
+	if (rq->inputsize > PAGE_SIZE)
+		return -EOPNOTSUPP;
+
+	strm = z_erofs_get_stream(alg);
+	if (IS_ERR(strm))
+		return PTR_ERR(strm);
+
+	/* the output would overwrite the input while it is being decoded */
+	if (rq->inplace_io) {
+		src = kmap_atomic(*rq->in);
+		memcpy(strm->inbuf, src, rq->inputsize);
+		kunmap_atomic(src);
+		src = strm->inbuf;
+	} else {
+		src = kmap(*rq->in);
+	}
+
+	/* the stream is aligned to the end of the cluster, skip the padding */
+	for (inpos = 0; inpos < rq->inputsize && !src[inpos]; ++inpos)
+		;
+
+	ret = -EIO;
+	if (inpos < rq->inputsize)
+		ret = sd->reset(strm->strm);
+
+	produced = 0;
+	for (i = 0; !ret && produced < rq->outputsize; ++i) {
+		struct page *page = rq->out[i];
+
+		start = outpos = i ? 0 : rq->pageofs_out;
+		outend = min_t(unsigned int, PAGE_SIZE,
+			       outpos + rq->outputsize - produced);
+
+		/* pages no one asked for still need to be decoded through */
+		if (!page) {
+			if (!bounce)
+				bounce = erofs_allocpage(pagepool, GFP_KERNEL,
+							 false);
+			if (!bounce) {
+				ret = -ENOMEM;
+				break;
+			}
+			page = bounce;
+		}
+
+		dst = kmap(page);
+		do {
+			const unsigned int oldin = inpos, oldout = outpos;
+
+			ret = sd->decode(strm->strm, src, &inpos,
+					 rq->inputsize, dst, &outpos, outend);
+			/* no progress: the input is truncated */
+			if (!ret && inpos == oldin && outpos == oldout)
+				ret = -EIO;
+		} while (!ret && outpos < outend);
+		kunmap(page);
+		produced += outpos - start;
+	}
+
+	/* a stream may end early only if it covers less than requested */
+	if (ret > 0)
+		ret = produced < rq->outputsize ? -EIO : 0;
+	if (ret)
+		erofs_err(rq->sb, "failed to decompress %s, in[%u, %u] out[%u, %u]: %d",
+			  alg->name, rq->inputsize, inpos, rq->outputsize,
+			  produced, ret);
+
+	if (bounce)
+		list_add(&bounce->lru, pagepool);
+	if (!rq->inplace_io)
+		kunmap(*rq->in);
+	z_erofs_put_stream(alg, strm);
+	return ret;
+}
+
+static void z_erofs_account_decompress(struct z_erofs_decompress_req *rq,
+				       u64 nsec)
+{
+	struct erofs_sb_info *const sbi = EROFS_SB(rq->sb);
+	struct z_erofs_decompress_stat *st;
+
+	st = &get_cpu_ptr(sbi->decompress_stats)->alg[rq->alg];
+	++st->count;
+	st->bytes_in += rq->inputsize;
+	st->bytes_out += rq->outputsize;
+	st->nsec += nsec;
+	put_cpu_ptr(sbi->decompress_stats);
+}
+
 int z_erofs_decompress(struct z_erofs_decompress_req *rq,
 		       struct list_head *pagepool)
 {
+	struct z_erofs_decompressor *const alg = decompressors + rq->alg;
+	u64 start;
+	int ret;
+
 	if (rq->alg == Z_EROFS_COMPRESSION_SHIFTED)
 		return z_erofs_shifted_transform(rq, pagepool);
-	return z_erofs_decompress_generic(rq, pagepool);
+
+	start = ktime_get_ns();
+	if (alg->stream)
+		ret = z_erofs_stream_decompress(rq, alg, pagepool);
+	else if (alg->decompress)
+		ret = z_erofs_decompress_generic(rq, pagepool);
+	else
+		return -EOPNOTSUPP;
+
+	if (!ret)
+		z_erofs_account_decompress(rq, ktime_get_ns() - start);
+	return ret;
+}
+
+void __init z_erofs_init_decompressor(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(decompressors); ++i) {
+		spin_lock_init(&decompressors[i].lock);
+		INIT_LIST_HEAD(&decompressors[i].streams);
+		init_waitqueue_head(&decompressors[i].wait);
+	}
+}
+
+void z_erofs_exit_decompressor(void)
+{
+	struct z_erofs_stream *strm, *n;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(decompressors); ++i) {
+		list_for_each_entry_safe(strm, n, &decompressors[i].streams,
+					 list)
+			z_erofs_free_stream(decompressors[i].stream, strm);
+		INIT_LIST_HEAD(&decompressors[i].streams);
+		decompressors[i].nr_streams = 0;
+	}
 }
 
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * DEFLATE decompression for EROFS, on top of lib/zlib_inflate.
+ *
+ * Each physical cluster holds a raw deflate stream (no zlib header or
+ * checksum) with up to a 32KiB window.  Its first byte must be non-zero to
+ * be told apart from the padding, so it can't start with a non-final stored
+ * block.
+ */
+#include "compress.h"
+#include <linux/zlib.h>
+
+static void z_erofs_deflate_free(void *strm)
+{
+	z_stream *z = strm;
+
+	vfree(z->workspace);
+	kfree(z);
+}
+
+static void *z_erofs_deflate_alloc(void)
+{
+	z_stream *z = kzalloc(sizeof(*z), GFP_KERNEL);
+
+	if (!z)
+		return NULL;
+
+	z->workspace = vmalloc(zlib_inflate_workspacesize());
+	if (!z->workspace) {
+		kfree(z);
+		return NULL;
+	}
+	return z;
+}
+
+static int z_erofs_deflate_reset(void *strm)
+{
+	return zlib_inflateInit2(strm, -MAX_WBITS) == Z_OK ? 0 : -EIO;
+}
+
+static int z_erofs_deflate_decode(void *strm, const u8 *in,
+				  unsigned int *inpos, unsigned int inlen,
+				  u8 *out, unsigned int *outpos,
+				  unsigned int outlen)
+{
+	z_stream *z = strm;
+	int ret;
+
+	z->next_in = in + *inpos;
+	z->avail_in = inlen - *inpos;
+	z->next_out = out + *outpos;
+	z->avail_out = outlen - *outpos;
+
+	ret = zlib_inflate(z, Z_SYNC_FLUSH);
+
+	*inpos = inlen - z->avail_in;
+	*outpos = outlen - z->avail_out;
+
+	switch (ret) {
+	case Z_OK:
+	case Z_BUF_ERROR:	/* no progress, checked by the caller */
+		return 0;
+	case Z_STREAM_END:
+		return 1;
+	case Z_MEM_ERROR:
+		return -ENOMEM;
+	default:
+		return -EIO;
+	}
+}
+
+const struct z_erofs_stream_decompressor z_erofs_deflate_decompressor = {
+	.alloc = z_erofs_deflate_alloc,
+	.free = z_erofs_deflate_free,
+	.reset = z_erofs_deflate_reset,
+	.decode = z_erofs_deflate_decode,
+};
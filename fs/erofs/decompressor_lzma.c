@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * LZMA decompression for EROFS, on top of lib/xz.
+ *
+ * Each physical cluster holds a single-block .xz stream with LZMA2 and
+ * either no integrity check or CRC32.  Only the .xz container is exposed
+ * by lib/xz, which costs a few dozen bytes of headers per cluster compared
+ * with raw LZMA.
+ */
+#include "compress.h"
+#include <linux/xz.h>
+
+/* the largest LZMA2 dictionary accepted, allocated on demand */
+#define Z_EROFS_LZMA_MAX_DICT_SIZE	(8 * 1024 * 1024)
+
+static void *z_erofs_lzma_alloc(void)
+{
+	return xz_dec_init(XZ_DYNALLOC, Z_EROFS_LZMA_MAX_DICT_SIZE);
+}
+
+static void z_erofs_lzma_free(void *strm)
+{
+	xz_dec_end(strm);
+}
+
+static int z_erofs_lzma_reset(void *strm)
+{
+	xz_dec_reset(strm);
+	return 0;
+}
+
+static int z_erofs_lzma_decode(void *strm, const u8 *in, unsigned int *inpos,
+			       unsigned int inlen, u8 *out,
+			       unsigned int *outpos, unsigned int outlen)
+{
+	struct xz_buf buf = {
+		.in = in,
+		.in_pos = *inpos,
+		.in_size = inlen,
+		.out = out,
+		.out_pos = *outpos,
+		.out_size = outlen,
+	};
+	enum xz_ret ret = xz_dec_run(strm, &buf);
+
+	*inpos = buf.in_pos;
+	*outpos = buf.out_pos;
+
+	switch (ret) {
+	case XZ_OK:
+		return 0;
+	case XZ_STREAM_END:
+		return 1;
+	case XZ_MEM_ERROR:
+		return -ENOMEM;
+	case XZ_MEMLIMIT_ERROR:
+	case XZ_OPTIONS_ERROR:
+		return -EOPNOTSUPP;
+	default:
+		return -EIO;
+	}
+}
+
+const struct z_erofs_stream_decompressor z_erofs_lzma_decompressor = {
+	.alloc = z_erofs_lzma_alloc,
+	.free = z_erofs_lzma_free,
+	.reset = z_erofs_lzma_reset,
+	.decode = z_erofs_lzma_decode,
+};
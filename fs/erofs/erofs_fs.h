@@ -16,7 +16,33 @@
  * be incompatible with this kernel version.
  */
 #define EROFS_FEATURE_INCOMPAT_LZ4_0PADDING	0x00000001
-#define EROFS_ALL_FEATURE_INCOMPAT		EROFS_FEATURE_INCOMPAT_LZ4_0PADDING
+#define EROFS_FEATURE_INCOMPAT_CHUNKED_FILE	0x00000004
+#define EROFS_FEATURE_INCOMPAT_DEVICE_TABLE	0x00000008
+/*
+ * Compressed with Z_EROFS_COMPRESSION_LZMA or _DEFLATE.  Deliberately private
+ * to this kernel, see below: kernels that don't know the bit refuse to mount.
+ */
+#define EROFS_FEATURE_INCOMPAT_STREAM_ALGS	0x00010000
+#define EROFS_ALL_FEATURE_INCOMPAT		\
+	(EROFS_FEATURE_INCOMPAT_LZ4_0PADDING | \
+	 EROFS_FEATURE_INCOMPAT_CHUNKED_FILE | \
+	 EROFS_FEATURE_INCOMPAT_DEVICE_TABLE | \
+	 EROFS_FEATURE_INCOMPAT_STREAM_ALGS)
+
+#define EROFS_DEVT_SLOT_SIZE	sizeof(struct erofs_deviceslot)
+
+/*
+ * 128-byte slot of the device table, one for each extra (blob) device.
+ * Blocks of all devices can be addressed either by chunk index device_id
+ * or, if mapped_blkaddr is set, by a flat block address space in which
+ * the device starts at mapped_blkaddr.
+ */
+struct erofs_deviceslot {
+	__u8 tag[64];		/* digest(sha256), etc. */
+	__le32 blocks;		/* total fs blocks of this device */
+	__le32 mapped_blkaddr;	/* map starting at mapped_blkaddr */
+	__u8 reserved[56];
+};
 
 /* 128-byte erofs on-disk super block */
 struct erofs_super_block {
@@ -37,8 +63,13 @@ struct erofs_super_block {
 	__u8 uuid[16];          /* 128-bit uuid for volume */
 	__u8 volume_name[16];   /* volume name */
 	__le32 feature_incompat;
+	__u8 reserved3[2];
+	/* # of devices besides the primary device */
+	__le16 extra_devices;
+	/* start of the device table, in units of EROFS_DEVT_SLOT_SIZE */
+	__le16 devt_slotoff;
 
-	__u8 reserved2[44];
+	__u8 reserved2[38];
 };
 
 /*
@@ -51,13 +82,16 @@ struct erofs_super_block {
  * inode, [xattrs], last_inline_data, ... | ... | no-holed data
  * 3 - inode compression D:
  * inode, [xattrs], map_header, extents ... | ...
- * 4~7 - reserved
+ * 4 - inode chunk-based E:
+ * inode, [xattrs], chunk indexes ... | ...
+ * 5~7 - reserved
  */
 enum {
 	EROFS_INODE_FLAT_PLAIN			= 0,
 	EROFS_INODE_FLAT_COMPRESSION_LEGACY	= 1,
 	EROFS_INODE_FLAT_INLINE			= 2,
 	EROFS_INODE_FLAT_COMPRESSION		= 3,
+	EROFS_INODE_CHUNK_BASED			= 4,
 	EROFS_INODE_DATALAYOUT_MAX
 };
 
@@ -74,6 +108,19 @@ static inline bool erofs_inode_is_data_compressed(unsigned int datamode)
 #define EROFS_I_VERSION_BIT             0
 #define EROFS_I_DATALAYOUT_BIT          1
 
+/* chunk bits (in addition to the block size bits) of chunk-based files */
+#define EROFS_CHUNK_FORMAT_BLKBITS_MASK		0x001F
+/* with chunk indexes rather than 4-byte block addresses */
+#define EROFS_CHUNK_FORMAT_INDEXES		0x0020
+
+#define EROFS_CHUNK_FORMAT_ALL	\
+	(EROFS_CHUNK_FORMAT_BLKBITS_MASK | EROFS_CHUNK_FORMAT_INDEXES)
+
+struct erofs_inode_chunk_info {
+	__le16 format;		/* chunk blkbits, etc. */
+	__le16 reserved;
+};
+
 /* 32-byte reduced form of an ondisk inode */
 struct erofs_inode_compact {
 	__le16 i_format;	/* inode format hints */
@@ -91,6 +138,9 @@ struct erofs_inode_compact {
 
 		/* for device files, used to indicate old/new device # */
 		__le32 rdev;
+
+		/* for chunk-based files, it contains the summary info */
+		struct erofs_inode_chunk_info c;
 	} i_u;
 	__le32 i_ino;           /* only used for 32-bit stat compatibility */
 	__le16 i_uid;
@@ -119,6 +169,9 @@ struct erofs_inode_extended {
 
 		/* for device files, used to indicate old/new device # */
 		__le32 rdev;
+
+		/* for chunk-based files, it contains the summary info */
+		struct erofs_inode_chunk_info c;
 	} i_u;
 
 	/* only used for 32-bit stat compatibility */
@@ -132,6 +185,23 @@ struct erofs_inode_extended {
 	__u8   i_reserved2[16];
 };
 
+/*
+ * Chunk-based files keep, right after the inode and its inline xattrs
+ * (aligned to the entry size), one entry per chunk:
+ * a 4-byte block address of the primary device, or an 8-byte chunk index
+ * if EROFS_CHUNK_FORMAT_INDEXES is set.  EROFS_NULL_ADDR marks a hole.
+ * Since chunks are referenced by address, identical chunks of different
+ * files (or of images sharing a blob device) are stored only once.
+ */
+#define EROFS_NULL_ADDR			-1
+#define EROFS_BLOCK_MAP_ENTRY_SIZE	sizeof(__le32)
+
+struct erofs_inode_chunk_index {
+	__le16 advise;		/* always 0, don't care for now */
+	__le16 device_id;	/* back-end storage id, 0 is the primary */
+	__le32 blkaddr;		/* start block address of this inode chunk */
+};
+
 #define EROFS_MAX_SHARED_XATTRS         (128)
 /* h_shared_count between 129 ... 255 are special # */
 #define EROFS_SHARED_XATTR_EXTENT       (255)
@@ -188,9 +258,25 @@ static inline unsigned int erofs_xattr_entry_size(struct erofs_xattr_entry *e)
 				 e->e_name_len + le16_to_cpu(e->e_value_size));
 }
 
-/* available compression algorithm types (for h_algorithmtype) */
+/*
+ * available compression algorithm types (for h_algorithmtype)
+ *
+ * All but LZ4 store each physical cluster as a complete stream
+ * (.xz with LZMA2 for LZMA, raw deflate for DEFLATE) aligned to its end
+ * and padded with leading zeroes, so they need LZ4_0PADDING as well as
+ * STREAM_ALGS.
+ *
+ * This format is deliberately private.  These streams are not the MicroLZMA
+ * and DEFLATE clusters (ids 1 and 2, set up by COMPR_CFGS) of mkfs.erofs and
+ * mainline, which this kernel can't decompress.  So they take ids mainline
+ * leaves unassigned, and a feature bit of their own.  Upstream mkfs.erofs
+ * can't make such images and other kernels can't read them; images made by
+ * upstream mkfs.erofs with LZMA or DEFLATE don't mount here.
+ */
 enum {
-	Z_EROFS_COMPRESSION_LZ4	= 0,
+	Z_EROFS_COMPRESSION_LZ4		= 0,
+	Z_EROFS_COMPRESSION_LZMA	= 14,
+	Z_EROFS_COMPRESSION_DEFLATE	= 15,
 	Z_EROFS_COMPRESSION_MAX
 };
 
@@ -227,6 +313,7 @@ struct z_erofs_map_header {
  *    0 - literal (uncompressed) cluster
  *    1 - compressed cluster (for the head logical cluster)
  *    2 - compressed cluster (for the other logical clusters)
+ *    3 - compressed cluster (for the head logical cluster, head 2 algorithm)
  *
  * In detail,
  *    0 - literal (uncompressed) cluster,
@@ -245,13 +332,16 @@ struct z_erofs_map_header {
  *           the decompressed data offset in its own head cluster
  *        di_u.delta[0] = distance to its corresponding head cluster
  *        di_u.delta[1] = distance to its corresponding tail cluster
- *                (di_advise could be 0, 1 or 2)
+ *                (di_advise could be 0, 1, 2 or 3)
+ *
+ *    3 - the same as 1, except that the cluster is compressed with the
+ *        head 2 algorithm of h_algorithmtype rather than the head 1 one.
  */
 enum {
 	Z_EROFS_VLE_CLUSTER_TYPE_PLAIN		= 0,
 	Z_EROFS_VLE_CLUSTER_TYPE_HEAD		= 1,
 	Z_EROFS_VLE_CLUSTER_TYPE_NONHEAD	= 2,
-	Z_EROFS_VLE_CLUSTER_TYPE_RESERVED	= 3,
+	Z_EROFS_VLE_CLUSTER_TYPE_HEAD2		= 3,
 	Z_EROFS_VLE_CLUSTER_TYPE_MAX
 };
 
@@ -307,6 +397,9 @@ static inline void erofs_check_ondisk_layout_definitions(void)
 	BUILD_BUG_ON(sizeof(struct z_erofs_map_header) != 8);
 	BUILD_BUG_ON(sizeof(struct z_erofs_vle_decompressed_index) != 8);
 	BUILD_BUG_ON(sizeof(struct erofs_dirent) != 12);
+	BUILD_BUG_ON(sizeof(struct erofs_inode_chunk_info) != 4);
+	BUILD_BUG_ON(sizeof(struct erofs_inode_chunk_index) != 8);
+	BUILD_BUG_ON(sizeof(struct erofs_deviceslot) != 128);
 
 	BUILD_BUG_ON(BIT(Z_EROFS_VLE_DI_CLUSTER_TYPE_BITS) <
 		     Z_EROFS_VLE_CLUSTER_TYPE_MAX - 1);
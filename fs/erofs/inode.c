@@ -40,7 +40,12 @@ static int erofs_read_inode(struct inode *inode, void *data)
 		case S_IFREG:
 		case S_IFDIR:
 		case S_IFLNK:
-			vi->raw_blkaddr = le32_to_cpu(die->i_u.raw_blkaddr);
+			if (vi->datalayout == EROFS_INODE_CHUNK_BASED)
+				vi->chunkformat =
+					le16_to_cpu(die->i_u.c.format);
+			else
+				vi->raw_blkaddr =
+					le32_to_cpu(die->i_u.raw_blkaddr);
 			break;
 		case S_IFCHR:
 		case S_IFBLK:
@@ -79,7 +84,12 @@ static int erofs_read_inode(struct inode *inode, void *data)
 		case S_IFREG:
 		case S_IFDIR:
 		case S_IFLNK:
-			vi->raw_blkaddr = le32_to_cpu(dic->i_u.raw_blkaddr);
+			if (vi->datalayout == EROFS_INODE_CHUNK_BASED)
+				vi->chunkformat =
+					le16_to_cpu(dic->i_u.c.format);
+			else
+				vi->raw_blkaddr =
+					le32_to_cpu(dic->i_u.raw_blkaddr);
 			break;
 		case S_IFCHR:
 		case S_IFBLK:
@@ -115,6 +125,20 @@ static int erofs_read_inode(struct inode *inode, void *data)
 		return -EOPNOTSUPP;
 	}
 
+	if (vi->datalayout == EROFS_INODE_CHUNK_BASED) {
+		if (!(sbi->feature_incompat &
+		      EROFS_FEATURE_INCOMPAT_CHUNKED_FILE) ||
+		    (vi->chunkformat & ~EROFS_CHUNK_FORMAT_ALL)) {
+			erofs_err(inode->i_sb,
+				  "unsupported chunk format %x of nid %llu",
+				  vi->chunkformat, vi->nid);
+			DBG_BUGON(1);
+			return -EOPNOTSUPP;
+		}
+		vi->chunkbits = LOG_BLOCK_SIZE +
+			(vi->chunkformat & EROFS_CHUNK_FORMAT_BLKBITS_MASK);
+	}
+
 	if (!nblks)
 		/* measure inode.i_blocks as generic filesystems */
 		inode->i_blocks = roundup(inode->i_size, EROFS_BLKSIZ) >> 9;
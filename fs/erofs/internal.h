@@ -15,6 +15,8 @@
 #include <linux/buffer_head.h>
 #include <linux/magic.h>
 #include <linux/slab.h>
+#include <linux/kobject.h>
+#include <linux/completion.h>
 #include <linux/vmalloc.h>
 #include "erofs_fs.h"
 
@@ -46,6 +48,28 @@ typedef u64 erofs_off_t;
 /* data type for filesystem-wide blocks number */
 typedef u32 erofs_blk_t;
 
+#ifdef CONFIG_EROFS_FS_ZIP
+/* decompression statistics of one algorithm, see sysfs.c */
+struct z_erofs_decompress_stat {
+	u64 count;			/* physical clusters decompressed */
+	u64 bytes_in, bytes_out;
+	u64 nsec;			/* time spent decompressing them */
+};
+
+struct z_erofs_decompress_stats {
+	struct z_erofs_decompress_stat alg[Z_EROFS_COMPRESSION_MAX];
+};
+#endif
+
+/* an extra (blob) device, given by the "device=" mount option */
+struct erofs_device_info {
+	char *path;
+	struct block_device *bdev;
+
+	u32 blocks;
+	u32 mapped_blkaddr;
+};
+
 struct erofs_sb_info {
 #ifdef CONFIG_EROFS_FS_ZIP
 	/* list for all registered superblocks, mainly for shrinker */
@@ -57,6 +81,8 @@ struct erofs_sb_info {
 
 	/* threshold for decompression synchronously */
 	unsigned int max_sync_decompress_pages;
+	/* EROFS_SYNC_DECOMPRESS_*, tunable through sysfs */
+	unsigned int sync_decompress;
 
 	unsigned int shrinker_run_no;
 
@@ -65,8 +91,17 @@ struct erofs_sb_info {
 
 	/* pseudo inode to manage cached pages */
 	struct inode *managed_cache;
+
+	/* per-CPU, summed up when read through sysfs */
+	struct z_erofs_decompress_stats __percpu *decompress_stats;
 #endif	/* CONFIG_EROFS_FS_ZIP */
+	/* extra devices in the order of the on-disk device table */
+	struct erofs_device_info *devs;
+	unsigned int nr_devs;
+	u16 extra_devices, devt_slotoff;
+
 	u32 blocks;
+	u32 total_blocks;		/* including all extra devices */
 	u32 meta_blkaddr;
 #ifdef CONFIG_EROFS_FS_XATTR
 	u32 xattr_blkaddr;
@@ -88,6 +123,10 @@ struct erofs_sb_info {
 	u32 feature_incompat;
 
 	unsigned int mount_opt;
+
+	/* /sys/fs/erofs/<devname> */
+	struct kobject s_kobj;
+	struct completion s_kobj_unregister;
 };
 
 #define EROFS_SB(sb) ((struct erofs_sb_info *)(sb)->s_fs_info)
@@ -108,6 +147,20 @@ enum {
 	EROFS_ZIP_CACHE_READAROUND
 };
 
+/*
+ * Whether small readaheads wait for their I/O and decompress in the
+ * reader's context rather than in the decompression workers:
+ *  AUTO      - only for readaheads which are not asynchronous, until bio
+ *              completions are seen in atomic context, then FORCE_ON;
+ *  FORCE_ON  - also for asynchronous readaheads;
+ *  FORCE_OFF - never, a single page read still decompresses in place.
+ */
+enum {
+	EROFS_SYNC_DECOMPRESS_AUTO,
+	EROFS_SYNC_DECOMPRESS_FORCE_ON,
+	EROFS_SYNC_DECOMPRESS_FORCE_OFF
+};
+
 #define EROFS_LOCKED_MAGIC     (INT_MIN | 0xE0F510CCL)
 
 /* basic unit of the workstation of a super_block */
@@ -179,7 +232,11 @@ static inline int erofs_wait_on_workgroup_freezed(struct erofs_workgroup *grp)
 
 /* hard limit of pages per compressed cluster */
 #define Z_EROFS_CLUSTER_MAX_PAGES       (CONFIG_EROFS_FS_CLUSTER_PAGE_LIMIT)
-#define EROFS_PCPUBUF_NR_PAGES          Z_EROFS_CLUSTER_MAX_PAGES
+/* outputs up to this size are decompressed into the per-CPU buffer */
+#define Z_EROFS_PCPUBUF_DST_PAGES       8
+#define EROFS_PCPUBUF_NR_PAGES          \
+	(Z_EROFS_CLUSTER_MAX_PAGES > Z_EROFS_PCPUBUF_DST_PAGES ? \
+	 Z_EROFS_CLUSTER_MAX_PAGES : Z_EROFS_PCPUBUF_DST_PAGES)
 #else
 #define EROFS_PCPUBUF_NR_PAGES          0
 #endif	/* !CONFIG_EROFS_FS_ZIP */
@@ -233,6 +290,10 @@ struct erofs_inode {
 
 	union {
 		erofs_blk_t raw_blkaddr;
+		struct {
+			unsigned short	chunkformat;
+			unsigned char	chunkbits;
+		};
 #ifdef CONFIG_EROFS_FS_ZIP
 		struct {
 			unsigned short z_advise;
@@ -326,10 +387,21 @@ struct erofs_map_blocks {
 	u64 m_plen, m_llen;
 
 	unsigned int m_flags;
+	/* Z_EROFS_COMPRESSION_* of a compressed extent */
+	unsigned int m_algorithmformat;
+	/* device the extent lives on, see erofs_map_dev() */
+	unsigned short m_deviceid;
 
 	struct page *mpage;
 };
 
+struct erofs_map_dev {
+	struct block_device *m_bdev;
+
+	erofs_off_t m_pa;
+	unsigned int m_deviceid;
+};
+
 /* Flags used by erofs_map_blocks() */
 #define EROFS_GET_BLOCKS_RAW    0x0001
 
@@ -353,6 +425,7 @@ static inline int z_erofs_map_blocks_iter(struct inode *inode,
 struct page *erofs_get_meta_page(struct super_block *sb, erofs_blk_t blkaddr);
 
 int erofs_map_blocks(struct inode *, struct erofs_map_blocks *, int);
+int erofs_map_dev(struct super_block *sb, struct erofs_map_dev *dev);
 
 /* inode.c */
 static inline unsigned long erofs_inode_hash(erofs_nid_t nid)
@@ -381,6 +454,12 @@ int erofs_namei(struct inode *dir, struct qstr *name,
 /* dir.c */
 extern const struct file_operations erofs_dir_fops;
 
+/* sysfs.c */
+int erofs_register_sysfs(struct super_block *sb);
+void erofs_unregister_sysfs(struct super_block *sb);
+int __init erofs_init_sysfs(void);
+void erofs_exit_sysfs(void);
+
 /* utils.c / zdata.c */
 struct page *erofs_allocpage(struct list_head *pool, gfp_t gfp, bool nofail);
 
@@ -390,6 +469,8 @@ void *erofs_get_pcpubuf(unsigned int pagenr);
 	(void)&(buf);	\
 	preempt_enable();	\
 } while (0)
+int __init erofs_init_pcpubuf(void);
+void erofs_exit_pcpubuf(void);
 #else
 static inline void *erofs_get_pcpubuf(unsigned int pagenr)
 {
@@ -397,6 +478,8 @@ static inline void *erofs_get_pcpubuf(unsigned int pagenr)
 }
 
 #define erofs_put_pcpubuf(buf) do {} while (0)
+static inline int erofs_init_pcpubuf(void) { return 0; }
+static inline void erofs_exit_pcpubuf(void) {}
 #endif
 
 #ifdef CONFIG_EROFS_FS_ZIP
@@ -416,6 +499,8 @@ int erofs_try_to_free_all_cached_pages(struct erofs_sb_info *sbi,
 				       struct erofs_workgroup *egrp);
 int erofs_try_to_free_cached_page(struct address_space *mapping,
 				  struct page *page);
+bool z_erofs_algorithm_supported(unsigned int alg);
+const char *z_erofs_algorithm_name(unsigned int alg);
 #else
 static inline void erofs_shrinker_register(struct super_block *sb) {}
 static inline void erofs_shrinker_unregister(struct super_block *sb) {}
@@ -133,6 +133,11 @@ static int erofs_read_superblock(struct super_block *sb)
 		goto out;
 
 	sbi->blocks = le32_to_cpu(dsb->blocks);
+	sbi->total_blocks = sbi->blocks;
+	if (sbi->feature_incompat & EROFS_FEATURE_INCOMPAT_DEVICE_TABLE) {
+		sbi->extra_devices = le16_to_cpu(dsb->extra_devices);
+		sbi->devt_slotoff = le16_to_cpu(dsb->devt_slotoff);
+	}
 	sbi->meta_blkaddr = le32_to_cpu(dsb->meta_blkaddr);
 #ifdef CONFIG_EROFS_FS_XATTR
 	sbi->xattr_blkaddr = le32_to_cpu(dsb->xattr_blkaddr);
@@ -160,6 +165,89 @@ static int erofs_read_superblock(struct super_block *sb)
 	return ret;
 }
 
+/* open the extra devices and read their slots of the device table */
+static int erofs_init_devices(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	erofs_off_t pos = (erofs_off_t)sbi->devt_slotoff * EROFS_DEVT_SLOT_SIZE;
+	struct erofs_deviceslot *dis;
+	struct erofs_device_info *dif;
+	struct block_device *bdev;
+	struct page *page;
+	unsigned int i;
+
+	if (sbi->nr_devs != sbi->extra_devices) {
+		erofs_err(sb, "%u extra devices required, %u given",
+			  sbi->extra_devices, sbi->nr_devs);
+		return -EINVAL;
+	}
+
+	for (i = 0; i < sbi->nr_devs; ++i, pos += EROFS_DEVT_SLOT_SIZE) {
+		dif = &sbi->devs[i];
+
+		page = erofs_get_meta_page(sb, erofs_blknr(pos));
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+
+		dis = page_address(page) + erofs_blkoff(pos);
+		dif->blocks = le32_to_cpu(dis->blocks);
+		dif->mapped_blkaddr = le32_to_cpu(dis->mapped_blkaddr);
+		unlock_page(page);
+		put_page(page);
+
+		bdev = blkdev_get_by_path(dif->path, FMODE_READ | FMODE_EXCL,
+					  sb->s_type);
+		if (IS_ERR(bdev)) {
+			erofs_err(sb, "cannot open device %s: %ld",
+				  dif->path, PTR_ERR(bdev));
+			return PTR_ERR(bdev);
+		}
+		dif->bdev = bdev;
+		sbi->total_blocks += dif->blocks;
+	}
+	return 0;
+}
+
+static void erofs_free_devices(struct erofs_sb_info *sbi)
+{
+	unsigned int i;
+
+	for (i = 0; i < sbi->nr_devs; ++i) {
+		if (sbi->devs[i].bdev)
+			blkdev_put(sbi->devs[i].bdev, FMODE_READ | FMODE_EXCL);
+		kfree(sbi->devs[i].path);
+	}
+	kfree(sbi->devs);
+}
+
+static int erofs_add_device(struct super_block *sb, substring_t *args)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	struct erofs_device_info *devs;
+	char *path;
+
+	/* devices can only be given at mount time */
+	if (sb->s_root) {
+		erofs_info(sb, "device options ignored on remount");
+		return 0;
+	}
+
+	path = match_strdup(args);
+	if (!path)
+		return -ENOMEM;
+
+	devs = krealloc(sbi->devs, (sbi->nr_devs + 1) * sizeof(*devs),
+			GFP_KERNEL | __GFP_ZERO);
+	if (!devs) {
+		kfree(path);
+		return -ENOMEM;
+	}
+	devs[sbi->nr_devs] = (struct erofs_device_info) { .path = path };
+	sbi->devs = devs;
+	++sbi->nr_devs;
+	return 0;
+}
+
 #ifdef CONFIG_EROFS_FS_ZIP
 static int erofs_build_cache_strategy(struct super_block *sb,
 				      substring_t *args)
@@ -201,6 +289,7 @@ static void erofs_default_options(struct erofs_sb_info *sbi)
 #ifdef CONFIG_EROFS_FS_ZIP
 	sbi->cache_strategy = EROFS_ZIP_CACHE_READAROUND;
 	sbi->max_sync_decompress_pages = 3;
+	sbi->sync_decompress = EROFS_SYNC_DECOMPRESS_AUTO;
 #endif
 #ifdef CONFIG_EROFS_FS_XATTR
 	set_opt(sbi, XATTR_USER);
@@ -216,6 +305,7 @@ enum {
 	Opt_acl,
 	Opt_noacl,
 	Opt_cache_strategy,
+	Opt_device,
 	Opt_err
 };
 
@@ -225,6 +315,7 @@ static match_table_t erofs_tokens = {
 	{Opt_acl, "acl"},
 	{Opt_noacl, "noacl"},
 	{Opt_cache_strategy, "cache_strategy=%s"},
+	{Opt_device, "device=%s"},
 	{Opt_err, NULL}
 };
 
@@ -282,6 +373,11 @@ static int erofs_parse_options(struct super_block *sb, char *options)
 			if (err)
 				return err;
 			break;
+		case Opt_device:
+			err = erofs_add_device(sb, args);
+			if (err)
+				return err;
+			break;
 		default:
 			erofs_err(sb, "Unrecognized mount option \"%s\" or missing value", p);
 			return -EINVAL;
@@ -392,8 +488,16 @@ static int erofs_fill_super(struct super_block *sb, void *data, int silent)
 	else
 		sb->s_flags &= ~SB_POSIXACL;
 
+	err = erofs_init_devices(sb);
+	if (err)
+		return err;
+
 #ifdef CONFIG_EROFS_FS_ZIP
 	INIT_RADIX_TREE(&sbi->workstn_tree, GFP_ATOMIC);
+
+	sbi->decompress_stats = alloc_percpu(struct z_erofs_decompress_stats);
+	if (!sbi->decompress_stats)
+		return -ENOMEM;
 #endif
 
 	/* get the root inode */
@@ -418,6 +522,10 @@ static int erofs_fill_super(struct super_block *sb, void *data, int silent)
 	if (err)
 		return err;
 
+	err = erofs_register_sysfs(sb);
+	if (err)
+		return err;
+
 	erofs_info(sb, "mounted with opts: %s, root inode @ nid %llu.",
 		   (char *)data, ROOT_NID(sbi));
 	return 0;
@@ -444,6 +552,10 @@ static void erofs_kill_sb(struct super_block *sb)
 	sbi = EROFS_SB(sb);
 	if (!sbi)
 		return;
+	erofs_free_devices(sbi);
+#ifdef CONFIG_EROFS_FS_ZIP
+	free_percpu(sbi->decompress_stats);
+#endif
 	kfree(sbi);
 	sb->s_fs_info = NULL;
 }
@@ -455,6 +567,7 @@ static void erofs_put_super(struct super_block *sb)
 
 	DBG_BUGON(!sbi);
 
+	erofs_unregister_sysfs(sb);
 	erofs_shrinker_unregister(sb);
 #ifdef CONFIG_EROFS_FS_ZIP
 	iput(sbi->managed_cache);
@@ -494,6 +607,10 @@ static int __init erofs_module_init(void)
 	if (err)
 		goto zip_err;
 
+	err = erofs_init_sysfs();
+	if (err)
+		goto sysfs_err;
+
 	err = register_filesystem(&erofs_fs_type);
 	if (err)
 		goto fs_err;
@@ -501,6 +618,8 @@ static int __init erofs_module_init(void)
 	return 0;
 
 fs_err:
+	erofs_exit_sysfs();
+sysfs_err:
 	z_erofs_exit_zip_subsystem();
 zip_err:
 	erofs_exit_shrinker();
@@ -513,6 +632,7 @@ static int __init erofs_module_init(void)
 static void __exit erofs_module_exit(void)
 {
 	unregister_filesystem(&erofs_fs_type);
+	erofs_exit_sysfs();
 	z_erofs_exit_zip_subsystem();
 	erofs_exit_shrinker();
 
@@ -530,7 +650,7 @@ static int erofs_statfs(struct dentry *dentry, struct kstatfs *buf)
 
 	buf->f_type = sb->s_magic;
 	buf->f_bsize = EROFS_BLKSIZ;
-	buf->f_blocks = sbi->blocks;
+	buf->f_blocks = sbi->total_blocks;
 	buf->f_bfree = buf->f_bavail = 0;
 
 	buf->f_files = ULLONG_MAX;
@@ -545,7 +665,11 @@ static int erofs_statfs(struct dentry *dentry, struct kstatfs *buf)
 
 static int erofs_show_options(struct seq_file *seq, struct dentry *root)
 {
-	struct erofs_sb_info *sbi __maybe_unused = EROFS_SB(root->d_sb);
+	struct erofs_sb_info *sbi = EROFS_SB(root->d_sb);
+	unsigned int i;
+
+	for (i = 0; i < sbi->nr_devs; ++i)
+		seq_show_option(seq, "device", sbi->devs[i].path);
 
 #ifdef CONFIG_EROFS_FS_XATTR
 	if (test_opt(sbi, XATTR_USER))
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * /sys/fs/erofs/<devname>/ of each mounted filesystem
+ */
+#include "internal.h"
+#include <linux/sysfs.h>
+
+struct erofs_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct erofs_sb_info *sbi, char *buf);
+	ssize_t (*store)(struct erofs_sb_info *sbi, const char *buf,
+			 size_t len);
+};
+
+#define EROFS_ATTR_RO(_name)					\
+static struct erofs_attr erofs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0444 },	\
+	.show = _name##_show,					\
+}
+
+#define EROFS_ATTR_RW(_name)					\
+static struct erofs_attr erofs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0644 },	\
+	.show = _name##_show,					\
+	.store = _name##_store,					\
+}
+
+#ifdef CONFIG_EROFS_FS_ZIP
+/* 0 - auto, 1 - force on, 2 - force off, see EROFS_SYNC_DECOMPRESS_* */
+static ssize_t sync_decompress_show(struct erofs_sb_info *sbi, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(sbi->sync_decompress));
+}
+
+static ssize_t sync_decompress_store(struct erofs_sb_info *sbi,
+				     const char *buf, size_t len)
+{
+	unsigned int t;
+	int err;
+
+	err = kstrtouint(buf, 0, &t);
+	if (err)
+		return err;
+	if (t > EROFS_SYNC_DECOMPRESS_FORCE_OFF)
+		return -EINVAL;
+
+	WRITE_ONCE(sbi->sync_decompress, t);
+	return len;
+}
+EROFS_ATTR_RW(sync_decompress);
+
+/* readaheads up to this many pages may decompress synchronously */
+static ssize_t max_sync_decompress_pages_show(struct erofs_sb_info *sbi,
+					      char *buf)
+{
+	return sprintf(buf, "%u\n",
+		       READ_ONCE(sbi->max_sync_decompress_pages));
+}
+
+static ssize_t max_sync_decompress_pages_store(struct erofs_sb_info *sbi,
+					       const char *buf, size_t len)
+{
+	unsigned int t;
+	int err;
+
+	err = kstrtouint(buf, 0, &t);
+	if (err)
+		return err;
+
+	WRITE_ONCE(sbi->max_sync_decompress_pages, t);
+	return len;
+}
+EROFS_ATTR_RW(max_sync_decompress_pages);
+
+/*
+ * One line per compression algorithm:
+ *   <name> <clusters> <bytes in> <bytes out> <nanoseconds>
+ */
+static ssize_t decompress_stats_show(struct erofs_sb_info *sbi, char *buf)
+{
+	ssize_t len = 0;
+	unsigned int alg;
+	int cpu;
+
+	for (alg = 0; alg < Z_EROFS_COMPRESSION_MAX; ++alg) {
+		struct z_erofs_decompress_stat sum = { 0 };
+
+		/* unassigned algorithm ids */
+		if (!z_erofs_algorithm_name(alg))
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			struct z_erofs_decompress_stat *st =
+				&per_cpu_ptr(sbi->decompress_stats,
+					     cpu)->alg[alg];
+
+			sum.count += st->count;
+			sum.bytes_in += st->bytes_in;
+			sum.bytes_out += st->bytes_out;
+			sum.nsec += st->nsec;
+		}
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%s %llu %llu %llu %llu\n",
+				 z_erofs_algorithm_name(alg), sum.count,
+				 sum.bytes_in, sum.bytes_out, sum.nsec);
+	}
+	return len;
+}
+EROFS_ATTR_RO(decompress_stats);
+#endif
+
+static struct attribute *erofs_attrs[] = {
+#ifdef CONFIG_EROFS_FS_ZIP
+	&erofs_attr_sync_decompress.attr,
+	&erofs_attr_max_sync_decompress_pages.attr,
+	&erofs_attr_decompress_stats.attr,
+#endif
+	NULL,
+};
+
+static ssize_t erofs_attr_show(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+	struct erofs_attr *a = container_of(attr, struct erofs_attr, attr);
+
+	return a->show(sbi, buf);
+}
+
+static ssize_t erofs_attr_store(struct kobject *kobj, struct attribute *attr,
+				const char *buf, size_t len)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+	struct erofs_attr *a = container_of(attr, struct erofs_attr, attr);
+
+	return a->store ? a->store(sbi, buf, len) : -EPERM;
+}
+
+static const struct sysfs_ops erofs_attr_ops = {
+	.show = erofs_attr_show,
+	.store = erofs_attr_store,
+};
+
+static void erofs_sb_release(struct kobject *kobj)
+{
+	struct erofs_sb_info *sbi = container_of(kobj, struct erofs_sb_info,
+						 s_kobj);
+
+	complete(&sbi->s_kobj_unregister);
+}
+
+static struct kobj_type erofs_sb_ktype = {
+	.default_attrs = erofs_attrs,
+	.sysfs_ops = &erofs_attr_ops,
+	.release = erofs_sb_release,
+};
+
+static struct kset *erofs_kset;
+
+int erofs_register_sysfs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+	int err;
+
+	sbi->s_kobj.kset = erofs_kset;
+	init_completion(&sbi->s_kobj_unregister);
+	err = kobject_init_and_add(&sbi->s_kobj, &erofs_sb_ktype, NULL,
+				   "%s", sb->s_id);
+	if (err) {
+		kobject_put(&sbi->s_kobj);
+		wait_for_completion(&sbi->s_kobj_unregister);
+	}
+	return err;
+}
+
+void erofs_unregister_sysfs(struct super_block *sb)
+{
+	struct erofs_sb_info *sbi = EROFS_SB(sb);
+
+	if (!sbi->s_kobj.state_in_sysfs)
+		return;
+
+	kobject_del(&sbi->s_kobj);
+	kobject_put(&sbi->s_kobj);
+	wait_for_completion(&sbi->s_kobj_unregister);
+}
+
+int __init erofs_init_sysfs(void)
+{
+	erofs_kset = kset_create_and_add("erofs", NULL, fs_kobj);
+	return erofs_kset ? 0 : -ENOMEM;
+}
+
+void erofs_exit_sysfs(void)
+{
+	kset_unregister(erofs_kset);
+}
@@ -22,14 +22,39 @@ struct page *erofs_allocpage(struct list_head *pool, gfp_t gfp, bool nofail)
 }
 
 #if (EROFS_PCPUBUF_NR_PAGES > 0)
-static struct {
-	u8 data[PAGE_SIZE * EROFS_PCPUBUF_NR_PAGES];
-} ____cacheline_aligned_in_smp erofs_pcpubuf[NR_CPUS];
+static DEFINE_PER_CPU(u8 *, erofs_pcpubuf);
 
 void *erofs_get_pcpubuf(unsigned int pagenr)
 {
 	preempt_disable();
-	return &erofs_pcpubuf[smp_processor_id()].data[pagenr * PAGE_SIZE];
+	return this_cpu_read(erofs_pcpubuf) + pagenr * PAGE_SIZE;
+}
+
+void erofs_exit_pcpubuf(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kvfree(per_cpu(erofs_pcpubuf, cpu));
+		per_cpu(erofs_pcpubuf, cpu) = NULL;
+	}
+}
+
+int __init erofs_init_pcpubuf(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		u8 *buf = kvmalloc_node(EROFS_PCPUBUF_NR_PAGES * PAGE_SIZE,
+					GFP_KERNEL, cpu_to_node(cpu));
+
+		if (!buf) {
+			erofs_exit_pcpubuf();
+			return -ENOMEM;
+		}
+		per_cpu(erofs_pcpubuf, cpu) = buf;
+	}
+	return 0;
 }
 #endif
 
@@ -7,6 +7,9 @@
 #include "zdata.h"
 #include "compress.h"
 #include <linux/prefetch.h>
+#include <linux/kthread.h>
+#include <linux/cpuhotplug.h>
+#include <uapi/linux/sched/types.h>
 
 #include <trace/events/erofs.h>
 
@@ -34,10 +37,84 @@ typedef tagptr1_t compressed_page_t;
 static struct workqueue_struct *z_erofs_workqueue __read_mostly;
 static struct kmem_cache *pcluster_cachep __read_mostly;
 
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+/*
+ * Created and destroyed as CPUs come and go; NULL while a CPU has none,
+ * bios completing there then use the workqueue instead.
+ */
+static DEFINE_PER_CPU(struct kthread_worker __rcu *, z_erofs_pcpu_workers);
+static DEFINE_SPINLOCK(z_erofs_pcpu_worker_lock);
+static enum cpuhp_state z_erofs_cpuhp_state;
+
+static int z_erofs_cpu_online(unsigned int cpu)
+{
+	struct kthread_worker *worker, *old;
+
+	worker = kthread_create_worker_on_cpu(cpu, 0, "erofs_worker/%u", cpu);
+	if (IS_ERR(worker))
+		return PTR_ERR(worker);
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD_HIPRI
+	sched_setscheduler_nocheck(worker->task, SCHED_FIFO,
+			&(struct sched_param) { .sched_priority = 1 });
+#endif
+
+	spin_lock(&z_erofs_pcpu_worker_lock);
+	old = rcu_dereference_protected(per_cpu(z_erofs_pcpu_workers, cpu),
+			lockdep_is_held(&z_erofs_pcpu_worker_lock));
+	if (!old)
+		rcu_assign_pointer(per_cpu(z_erofs_pcpu_workers, cpu), worker);
+	spin_unlock(&z_erofs_pcpu_worker_lock);
+
+	if (old)
+		kthread_destroy_worker(worker);
+	return 0;
+}
+
+static int z_erofs_cpu_offline(unsigned int cpu)
+{
+	struct kthread_worker *worker;
+
+	spin_lock(&z_erofs_pcpu_worker_lock);
+	worker = rcu_dereference_protected(per_cpu(z_erofs_pcpu_workers, cpu),
+			lockdep_is_held(&z_erofs_pcpu_worker_lock));
+	RCU_INIT_POINTER(per_cpu(z_erofs_pcpu_workers, cpu), NULL);
+	spin_unlock(&z_erofs_pcpu_worker_lock);
+
+	/* Wait for z_erofs_vle_unzip_bg() to stop queueing, then drain */
+	synchronize_rcu();
+	if (worker)
+		kthread_destroy_worker(worker);
+	return 0;
+}
+
+static void z_erofs_destroy_pcpu_workers(void)
+{
+	cpuhp_remove_state(z_erofs_cpuhp_state);
+}
+
+static int __init z_erofs_init_pcpu_workers(void)
+{
+	int ret;
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "fs/erofs:online",
+				z_erofs_cpu_online, z_erofs_cpu_offline);
+	if (ret < 0)
+		return ret;
+	z_erofs_cpuhp_state = ret;
+	return 0;
+}
+#else
+static inline void z_erofs_destroy_pcpu_workers(void) {}
+static inline int z_erofs_init_pcpu_workers(void) { return 0; }
+#endif
+
 void z_erofs_exit_zip_subsystem(void)
 {
+	z_erofs_destroy_pcpu_workers();
 	destroy_workqueue(z_erofs_workqueue);
 	kmem_cache_destroy(pcluster_cachep);
+	erofs_exit_pcpubuf();
+	z_erofs_exit_decompressor();
 }
 
 static inline int z_erofs_init_workqueue(void)
@@ -79,17 +156,38 @@ static void z_erofs_pcluster_init_always(struct z_erofs_pcluster *pcl)
 
 int __init z_erofs_init_zip_subsystem(void)
 {
+	int err;
+
+	z_erofs_init_decompressor();
+
+	err = erofs_init_pcpubuf();
+	if (err)
+		return err;
+
+	err = -ENOMEM;
 	pcluster_cachep = kmem_cache_create("erofs_compress",
 					    Z_EROFS_WORKGROUP_SIZE, 0,
 					    SLAB_RECLAIM_ACCOUNT,
 					    z_erofs_pcluster_init_once);
-	if (pcluster_cachep) {
-		if (!z_erofs_init_workqueue())
-			return 0;
+	if (!pcluster_cachep)
+		goto out_pcpubuf;
 
-		kmem_cache_destroy(pcluster_cachep);
-	}
-	return -ENOMEM;
+	err = z_erofs_init_workqueue();
+	if (err)
+		goto out_cache;
+
+	err = z_erofs_init_pcpu_workers();
+	if (err)
+		goto out_workqueue;
+	return 0;
+
+out_workqueue:
+	destroy_workqueue(z_erofs_workqueue);
+out_cache:
+	kmem_cache_destroy(pcluster_cachep);
+out_pcpubuf:
+	erofs_exit_pcpubuf();
+	return err;
 }
 
 enum z_erofs_collectmode {
@@ -418,7 +516,7 @@ static struct z_erofs_collection *clregister(struct z_erofs_collector *clt,
 			Z_EROFS_PCLUSTER_FULL_LENGTH : 0);
 
 	if (map->m_flags & EROFS_MAP_ZIPPED)
-		pcl->algorithmformat = Z_EROFS_COMPRESSION_LZ4;
+		pcl->algorithmformat = map->m_algorithmformat;
 	else
 		pcl->algorithmformat = Z_EROFS_COMPRESSION_SHIFTED;
 
@@ -698,6 +796,8 @@ static int z_erofs_do_read_page(struct z_erofs_decompress_frontend *fe,
 	goto out;
 }
 
+static void z_erofs_vle_unzip_bg(struct z_erofs_unzip_io_sb *iosb);
+
 static void z_erofs_vle_unzip_kickoff(void *ptr, int bios)
 {
 	tagptr1_t t = tagptr_init(tagptr1_t, ptr);
@@ -715,7 +815,8 @@ static void z_erofs_vle_unzip_kickoff(void *ptr, int bios)
 	}
 
 	if (!atomic_add_return(bios, &io->pending_bios))
-		queue_work(z_erofs_workqueue, &io->u.work);
+		z_erofs_vle_unzip_bg(container_of(io, struct z_erofs_unzip_io_sb,
+						  io));
 }
 
 static inline void z_erofs_vle_read_endio(struct bio *bio)
@@ -975,10 +1076,8 @@ static void z_erofs_vle_unzip_all(struct super_block *sb,
 	}
 }
 
-static void z_erofs_vle_unzip_wq(struct work_struct *work)
+static void z_erofs_vle_unzip_iosb(struct z_erofs_unzip_io_sb *iosb)
 {
-	struct z_erofs_unzip_io_sb *iosb =
-		container_of(work, struct z_erofs_unzip_io_sb, io.u.work);
 	LIST_HEAD(pagepool);
 
 	DBG_BUGON(iosb->io.head == Z_EROFS_PCLUSTER_TAIL_CLOSED);
@@ -988,6 +1087,60 @@ static void z_erofs_vle_unzip_wq(struct work_struct *work)
 	kvfree(iosb);
 }
 
+static void z_erofs_vle_unzip_wq(struct work_struct *work)
+{
+	z_erofs_vle_unzip_iosb(container_of(work, struct z_erofs_unzip_io_sb,
+					    io.u.work));
+}
+
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+static void z_erofs_vle_unzip_kthread(struct kthread_work *work)
+{
+	z_erofs_vle_unzip_iosb(container_of(work, struct z_erofs_unzip_io_sb,
+					    io.u.kthread_work));
+}
+#endif
+
+/* all bios of a background jobqueue have completed */
+static void z_erofs_vle_unzip_bg(struct z_erofs_unzip_io_sb *iosb)
+{
+	struct erofs_sb_info *const sbi = EROFS_SB(iosb->sb);
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+	struct kthread_worker *worker;
+#endif
+
+	/*
+	 * Save the context switch if the last bio completed in process
+	 * context (e.g. from dm-verity or loop workers) or before the
+	 * submitter got here.
+	 */
+	if (in_task() && !irqs_disabled() && !rcu_read_lock_any_held()) {
+		z_erofs_vle_unzip_iosb(iosb);
+		return;
+	}
+
+	/* small readaheads had better wait and decompress by themselves */
+	if (READ_ONCE(sbi->sync_decompress) == EROFS_SYNC_DECOMPRESS_AUTO)
+		WRITE_ONCE(sbi->sync_decompress,
+			   EROFS_SYNC_DECOMPRESS_FORCE_ON);
+
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+	rcu_read_lock();
+	worker = rcu_dereference(per_cpu(z_erofs_pcpu_workers,
+					 raw_smp_processor_id()));
+	if (worker) {
+		kthread_init_work(&iosb->io.u.kthread_work,
+				  z_erofs_vle_unzip_kthread);
+		kthread_queue_work(worker, &iosb->io.u.kthread_work);
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+#endif
+	INIT_WORK(&iosb->io.u.work, z_erofs_vle_unzip_wq);
+	queue_work(z_erofs_workqueue, &iosb->io.u.work);
+}
+
 static struct page *pickup_page_for_submission(struct z_erofs_pcluster *pcl,
 					       unsigned int nr,
 					       struct list_head *pagepool,
@@ -1133,7 +1286,6 @@ static struct z_erofs_unzip_io *jobqueue_init(struct super_block *sb,
 	/* initialize fields in the allocated descriptor */
 	io = &iosb->io;
 	iosb->sb = sb;
-	INIT_WORK(&io->u.work, z_erofs_vle_unzip_wq);
 out:
 	io->head = Z_EROFS_PCLUSTER_TAIL_CLOSED;
 	return io;
@@ -1361,7 +1513,9 @@ static int z_erofs_vle_normalaccess_readpage(struct file *file,
 static bool should_decompress_synchronously(struct erofs_sb_info *sbi,
 					    unsigned int nr)
 {
-	return nr <= sbi->max_sync_decompress_pages;
+	return READ_ONCE(sbi->sync_decompress) !=
+		EROFS_SYNC_DECOMPRESS_FORCE_OFF &&
+		nr <= READ_ONCE(sbi->max_sync_decompress_pages);
 }
 
 static int z_erofs_vle_normalaccess_readpages(struct file *filp,
@@ -1373,6 +1527,8 @@ static int z_erofs_vle_normalaccess_readpages(struct file *filp,
 	struct erofs_sb_info *const sbi = EROFS_I_SB(inode);
 
 	bool sync = should_decompress_synchronously(sbi, nr_pages);
+	const bool force_sync = READ_ONCE(sbi->sync_decompress) ==
+		EROFS_SYNC_DECOMPRESS_FORCE_ON;
 	struct z_erofs_decompress_frontend f = DECOMPRESS_FRONTEND_INIT(inode);
 	gfp_t gfp = mapping_gfp_constraint(mapping, GFP_KERNEL);
 	struct page *head = NULL;
@@ -1392,9 +1548,11 @@ static int z_erofs_vle_normalaccess_readpages(struct file *filp,
 		/*
 		 * A pure asynchronous readahead is indicated if
 		 * a PG_readahead marked page is hitted at first.
-		 * Let's also do asynchronous decompression for this case.
+		 * Let's also do asynchronous decompression for this case,
+		 * unless the decompression workers are known to be slow.
 		 */
-		sync &= !(PageReadahead(page) && !head);
+		if (!force_sync)
+			sync &= !(PageReadahead(page) && !head);
 
 		if (add_to_page_cache_lru(page, mapping, page->index, gfp)) {
 			list_add(&page->lru, &pagepool);
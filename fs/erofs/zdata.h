@@ -91,6 +91,9 @@ struct z_erofs_unzip_io {
 	union {
 		wait_queue_head_t wait;
 		struct work_struct work;
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+		struct kthread_work kthread_work;
+#endif
 	} u;
 };
 
@@ -26,6 +26,35 @@ int z_erofs_fill_inode(struct inode *inode)
 	return 0;
 }
 
+static int z_erofs_check_algorithm(struct inode *inode, unsigned int alg)
+{
+	struct super_block *const sb = inode->i_sb;
+	const erofs_nid_t nid = EROFS_I(inode)->nid;
+
+	if (alg >= Z_EROFS_COMPRESSION_MAX || !z_erofs_algorithm_name(alg)) {
+		erofs_err(sb, "unknown compression format %u for nid %llu, please upgrade kernel",
+			  alg, nid);
+		return -EOPNOTSUPP;
+	}
+
+	if (!z_erofs_algorithm_supported(alg)) {
+		erofs_err(sb, "compression format %s for nid %llu is not enabled in this kernel",
+			  z_erofs_algorithm_name(alg), nid);
+		return -EOPNOTSUPP;
+	}
+
+	/* only LZ4 streams can be told apart from unpadded clusters */
+	if (alg != Z_EROFS_COMPRESSION_LZ4 &&
+	    (~EROFS_SB(sb)->feature_incompat &
+	     (EROFS_FEATURE_INCOMPAT_LZ4_0PADDING |
+	      EROFS_FEATURE_INCOMPAT_STREAM_ALGS))) {
+		erofs_err(sb, "compression format %s for nid %llu needs 0padding and stream_algs",
+			  z_erofs_algorithm_name(alg), nid);
+		return -EFSCORRUPTED;
+	}
+	return 0;
+}
+
 static int fill_inode_lazy(struct inode *inode)
 {
 	struct erofs_inode *const vi = EROFS_I(inode);
@@ -63,26 +92,27 @@ static int fill_inode_lazy(struct inode *inode)
 	vi->z_algorithmtype[0] = h->h_algorithmtype & 15;
 	vi->z_algorithmtype[1] = h->h_algorithmtype >> 4;
 
-	if (vi->z_algorithmtype[0] >= Z_EROFS_COMPRESSION_MAX) {
-		erofs_err(sb, "unknown compression format %u for nid %llu, please upgrade kernel",
-			  vi->z_algorithmtype[0], vi->nid);
-		err = -EOPNOTSUPP;
+	err = z_erofs_check_algorithm(inode, vi->z_algorithmtype[0]);
+	if (!err)
+		err = z_erofs_check_algorithm(inode, vi->z_algorithmtype[1]);
+	if (err)
 		goto unmap_done;
-	}
 
 	vi->z_logical_clusterbits = LOG_BLOCK_SIZE + (h->h_clusterbits & 7);
 	vi->z_physical_clusterbits[0] = vi->z_logical_clusterbits +
 					((h->h_clusterbits >> 3) & 3);
+	vi->z_physical_clusterbits[1] = vi->z_logical_clusterbits +
+					((h->h_clusterbits >> 5) & 7);
 
-	if (vi->z_physical_clusterbits[0] != LOG_BLOCK_SIZE) {
-		erofs_err(sb, "unsupported physical clusterbits %u for nid %llu, please upgrade kernel",
-			  vi->z_physical_clusterbits[0], vi->nid);
+	if (vi->z_physical_clusterbits[0] != LOG_BLOCK_SIZE ||
+	    vi->z_physical_clusterbits[1] != LOG_BLOCK_SIZE) {
+		erofs_err(sb, "unsupported physical clusterbits %u/%u for nid %llu, please upgrade kernel",
+			  vi->z_physical_clusterbits[0],
+			  vi->z_physical_clusterbits[1], vi->nid);
 		err = -EOPNOTSUPP;
 		goto unmap_done;
 	}
 
-	vi->z_physical_clusterbits[1] = vi->z_logical_clusterbits +
-					((h->h_clusterbits >> 5) & 7);
 	set_bit(EROFS_I_Z_INITED_BIT, &vi->flags);
 unmap_done:
 	kunmap_atomic(kaddr);
@@ -170,6 +200,7 @@ static int vle_legacy_load_cluster_from_disk(struct z_erofs_maprecorder *m,
 		break;
 	case Z_EROFS_VLE_CLUSTER_TYPE_PLAIN:
 	case Z_EROFS_VLE_CLUSTER_TYPE_HEAD:
+	case Z_EROFS_VLE_CLUSTER_TYPE_HEAD2:
 		m->clusterofs = le16_to_cpu(di->di_clusterofs);
 		m->pblk = le32_to_cpu(di->di_u.blkaddr);
 		break;
@@ -361,6 +392,7 @@ static int vle_extent_lookback(struct z_erofs_maprecorder *m,
 		map->m_flags &= ~EROFS_MAP_ZIPPED;
 		/* fallthrough */
 	case Z_EROFS_VLE_CLUSTER_TYPE_HEAD:
+	case Z_EROFS_VLE_CLUSTER_TYPE_HEAD2:
 		map->m_la = (lcn << lclusterbits) | m->clusterofs;
 		break;
 	default:
@@ -418,6 +450,7 @@ int z_erofs_map_blocks_iter(struct inode *inode,
 			map->m_flags &= ~EROFS_MAP_ZIPPED;
 		/* fallthrough */
 	case Z_EROFS_VLE_CLUSTER_TYPE_HEAD:
+	case Z_EROFS_VLE_CLUSTER_TYPE_HEAD2:
 		if (endoff >= m.clusterofs) {
 			map->m_la = (m.lcn << lclusterbits) | m.clusterofs;
 			break;
@@ -448,6 +481,11 @@ int z_erofs_map_blocks_iter(struct inode *inode,
 		goto unmap_out;
 	}
 
+	/* m.type is the type of the head lcluster of the extent by now */
+	map->m_algorithmformat = vi->z_algorithmtype[0];
+	if (m.type == Z_EROFS_VLE_CLUSTER_TYPE_HEAD2)
+		map->m_algorithmformat = vi->z_algorithmtype[1];
+
 	map->m_llen = end - map->m_la;
 	map->m_plen = 1 << lclusterbits;
 	map->m_pa = blknr_to_addr(m.pblk);
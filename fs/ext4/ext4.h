@@ -142,6 +142,10 @@ enum SHIFT_DIRECTION {
 #define EXT4_MB_USE_ROOT_BLOCKS		0x1000
 /* Use blocks from reserved pool */
 #define EXT4_MB_USE_RESERVED		0x2000
+/* cr0 group was picked from the largest free order lists */
+#define EXT4_MB_CR0_OPTIMIZED		0x4000
+/* cr1 group was picked from the average fragment size lists */
+#define EXT4_MB_CR1_OPTIMIZED		0x8000
 
 struct ext4_allocation_request {
 	/* target inode for block we're allocating */
@@ -922,6 +926,7 @@ do {									       \
 #endif /* defined(__KERNEL__) || defined(__linux__) */
 
 #include "extents_status.h"
+#include "fast_commit.h"
 
 /*
  * Lock subclasses for i_data_sem in the ext4_inode_info structure.
@@ -1084,6 +1089,14 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/*
+	 * Logical blocks whose mapping changed in transaction i_fc_tid, to
+	 * be logged by a fast commit.  Protected by i_data_sem.
+	 */
+	tid_t i_fc_tid;
+	ext4_lblk_t i_fc_lblk_start;
+	ext4_lblk_t i_fc_lblk_end;
+
 #ifdef CONFIG_QUOTA
 	struct dquot *i_dquot[MAXQUOTAS];
 #endif
@@ -1170,6 +1183,12 @@ struct ext4_inode_info {
 #define EXT4_MOUNT2_EXPLICIT_JOURNAL_CHECKSUM	0x00000008 /* User explicitly
 						specified journal checksum */
 
+#define EXT4_MOUNT2_JOURNAL_FAST_COMMIT	0x00000010 /* Fast commits */
+#define EXT4_MOUNT2_MB_OPTIMIZE_SCAN	0x00000020 /* Pick allocation groups
+						      from free space lists */
+#define EXT4_MOUNT2_EXPLICIT_MB_OPTIMIZE_SCAN	0x00000040 /* User explicitly
+						set mb_optimize_scan */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1476,6 +1495,7 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_max_linear_groups;
 	unsigned int s_max_dir_size_kb;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
@@ -1489,6 +1509,12 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_groups_scanned;	/* groups scanned */
+	atomic64_t s_bal_cX_hits[4];	/* allocations done at each cr */
+	atomic64_t s_bal_cX_groups_considered[4];
+	atomic64_t s_bal_cX_failed[4];	/* cr passes that found nothing */
+	atomic_t s_bal_cr0_bad_suggestions;
+	atomic_t s_bal_cr1_bad_suggestions;
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -1500,6 +1526,16 @@ struct ext4_sb_info {
 	/* locality groups */
 	struct ext4_locality_group __percpu *s_locality_groups;
 
+	/*
+	 * Initialized groups with free space, by order of their largest
+	 * free extent and by order of their average free extent size, for
+	 * mb_optimize_scan.  Each list has its own lock.
+	 */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+	struct list_head *s_mb_avg_fragment_size;
+	rwlock_t *s_mb_avg_fragment_size_locks;
+
 	/* for write statistics */
 	unsigned long s_sectors_written_start;
 	u64 s_kbytes_written;
@@ -1554,6 +1590,16 @@ struct ext4_sb_info {
 	 */
 	struct percpu_rw_semaphore s_writepages_rwsem;
 	struct dax_device *s_daxdev;
+
+	/* Fast commits */
+	spinlock_t s_fc_lock;
+	struct list_head s_fc_dentry_q;	/* links/unlinks to fast commit */
+	bool s_fc_ineligible;		/* s_fc_ineligible_tid needs a full
+					   commit */
+	tid_t s_fc_ineligible_tid;
+	int s_fc_ineligible_ops;	/* ineligible ops in progress */
+	struct ext4_fc_stats s_fc_stats;
+	struct ext4_fc_replay_state s_fc_replay;
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1605,6 +1651,7 @@ enum {
 	EXT4_STATE_EXT_PRECACHED,	/* extents have been precached */
 	EXT4_STATE_LUSTRE_EA_INODE,	/* Lustre-style ea_inode */
 	EXT4_STATE_VERITY_IN_PROGRESS,	/* building fs-verity Merkle tree */
+	EXT4_STATE_FC_RANGE,		/* i_fc_lblk_* are valid */
 };
 
 #define EXT4_INODE_BIT_FNS(name, field, offset)				\
@@ -1698,6 +1745,7 @@ static inline bool ext4_verity_in_progress(struct inode *inode)
 #define EXT4_FEATURE_COMPAT_RESIZE_INODE	0x0010
 #define EXT4_FEATURE_COMPAT_DIR_INDEX		0x0020
 #define EXT4_FEATURE_COMPAT_SPARSE_SUPER2	0x0200
+#define EXT4_FEATURE_COMPAT_FAST_COMMIT		0x8000 /* not mainline's */
 
 #define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
 #define EXT4_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
@@ -1799,6 +1847,7 @@ EXT4_FEATURE_COMPAT_FUNCS(xattr,		EXT_ATTR)
 EXT4_FEATURE_COMPAT_FUNCS(resize_inode,		RESIZE_INODE)
 EXT4_FEATURE_COMPAT_FUNCS(dir_index,		DIR_INDEX)
 EXT4_FEATURE_COMPAT_FUNCS(sparse_super2,	SPARSE_SUPER2)
+EXT4_FEATURE_COMPAT_FUNCS(fast_commit,		FAST_COMMIT)
 
 EXT4_FEATURE_RO_COMPAT_FUNCS(sparse_super,	SPARSE_SUPER)
 EXT4_FEATURE_RO_COMPAT_FUNCS(large_file,	LARGE_FILE)
@@ -2519,6 +2568,24 @@ extern int ext4_check_all_de(struct inode *dir, struct buffer_head *bh,
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *sb, journal_t *journal);
+extern void ext4_fc_init_inode(struct inode *inode);
+extern void ext4_fc_del(struct inode *inode);
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				ext4_lblk_t start, ext4_lblk_t len);
+extern void ext4_fc_track_link(handle_t *handle, struct inode *dir,
+			       struct dentry *dentry);
+extern void ext4_fc_track_unlink(handle_t *handle, struct inode *dir,
+				 struct dentry *dentry);
+extern void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle);
+extern void ext4_fc_start_ineligible(struct super_block *sb);
+extern void ext4_fc_stop_ineligible(struct super_block *sb);
+extern int ext4_fc_commit(struct inode *inode, tid_t commit_tid);
+extern int ext4_fc_replay(struct super_block *sb);
+extern void ext4_fc_destroy(struct super_block *sb);
+extern int ext4_seq_fc_info_show(struct seq_file *seq, void *v);
+
 /* hash.c */
 extern int ext4fs_dirhash(const struct inode *dir, const char *name, int len,
 			  struct dx_hash_info *hinfo);
@@ -2551,6 +2618,7 @@ extern void ext4_end_bitmap_read(struct buffer_head *bh, int uptodate);
 
 /* mballoc.c */
 extern const struct seq_operations ext4_mb_seq_groups_ops;
+extern int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset);
 extern long ext4_mb_stats;
 extern long ext4_mb_max_to_scan;
 extern int ext4_mb_init(struct super_block *);
@@ -2684,6 +2752,10 @@ extern int ext4_generic_delete_entry(handle_t *handle,
 				     int buf_size,
 				     int csum_size);
 extern bool ext4_empty_dir(struct inode *inode);
+extern int ext4_replay_link(struct inode *dir, struct inode *inode,
+			    const struct qstr *name);
+extern int ext4_replay_unlink(struct inode *dir, struct inode *inode,
+			      const struct qstr *name);
 
 /* resize.c */
 extern void ext4_kvfree_array_rcu(void *to_free);
@@ -3020,7 +3092,12 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_grpblk_t	bb_avg_fragment_size_order;	/* order of average
+							   fragment in BG */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct list_head bb_largest_free_order_node;
+	struct list_head bb_avg_fragment_size_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
@@ -4899,14 +4899,19 @@ long ext4_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
 	if (ret)
 		return ret;
 
-	if (mode & FALLOC_FL_COLLAPSE_RANGE)
-		return ext4_collapse_range(inode, offset, len);
-
-	if (mode & FALLOC_FL_INSERT_RANGE)
-		return ext4_insert_range(inode, offset, len);
-
-	if (mode & FALLOC_FL_ZERO_RANGE)
-		return ext4_zero_range(file, offset, len, mode);
+	/* Fast commits can't describe shifted or zeroed extents */
+	if (mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE |
+		    FALLOC_FL_ZERO_RANGE)) {
+		ext4_fc_start_ineligible(inode->i_sb);
+		if (mode & FALLOC_FL_COLLAPSE_RANGE)
+			ret = ext4_collapse_range(inode, offset, len);
+		else if (mode & FALLOC_FL_INSERT_RANGE)
+			ret = ext4_insert_range(inode, offset, len);
+		else
+			ret = ext4_zero_range(file, offset, len, mode);
+		ext4_fc_stop_ineligible(inode->i_sb);
+		return ret;
+	}
 
 	trace_ext4_fallocate_enter(inode, offset, len, mode);
 	lblk = offset >> blkbits;
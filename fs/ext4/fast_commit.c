@@ -0,0 +1,1385 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fs/ext4/fast_commit.c
+ *
+ * Fast commits: fsync without a full jbd2 commit
+ *
+ * A full commit writes every metadata block the running transaction has
+ * touched, plus a descriptor and a commit block, and fsync has to wait for
+ * all of it.  With the fast_commit feature, fsync instead logs a compact
+ * description of what it needs into the fast commit area at the end of the
+ * journal: the links and unlinks done by the running transaction, the
+ * changed block mappings of the file being synced and its inode.  This is
+ * usually a single block written with one FUA request.
+ *
+ * Block mappings are tracked per inode, as the range of logical blocks
+ * whose mapping changed in the running transaction (ext4_fc_track_range()).
+ * At commit time the current mapping of that range is logged, so a range
+ * logged twice simply converges on the latest state.  Operations that are
+ * not described by the fast commit format (renames, directory creation,
+ * xattrs, resizing, ...) mark the running transaction ineligible, and
+ * fsync then falls back to a full commit until that transaction is done.
+ *
+ * Recovery runs the normal jbd2 replay first.  The fast commits of the
+ * transaction that was running at the time of the crash are then checked
+ * (ext4_fc_replay_scan()) and applied once the filesystem is mounted
+ * (ext4_fc_replay()), with regular transactions.
+ */
+
+#include <linux/blkdev.h>
+#include <linux/buffer_head.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+
+static inline bool ext4_fc_enabled(struct super_block *sb)
+{
+	return test_opt2(sb, JOURNAL_FAST_COMMIT);
+}
+
+void ext4_fc_init_inode(struct inode *inode)
+{
+	ext4_clear_inode_state(inode, EXT4_STATE_FC_RANGE);
+	EXT4_I(inode)->i_fc_lblk_start = 0;
+	EXT4_I(inode)->i_fc_lblk_end = 0;
+}
+
+/*
+ * Tracking
+ */
+
+static void __ext4_fc_mark_ineligible(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!sbi->s_fc_ineligible || tid_gt(tid, sbi->s_fc_ineligible_tid))
+		sbi->s_fc_ineligible_tid = tid;
+	sbi->s_fc_ineligible = true;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Make fsync fall back to full commits until the transaction of @handle
+ * has committed.  Without a handle, the running transaction is used,
+ * which must then include the changes being described.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	tid_t tid;
+
+	if (!ext4_fc_enabled(sb))
+		return;
+
+	if (ext4_handle_valid(handle)) {
+		tid = handle->h_transaction->t_tid;
+	} else {
+		read_lock(&journal->j_state_lock);
+		if (journal->j_running_transaction)
+			tid = journal->j_running_transaction->t_tid;
+		else
+			tid = journal->j_transaction_sequence;
+		read_unlock(&journal->j_state_lock);
+	}
+	__ext4_fc_mark_ineligible(sb, tid);
+}
+
+/*
+ * Bracket an operation that may span several transactions and can't be
+ * fast committed, such as a resize.
+ */
+void ext4_fc_start_ineligible(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!ext4_fc_enabled(sb))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_ineligible_ops++;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+void ext4_fc_stop_ineligible(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!ext4_fc_enabled(sb))
+		return;
+
+	ext4_fc_mark_ineligible(sb, NULL);
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_ineligible_ops--;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Record that the mapping of blocks [@start, @start + @len) of @inode
+ * changed in the transaction of @handle.  Called with i_data_sem held for
+ * writing.
+ */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t start, ext4_lblk_t len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	ext4_lblk_t end = start + len - 1;
+	tid_t tid;
+
+	if (!ext4_fc_enabled(inode->i_sb) || !ext4_handle_valid(handle) ||
+	    !S_ISREG(inode->i_mode) || !len)
+		return;
+
+	tid = handle->h_transaction->t_tid;
+	if (!ext4_test_inode_state(inode, EXT4_STATE_FC_RANGE) ||
+	    ei->i_fc_tid != tid) {
+		ei->i_fc_tid = tid;
+		ei->i_fc_lblk_start = start;
+		ei->i_fc_lblk_end = end;
+		ext4_set_inode_state(inode, EXT4_STATE_FC_RANGE);
+		return;
+	}
+	ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, start);
+	ei->i_fc_lblk_end = max(ei->i_fc_lblk_end, end);
+}
+
+static void ext4_fc_track_dentry(handle_t *handle, struct inode *dir,
+				 struct dentry *dentry, int op)
+{
+	struct super_block *sb = dir->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct inode *inode = d_inode(dentry);
+	struct ext4_fc_dentry_update *fcd;
+
+	if (!ext4_fc_enabled(sb) || !ext4_handle_valid(handle))
+		return;
+
+	/* Replay looks names up in plaintext, on regular files only */
+	if (!S_ISREG(inode->i_mode) || IS_ENCRYPTED(dir) ||
+	    IS_CASEFOLDED(dir)) {
+		ext4_fc_mark_ineligible(sb, handle);
+		return;
+	}
+
+	fcd = kmalloc(sizeof(*fcd) + dentry->d_name.len, GFP_NOFS);
+	if (!fcd) {
+		ext4_fc_mark_ineligible(sb, handle);
+		return;
+	}
+	fcd->fcd_tid = handle->h_transaction->t_tid;
+	fcd->fcd_op = op;
+	fcd->fcd_parent = dir->i_ino;
+	fcd->fcd_ino = inode->i_ino;
+	fcd->fcd_name_len = dentry->d_name.len;
+	memcpy(fcd->fcd_name, dentry->d_name.name, dentry->d_name.len);
+
+	spin_lock(&sbi->s_fc_lock);
+	list_add_tail(&fcd->fcd_list, &sbi->s_fc_dentry_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+void ext4_fc_track_link(handle_t *handle, struct inode *dir,
+			struct dentry *dentry)
+{
+	ext4_fc_track_dentry(handle, dir, dentry, EXT4_FC_TAG_LINK);
+}
+
+void ext4_fc_track_unlink(handle_t *handle, struct inode *dir,
+			  struct dentry *dentry)
+{
+	ext4_fc_track_dentry(handle, dir, dentry, EXT4_FC_TAG_UNLINK);
+}
+
+/*
+ * Called when @inode is evicted.  The ranges it tracked would be lost, so
+ * a later fsync of the inode read back from disk must do a full commit.
+ * Unlinked inodes don't matter, their blocks go away anyway.
+ */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+	tid_t commit_sequence;
+
+	if (!ext4_fc_enabled(inode->i_sb) || !inode->i_nlink ||
+	    !ext4_test_inode_state(inode, EXT4_STATE_FC_RANGE))
+		return;
+
+	read_lock(&journal->j_state_lock);
+	commit_sequence = journal->j_commit_sequence;
+	read_unlock(&journal->j_state_lock);
+	if (tid_gt(ei->i_fc_tid, commit_sequence))
+		__ext4_fc_mark_ineligible(inode->i_sb, ei->i_fc_tid);
+}
+
+static void ext4_fc_free_dentries(struct list_head *head)
+{
+	struct ext4_fc_dentry_update *fcd, *tmp;
+
+	list_for_each_entry_safe(fcd, tmp, head, fcd_list) {
+		list_del(&fcd->fcd_list);
+		kfree(fcd);
+	}
+}
+
+/* jbd2 callback: transaction @tid has been fully committed */
+static void ext4_fc_cleanup(journal_t *journal, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(journal->j_private);
+	struct ext4_fc_dentry_update *fcd, *tmp;
+	LIST_HEAD(done);
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(fcd, tmp, &sbi->s_fc_dentry_q, fcd_list)
+		if (!tid_gt(fcd->fcd_tid, tid))
+			list_move_tail(&fcd->fcd_list, &done);
+	if (sbi->s_fc_ineligible && !tid_gt(sbi->s_fc_ineligible_tid, tid))
+		sbi->s_fc_ineligible = false;
+	spin_unlock(&sbi->s_fc_lock);
+
+	ext4_fc_free_dentries(&done);
+}
+
+/*
+ * Commit
+ */
+
+struct ext4_fc_writer {
+	struct super_block *sb;
+	journal_t *journal;
+	struct buffer_head *bh;		/* block being filled, locked */
+	int off;			/* first free byte in bh */
+	int nblks;			/* blocks used by this fast commit */
+	u32 crc;
+};
+
+static void ext4_fc_submit_bh(struct ext4_fc_writer *w, bool is_tail)
+{
+	struct buffer_head *bh = w->bh;
+	int write_flags = REQ_SYNC;
+
+	/*
+	 * Every block is written through to stable storage, and the tail also
+	 * flushes the data the fast commit depends on.
+	 */
+	if (w->journal->j_flags & JBD2_BARRIER)
+		write_flags |= is_tail ? REQ_PREFLUSH | REQ_FUA : REQ_FUA;
+
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(REQ_OP_WRITE, write_flags, bh);
+	w->bh = NULL;
+}
+
+/* Pad out and submit the current block, then start the next one */
+static int ext4_fc_next_block(struct ext4_fc_writer *w)
+{
+	int blocksize = w->journal->j_blocksize;
+	struct buffer_head *bh;
+	struct ext4_fc_tl tl;
+	int ret;
+
+	if (w->bh) {
+		if (w->off < blocksize) {
+			int pad = blocksize - w->off - sizeof(tl);
+
+			tl.fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+			tl.fc_len = cpu_to_le16(pad);
+			memcpy(w->bh->b_data + w->off, &tl, sizeof(tl));
+			memset(w->bh->b_data + w->off + sizeof(tl), 0, pad);
+		}
+		w->crc = ext4_chksum(EXT4_SB(w->sb), w->crc, w->bh->b_data,
+				     blocksize);
+		ext4_fc_submit_bh(w, false);
+	}
+
+	ret = jbd2_fc_get_buf(w->journal, &bh);
+	if (ret)
+		return ret;
+	lock_buffer(bh);
+	w->bh = bh;
+	w->off = 0;
+	w->nblks++;
+	return 0;
+}
+
+/* Make room for a tag with a value of @len bytes */
+static int ext4_fc_reserve(struct ext4_fc_writer *w, int len)
+{
+	if (!w->bh || w->off + sizeof(struct ext4_fc_tl) + len >
+		      w->journal->j_blocksize)
+		return ext4_fc_next_block(w);
+	return 0;
+}
+
+/* Append the tag @tl, followed by its value */
+static int ext4_fc_add_tag(struct ext4_fc_writer *w, struct ext4_fc_tl *tl)
+{
+	int len = sizeof(*tl) + le16_to_cpu(tl->fc_len);
+	int ret;
+
+	ret = ext4_fc_reserve(w, len - sizeof(*tl));
+	if (ret)
+		return ret;
+
+	memcpy(w->bh->b_data + w->off, tl, len);
+	w->off += len;
+	return 0;
+}
+
+static int ext4_fc_write_tail(struct ext4_fc_writer *w, tid_t tid)
+{
+	struct ext4_fc_tail tail;
+	struct ext4_fc_tl tl;
+	u8 *dst;
+	int ret;
+
+	ret = ext4_fc_reserve(w, sizeof(tail));
+	if (ret)
+		return ret;
+
+	tl.fc_tag = cpu_to_le16(EXT4_FC_TAG_TAIL);
+	tl.fc_len = cpu_to_le16(sizeof(tail));
+	tail.fc_tid = cpu_to_le32(tid);
+	dst = w->bh->b_data + w->off;
+	memcpy(dst, &tl, sizeof(tl));
+	memcpy(dst + sizeof(tl), &tail.fc_tid, sizeof(tail.fc_tid));
+	w->off += sizeof(tl) + sizeof(tail.fc_tid);
+	tail.fc_crc = cpu_to_le32(ext4_chksum(EXT4_SB(w->sb), w->crc,
+					      w->bh->b_data, w->off));
+	memcpy(w->bh->b_data + w->off, &tail.fc_crc, sizeof(tail.fc_crc));
+	w->off += sizeof(tail.fc_crc);
+	memset(w->bh->b_data + w->off, 0, w->journal->j_blocksize - w->off);
+
+	ext4_fc_submit_bh(w, true);
+	return 0;
+}
+
+/*
+ * Tags of a fast commit, gathered while updates are locked and written out
+ * once they are unlocked again.
+ */
+struct ext4_fc_snapshot {
+	u8 *buf;
+	int len;
+	int size;
+	int max;			/* what fits in the fast commit area */
+};
+
+/* Append a tag whose value is @val followed by @val2 */
+static int ext4_fc_snap_tag(struct ext4_fc_snapshot *snap, u16 tag,
+			    const void *val, int len,
+			    const void *val2, int len2)
+{
+	int total = round_up(len + len2, 4);
+	int need = snap->len + sizeof(struct ext4_fc_tl) + total;
+	struct ext4_fc_tl tl;
+	u8 *dst;
+
+	if (need > snap->max)
+		return -ENOSPC;
+	if (need > snap->size) {
+		int size = min(max(need, 2 * snap->size), snap->max);
+		u8 *buf = krealloc(snap->buf, size, GFP_NOFS);
+
+		if (!buf)
+			return -ENOMEM;
+		snap->buf = buf;
+		snap->size = size;
+	}
+
+	tl.fc_tag = cpu_to_le16(tag);
+	tl.fc_len = cpu_to_le16(total);
+	dst = snap->buf + snap->len;
+	memcpy(dst, &tl, sizeof(tl));
+	dst += sizeof(tl);
+	memcpy(dst, val, len);
+	if (len2)
+		memcpy(dst + len, val2, len2);
+	memset(dst + len + len2, 0, total - len - len2);
+	snap->len = need;
+	return 0;
+}
+
+static int ext4_fc_snap_dentry(struct ext4_fc_snapshot *snap,
+			       struct ext4_fc_dentry_update *fcd)
+{
+	struct ext4_fc_dentry_info dinfo;
+
+	dinfo.fc_parent_ino = cpu_to_le32(fcd->fcd_parent);
+	dinfo.fc_ino = cpu_to_le32(fcd->fcd_ino);
+	return ext4_fc_snap_tag(snap, fcd->fcd_op, &dinfo, sizeof(dinfo),
+				fcd->fcd_name, fcd->fcd_name_len);
+}
+
+/*
+ * Log the current mapping of the blocks of @inode that changed in @tid,
+ * as added ranges and holes.
+ */
+static int ext4_fc_snap_ranges(struct ext4_fc_snapshot *snap,
+			       struct inode *inode, tid_t tid)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_fc_add_range add;
+	struct ext4_fc_del_range del;
+	struct ext4_map_blocks map;
+	ext4_lblk_t start, end;
+	int ret;
+
+	if (!ext4_test_inode_state(inode, EXT4_STATE_FC_RANGE) ||
+	    ei->i_fc_tid != tid)
+		return 0;
+
+	start = ei->i_fc_lblk_start;
+	end = ei->i_fc_lblk_end;
+	while (start <= end) {
+		map.m_lblk = start;
+		map.m_len = end - start + 1;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+
+		if (ret > 0) {
+			map.m_len = ret;
+			add.fc_ino = cpu_to_le32(inode->i_ino);
+			add.fc_lblk = cpu_to_le32(map.m_lblk);
+			add.fc_len = cpu_to_le32(map.m_len);
+			add.fc_flags = cpu_to_le32(
+				map.m_flags & EXT4_MAP_UNWRITTEN ?
+				EXT4_FC_RANGE_UNWRITTEN : 0);
+			add.fc_pblk = cpu_to_le64(map.m_pblk);
+			ret = ext4_fc_snap_tag(snap, EXT4_FC_TAG_ADD_RANGE,
+					       &add, sizeof(add), NULL, 0);
+		} else {
+			if (WARN_ON_ONCE(!map.m_len))
+				return -EFSCORRUPTED;
+			del.fc_ino = cpu_to_le32(inode->i_ino);
+			del.fc_lblk = cpu_to_le32(map.m_lblk);
+			del.fc_len = cpu_to_le32(map.m_len);
+			ret = ext4_fc_snap_tag(snap, EXT4_FC_TAG_DEL_RANGE,
+					       &del, sizeof(del), NULL, 0);
+		}
+		if (ret)
+			return ret;
+		if (end - start < map.m_len)
+			break;
+		start += map.m_len;
+	}
+	return 0;
+}
+
+static int ext4_fc_snap_inode(struct ext4_fc_snapshot *snap,
+			      struct inode *inode)
+{
+	struct ext4_fc_inode fc_inode;
+	struct ext4_iloc iloc;
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	fc_inode.fc_ino = cpu_to_le32(inode->i_ino);
+	ret = ext4_fc_snap_tag(snap, EXT4_FC_TAG_INODE, &fc_inode,
+			       sizeof(fc_inode), ext4_raw_inode(&iloc),
+			       EXT4_INODE_SIZE(inode->i_sb));
+	brelse(iloc.bh);
+	return ret;
+}
+
+/*
+ * Can @inode be fast committed right now?  Called with updates locked, so
+ * nothing can be changing under us.
+ */
+static bool ext4_fc_inode_eligible(struct inode *inode)
+{
+	struct address_space *mapping = inode->i_mapping;
+
+	if (S_ISDIR(inode->i_mode))
+		return true;
+	if (!S_ISREG(inode->i_mode))
+		return false;
+	if (!ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    ext4_has_inline_data(inode) || ext4_should_journal_data(inode))
+		return false;
+	/* A truncate in progress, the orphan list must stay in charge */
+	if (!list_empty(&EXT4_I(inode)->i_orphan))
+		return false;
+	/*
+	 * Blocks allocated for pages under writeback may not hold their data
+	 * yet, and without delalloc neither may those of dirty pages.
+	 */
+	if (mapping_tagged(mapping, PAGECACHE_TAG_WRITEBACK))
+		return false;
+	if (!test_opt(inode->i_sb, DELALLOC) &&
+	    mapping_tagged(mapping, PAGECACHE_TAG_DIRTY))
+		return false;
+	return true;
+}
+
+/*
+ * Gather the tags of a fast commit of @inode for @tid.  Called with updates
+ * locked, so that they describe a consistent state; the dentry updates
+ * logged are moved to @dentries.
+ */
+static int ext4_fc_snapshot(struct inode *inode, tid_t tid,
+			    struct ext4_fc_snapshot *snap,
+			    struct list_head *dentries)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_fc_dentry_update *fcd;
+	bool eligible;
+	int ret;
+
+	read_lock(&journal->j_state_lock);
+	eligible = journal->j_running_transaction &&
+		   journal->j_running_transaction->t_tid == tid;
+	read_unlock(&journal->j_state_lock);
+	if (!eligible || !ext4_fc_inode_eligible(inode))
+		return -EAGAIN;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (sbi->s_fc_ineligible || sbi->s_fc_ineligible_ops)
+		eligible = false;
+	else
+		list_splice_init(&sbi->s_fc_dentry_q, dentries);
+	spin_unlock(&sbi->s_fc_lock);
+	if (!eligible)
+		return -EAGAIN;
+
+	list_for_each_entry(fcd, dentries, fcd_list) {
+		ret = ext4_fc_snap_dentry(snap, fcd);
+		if (ret)
+			return ret;
+	}
+	if (S_ISREG(inode->i_mode)) {
+		ret = ext4_fc_snap_ranges(snap, inode, tid);
+		if (!ret)
+			ret = ext4_fc_snap_inode(snap, inode);
+	}
+	return ret;
+}
+
+/* Write the gathered tags and the tail to the fast commit area */
+static int ext4_fc_write_snapshot(struct ext4_fc_writer *w,
+				  struct ext4_fc_snapshot *snap, tid_t tid)
+{
+	struct ext4_fc_tl *tl;
+	int off = 0;
+	int ret;
+
+	while (off < snap->len) {
+		tl = (struct ext4_fc_tl *)(snap->buf + off);
+		ret = ext4_fc_add_tag(w, tl);
+		if (ret)
+			return ret;
+		off += sizeof(*tl) + le16_to_cpu(tl->fc_len);
+	}
+	return ext4_fc_write_tail(w, tid);
+}
+
+/*
+ * Do the fast commit itself.  Returns -EAGAIN, with nothing written, if a
+ * full commit is needed.
+ */
+static int ext4_fc_perform_commit(struct inode *inode, tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_fc_writer w = {
+		.sb = sb,
+		.journal = journal,
+		.crc = ~0,
+	};
+	struct ext4_fc_snapshot snap = {
+		.max = journal->j_fc_wbufsize * journal->j_blocksize,
+	};
+	LIST_HEAD(dentries);
+	int ret;
+
+	/*
+	 * Updates are only locked while the tags are gathered, the I/O is
+	 * done without blocking new handles.  Whoever holds the barrier
+	 * already, freeze or resize for instance, may be waiting for a full
+	 * commit, which in turn waits for us: leave it to that full commit.
+	 */
+	ret = jbd2_journal_trylock_updates(journal);
+	if (ret) {
+		ret = -EAGAIN;
+		goto out;
+	}
+	ret = ext4_fc_snapshot(inode, tid, &snap, &dentries);
+	jbd2_journal_unlock_updates(journal);
+	if (ret) {
+		/* Nothing written yet, a full commit will do */
+		ret = -EAGAIN;
+		goto out;
+	}
+
+	/* The tail only flushes the journal device */
+	if (journal->j_fs_dev != journal->j_dev &&
+	    (journal->j_flags & JBD2_BARRIER))
+		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+
+	ret = ext4_fc_write_snapshot(&w, &snap, tid);
+	if (ret) {
+		if (w.bh)
+			unlock_buffer(w.bh);
+		jbd2_fc_release_bufs(journal);
+	} else {
+		ret = jbd2_fc_wait_bufs(journal, w.nblks);
+	}
+out:
+	kfree(snap.buf);
+	if (!ret) {
+		ext4_fc_free_dentries(&dentries);
+		spin_lock(&sbi->s_fc_lock);
+		sbi->s_fc_stats.fc_num_blocks += w.nblks;
+		spin_unlock(&sbi->s_fc_lock);
+	} else {
+		/* Older than anything queued since, put them back in front */
+		spin_lock(&sbi->s_fc_lock);
+		list_splice(&dentries, &sbi->s_fc_dentry_q);
+		spin_unlock(&sbi->s_fc_lock);
+	}
+	return ret;
+}
+
+/**
+ * ext4_fc_commit - make the changes of a transaction to an inode durable
+ * @inode: inode being synced
+ * @commit_tid: transaction that holds the changes
+ *
+ * Does a fast commit when it can, and a full commit of @commit_tid
+ * otherwise.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = sbi->s_journal;
+	int ret;
+
+	if (!ext4_fc_enabled(sb) || is_journal_aborted(journal))
+		return jbd2_complete_transaction(journal, commit_tid);
+
+	ret = jbd2_fc_begin_commit(journal, commit_tid);
+	if (ret == -EALREADY)
+		return 0;
+	if (ret)
+		goto fallback;
+
+	ret = ext4_fc_perform_commit(inode, commit_tid);
+	/*
+	 * A failed fast commit may have left blocks that don't end with a
+	 * valid tail, replay would stop there and miss any later fast commit.
+	 */
+	if (ret && ret != -EAGAIN)
+		__ext4_fc_mark_ineligible(sb, commit_tid);
+	jbd2_fc_end_commit(journal);
+
+	if (!ret) {
+		spin_lock(&sbi->s_fc_lock);
+		sbi->s_fc_stats.fc_num_commits++;
+		spin_unlock(&sbi->s_fc_lock);
+		return 0;
+	}
+fallback:
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_stats.fc_fallbacks++;
+	spin_unlock(&sbi->s_fc_lock);
+	return jbd2_complete_transaction(journal, commit_tid);
+}
+
+/*
+ * Replay
+ */
+
+static int ext4_fc_tag_min_len(int tag)
+{
+	switch (tag) {
+	case EXT4_FC_TAG_ADD_RANGE:
+		return sizeof(struct ext4_fc_add_range);
+	case EXT4_FC_TAG_DEL_RANGE:
+		return sizeof(struct ext4_fc_del_range);
+	case EXT4_FC_TAG_LINK:
+	case EXT4_FC_TAG_UNLINK:
+		return sizeof(struct ext4_fc_dentry_info) + 1;
+	case EXT4_FC_TAG_INODE:
+		return sizeof(struct ext4_fc_inode) + EXT4_GOOD_OLD_INODE_SIZE;
+	case EXT4_FC_TAG_TAIL:
+		return sizeof(struct ext4_fc_tail);
+	case EXT4_FC_TAG_PAD:
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * jbd2 callback, called during recovery for each block of the fast commit
+ * area.  Saves the tags of the fast commits of @expected_tid that have a
+ * valid tail, for ext4_fc_replay() to apply after mount.
+ */
+static int ext4_fc_replay_scan(journal_t *journal, struct buffer_head *bh,
+			       int off, tid_t expected_tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(journal->j_private);
+	struct ext4_fc_replay_state *state = &sbi->s_fc_replay;
+	u8 *start = bh->b_data, *end = start + journal->j_blocksize, *cur;
+	struct ext4_fc_tail tail;
+	struct ext4_fc_tl tl;
+	int tag, len, min_len;
+	u32 crc;
+
+	if (off == 0) {
+		if (!state->fc_buf) {
+			state->fc_buf_size = (journal->j_fc_last -
+					      journal->j_fc_first) *
+					     journal->j_blocksize;
+			state->fc_buf = kvmalloc(state->fc_buf_size,
+						 GFP_KERNEL);
+			if (!state->fc_buf)
+				return -ENOMEM;
+		}
+		state->fc_valid_len = state->fc_len = 0;
+		state->fc_num_commits = 0;
+		state->fc_crc = ~0;
+	}
+
+	for (cur = start; cur + sizeof(tl) <= end;
+	     cur += sizeof(tl) + len) {
+		memcpy(&tl, cur, sizeof(tl));
+		tag = le16_to_cpu(tl.fc_tag);
+		len = le16_to_cpu(tl.fc_len);
+		min_len = ext4_fc_tag_min_len(tag);
+		if (min_len < 0 || len < min_len || len & 3 ||
+		    cur + sizeof(tl) + len > end)
+			return JBD2_FC_REPLAY_STOP;
+
+		switch (tag) {
+		case EXT4_FC_TAG_PAD:
+			state->fc_crc = ext4_chksum(sbi, state->fc_crc, start,
+						    journal->j_blocksize);
+			return JBD2_FC_REPLAY_CONTINUE;
+		case EXT4_FC_TAG_TAIL:
+			memcpy(&tail, cur + sizeof(tl), sizeof(tail));
+			crc = ext4_chksum(sbi, state->fc_crc, start,
+					  cur + sizeof(tl) +
+					  sizeof(tail.fc_tid) - start);
+			if (le32_to_cpu(tail.fc_tid) != expected_tid ||
+			    le32_to_cpu(tail.fc_crc) != crc ||
+			    state->fc_len + sizeof(tl) + len >
+			    state->fc_buf_size)
+				return JBD2_FC_REPLAY_STOP;
+			/* Kept to tell fast commits apart when replaying */
+			memcpy(state->fc_buf + state->fc_len, cur,
+			       sizeof(tl) + len);
+			state->fc_len += sizeof(tl) + len;
+			state->fc_valid_len = state->fc_len;
+			state->fc_num_commits++;
+			/* The next fast commit starts on the next block */
+			state->fc_crc = ~0;
+			return JBD2_FC_REPLAY_CONTINUE;
+		default:
+			if (state->fc_len + sizeof(tl) + len >
+			    state->fc_buf_size)
+				return JBD2_FC_REPLAY_STOP;
+			memcpy(state->fc_buf + state->fc_len, cur,
+			       sizeof(tl) + len);
+			state->fc_len += sizeof(tl) + len;
+			break;
+		}
+	}
+
+	state->fc_crc = ext4_chksum(sbi, state->fc_crc, start,
+				    journal->j_blocksize);
+	return JBD2_FC_REPLAY_CONTINUE;
+}
+
+static struct inode *ext4_fc_iget(struct super_block *sb, u32 ino)
+{
+	struct inode *inode = ext4_iget(sb, ino, EXT4_IGET_NORMAL);
+
+	if (IS_ERR(inode))
+		return inode;
+	if (!S_ISREG(inode->i_mode) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+		iput(inode);
+		return ERR_PTR(-EFSCORRUPTED);
+	}
+	return inode;
+}
+
+/* Remember that the replay took [@pblk, @pblk + @len) */
+static int ext4_fc_record_region(struct ext4_fc_replay_state *state,
+				 ext4_fsblk_t pblk, unsigned int len)
+{
+	struct ext4_fc_alloc_region *region;
+
+	if (state->fc_regions_used) {
+		region = &state->fc_regions[state->fc_regions_used - 1];
+		if (region->pblk + region->len == pblk) {
+			region->len += len;
+			return 0;
+		}
+	}
+
+	if (state->fc_regions_used == state->fc_regions_size) {
+		int size = state->fc_regions_size * 2 ?: 16;
+
+		region = krealloc(state->fc_regions, size * sizeof(*region),
+				  GFP_KERNEL);
+		if (!region)
+			return -ENOMEM;
+		state->fc_regions = region;
+		state->fc_regions_size = size;
+	}
+
+	region = &state->fc_regions[state->fc_regions_used++];
+	region->pblk = pblk;
+	region->len = len;
+	return 0;
+}
+
+/*
+ * How many blocks from @pblk on, up to @len, were taken by the replay
+ * already?  Zero if @pblk was not.
+ */
+static unsigned int ext4_fc_claimed_len(struct ext4_fc_replay_state *state,
+					ext4_fsblk_t pblk, unsigned int len)
+{
+	struct ext4_fc_alloc_region *region;
+	int i;
+
+	for (i = 0; i < state->fc_regions_used; i++) {
+		region = &state->fc_regions[i];
+		if (pblk >= region->pblk && pblk < region->pblk + region->len)
+			return min_t(ext4_fsblk_t, len,
+				     region->pblk + region->len - pblk);
+	}
+	return 0;
+}
+
+/*
+ * Take [@pblk, @pblk + @len) in the block bitmaps for @inode.  Blocks that
+ * are already in use must have been taken by the replay for an earlier tag
+ * of the same range; anything else would cross-link them.
+ */
+static int ext4_fc_claim_blocks(struct inode *inode, ext4_lblk_t lblk,
+				ext4_fsblk_t pblk, unsigned int len)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(inode->i_sb)->s_fc_replay;
+	struct ext4_allocation_request ar;
+	ext4_fsblk_t newblk;
+	handle_t *handle;
+	int ret = 0;
+
+	while (len) {
+		handle = ext4_journal_start(inode, EXT4_HT_MISC,
+				ext4_chunk_trans_blocks(inode, len));
+		if (IS_ERR(handle))
+			return PTR_ERR(handle);
+
+		memset(&ar, 0, sizeof(ar));
+		ar.inode = inode;
+		ar.logical = lblk;
+		ar.goal = pblk;
+		ar.len = len;
+		ar.flags = EXT4_MB_HINT_TRY_GOAL | EXT4_MB_HINT_GOAL_ONLY |
+			   EXT4_MB_HINT_MERGE | EXT4_MB_HINT_NOPREALLOC;
+		newblk = ext4_mb_new_blocks(handle, &ar, &ret);
+		ext4_journal_stop(handle);
+		if (ret == -ENOSPC) {
+			ar.len = ext4_fc_claimed_len(state, pblk, len);
+			if (!ar.len)
+				return -EFSCORRUPTED;
+			ret = 0;
+		} else if (ret) {
+			return ret;
+		} else if (newblk != pblk) {
+			return -EFSCORRUPTED;
+		} else {
+			ret = ext4_fc_record_region(state, pblk, ar.len);
+			if (ret)
+				return ret;
+		}
+		lblk += ar.len;
+		pblk += ar.len;
+		len -= ar.len;
+	}
+	return 0;
+}
+
+/* Drop the mapping of blocks [@lblk, @lblk + @len) of @inode */
+static int ext4_fc_remove_range(struct inode *inode, ext4_lblk_t lblk,
+				ext4_lblk_t len)
+{
+	int ret;
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ret = ext4_es_remove_extent(inode, lblk, len);
+	if (!ret)
+		ret = ext4_ext_remove_space(inode, lblk, lblk + len - 1);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	return ret;
+}
+
+/* Map blocks [@lblk, @lblk + @len) of @inode, a hole, to @pblk */
+static int ext4_fc_insert_range(struct inode *inode, ext4_lblk_t lblk,
+				ext4_fsblk_t pblk, unsigned int len,
+				bool unwritten)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent newex;
+	handle_t *handle;
+	int ret;
+
+	handle = ext4_journal_start(inode, EXT4_HT_MAP_BLOCKS,
+				    ext4_chunk_trans_blocks(inode, len));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	path = ext4_find_extent(inode, lblk, NULL, 0);
+	if (IS_ERR(path)) {
+		ret = PTR_ERR(path);
+		goto out;
+	}
+	newex.ee_block = cpu_to_le32(lblk);
+	newex.ee_len = cpu_to_le16(len);
+	ext4_ext_store_pblock(&newex, pblk);
+	if (unwritten)
+		ext4_ext_mark_unwritten(&newex);
+	ret = ext4_ext_insert_extent(handle, inode, &path, &newex, 0);
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	if (!ret)
+		ret = ext4_es_remove_extent(inode, lblk, len);
+out:
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (!ret)
+		ret = ext4_mark_inode_dirty(handle, inode);
+	ext4_journal_stop(handle);
+	return ret;
+}
+
+/*
+ * Walk the range of an add range tag against the current mapping of the
+ * inode.  In the claim pass, take the blocks that aren't mapped to the
+ * right place yet; afterwards, remap them.
+ */
+static int ext4_fc_replay_add_range(struct super_block *sb,
+				    struct ext4_fc_add_range *add, bool claim)
+{
+	ext4_lblk_t lblk = le32_to_cpu(add->fc_lblk);
+	unsigned int len = le32_to_cpu(add->fc_len);
+	ext4_fsblk_t pblk = le64_to_cpu(add->fc_pblk);
+	bool unwritten = le32_to_cpu(add->fc_flags) & EXT4_FC_RANGE_UNWRITTEN;
+	struct ext4_map_blocks map;
+	struct inode *inode;
+	int ret = 0;
+
+	if (!len || len > (unwritten ? EXT_UNWRITTEN_MAX_LEN :
+					EXT_INIT_MAX_LEN) ||
+	    !ext4_data_block_valid(EXT4_SB(sb), pblk, len))
+		return -EFSCORRUPTED;
+
+	inode = ext4_fc_iget(sb, le32_to_cpu(add->fc_ino));
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+
+	while (len) {
+		map.m_lblk = lblk;
+		map.m_len = len;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			break;
+		if (ret > 0)
+			map.m_len = ret;
+		map.m_len = min_t(unsigned int, map.m_len, len);
+
+		if (ret > 0 && map.m_pblk == pblk) {
+			/* Already there, written or not */
+			ret = 0;
+			if (!claim && !unwritten &&
+			    map.m_flags & EXT4_MAP_UNWRITTEN)
+				ret = ext4_convert_unwritten_extents(NULL,
+					inode, (loff_t)lblk << inode->i_blkbits,
+					(loff_t)map.m_len << inode->i_blkbits);
+		} else if (claim) {
+			ret = ext4_fc_claim_blocks(inode, lblk, pblk,
+						   map.m_len);
+		} else {
+			if (ret > 0)
+				ret = ext4_fc_remove_range(inode, lblk,
+							   map.m_len);
+			if (!ret)
+				ret = ext4_fc_insert_range(inode, lblk, pblk,
+							   map.m_len,
+							   unwritten);
+		}
+		if (ret)
+			break;
+		lblk += map.m_len;
+		pblk += map.m_len;
+		len -= map.m_len;
+	}
+
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_del_range(struct super_block *sb,
+				    struct ext4_fc_del_range *del)
+{
+	ext4_lblk_t lblk = le32_to_cpu(del->fc_lblk);
+	ext4_lblk_t len = le32_to_cpu(del->fc_len);
+	struct inode *inode;
+	int ret;
+
+	if (!len || lblk + len - 1 < lblk)
+		return -EFSCORRUPTED;
+
+	inode = ext4_fc_iget(sb, le32_to_cpu(del->fc_ino));
+	if (IS_ERR(inode))
+		return PTR_ERR(inode);
+	ret = ext4_fc_remove_range(inode, lblk, len);
+	iput(inode);
+	return ret;
+}
+
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *fc_inode, int len)
+{
+	struct ext4_inode *raw_inode;
+	struct ext4_inode_info *ei;
+	struct inode *inode;
+	handle_t *handle;
+	uid_t i_uid;
+	gid_t i_gid;
+	umode_t mode;
+	loff_t size;
+	int ret;
+
+	raw_inode = kzalloc(EXT4_INODE_SIZE(sb), GFP_KERNEL);
+	if (!raw_inode)
+		return -ENOMEM;
+	memcpy(raw_inode, fc_inode->fc_raw_inode,
+	       min_t(int, len, EXT4_INODE_SIZE(sb)));
+
+	inode = ext4_fc_iget(sb, le32_to_cpu(fc_inode->fc_ino));
+	if (IS_ERR(inode)) {
+		ret = PTR_ERR(inode);
+		goto out_free;
+	}
+	ei = EXT4_I(inode);
+
+	mode = le16_to_cpu(raw_inode->i_mode);
+	if ((mode ^ inode->i_mode) & S_IFMT) {
+		ret = -EFSCORRUPTED;
+		goto out_iput;
+	}
+
+	handle = ext4_journal_start(inode, EXT4_HT_INODE, 1);
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		goto out_iput;
+	}
+
+	/* The same fields as ext4_iget() reads and a fast commit can change */
+	i_uid = (uid_t)le16_to_cpu(raw_inode->i_uid_low);
+	i_gid = (gid_t)le16_to_cpu(raw_inode->i_gid_low);
+	if (!test_opt(sb, NO_UID32)) {
+		i_uid |= le16_to_cpu(raw_inode->i_uid_high) << 16;
+		i_gid |= le16_to_cpu(raw_inode->i_gid_high) << 16;
+	}
+	inode->i_mode = mode;
+	i_uid_write(inode, i_uid);
+	i_gid_write(inode, i_gid);
+
+	size = ext4_isize(sb, raw_inode);
+	i_size_write(inode, size);
+	ei->i_disksize = size;
+
+	EXT4_INODE_GET_XTIME(i_ctime, inode, raw_inode);
+	EXT4_INODE_GET_XTIME(i_mtime, inode, raw_inode);
+	EXT4_INODE_GET_XTIME(i_atime, inode, raw_inode);
+
+	ret = ext4_mark_inode_dirty(handle, inode);
+	ext4_journal_stop(handle);
+out_iput:
+	iput(inode);
+out_free:
+	kfree(raw_inode);
+	return ret;
+}
+
+static int ext4_fc_replay_dentry(struct super_block *sb, int tag,
+				 struct ext4_fc_dentry_info *dinfo, int len)
+{
+	struct inode *dir, *inode;
+	struct qstr name;
+	int ret;
+
+	/* The name was padded with zeroes up to a multiple of 4 bytes */
+	name.name = dinfo->fc_dname;
+	name.len = strnlen(dinfo->fc_dname, len - sizeof(*dinfo));
+	if (!name.len)
+		return -EFSCORRUPTED;
+
+	dir = ext4_iget(sb, le32_to_cpu(dinfo->fc_parent_ino),
+			EXT4_IGET_NORMAL);
+	if (IS_ERR(dir))
+		return PTR_ERR(dir);
+	if (!S_ISDIR(dir->i_mode)) {
+		iput(dir);
+		return -EFSCORRUPTED;
+	}
+
+	inode = ext4_iget(sb, le32_to_cpu(dinfo->fc_ino), EXT4_IGET_NORMAL);
+	if (IS_ERR(inode)) {
+		iput(dir);
+		return PTR_ERR(inode);
+	}
+	if (!S_ISREG(inode->i_mode)) {
+		iput(inode);
+		iput(dir);
+		return -EFSCORRUPTED;
+	}
+
+	if (tag == EXT4_FC_TAG_LINK)
+		ret = ext4_replay_link(dir, inode, &name);
+	else
+		ret = ext4_replay_unlink(dir, inode, &name);
+
+	iput(inode);
+	iput(dir);
+	return ret;
+}
+
+/* Number of the last fast commit that logged the mapping of an inode */
+struct ext4_fc_last_commit {
+	u32 ino;
+	int commit;
+};
+
+static u32 ext4_fc_tag_ino(int tag, u8 *val)
+{
+	switch (tag) {
+	case EXT4_FC_TAG_ADD_RANGE:
+		return le32_to_cpu(((struct ext4_fc_add_range *)val)->fc_ino);
+	case EXT4_FC_TAG_DEL_RANGE:
+		return le32_to_cpu(((struct ext4_fc_del_range *)val)->fc_ino);
+	case EXT4_FC_TAG_INODE:
+		return le32_to_cpu(((struct ext4_fc_inode *)val)->fc_ino);
+	}
+	return 0;
+}
+
+/*
+ * Every fast commit of an inode logs all the blocks whose mapping changed
+ * since the last full commit, so only the last one that logged the inode
+ * needs replaying.  Find it for each inode.
+ */
+static int ext4_fc_find_last_commits(struct ext4_fc_replay_state *state,
+				     struct ext4_fc_last_commit **lastp)
+{
+	struct ext4_fc_last_commit *last = NULL;
+	int i, nr = 0, commit = 0, len;
+	struct ext4_fc_tl tl;
+	u8 *cur;
+	u32 ino;
+
+	for (cur = state->fc_buf; cur < state->fc_buf + state->fc_valid_len;
+	     cur += sizeof(tl) + len) {
+		memcpy(&tl, cur, sizeof(tl));
+		len = le16_to_cpu(tl.fc_len);
+		if (le16_to_cpu(tl.fc_tag) == EXT4_FC_TAG_TAIL) {
+			commit++;
+			continue;
+		}
+		ino = ext4_fc_tag_ino(le16_to_cpu(tl.fc_tag),
+				      cur + sizeof(tl));
+		if (!ino)
+			continue;
+		for (i = 0; i < nr; i++)
+			if (last[i].ino == ino)
+				break;
+		if (i == nr) {
+			if (!(nr % 64)) {
+				struct ext4_fc_last_commit *new;
+
+				new = krealloc(last, (nr + 64) * sizeof(*last),
+					       GFP_KERNEL);
+				if (!new) {
+					kfree(last);
+					return -ENOMEM;
+				}
+				last = new;
+			}
+			last[nr++].ino = ino;
+		}
+		last[i].commit = commit;
+	}
+
+	*lastp = last;
+	return nr;
+}
+
+static int ext4_fc_replay_tags(struct super_block *sb,
+			       struct ext4_fc_last_commit *last, int nr,
+			       bool claim)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay;
+	int i, tag, len, commit = 0, ret = 0;
+	struct ext4_fc_tl tl;
+	u8 *cur, *val;
+	u32 ino;
+
+	for (cur = state->fc_buf; cur < state->fc_buf + state->fc_valid_len;
+	     cur += sizeof(tl) + len) {
+		memcpy(&tl, cur, sizeof(tl));
+		tag = le16_to_cpu(tl.fc_tag);
+		len = le16_to_cpu(tl.fc_len);
+		val = cur + sizeof(tl);
+
+		if (tag == EXT4_FC_TAG_TAIL) {
+			commit++;
+			continue;
+		}
+		ino = ext4_fc_tag_ino(tag, val);
+		if (ino) {
+			for (i = 0; i < nr && last[i].ino != ino; i++)
+				;
+			if (i < nr && last[i].commit != commit)
+				continue;
+		}
+
+		switch (tag) {
+		case EXT4_FC_TAG_ADD_RANGE:
+			ret = ext4_fc_replay_add_range(sb,
+					(struct ext4_fc_add_range *)val, claim);
+			break;
+		case EXT4_FC_TAG_DEL_RANGE:
+			if (!claim)
+				ret = ext4_fc_replay_del_range(sb,
+					(struct ext4_fc_del_range *)val);
+			break;
+		case EXT4_FC_TAG_LINK:
+		case EXT4_FC_TAG_UNLINK:
+			if (!claim)
+				ret = ext4_fc_replay_dentry(sb, tag,
+					(struct ext4_fc_dentry_info *)val, len);
+			break;
+		case EXT4_FC_TAG_INODE:
+			if (!claim)
+				ret = ext4_fc_replay_inode(sb,
+					(struct ext4_fc_inode *)val,
+					len - sizeof(struct ext4_fc_inode));
+			break;
+		}
+		if (ret) {
+			ext4_msg(sb, KERN_ERR, "fast commit replay: tag %d "
+				 "failed with error %d", tag, ret);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/**
+ * ext4_fc_replay - apply the fast commits found during journal recovery
+ * @sb: the filesystem, mounted and with orphans not yet cleaned up
+ *
+ * The blocks of all add range tags are taken first, so that the metadata
+ * blocks allocated while replaying can't land on one of them.  Everything
+ * is in the journal before we return.
+ */
+int ext4_fc_replay(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_replay_state *state = &sbi->s_fc_replay;
+	struct ext4_fc_last_commit *last = NULL;
+	unsigned int s_flags = sb->s_flags;
+	int nr, ret = 0;
+
+	if (!state->fc_buf)
+		return 0;
+	if (!state->fc_valid_len)
+		goto out;
+
+	nr = ext4_fc_find_last_commits(state, &last);
+	if (nr < 0) {
+		ret = nr;
+		goto out;
+	}
+
+	if (s_flags & SB_RDONLY)
+		sb->s_flags &= ~SB_RDONLY;
+	ret = ext4_fc_replay_tags(sb, last, nr, true);
+	if (!ret)
+		ret = ext4_fc_replay_tags(sb, last, nr, false);
+	if (!ret)
+		ret = jbd2_journal_flush(sbi->s_journal);
+	sb->s_flags = s_flags;
+	kfree(last);
+
+	if (!ret) {
+		sbi->s_fc_stats.fc_replayed = state->fc_num_commits;
+		ext4_msg(sb, KERN_INFO, "replayed %d fast commits",
+			 state->fc_num_commits);
+	}
+out:
+	kvfree(state->fc_buf);
+	state->fc_buf = NULL;
+	kfree(state->fc_regions);
+	state->fc_regions = NULL;
+	state->fc_regions_used = state->fc_regions_size = 0;
+	return ret;
+}
+
+/*
+ * Setup and teardown
+ */
+
+void ext4_fc_init(struct super_block *sb, journal_t *journal)
+{
+	journal->j_fc_cleanup_callback = ext4_fc_cleanup;
+	journal->j_fc_replay_callback = ext4_fc_replay_scan;
+}
+
+void ext4_fc_destroy(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	ext4_fc_free_dentries(&sbi->s_fc_dentry_q);
+	kvfree(sbi->s_fc_replay.fc_buf);
+	sbi->s_fc_replay.fc_buf = NULL;
+}
+
+int ext4_seq_fc_info_show(struct seq_file *seq, void *v)
+{
+	struct ext4_sb_info *sbi = EXT4_SB((struct super_block *)seq->private);
+	struct ext4_fc_stats stats;
+
+	if (v != SEQ_START_TOKEN)
+		return 0;
+
+	spin_lock(&sbi->s_fc_lock);
+	stats = sbi->s_fc_stats;
+	spin_unlock(&sbi->s_fc_lock);
+
+	seq_printf(seq, "fast commits:\n  %lu commits\n  %lu blocks\n",
+		   stats.fc_num_commits, stats.fc_num_blocks);
+	seq_printf(seq, "  %lu fsyncs needed a full commit\n",
+		   stats.fc_fallbacks);
+	seq_printf(seq, "  %lu replayed at mount\n", stats.fc_replayed);
+	return 0;
+}
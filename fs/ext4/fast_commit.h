@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+/*
+ * On-disk format of fast commits
+ *
+ * This is not the format of mainline's fast_commit feature (tag numbers
+ * and payloads differ), which is why EXT4_FEATURE_COMPAT_FAST_COMMIT and
+ * JBD2_FEATURE_INCOMPAT_FAST_COMMIT use bits mainline has not assigned.
+ *
+ * A fast commit is a run of tags in the fast commit area of the journal,
+ * starting on a block boundary and ending with a tail tag.  Every tag
+ * starts with a struct ext4_fc_tl, is a multiple of 4 bytes long and
+ * never crosses a block boundary; a pad tag fills the end of a block
+ * when the next tag does not fit.  The tail holds the ID of the running
+ * transaction the fast commit belongs to and the crc32c of the fast
+ * commit up to the crc itself.
+ */
+
+/* Fast commit tags */
+#define EXT4_FC_TAG_ADD_RANGE		0x0001
+#define EXT4_FC_TAG_DEL_RANGE		0x0002
+#define EXT4_FC_TAG_LINK		0x0003
+#define EXT4_FC_TAG_UNLINK		0x0004
+#define EXT4_FC_TAG_INODE		0x0005
+#define EXT4_FC_TAG_PAD			0x0006
+#define EXT4_FC_TAG_TAIL		0x0007
+
+/* Tag header, fc_len is the length of the value that follows */
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;
+};
+
+/* Value of EXT4_FC_TAG_ADD_RANGE */
+struct ext4_fc_add_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+	__le32 fc_flags;
+	__le64 fc_pblk;
+};
+
+/* fc_flags of struct ext4_fc_add_range */
+#define EXT4_FC_RANGE_UNWRITTEN		0x0001
+
+/* Value of EXT4_FC_TAG_DEL_RANGE */
+struct ext4_fc_del_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+};
+
+/* Value of EXT4_FC_TAG_LINK and EXT4_FC_TAG_UNLINK, followed by the name */
+struct ext4_fc_dentry_info {
+	__le32 fc_parent_ino;
+	__le32 fc_ino;
+	__u8 fc_dname[0];
+};
+
+/* Value of EXT4_FC_TAG_INODE, followed by the raw inode */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];
+};
+
+/* Value of EXT4_FC_TAG_TAIL */
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;
+};
+
+/*
+ * In-memory state
+ */
+
+/* A link or unlink done by the running transaction, not yet fast committed */
+struct ext4_fc_dentry_update {
+	struct list_head fcd_list;	/* on s_fc_dentry_q */
+	tid_t fcd_tid;			/* transaction that did it */
+	int fcd_op;			/* EXT4_FC_TAG_LINK or _UNLINK */
+	__u32 fcd_parent;		/* parent directory */
+	__u32 fcd_ino;			/* inode linked or unlinked */
+	int fcd_name_len;
+	unsigned char fcd_name[0];
+};
+
+struct ext4_fc_stats {
+	unsigned long fc_num_commits;	/* fast commits done */
+	unsigned long fc_fallbacks;	/* fsyncs that needed a full commit */
+	unsigned long fc_num_blocks;	/* fast commit blocks written */
+	unsigned long fc_replayed;	/* fast commits replayed at mount */
+};
+
+/* Blocks taken in the bitmaps by the replay */
+struct ext4_fc_alloc_region {
+	ext4_fsblk_t pblk;
+	unsigned int len;
+};
+
+/* Fast commits found valid during recovery, applied after mount */
+struct ext4_fc_replay_state {
+	u8 *fc_buf;			/* tags of the valid fast commits */
+	int fc_buf_size;
+	int fc_valid_len;		/* end of the last valid fast commit */
+	int fc_len;			/* end of the fast commit being read */
+	u32 fc_crc;			/* crc32c of the fast commit so far */
+	int fc_num_commits;
+	struct ext4_fc_alloc_region *fc_regions;
+	int fc_regions_used;
+	int fc_regions_size;
+};
+
+#endif /* _EXT4_FAST_COMMIT_H */
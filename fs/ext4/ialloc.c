@@ -974,6 +974,9 @@ struct inode *__ext4_new_inode(handle_t *handle, struct inode *dir,
 		goto out;
 	}
 
+	/* Fast commits don't describe new inodes */
+	ext4_fc_mark_ineligible(sb, handle);
+
 	BUFFER_TRACE(group_desc_bh, "get_write_access");
 	err = ext4_journal_get_write_access(handle, group_desc_bh);
 	if (err) {
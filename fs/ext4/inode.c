@@ -699,6 +699,9 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 			}
 		}
 
+		/* The mapping changed, even if the status tree is kept */
+		ext4_fc_track_range(handle, inode, map->m_lblk, map->m_len);
+
 		/*
 		 * If the extent has been zeroed out, we don't need to update
 		 * extent status tree.
@@ -1246,7 +1249,7 @@ static int ext4_block_write_begin(struct page *page, loff_t pos, unsigned len,
 	}
 	if (unlikely(err)) {
 		page_zero_new_buffers(page, from, to);
-	} else if (IS_ENCRYPTED(inode) && S_ISREG(inode->i_mode)) {
+	} else if (fscrypt_inode_uses_fs_layer_crypto(inode)) {
 		for (i = 0; i < nr_wait; i++) {
 			int err2;
 
@@ -4055,7 +4058,7 @@ static int __ext4_block_zero_page_range(handle_t *handle,
 		/* Uhhuh. Read error. Complain and punt. */
 		if (!buffer_uptodate(bh))
 			goto unlock;
-		if (S_ISREG(inode->i_mode) && IS_ENCRYPTED(inode)) {
+		if (fscrypt_inode_uses_fs_layer_crypto(inode)) {
 			/* We expect the key to be set. */
 			BUG_ON(!fscrypt_has_encryption_key(inode));
 			WARN_ON_ONCE(fscrypt_decrypt_pagecache_blocks(
@@ -4387,6 +4390,8 @@ int ext4_punch_hole(struct inode *inode, loff_t offset, loff_t length)
 			ret = ext4_ind_remove_space(handle, inode, first_block,
 						    stop_block);
 
+		ext4_fc_track_range(handle, inode, first_block,
+				    stop_block - first_block);
 		up_write(&EXT4_I(inode)->i_data_sem);
 	}
 	if (IS_SYNC(inode))
@@ -4533,6 +4538,13 @@ int ext4_truncate(struct inode *inode)
 	else
 		ext4_ind_truncate(handle, inode);
 
+	if (!err) {
+		ext4_lblk_t start = (inode->i_size + inode->i_sb->s_blocksize -
+				     1) >> inode->i_blkbits;
+
+		ext4_fc_track_range(handle, inode, start,
+				    EXT_MAX_BLOCKS - start);
+	}
 	up_write(&ei->i_data_sem);
 	if (err)
 		goto out_stop;
@@ -5722,6 +5734,10 @@ int ext4_setattr(struct dentry *dentry, struct iattr *attr)
 	if (!error && (ia_valid & ATTR_MODE))
 		rc = posix_acl_chmod(inode, inode->i_mode);
 
+	/* Fast commits only log the attributes of regular files */
+	if (!error && !S_ISREG(inode->i_mode))
+		ext4_fc_mark_ineligible(inode->i_sb, NULL);
+
 err_out:
 	ext4_std_error(inode->i_sb, error);
 	if (!error)
@@ -303,6 +303,9 @@ static int ext4_ioctl_setflags(struct inode *inode,
 	unsigned int jflag;
 	struct super_block *sb = inode->i_sb;
 
+	/* Flags are not logged by fast commits */
+	ext4_fc_start_ineligible(sb);
+
 	/* Is it quota file? Do not allow user to mess with it */
 	if (ext4_is_quota_file(inode))
 		goto flags_out;
@@ -424,6 +427,7 @@ static int ext4_ioctl_setflags(struct inode *inode,
 	}
 
 flags_out:
+	ext4_fc_stop_ineligible(sb);
 	return err;
 }
 
@@ -505,6 +509,7 @@ static int ext4_ioctl_setproject(struct file *filp, __u32 projid)
 
 	EXT4_I(inode)->i_projid = kprojid;
 	inode->i_ctime = current_time(inode);
+	ext4_fc_mark_ineligible(sb, handle);
 out_dirty:
 	rc = ext4_mark_iloc_dirty(handle, inode, &iloc);
 	if (!err)
@@ -717,12 +722,14 @@ static long ext4_ioctl_group_add(struct file *file,
 	if (err)
 		goto group_add_out;
 
+	ext4_fc_start_ineligible(sb);
 	err = ext4_group_add(sb, input);
 	if (EXT4_SB(sb)->s_journal) {
 		jbd2_journal_lock_updates(EXT4_SB(sb)->s_journal);
 		err2 = jbd2_journal_flush(EXT4_SB(sb)->s_journal);
 		jbd2_journal_unlock_updates(EXT4_SB(sb)->s_journal);
 	}
+	ext4_fc_stop_ineligible(sb);
 	if (err == 0)
 		err = err2;
 	mnt_drop_write_file(file);
@@ -936,12 +943,14 @@ long ext4_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		if (err)
 			goto group_extend_out;
 
+		ext4_fc_start_ineligible(sb);
 		err = ext4_group_extend(sb, EXT4_SB(sb)->s_es, n_blocks_count);
 		if (EXT4_SB(sb)->s_journal) {
 			jbd2_journal_lock_updates(EXT4_SB(sb)->s_journal);
 			err2 = jbd2_journal_flush(EXT4_SB(sb)->s_journal);
 			jbd2_journal_unlock_updates(EXT4_SB(sb)->s_journal);
 		}
+		ext4_fc_stop_ineligible(sb);
 		if (err == 0)
 			err = err2;
 		mnt_drop_write_file(filp);
@@ -989,8 +998,10 @@ long ext4_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		if (err)
 			goto mext_out;
 
+		ext4_fc_start_ineligible(sb);
 		err = ext4_move_extents(filp, donor.file, me.orig_start,
 					me.donor_start, me.len, &me.moved_len);
+		ext4_fc_stop_ineligible(sb);
 		mnt_drop_write_file(filp);
 
 		if (copy_to_user((struct move_extent __user *)arg,
@@ -1027,7 +1038,9 @@ long ext4_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		 * inode format to prevent read.
 		 */
 		inode_lock((inode));
+		ext4_fc_start_ineligible(sb);
 		err = ext4_ext_migrate(inode);
+		ext4_fc_stop_ineligible(sb);
 		inode_unlock((inode));
 		mnt_drop_write_file(filp);
 		return err;
@@ -1055,7 +1068,9 @@ long ext4_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		err = mnt_want_write_file(filp);
 		if (err)
 			return err;
+		ext4_fc_start_ineligible(sb);
 		err = swap_inode_boot_loader(sb, inode);
+		ext4_fc_stop_ineligible(sb);
 		mnt_drop_write_file(filp);
 		return err;
 	}
@@ -1078,12 +1093,14 @@ long ext4_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		if (err)
 			goto resizefs_out;
 
+		ext4_fc_start_ineligible(sb);
 		err = ext4_resize_fs(sb, n_blocks_count);
 		if (EXT4_SB(sb)->s_journal) {
 			jbd2_journal_lock_updates(EXT4_SB(sb)->s_journal);
 			err2 = jbd2_journal_flush(EXT4_SB(sb)->s_journal);
 			jbd2_journal_unlock_updates(EXT4_SB(sb)->s_journal);
 		}
+		ext4_fc_stop_ineligible(sb);
 		if (err == 0)
 			err = err2;
 		mnt_drop_write_file(filp);
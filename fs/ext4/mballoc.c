@@ -156,6 +156,19 @@ MODULE_PARM_DESC(mballoc_debug, "Debugging level for ext4's mballoc");
  * can be used for allocation. ext4_mb_good_group explains how the groups are
  * checked.
  *
+ * With the mb_optimize_scan mount option (the default with at least
+ * MB_DEFAULT_LINEAR_SCAN_THRESHOLD groups), groups after the goal are not
+ * walked one by one for cr 0 and cr 1.  Groups are kept on lists by the
+ * order of their largest free extent and by the order of their average
+ * free extent size, and ext4_mb_choose_next_group() takes the next group
+ * from the first list that can satisfy the request.  Groups whose bitmap
+ * hasn't been read yet are listed as if their free clusters formed a
+ * single extent, and move to their real lists when picked and
+ * initialized.  On
+ * rotational devices, /sys/fs/ext4/<partition>/mb_max_linear_groups groups
+ * are still scanned linearly from the goal first, for locality.  cr 2 and
+ * cr 3 always scan linearly.
+ *
  * Both the prealloc space are getting populated as above. So for the first
  * request we will hit the buddy cache which will result in this prealloc
  * space getting filled. The prealloc space is then later used for the
@@ -688,23 +701,121 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and move the group to the matching list for mb_optimize_scan.
+ * Called with the group locked.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	int i;
-	int bits;
 
-	grp->bb_largest_free_order = -1; /* uninit */
-
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
-		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--)
+		if (grp->bb_counters[i] > 0)
 			break;
-		}
+
+	if (!test_opt2(sb, MB_OPTIMIZE_SCAN) ||
+	    i == grp->bb_largest_free_order) {
+		grp->bb_largest_free_order = i;
+		return;
+	}
+
+	if (grp->bb_largest_free_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+	}
+	grp->bb_largest_free_order = i;
+	if (i >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+}
+
+/*
+ * Order of the average free extent size list a group with average free
+ * extent size @len belongs on.  List n holds sizes in [2^(n+1), 2^(n+2)),
+ * the first and last lists also take what is below and above.
+ */
+static int mb_avg_fragment_size_order(struct super_block *sb, ext4_grpblk_t len)
+{
+	int order;
+
+	order = fls(len) - 2;
+	if (order < 0)
+		return 0;
+	if (order >= MB_NUM_ORDERS(sb))
+		order = MB_NUM_ORDERS(sb) - 1;
+	return order;
+}
+
+/*
+ * Move the group to the average free extent size list matching its
+ * bb_free and bb_fragments.  Called with the group locked.
+ */
+static void
+mb_update_avg_fragment_size(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int new_order = -1;
+
+	if (!test_opt2(sb, MB_OPTIMIZE_SCAN))
+		return;
+
+	if (grp->bb_fragments > 0)
+		new_order = mb_avg_fragment_size_order(sb,
+					grp->bb_free / grp->bb_fragments);
+	if (new_order == grp->bb_avg_fragment_size_order)
+		return;
+
+	if (grp->bb_avg_fragment_size_order >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[
+					grp->bb_avg_fragment_size_order]);
+		list_del_init(&grp->bb_avg_fragment_size_node);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[
+					grp->bb_avg_fragment_size_order]);
 	}
+	grp->bb_avg_fragment_size_order = new_order;
+	if (new_order >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[new_order]);
+		list_add_tail(&grp->bb_avg_fragment_size_node,
+			      &sbi->s_mb_avg_fragment_size[new_order]);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[new_order]);
+	}
+}
+
+/*
+ * Put a group that is not initialized yet on the free space lists, as if
+ * its free clusters formed one extent, so that cr 0 and cr 1 find groups
+ * nobody has touched since mount.  ext4_mb_generate_buddy() moves it to
+ * the lists it really belongs on.
+ */
+static void ext4_mb_list_cold_group(struct super_block *sb,
+				    struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int order;
+
+	if (!test_opt2(sb, MB_OPTIMIZE_SCAN) || !grp->bb_free)
+		return;
+
+	order = min_t(int, fls(grp->bb_free) - 1, MB_NUM_ORDERS(sb) - 1);
+	grp->bb_largest_free_order = order;
+	write_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+	list_add_tail(&grp->bb_largest_free_order_node,
+		      &sbi->s_mb_largest_free_orders[order]);
+	write_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+
+	order = mb_avg_fragment_size_order(sb, grp->bb_free);
+	grp->bb_avg_fragment_size_order = order;
+	write_lock(&sbi->s_mb_avg_fragment_size_locks[order]);
+	list_add_tail(&grp->bb_avg_fragment_size_node,
+		      &sbi->s_mb_avg_fragment_size[order]);
+	write_unlock(&sbi->s_mb_avg_fragment_size_locks[order]);
 }
 
 static noinline_for_stack
@@ -754,6 +865,7 @@ void ext4_mb_generate_buddy(struct super_block *sb,
 					EXT4_GROUP_INFO_BBITMAP_CORRUPT);
 	}
 	mb_set_largest_free_order(sb, grp);
+	mb_update_avg_fragment_size(sb, grp);
 
 	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
 
@@ -1487,6 +1599,7 @@ static void mb_free_blocks(struct inode *inode, struct ext4_buddy *e4b,
 
 done:
 	mb_set_largest_free_order(sb, e4b->bd_info);
+	mb_update_avg_fragment_size(sb, e4b->bd_info);
 	mb_check_buddy(e4b);
 }
 
@@ -1621,6 +1734,7 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 		e4b->bd_info->bb_counters[ord]++;
 	}
 	mb_set_largest_free_order(e4b->bd_sb, e4b->bd_info);
+	mb_update_avg_fragment_size(e4b->bd_sb, e4b->bd_info);
 
 	ext4_set_bits(e4b->bd_bitmap, ex->fe_start, len0);
 	mb_check_buddy(e4b);
@@ -2097,11 +2211,142 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Whether cr 0 and cr 1 pick groups from the free space lists.  Files
+ * without extents are limited to the first groups, which the lists don't
+ * know about.
+ */
+static inline bool ext4_mb_should_optimize_scan(
+				struct ext4_allocation_context *ac)
+{
+	if (!test_opt2(ac->ac_sb, MB_OPTIMIZE_SCAN))
+		return false;
+	if (ac->ac_criteria >= 2)
+		return false;
+	return ext4_test_inode_flag(ac->ac_inode, EXT4_INODE_EXTENTS);
+}
+
+/*
+ * Check a group found on one of the free space lists, with the list lock
+ * held.  A group that is not initialized can't be loaded here, so it is
+ * taken on its free cluster count alone: ext4_mb_good_group() in
+ * ext4_mb_regular_allocator() then initializes it, which moves it to the
+ * right lists, and checks it for real.
+ */
+static bool ext4_mb_good_listed_group(struct ext4_allocation_context *ac,
+				      struct ext4_group_info *grp, int cr)
+{
+	if (unlikely(EXT4_MB_GRP_NEED_INIT(grp)))
+		return grp->bb_free >= ac->ac_g_ex.fe_len &&
+		       !EXT4_MB_GRP_BBITMAP_CORRUPT(grp);
+	return ext4_mb_good_group(ac, grp->bb_group, cr) > 0;
+}
+
+/*
+ * cr 0: take the first good group on the list of groups whose largest
+ * free extent is of order ac_2order, or on the lists above.
+ */
+static void ext4_mb_choose_next_group_cr0(struct ext4_allocation_context *ac,
+					  int *new_cr, ext4_group_t *group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *iter;
+	int i;
+
+	if (unlikely(sbi->s_mb_stats && ac->ac_flags & EXT4_MB_CR0_OPTIMIZED))
+		atomic_inc(&sbi->s_bal_cr0_bad_suggestions);
+
+	for (i = ac->ac_2order; i < MB_NUM_ORDERS(ac->ac_sb); i++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[i]))
+			continue;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_for_each_entry(iter, &sbi->s_mb_largest_free_orders[i],
+				    bb_largest_free_order_node) {
+			if (ext4_mb_good_listed_group(ac, iter, 0)) {
+				*group = iter->bb_group;
+				ac->ac_flags |= EXT4_MB_CR0_OPTIMIZED;
+				read_unlock(
+				    &sbi->s_mb_largest_free_orders_locks[i]);
+				return;
+			}
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
+	/* Nothing fits, move on to cr 1 */
+	*new_cr = 1;
+}
+
+/*
+ * cr 1: take the first good group on the list of groups whose average free
+ * extent is as large as the goal length, or on the lists above.
+ */
+static void ext4_mb_choose_next_group_cr1(struct ext4_allocation_context *ac,
+					  int *new_cr, ext4_group_t *group)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *iter;
+	int i;
+
+	if (unlikely(sbi->s_mb_stats && ac->ac_flags & EXT4_MB_CR1_OPTIMIZED))
+		atomic_inc(&sbi->s_bal_cr1_bad_suggestions);
+
+	for (i = mb_avg_fragment_size_order(ac->ac_sb, ac->ac_g_ex.fe_len);
+	     i < MB_NUM_ORDERS(ac->ac_sb); i++) {
+		if (list_empty(&sbi->s_mb_avg_fragment_size[i]))
+			continue;
+		read_lock(&sbi->s_mb_avg_fragment_size_locks[i]);
+		list_for_each_entry(iter, &sbi->s_mb_avg_fragment_size[i],
+				    bb_avg_fragment_size_node) {
+			if (ext4_mb_good_listed_group(ac, iter, 1)) {
+				*group = iter->bb_group;
+				ac->ac_flags |= EXT4_MB_CR1_OPTIMIZED;
+				read_unlock(
+				    &sbi->s_mb_avg_fragment_size_locks[i]);
+				return;
+			}
+		}
+		read_unlock(&sbi->s_mb_avg_fragment_size_locks[i]);
+	}
+
+	/* Nothing fits, move on to cr 2 */
+	*new_cr = 2;
+}
+
+/*
+ * Pick the group to try after *@group.  With mb_optimize_scan this may
+ * also decide that the current criteria can't be met and set *@new_cr to
+ * the next one.
+ */
+static void ext4_mb_choose_next_group(struct ext4_allocation_context *ac,
+				      int *new_cr, ext4_group_t *group,
+				      ext4_group_t ngroups)
+{
+	*new_cr = ac->ac_criteria;
+
+	if (!ext4_mb_should_optimize_scan(ac) ||
+	    ac->ac_groups_linear_remaining) {
+		if (ac->ac_groups_linear_remaining)
+			ac->ac_groups_linear_remaining--;
+		/*
+		 * Artificially restricted ngroups for non-extent
+		 * files makes group > ngroups possible on first loop.
+		 */
+		*group = *group + 1 >= ngroups ? 0 : *group + 1;
+		return;
+	}
+
+	if (*new_cr == 0)
+		ext4_mb_choose_next_group_cr0(ac, new_cr, group);
+	else
+		ext4_mb_choose_next_group_cr1(ac, new_cr, group);
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
 	ext4_group_t ngroups, group, i;
-	int cr;
+	int cr, new_cr;
 	int err = 0, first_err = 0;
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
@@ -2170,10 +2415,19 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		 * from the goal value specified
 		 */
 		group = ac->ac_g_ex.fe_group;
+		ac->ac_groups_linear_remaining = min_t(unsigned int, U16_MAX,
+						sbi->s_mb_max_linear_groups);
 
-		for (i = 0; i < ngroups; group++, i++) {
+		for (i = 0, new_cr = cr; i < ngroups; i++,
+		     ext4_mb_choose_next_group(ac, &new_cr, &group, ngroups)) {
 			int ret = 0;
 			cond_resched();
+			if (new_cr != cr) {
+				if (sbi->s_mb_stats)
+					atomic64_inc(&sbi->s_bal_cX_failed[cr]);
+				cr = new_cr;
+				goto repeat;
+			}
 			/*
 			 * Artificially restricted ngroups for non-extent
 			 * files makes group > ngroups possible on first loop.
@@ -2182,6 +2436,9 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 				group = 0;
 
 			/* This now checks without needing the buddy page */
+			if (sbi->s_mb_stats)
+				atomic64_inc(
+				    &sbi->s_bal_cX_groups_considered[cr]);
 			ret = ext4_mb_good_group(ac, group, cr);
 			if (ret <= 0) {
 				if (!first_err)
@@ -2223,6 +2480,9 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
+		/* Processed all groups and haven't found blocks */
+		if (sbi->s_mb_stats && i == ngroups)
+			atomic64_inc(&sbi->s_bal_cX_failed[cr]);
 	}
 
 	if (ac->ac_b_ex.fe_len > 0 && ac->ac_status != AC_STATUS_FOUND &&
@@ -2341,6 +2601,57 @@ const struct seq_operations ext4_mb_seq_groups_ops = {
 	.show   = ext4_mb_seq_groups_show,
 };
 
+int ext4_seq_mb_stats_show(struct seq_file *seq, void *offset)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int cr;
+
+	seq_puts(seq, "mballoc:\n");
+	if (!sbi->s_mb_stats) {
+		seq_puts(seq, "\tstats collection turned off, "
+			 "write 1 to /sys/fs/ext4/<partition>/mb_stats\n");
+		return 0;
+	}
+	seq_printf(seq, "\toptimize_scan: %d\n",
+		   test_opt2(sb, MB_OPTIMIZE_SCAN) ? 1 : 0);
+	seq_printf(seq, "\treqs: %u\n", atomic_read(&sbi->s_bal_reqs));
+	seq_printf(seq, "\tsuccess: %u\n", atomic_read(&sbi->s_bal_success));
+	seq_printf(seq, "\tgroups_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_groups_scanned));
+	for (cr = 0; cr < 4; cr++) {
+		seq_printf(seq, "\tcr%d_stats:\n", cr);
+		seq_printf(seq, "\t\thits: %lld\n",
+			   atomic64_read(&sbi->s_bal_cX_hits[cr]));
+		seq_printf(seq, "\t\tgroups_considered: %lld\n",
+			   atomic64_read(&sbi->s_bal_cX_groups_considered[cr]));
+		seq_printf(seq, "\t\tuseless_loops: %lld\n",
+			   atomic64_read(&sbi->s_bal_cX_failed[cr]));
+	}
+	seq_printf(seq, "\tcr0_bad_suggestions: %u\n",
+		   atomic_read(&sbi->s_bal_cr0_bad_suggestions));
+	seq_printf(seq, "\tcr1_bad_suggestions: %u\n",
+		   atomic_read(&sbi->s_bal_cr1_bad_suggestions));
+	seq_printf(seq, "\textents_scanned: %u\n",
+		   atomic_read(&sbi->s_bal_ex_scanned));
+	seq_printf(seq, "\t\tgoal_hits: %u\n",
+		   atomic_read(&sbi->s_bal_goals));
+	seq_printf(seq, "\t\t2^n_hits: %u\n",
+		   atomic_read(&sbi->s_bal_2orders));
+	seq_printf(seq, "\t\tbreaks: %u\n", atomic_read(&sbi->s_bal_breaks));
+	seq_printf(seq, "\t\tlost: %u\n",
+		   atomic_read(&sbi->s_mb_lost_chunks));
+	seq_printf(seq, "\tbuddies_generated: %lu\n",
+		   sbi->s_mb_buddies_generated);
+	seq_printf(seq, "\tbuddies_time_used: %llu\n",
+		   sbi->s_mb_generation_time);
+	seq_printf(seq, "\tpreallocated: %u\n",
+		   atomic_read(&sbi->s_mb_preallocated));
+	seq_printf(seq, "\tdiscarded: %u\n",
+		   atomic_read(&sbi->s_mb_discarded));
+	return 0;
+}
+
 static struct kmem_cache *get_groupinfo_cache(int blocksize_bits)
 {
 	int cache_index = blocksize_bits - EXT4_MIN_BLOCK_LOG_SIZE;
@@ -2443,7 +2754,12 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_avg_fragment_size_node);
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_avg_fragment_size_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	ext4_mb_list_cold_group(sb, meta_group_info[i]);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2625,6 +2941,32 @@ int ext4_mb_init(struct super_block *sb)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t),
+			      GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks ||
+	    !sbi->s_mb_avg_fragment_size ||
+	    !sbi->s_mb_avg_fragment_size_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+		INIT_LIST_HEAD(&sbi->s_mb_avg_fragment_size[i]);
+		rwlock_init(&sbi->s_mb_avg_fragment_size_locks[i]);
+	}
+
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 	sbi->s_mb_free_pending = 0;
@@ -2635,6 +2977,14 @@ int ext4_mb_init(struct super_block *sb)
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	if (!test_opt2(sb, EXPLICIT_MB_OPTIMIZE_SCAN) &&
+	    sbi->s_groups_count >= MB_DEFAULT_LINEAR_SCAN_THRESHOLD)
+		set_opt2(sb, MB_OPTIMIZE_SCAN);
+	/* Seeking is cheap on non-rotational devices, don't bother */
+	if (blk_queue_nonrot(bdev_get_queue(sb->s_bdev)))
+		sbi->s_mb_max_linear_groups = 0;
+	else
+		sbi->s_mb_max_linear_groups = MB_DEFAULT_LINEAR_LIMIT;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2687,6 +3037,14 @@ int ext4_mb_init(struct super_block *sb)
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
+	kfree(sbi->s_mb_avg_fragment_size);
+	sbi->s_mb_avg_fragment_size = NULL;
+	kfree(sbi->s_mb_avg_fragment_size_locks);
+	sbi->s_mb_avg_fragment_size_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2743,6 +3101,10 @@ int ext4_mb_release(struct super_block *sb)
 		kvfree(group_info);
 		rcu_read_unlock();
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	kfree(sbi->s_mb_avg_fragment_size);
+	kfree(sbi->s_mb_avg_fragment_size_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -3288,6 +3650,9 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 			atomic_inc(&sbi->s_bal_goals);
 		if (ac->ac_found > sbi->s_mb_max_to_scan)
 			atomic_inc(&sbi->s_bal_breaks);
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
+		if (ac->ac_status == AC_STATUS_FOUND && ac->ac_groups_scanned)
+			atomic64_inc(&sbi->s_bal_cX_hits[ac->ac_criteria]);
 	}
 
 	if (ac->ac_op == EXT4_MB_HISTORY_ALLOC)
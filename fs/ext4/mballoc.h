@@ -77,6 +77,24 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * Number of groups from which mb_optimize_scan is enabled by default,
+ * scanning them linearly is cheap enough below that
+ */
+#define MB_DEFAULT_LINEAR_SCAN_THRESHOLD	16
+
+/*
+ * Number of groups scanned linearly from the goal on rotational devices
+ * before mb_optimize_scan picks groups from the free space lists, to keep
+ * allocations close together
+ */
+#define MB_DEFAULT_LINEAR_LIMIT		4
+
+/*
+ * Number of buddy orders, also the number of free space lists
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from sb_info */
@@ -162,6 +180,7 @@ struct ext4_allocation_context {
 	struct ext4_free_extent ac_f_ex;
 
 	__u16 ac_groups_scanned;
+	__u16 ac_groups_linear_remaining;
 	__u16 ac_found;
 	__u16 ac_tail;
 	__u16 ac_buddy;
@@ -3144,8 +3144,10 @@ static int ext4_rmdir(struct inode *dir, struct dentry *dentry)
 
 end_rmdir:
 	brelse(bh);
-	if (handle)
+	if (handle) {
+		ext4_fc_mark_ineligible(dir->i_sb, handle);
 		ext4_journal_stop(handle);
+	}
 	return retval;
 }
 
@@ -3209,6 +3211,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 		ext4_orphan_add(handle, inode);
 	inode->i_ctime = current_time(inode);
 	ext4_mark_inode_dirty(handle, inode);
+	ext4_fc_track_unlink(handle, dir, dentry);
 
 #ifdef CONFIG_UNICODE
 	/* VFS negative dentries are incompatible with Encoding and
@@ -3229,6 +3232,51 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	return retval;
 }
 
+/*
+ * Redo an unlink logged by a fast commit.  Nothing to do if the entry is
+ * already gone.
+ */
+int ext4_replay_unlink(struct inode *dir, struct inode *inode,
+		       const struct qstr *name)
+{
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	handle_t *handle;
+	int retval;
+
+	bh = ext4_find_entry(dir, name, &de, NULL);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	if (!bh || le32_to_cpu(de->inode) != inode->i_ino) {
+		brelse(bh);
+		return 0;
+	}
+
+	handle = ext4_journal_start(dir, EXT4_HT_DIR,
+				    EXT4_DATA_TRANS_BLOCKS(dir->i_sb));
+	if (IS_ERR(handle)) {
+		brelse(bh);
+		return PTR_ERR(handle);
+	}
+
+	retval = ext4_delete_entry(handle, dir, de, bh);
+	if (retval)
+		goto out;
+	dir->i_ctime = dir->i_mtime = current_time(dir);
+	ext4_update_dx_flag(dir);
+	ext4_mark_inode_dirty(handle, dir);
+	if (inode->i_nlink)
+		drop_nlink(inode);
+	if (!inode->i_nlink)
+		ext4_orphan_add(handle, inode);
+	inode->i_ctime = current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+out:
+	brelse(bh);
+	ext4_journal_stop(handle);
+	return retval;
+}
+
 static int ext4_symlink(struct inode *dir,
 			struct dentry *dentry, const char *symname)
 {
@@ -3402,8 +3450,12 @@ static int ext4_link(struct dentry *old_dentry,
 		/* this can happen only for tmpfile being
 		 * linked the first time
 		 */
-		if (inode->i_nlink == 1)
+		if (inode->i_nlink == 1) {
 			ext4_orphan_del(handle, inode);
+			ext4_fc_mark_ineligible(dir->i_sb, handle);
+		} else {
+			ext4_fc_track_link(handle, dir, dentry);
+		}
 		d_instantiate(dentry, inode);
 	} else {
 		drop_nlink(inode);
@@ -3415,6 +3467,58 @@ static int ext4_link(struct dentry *old_dentry,
 	return err;
 }
 
+/*
+ * Redo a link logged by a fast commit.  Nothing to do if the entry is
+ * already there.
+ */
+int ext4_replay_link(struct inode *dir, struct inode *inode,
+		     const struct qstr *name)
+{
+	struct dentry *parent, *dentry;
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	handle_t *handle;
+	int err;
+
+	bh = ext4_find_entry(dir, name, &de, NULL);
+	if (IS_ERR(bh))
+		return PTR_ERR(bh);
+	if (bh) {
+		brelse(bh);
+		return 0;
+	}
+
+	/* ext4_add_entry() takes the name and the directory from a dentry */
+	parent = d_obtain_alias(igrab(dir));
+	if (IS_ERR(parent))
+		return PTR_ERR(parent);
+	dentry = d_alloc(parent, name);
+	if (!dentry) {
+		dput(parent);
+		return -ENOMEM;
+	}
+
+	handle = ext4_journal_start(dir, EXT4_HT_DIR,
+		(EXT4_DATA_TRANS_BLOCKS(dir->i_sb) +
+		 EXT4_INDEX_EXTRA_TRANS_BLOCKS) + 1);
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+		goto out;
+	}
+
+	err = ext4_add_entry(handle, dentry, inode);
+	if (!err) {
+		inode->i_ctime = current_time(inode);
+		ext4_inc_count(handle, inode);
+		ext4_mark_inode_dirty(handle, inode);
+	}
+	ext4_journal_stop(handle);
+out:
+	dput(dentry);
+	dput(parent);
+	return err;
+}
+
 
 /*
  * Try to find buffer head where contains the parent block.
@@ -3840,8 +3944,10 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 		unlock_new_inode(whiteout);
 		iput(whiteout);
 	}
-	if (handle)
+	if (handle) {
+		ext4_fc_mark_ineligible(old.dir->i_sb, handle);
 		ext4_journal_stop(handle);
+	}
 	return retval;
 }
 
@@ -3980,8 +4086,10 @@ static int ext4_cross_rename(struct inode *old_dir, struct dentry *old_dentry,
 	brelse(new.dir_bh);
 	brelse(old.bh);
 	brelse(new.bh);
-	if (handle)
+	if (handle) {
+		ext4_fc_mark_ineligible(old.dir->i_sb, handle);
 		ext4_journal_stop(handle);
+	}
 	return retval;
 }
 
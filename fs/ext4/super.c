@@ -992,6 +992,7 @@ static void ext4_put_super(struct super_block *sb)
 	ext4_unregister_sysfs(sb);
 	ext4_es_unregister_shrinker(sbi);
 	del_timer_sync(&sbi->s_err_report);
+	ext4_fc_destroy(sb);
 	ext4_release_system_zone(sb);
 	ext4_mb_release(sb);
 	ext4_ext_release(sb);
@@ -1111,6 +1112,7 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->i_datasync_tid = 0;
 	atomic_set(&ei->i_unwritten, 0);
 	INIT_WORK(&ei->i_rsv_conversion_work, ext4_end_io_rsv_work);
+	ext4_fc_init_inode(&ei->vfs_inode);
 	return &ei->vfs_inode;
 }
 
@@ -1183,6 +1185,7 @@ void ext4_clear_inode(struct inode *inode)
 {
 	invalidate_inode_buffers(inode);
 	clear_inode(inode);
+	ext4_fc_del(inode);
 	ext4_discard_preallocations(inode);
 	ext4_es_remove_extent(inode, 0, EXT_MAX_BLOCKS);
 	dquot_drop(inode);
@@ -1470,6 +1473,7 @@ enum {
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
 	Opt_max_dir_size_kb, Opt_nojournal_checksum, Opt_nombcache,
+	Opt_inlinecrypt, Opt_mb_optimize_scan,
 };
 
 static const match_table_t tokens = {
@@ -1554,8 +1558,10 @@ static const match_table_t tokens = {
 	{Opt_noinit_itable, "noinit_itable"},
 	{Opt_max_dir_size_kb, "max_dir_size_kb=%u"},
 	{Opt_test_dummy_encryption, "test_dummy_encryption"},
+	{Opt_inlinecrypt, "inlinecrypt"},
 	{Opt_nombcache, "nombcache"},
 	{Opt_nombcache, "no_mbcache"},	/* for backward compatibility */
+	{Opt_mb_optimize_scan, "mb_optimize_scan=%u"},
 	{Opt_removed, "check=none"},	/* mount option from ext2/3 */
 	{Opt_removed, "nocheck"},	/* mount option from ext2/3 */
 	{Opt_removed, "reservation"},	/* mount option from ext2/3 */
@@ -1765,7 +1771,13 @@ static const struct mount_opts {
 	{Opt_jqfmt_vfsv1, QFMT_VFS_V1, MOPT_QFMT},
 	{Opt_max_dir_size_kb, 0, MOPT_GTE0},
 	{Opt_test_dummy_encryption, 0, MOPT_GTE0},
+#ifdef CONFIG_FS_ENCRYPTION_INLINE_CRYPT
+	{Opt_inlinecrypt, 0, MOPT_SET},
+#else
+	{Opt_inlinecrypt, 0, MOPT_NOSUPPORT},
+#endif
 	{Opt_nombcache, EXT4_MOUNT_NO_MBCACHE, MOPT_SET},
+	{Opt_mb_optimize_scan, 0, MOPT_GTE0},
 	{Opt_err, 0, 0}
 };
 
@@ -1925,6 +1937,26 @@ static int handle_mount_opt(struct super_block *sb, char *opt, int token,
 		sbi->s_li_wait_mult = arg;
 	} else if (token == Opt_max_dir_size_kb) {
 		sbi->s_max_dir_size_kb = arg;
+	} else if (token == Opt_mb_optimize_scan) {
+		if (arg > 1) {
+			ext4_msg(sb, KERN_ERR,
+				 "mb_optimize_scan should be set to 0 or 1.");
+			return -1;
+		}
+		if (is_remount) {
+			/* The free space lists are only kept when enabled */
+			if (!arg != !test_opt2(sb, MB_OPTIMIZE_SCAN)) {
+				ext4_msg(sb, KERN_ERR, "can't change "
+					 "mb_optimize_scan on remount");
+				return -1;
+			}
+		} else {
+			if (arg)
+				set_opt2(sb, MB_OPTIMIZE_SCAN);
+			else
+				clear_opt2(sb, MB_OPTIMIZE_SCAN);
+			set_opt2(sb, EXPLICIT_MB_OPTIMIZE_SCAN);
+		}
 	} else if (token == Opt_stripe) {
 		sbi->s_stripe = arg;
 	} else if (token == Opt_resuid) {
@@ -2003,6 +2035,8 @@ static int handle_mount_opt(struct super_block *sb, char *opt, int token,
 		ext4_msg(sb, KERN_WARNING,
 			 "Test dummy encryption mount option ignored");
 #endif
+	} else if (token == Opt_inlinecrypt) {
+		sb->s_flags |= SB_INLINECRYPT;
 	} else if (m->flags & MOPT_DATAJ) {
 		if (is_remount) {
 			if (!sbi->s_journal)
@@ -2259,10 +2293,15 @@ static int _ext4_show_options(struct seq_file *seq, struct super_block *sb,
 		SEQ_OPTS_PRINT("init_itable=%u", sbi->s_li_wait_mult);
 	if (nodefs || sbi->s_max_dir_size_kb)
 		SEQ_OPTS_PRINT("max_dir_size_kb=%u", sbi->s_max_dir_size_kb);
+	if (nodefs || test_opt2(sb, EXPLICIT_MB_OPTIMIZE_SCAN))
+		SEQ_OPTS_PRINT("mb_optimize_scan=%u",
+			       test_opt2(sb, MB_OPTIMIZE_SCAN) ? 1 : 0);
 	if (test_opt(sb, DATA_ERR_ABORT))
 		SEQ_OPTS_PUTS("data_err=abort");
 	if (DUMMY_ENCRYPTION_ENABLED(sbi))
 		SEQ_OPTS_PUTS("test_dummy_encryption");
+	if (sb->s_flags & SB_INLINECRYPT)
+		SEQ_OPTS_PUTS("inlinecrypt");
 
 	ext4_show_quota_options(seq, sb);
 	return 0;
@@ -4343,6 +4382,8 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 
 	INIT_LIST_HEAD(&sbi->s_orphan); /* unlinked but open files */
 	mutex_init(&sbi->s_orphan_lock);
+	spin_lock_init(&sbi->s_fc_lock);
+	INIT_LIST_HEAD(&sbi->s_fc_dentry_q);
 
 	sb->s_root = NULL;
 
@@ -4411,6 +4452,18 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount_wq;
 	}
 
+	if (ext4_has_feature_fast_commit(sb)) {
+		if (ext4_has_feature_bigalloc(sb))
+			ext4_msg(sb, KERN_WARNING, "fast commits not "
+				 "supported with bigalloc");
+		else if (!jbd2_journal_set_features(sbi->s_journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+			ext4_msg(sb, KERN_WARNING, "Failed to set fast commit "
+				 "journal feature");
+		else
+			set_opt2(sb, JOURNAL_FAST_COMMIT);
+	}
+
 	/* We have now updated the journal if required, so we can
 	 * validate the data journaling mode. */
 	switch (test_opt(sb, DATA_FLAGS)) {
@@ -4619,6 +4672,18 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	}
 #endif  /* CONFIG_QUOTA */
 
+	/*
+	 * Replay fast commits first, inodes they leave without links are put
+	 * on the orphan list and cleaned up below.  A partial replay would
+	 * leave the filesystem inconsistent, so fail the mount instead.
+	 */
+	err = ext4_fc_replay(sb);
+	if (err) {
+		ext4_msg(sb, KERN_ERR, "failed to replay fast commits: %d",
+			 err);
+		goto failed_mount9;
+	}
+
 	EXT4_SB(sb)->s_mount_state |= EXT4_ORPHAN_FS;
 	ext4_orphan_cleanup(sb, es);
 	EXT4_SB(sb)->s_mount_state &= ~EXT4_ORPHAN_FS;
@@ -4667,10 +4732,12 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		ext4_msg(sb, KERN_ERR, "VFS: Can't find ext4 filesystem");
 	goto failed_mount;
 
+failed_mount9:
+	ext4_quota_off_umount(sb);
 #ifdef CONFIG_QUOTA
 failed_mount8:
-	ext4_unregister_sysfs(sb);
 #endif
+	ext4_unregister_sysfs(sb);
 failed_mount7:
 	ext4_unregister_li_request(sb);
 failed_mount6:
@@ -4710,6 +4777,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		sbi->s_journal = NULL;
 	}
 failed_mount3a:
+	ext4_fc_destroy(sb);
 	ext4_es_unregister_shrinker(sbi);
 failed_mount3:
 	del_timer_sync(&sbi->s_err_report);
@@ -4769,6 +4837,7 @@ static void ext4_init_journal_params(struct super_block *sb, journal_t *journal)
 	else
 		journal->j_flags &= ~JBD2_ABORT_ON_SYNCDATA_ERR;
 	write_unlock(&journal->j_state_lock);
+	ext4_fc_init(sb, journal);
 }
 
 static struct inode *ext4_get_journal_inode(struct super_block *sb,
@@ -2317,6 +2317,9 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 	if (strlen(name) > 255)
 		return -ERANGE;
 
+	/* Fast commits don't log xattrs */
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
+
 	ext4_write_lock_xattr(inode, &no_expand);
 
 	/* Check journal credits under write lock. */
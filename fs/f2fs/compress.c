@@ -0,0 +1,1214 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fs/f2fs/compress.c
+ *
+ * Transparent compression of regular files.
+ *
+ * A compressed file is split into clusters of 2^i_log_cluster_size pages,
+ * and addrs_per_inode()/addrs_per_block() keep every cluster within one node
+ * block.  A cluster whose pages all lie below EOF may be stored compressed:
+ * its first block address is then COMPRESS_ADDR, the following ones point to
+ * the compressed data (a struct compress_data header followed by the output
+ * of the compressor), and the rest are NULL_ADDR.  Those NULL_ADDR slots are
+ * the blocks compression saved; i_compr_blocks counts them.  Any other
+ * cluster is stored as is.
+ *
+ * Clusters are written back as a whole: f2fs_write_cluster() locks every page
+ * of the cluster and compresses it, or writes its pages one by one when that
+ * would not save a block.  Reading a compressed cluster fetches its blocks
+ * synchronously and decompresses them once for all the pages being read.
+ * Before a page of a compressed cluster is dirtied, the blocks compression
+ * saved are reserved again, so that writeback can always fall back to storing
+ * the cluster uncompressed.
+ */
+#include <linux/fs.h>
+#include <linux/f2fs_fs.h>
+#include <linux/writeback.h>
+#include <linux/backing-dev.h>
+#include <linux/blkdev.h>
+#include <linux/crypto.h>
+#include <linux/lzo.h>
+#include <linux/sched/mm.h>
+#include <linux/threads.h>
+#include <linux/vmalloc.h>
+
+#include "f2fs.h"
+#include "node.h"
+#include "segment.h"
+
+#define F2FS_COMPRESSED_PAGE_MAGIC	0xF5F2C000
+
+/* on-disk header of a compressed cluster */
+struct compress_data {
+	__le32 clen;			/* compressed data size */
+	__le32 chksum;			/* checksum of compressed data */
+	__le32 reserved[4];		/* reserved */
+	u8 cdata[];			/* compressed data */
+};
+
+#define COMPRESS_HEADER_SIZE	(sizeof(struct compress_data))
+
+/* keeps the pages of a cluster under writeback until its data is on disk */
+struct compress_io_ctx {
+	u32 magic;			/* F2FS_COMPRESSED_PAGE_MAGIC */
+	struct inode *inode;		/* inode the cluster belongs to */
+	struct page **rpages;		/* pagecache pages of the cluster */
+	unsigned int nr_rpages;		/* # of pages in rpages */
+	atomic_t pending_pages;		/* # of compressed pages in flight */
+};
+
+/* a compressor instance and its output buffer */
+struct f2fs_comp_strm {
+	struct list_head list;		/* link in f2fs_comp_pool.idle_strm */
+	struct crypto_comp *tfm;	/* crypto API compressor */
+	void *buf;			/* compressed data with its header */
+	unsigned int buf_size;		/* size of buf */
+};
+
+/*
+ * Compressors are shared by all f2fs instances.  Up to one per online CPU is
+ * allocated on demand for each algorithm, and kept on an idle list once used.
+ */
+struct f2fs_comp_pool {
+	const char *name;		/* crypto API algorithm name */
+	spinlock_t lock;		/* protects idle_strm and avail_strm */
+	struct list_head idle_strm;	/* streams not in use */
+	unsigned int avail_strm;	/* # of allocated streams */
+	wait_queue_head_t strm_wait;	/* waiters for an idle stream */
+};
+
+static struct f2fs_comp_pool f2fs_comp_pools[COMPRESS_MAX] = {
+	[COMPRESS_LZO]	= { .name = "lzo" },
+	[COMPRESS_LZ4]	= { .name = "lz4" },
+	[COMPRESS_ZSTD]	= { .name = "zstd" },
+};
+
+/* kvmalloc() only falls back to vmalloc() for GFP_KERNEL allocations */
+static void *f2fs_compress_kvmalloc(size_t size)
+{
+	unsigned int nofs_flag;
+	void *p;
+
+	nofs_flag = memalloc_nofs_save();
+	p = kvmalloc(size, GFP_KERNEL);
+	memalloc_nofs_restore(nofs_flag);
+	return p;
+}
+
+static struct f2fs_comp_strm *f2fs_comp_strm_alloc(const char *name)
+{
+	struct f2fs_comp_strm *strm;
+	unsigned int nofs_flag;
+
+	strm = kzalloc(sizeof(*strm), GFP_NOFS);
+	if (!strm)
+		return ERR_PTR(-ENOMEM);
+
+	nofs_flag = memalloc_nofs_save();
+	strm->tfm = crypto_alloc_comp(name, 0, 0);
+	memalloc_nofs_restore(nofs_flag);
+	if (IS_ERR(strm->tfm)) {
+		int err = PTR_ERR(strm->tfm);
+
+		kfree(strm);
+		return ERR_PTR(err);
+	}
+	return strm;
+}
+
+static void f2fs_comp_strm_free(struct f2fs_comp_strm *strm)
+{
+	crypto_free_comp(strm->tfm);
+	kvfree(strm->buf);
+	kfree(strm);
+}
+
+static struct f2fs_comp_strm *f2fs_comp_strm_get(struct f2fs_comp_pool *pool)
+{
+	struct f2fs_comp_strm *strm;
+
+	while (1) {
+		spin_lock(&pool->lock);
+		if (!list_empty(&pool->idle_strm)) {
+			strm = list_first_entry(&pool->idle_strm,
+						struct f2fs_comp_strm, list);
+			list_del(&strm->list);
+			spin_unlock(&pool->lock);
+			return strm;
+		}
+
+		if (pool->avail_strm >= num_online_cpus()) {
+			spin_unlock(&pool->lock);
+			wait_event(pool->strm_wait,
+					!list_empty(&pool->idle_strm));
+			continue;
+		}
+		pool->avail_strm++;
+		spin_unlock(&pool->lock);
+
+		strm = f2fs_comp_strm_alloc(pool->name);
+		if (!IS_ERR(strm))
+			return strm;
+
+		spin_lock(&pool->lock);
+		pool->avail_strm--;
+		if (!pool->avail_strm) {
+			/* nobody will release a stream to us */
+			spin_unlock(&pool->lock);
+			return strm;
+		}
+		spin_unlock(&pool->lock);
+		wait_event(pool->strm_wait, !list_empty(&pool->idle_strm));
+	}
+}
+
+static void f2fs_comp_strm_put(struct f2fs_comp_pool *pool,
+					struct f2fs_comp_strm *strm)
+{
+	spin_lock(&pool->lock);
+	list_add(&strm->list, &pool->idle_strm);
+	spin_unlock(&pool->lock);
+	wake_up(&pool->strm_wait);
+}
+
+static int f2fs_comp_strm_reserve(struct f2fs_comp_strm *strm,
+						unsigned int size)
+{
+	if (strm->buf_size >= size)
+		return 0;
+
+	kvfree(strm->buf);
+	strm->buf = f2fs_compress_kvmalloc(size);
+	if (!strm->buf) {
+		strm->buf_size = 0;
+		return -ENOMEM;
+	}
+	strm->buf_size = size;
+	return 0;
+}
+
+static struct f2fs_comp_pool *f2fs_inode_comp_pool(struct inode *inode)
+{
+	return &f2fs_comp_pools[F2FS_I(inode)->i_compress_algorithm];
+}
+
+/*
+ * Compress the pages of a full cluster into newly allocated @cpages.
+ * Returns the number of compressed pages, 0 if compression would not save
+ * any block, or -errno.
+ */
+static int f2fs_compress_pages(struct inode *inode, struct page **rpages,
+						struct page **cpages)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct f2fs_comp_pool *pool = f2fs_inode_comp_pool(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	unsigned int rlen = cluster_size << PAGE_SHIFT;
+	unsigned int clen, nr_cpages, i;
+	struct compress_data *cdata;
+	struct f2fs_comp_strm *strm;
+	void *rbuf;
+	u64 start;
+	int ret;
+
+	rbuf = vmap(rpages, cluster_size, VM_MAP, PAGE_KERNEL_RO);
+	if (!rbuf)
+		return -ENOMEM;
+
+	strm = f2fs_comp_strm_get(pool);
+	if (IS_ERR(strm)) {
+		ret = PTR_ERR(strm);
+		goto out_vunmap;
+	}
+
+	ret = f2fs_comp_strm_reserve(strm,
+			COMPRESS_HEADER_SIZE + lzo1x_worst_compress(rlen));
+	if (ret)
+		goto out_put_strm;
+
+	cdata = strm->buf;
+	clen = strm->buf_size - COMPRESS_HEADER_SIZE;
+	start = ktime_get_ns();
+	if (crypto_comp_compress(strm->tfm, rbuf, rlen, cdata->cdata, &clen)) {
+		/* not compressible, write the cluster as is */
+		ret = 0;
+		goto out_put_strm;
+	}
+	atomic64_add(ktime_get_ns() - start, &sbi->compress_ns);
+	atomic64_inc(&sbi->compress_count);
+
+	nr_cpages = DIV_ROUND_UP(COMPRESS_HEADER_SIZE + clen, PAGE_SIZE);
+	if (nr_cpages > cluster_size - 2) {
+		/* COMPRESS_ADDR takes a slot, so this saves nothing */
+		ret = 0;
+		goto out_put_strm;
+	}
+
+	cdata->clen = cpu_to_le32(clen);
+	cdata->chksum = cpu_to_le32(f2fs_crc32(sbi, cdata->cdata, clen));
+	memset(cdata->reserved, 0, sizeof(cdata->reserved));
+	memset(cdata->cdata + clen, 0,
+		(nr_cpages << PAGE_SHIFT) - COMPRESS_HEADER_SIZE - clen);
+
+	for (i = 0; i < nr_cpages; i++) {
+		cpages[i] = alloc_page(GFP_NOFS);
+		if (!cpages[i]) {
+			while (i--) {
+				__free_page(cpages[i]);
+				cpages[i] = NULL;
+			}
+			ret = -ENOMEM;
+			goto out_put_strm;
+		}
+		memcpy(page_address(cpages[i]),
+			strm->buf + (i << PAGE_SHIFT), PAGE_SIZE);
+	}
+	ret = nr_cpages;
+out_put_strm:
+	f2fs_comp_strm_put(pool, strm);
+out_vunmap:
+	vunmap(rbuf);
+	return ret;
+}
+
+/*
+ * Look up the cluster starting at @index.  Returns the number of blocks
+ * holding its compressed data, stored in @blkaddr if it isn't NULL, 0 if the
+ * cluster isn't compressed, or -errno.
+ */
+static int f2fs_lookup_cluster(struct inode *inode, pgoff_t index,
+							block_t *blkaddr)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	struct dnode_of_data dn;
+	unsigned int i;
+	int ret;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	ret = f2fs_get_dnode_of_data(&dn, index, LOOKUP_NODE);
+	if (ret)
+		return ret == -ENOENT ? 0 : ret;
+
+	if (dn.data_blkaddr != COMPRESS_ADDR)
+		goto out;
+
+	for (i = 1; i < cluster_size; i++) {
+		block_t addr = datablock_addr(dn.inode, dn.node_page,
+						dn.ofs_in_node + i);
+
+		if (!__is_valid_data_blkaddr(addr))
+			break;
+		if (blkaddr)
+			blkaddr[i - 1] = addr;
+		ret++;
+	}
+	if (!ret) {
+		set_sbi_flag(sbi, SBI_NEED_FSCK);
+		ret = -EFSCORRUPTED;
+	}
+out:
+	f2fs_put_dnode(&dn);
+	return ret;
+}
+
+static int f2fs_submit_bio_wait(struct bio *bio)
+{
+	int ret = submit_bio_wait(bio);
+
+	bio_put(bio);
+	return ret;
+}
+
+/* Read @nr blocks into @pages, and wait for them. */
+static int f2fs_read_blocks(struct inode *inode, block_t *blkaddr,
+				struct page **pages, unsigned int nr)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct bio *bio = NULL;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < nr; i++) {
+		if (!f2fs_is_valid_blkaddr(sbi, blkaddr[i],
+						DATA_GENERIC_ENHANCE_READ)) {
+			ret = -EFSCORRUPTED;
+			break;
+		}
+
+		/* wait for GCed page writeback via META_MAPPING */
+		f2fs_wait_on_block_writeback(inode, blkaddr[i]);
+
+		if (bio && (blkaddr[i] != blkaddr[i - 1] + 1 ||
+			f2fs_target_device_index(sbi, blkaddr[i]) !=
+			f2fs_target_device_index(sbi, blkaddr[i - 1]))) {
+			ret = f2fs_submit_bio_wait(bio);
+			bio = NULL;
+			if (ret)
+				break;
+		}
+		if (!bio) {
+			bio = f2fs_bio_alloc(sbi, nr - i, true);
+			f2fs_target_device(sbi, blkaddr[i], bio);
+			bio_set_op_attrs(bio, REQ_OP_READ, 0);
+		}
+		if (bio_add_page(bio, pages[i], PAGE_SIZE, 0) < PAGE_SIZE) {
+			ret = -EIO;
+			break;
+		}
+	}
+	if (bio) {
+		int err = f2fs_submit_bio_wait(bio);
+
+		if (!ret)
+			ret = err;
+	}
+	return ret;
+}
+
+static int f2fs_decompress_cluster(struct compress_ctx *cc,
+						unsigned int nr_cpages)
+{
+	struct inode *inode = cc->inode;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct f2fs_comp_pool *pool = f2fs_inode_comp_pool(inode);
+	unsigned int rlen = F2FS_I(inode)->i_cluster_size << PAGE_SHIFT;
+	unsigned int clen, dlen, i;
+	struct compress_data *cdata;
+	struct f2fs_comp_strm *strm;
+	struct page **cpages;
+	u64 start;
+	int ret;
+
+	if (!cc->rbuf) {
+		cc->rbuf = f2fs_compress_kvmalloc(rlen);
+		if (!cc->rbuf)
+			return -ENOMEM;
+	}
+
+	cpages = kcalloc(nr_cpages, sizeof(struct page *), GFP_NOFS);
+	if (!cpages)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_cpages; i++) {
+		cpages[i] = alloc_page(GFP_NOFS);
+		if (!cpages[i]) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	ret = f2fs_read_blocks(inode, cc->blkaddr, cpages, nr_cpages);
+	if (ret)
+		goto out_free;
+
+	cdata = vmap(cpages, nr_cpages, VM_MAP, PAGE_KERNEL_RO);
+	if (!cdata) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	clen = le32_to_cpu(cdata->clen);
+	if (clen > (nr_cpages << PAGE_SHIFT) - COMPRESS_HEADER_SIZE ||
+			f2fs_crc32(sbi, cdata->cdata, clen) !=
+					le32_to_cpu(cdata->chksum)) {
+		ret = -EFSCORRUPTED;
+		goto out_vunmap;
+	}
+
+	strm = f2fs_comp_strm_get(pool);
+	if (IS_ERR(strm)) {
+		ret = PTR_ERR(strm);
+		goto out_vunmap;
+	}
+
+	dlen = rlen;
+	start = ktime_get_ns();
+	ret = crypto_comp_decompress(strm->tfm, cdata->cdata, clen,
+							cc->rbuf, &dlen);
+	f2fs_comp_strm_put(pool, strm);
+	if (ret || dlen != rlen) {
+		ret = -EFSCORRUPTED;
+		goto out_vunmap;
+	}
+	atomic64_add(ktime_get_ns() - start, &sbi->decompress_ns);
+	atomic64_inc(&sbi->decompress_count);
+out_vunmap:
+	vunmap(cdata);
+	if (ret == -EFSCORRUPTED) {
+		set_sbi_flag(sbi, SBI_NEED_FSCK);
+		f2fs_warn(sbi, "%s: corrupted compressed cluster, ino:%lu, cluster:%lu, blkaddr:%u",
+			  __func__, inode->i_ino,
+			  (unsigned long)cc->cluster_idx, cc->blkaddr[0]);
+	}
+out_free:
+	for (i = 0; i < nr_cpages; i++)
+		if (cpages[i])
+			__free_page(cpages[i]);
+	kfree(cpages);
+	return ret;
+}
+
+/**
+ * f2fs_read_compressed_page - fill a page from its compressed cluster
+ * @cc: read state, reused across the pages of one read request
+ * @page: locked pagecache page of a compressed file
+ *
+ * Returns 0 with @page uptodate, -EAGAIN if the cluster of @page isn't
+ * compressed and the page has to be read as usual, or another -errno.
+ * @page is left locked in every case.
+ */
+int f2fs_read_compressed_page(struct compress_ctx *cc, struct page *page)
+{
+	struct inode *inode = cc->inode;
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	pgoff_t cluster_idx = page->index >> F2FS_I(inode)->i_log_cluster_size;
+	unsigned int ofs = page->index & (cluster_size - 1);
+	void *dst;
+	int ret;
+
+	if (!cc->blkaddr) {
+		cc->blkaddr = kcalloc(cluster_size - 1, sizeof(block_t),
+								GFP_NOFS);
+		if (!cc->blkaddr)
+			return -ENOMEM;
+	}
+
+	ret = f2fs_lookup_cluster(inode, round_down(page->index, cluster_size),
+								cc->blkaddr);
+	if (ret <= 0)
+		return ret ? ret : -EAGAIN;
+
+	/* rbuf is stale if the cluster was rewritten or moved meanwhile */
+	if (cc->cluster_idx != cluster_idx || cc->cblkaddr != cc->blkaddr[0]) {
+		cc->cluster_idx = cluster_idx;
+		ret = f2fs_decompress_cluster(cc, ret);
+		if (ret) {
+			cc->cluster_idx = NULL_CLUSTER;
+			return ret;
+		}
+		cc->cblkaddr = cc->blkaddr[0];
+	}
+
+	dst = kmap_atomic(page);
+	memcpy(dst, cc->rbuf + (ofs << PAGE_SHIFT), PAGE_SIZE);
+	kunmap_atomic(dst);
+	flush_dcache_page(page);
+	SetPageUptodate(page);
+	return 0;
+}
+
+int f2fs_read_compressed_single_page(struct inode *inode, struct page *page)
+{
+	struct compress_ctx cc;
+	int ret;
+
+	f2fs_init_compress_ctx(&cc, inode);
+	ret = f2fs_read_compressed_page(&cc, page);
+	f2fs_destroy_compress_ctx(&cc);
+	return ret;
+}
+
+void f2fs_destroy_compress_ctx(struct compress_ctx *cc)
+{
+	kvfree(cc->rbuf);
+	kfree(cc->blkaddr);
+	f2fs_init_compress_ctx(cc, cc->inode);
+}
+
+static int f2fs_read_raw_page(struct inode *inode, struct page *page)
+{
+	struct dnode_of_data dn;
+	block_t blkaddr = NULL_ADDR;
+	int ret;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	ret = f2fs_get_dnode_of_data(&dn, page->index, LOOKUP_NODE);
+	if (ret && ret != -ENOENT)
+		return ret;
+	if (!ret) {
+		blkaddr = dn.data_blkaddr;
+		f2fs_put_dnode(&dn);
+	}
+
+	if (blkaddr == NULL_ADDR || blkaddr == NEW_ADDR) {
+		zero_user_segment(page, 0, PAGE_SIZE);
+	} else {
+		ret = f2fs_read_blocks(inode, &blkaddr, &page, 1);
+		if (ret)
+			return ret;
+	}
+	SetPageUptodate(page);
+	return 0;
+}
+
+/* Bring the locked pages of a cluster uptodate. */
+static int f2fs_read_cluster_pages(struct inode *inode, struct page **rpages,
+						unsigned int nr_pages)
+{
+	struct compress_ctx cc;
+	unsigned int i;
+	int ret = 0;
+
+	f2fs_init_compress_ctx(&cc, inode);
+	for (i = 0; i < nr_pages && !ret; i++) {
+		if (PageUptodate(rpages[i]))
+			continue;
+		ret = f2fs_read_compressed_page(&cc, rpages[i]);
+		if (ret == -EAGAIN)
+			ret = f2fs_read_raw_page(inode, rpages[i]);
+	}
+	f2fs_destroy_compress_ctx(&cc);
+	return ret;
+}
+
+static void f2fs_set_cluster_blkaddr(struct dnode_of_data *dn,
+				unsigned int start, unsigned int i,
+				block_t blkaddr)
+{
+	dn->ofs_in_node = start + i;
+	dn->data_blkaddr = blkaddr;
+	f2fs_set_data_blkaddr(dn);
+}
+
+static unsigned int f2fs_count_cluster_nulls(struct dnode_of_data *dn,
+				unsigned int start, unsigned int ofs,
+				unsigned int end)
+{
+	unsigned int i, count = 0;
+
+	for (i = ofs; i < end; i++)
+		if (datablock_addr(dn->inode, dn->node_page,
+					start + i) == NULL_ADDR)
+			count++;
+	return count;
+}
+
+/*
+ * Reserve every NULL_ADDR slot in [@ofs, @end) of the cluster starting at
+ * @start in @dn, or none of them.  Returns the number of reserved blocks or
+ * -errno.
+ */
+static int f2fs_reserve_cluster_blocks(struct dnode_of_data *dn,
+				unsigned int start, unsigned int ofs,
+				unsigned int end)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dn->inode);
+	blkcnt_t count, wanted;
+	unsigned int i;
+	int err;
+
+	wanted = f2fs_count_cluster_nulls(dn, start, ofs, end);
+	if (!wanted)
+		return 0;
+
+	if (unlikely(is_inode_flag_set(dn->inode, FI_NO_ALLOC)))
+		return -EPERM;
+
+	/* inc_valid_block_count() may grant only part of the request */
+	count = wanted;
+	err = inc_valid_block_count(sbi, dn->inode, &count);
+	if (err)
+		return err;
+	if (count < wanted) {
+		dec_valid_block_count(sbi, dn->inode, count);
+		return -ENOSPC;
+	}
+
+	for (i = ofs; i < end; i++)
+		if (datablock_addr(dn->inode, dn->node_page,
+					start + i) == NULL_ADDR)
+			f2fs_set_cluster_blkaddr(dn, start, i, NEW_ADDR);
+	dn->ofs_in_node = start;
+	return wanted;
+}
+
+/*
+ * Drop the blocks in [@ofs, cluster_size) of the cluster starting at @start
+ * in @dn.  Returns the number of NULL_ADDR slots that were there.
+ */
+static unsigned int f2fs_release_cluster_blocks(struct dnode_of_data *dn,
+				unsigned int start, unsigned int ofs)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(dn->inode);
+	unsigned int cluster_size = F2FS_I(dn->inode)->i_cluster_size;
+	unsigned int i, nr_free = 0, nr_null = 0;
+
+	for (i = ofs; i < cluster_size; i++) {
+		block_t blkaddr = datablock_addr(dn->inode, dn->node_page,
+								start + i);
+
+		if (blkaddr == NULL_ADDR) {
+			nr_null++;
+			continue;
+		}
+		if (__is_valid_data_blkaddr(blkaddr))
+			f2fs_invalidate_blocks(sbi, blkaddr);
+		f2fs_set_cluster_blkaddr(dn, start, i, NULL_ADDR);
+		nr_free++;
+	}
+	if (nr_free)
+		dec_valid_block_count(sbi, dn->inode, nr_free);
+	dn->ofs_in_node = start;
+	return nr_null;
+}
+
+/**
+ * f2fs_prepare_compress_overwrite - get a compressed cluster ready to dirty
+ * @inode: a compressed file
+ * @index: page about to be dirtied
+ *
+ * Reserves the blocks the cluster of @index saved by being compressed, so
+ * that writeback can store it uncompressed if needed.  Returns 1 if that
+ * cluster is compressed, 0 if it isn't, or -errno.
+ */
+int f2fs_prepare_compress_overwrite(struct inode *inode, pgoff_t index)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	struct dnode_of_data dn;
+	int ret;
+
+	__do_map_lock(sbi, F2FS_GET_BLOCK_PRE_AIO, true);
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	ret = f2fs_get_dnode_of_data(&dn, round_down(index, cluster_size),
+								LOOKUP_NODE);
+	if (ret) {
+		if (ret == -ENOENT)
+			ret = 0;
+		goto out;
+	}
+
+	if (dn.data_blkaddr == COMPRESS_ADDR) {
+		ret = f2fs_reserve_cluster_blocks(&dn, dn.ofs_in_node, 1,
+								cluster_size);
+		if (ret >= 0) {
+			f2fs_i_compr_blocks_update(inode, -ret);
+			ret = 1;
+		}
+	}
+	f2fs_put_dnode(&dn);
+out:
+	__do_map_lock(sbi, F2FS_GET_BLOCK_PRE_AIO, false);
+	return ret;
+}
+
+/**
+ * f2fs_truncate_partial_cluster - store the cluster holding @from raw
+ * @inode: a compressed file
+ * @from: new size of @inode
+ *
+ * The data of a compressed cluster can't be cut short in place, so before
+ * the blocks past @from are truncated, a compressed cluster straddling @from
+ * is written back uncompressed.
+ */
+int f2fs_truncate_partial_cluster(struct inode *inode, u64 from)
+{
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	pgoff_t start = round_down(from >> PAGE_SHIFT, cluster_size);
+	pgoff_t end = DIV_ROUND_UP(from, PAGE_SIZE);
+	pgoff_t index;
+	int ret;
+
+	if (!(from & (((u64)cluster_size << PAGE_SHIFT) - 1)))
+		return 0;
+
+	ret = f2fs_prepare_compress_overwrite(inode, start);
+	if (ret <= 0)
+		return ret;
+
+	for (index = start; index < end; index++) {
+		struct page *page = f2fs_get_lock_data_page(inode, index, true);
+
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+		set_page_dirty(page);
+		f2fs_put_page(page, 1);
+	}
+
+	return filemap_write_and_wait_range(inode->i_mapping,
+				(loff_t)start << PAGE_SHIFT,
+				((loff_t)end << PAGE_SHIFT) - 1);
+}
+
+/*
+ * Write the locked pages of a cluster one by one, dirtying the clean ones
+ * below EOF too if @all is set.  Every page is unlocked on return.
+ */
+static int f2fs_write_raw_pages(struct inode *inode, struct page **rpages,
+				unsigned int nr_pages, bool all,
+				bool *submitted, struct writeback_control *wbc,
+				enum iostat_type io_type, bool op_locked,
+				int *nr_written)
+{
+	pgoff_t end_index = DIV_ROUND_UP(i_size_read(inode), PAGE_SIZE);
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = rpages[i];
+		bool _submitted = false;
+		int err;
+
+		if (!page)
+			continue;
+		if (ret) {
+			unlock_page(page);
+			continue;
+		}
+		if (all && page->index < end_index)
+			set_page_dirty(page);
+		if (!clear_page_dirty_for_io(page)) {
+			unlock_page(page);
+			continue;
+		}
+
+		err = f2fs_write_single_data_page(page, &_submitted, NULL,
+					NULL, wbc, io_type, op_locked);
+		if (err == AOP_WRITEPAGE_ACTIVATE) {
+			unlock_page(page);
+			continue;
+		}
+		if (err) {
+			ret = err;
+			continue;
+		}
+		(*nr_written)++;
+		*submitted |= _submitted;
+	}
+	return ret;
+}
+
+static int f2fs_write_compressed_pages(struct inode *inode, pgoff_t start,
+				struct page **rpages, struct page **cpages,
+				unsigned int nr_cpages,
+				struct writeback_control *wbc,
+				enum iostat_type io_type, int *nr_written)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	loff_t psize = (loff_t)(start + cluster_size) << PAGE_SHIFT;
+	struct compress_io_ctx *cic;
+	struct dnode_of_data dn;
+	struct node_info ni;
+	unsigned int old_nulls = 0, ofs, i;
+	block_t blkaddr;
+	struct f2fs_io_info fio = {
+		.sbi = sbi,
+		.ino = inode->i_ino,
+		.type = DATA,
+		.op = REQ_OP_WRITE,
+		.op_flags = wbc_to_write_flags(wbc),
+		.page = rpages[0],
+		.encrypted_page = NULL,
+		.need_lock = LOCK_DONE,
+		.io_type = io_type,
+		.io_wbc = wbc,
+	};
+	int err;
+
+	cic = kzalloc(sizeof(*cic), GFP_NOFS);
+	if (!cic)
+		return -ENOMEM;
+	cic->rpages = kcalloc(cluster_size, sizeof(struct page *), GFP_NOFS);
+	if (!cic->rpages) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = f2fs_get_dnode_of_data(&dn, start, ALLOC_NODE);
+	if (err)
+		goto out_free;
+	ofs = dn.ofs_in_node;
+
+	err = f2fs_get_node_info(sbi, dn.nid, &ni);
+	if (err)
+		goto out_put_dnode;
+	fio.version = ni.version;
+
+	if (dn.data_blkaddr == COMPRESS_ADDR)
+		old_nulls = f2fs_count_cluster_nulls(&dn, ofs, 1, cluster_size);
+
+	err = f2fs_reserve_cluster_blocks(&dn, ofs, 0, nr_cpages + 1);
+	if (err < 0)
+		goto out_put_dnode;
+
+	blkaddr = datablock_addr(dn.inode, dn.node_page, ofs);
+	if (__is_valid_data_blkaddr(blkaddr))
+		f2fs_invalidate_blocks(sbi, blkaddr);
+	f2fs_set_cluster_blkaddr(&dn, ofs, 0, COMPRESS_ADDR);
+
+	cic->magic = F2FS_COMPRESSED_PAGE_MAGIC;
+	cic->inode = inode;
+	cic->nr_rpages = cluster_size;
+	atomic_set(&cic->pending_pages, nr_cpages);
+	for (i = 0; i < cluster_size; i++) {
+		get_page(rpages[i]);
+		cic->rpages[i] = rpages[i];
+		if (clear_page_dirty_for_io(rpages[i])) {
+			inode_dec_dirty_pages(inode);
+			(*nr_written)++;
+		}
+		set_page_writeback(rpages[i]);
+		ClearPageError(rpages[i]);
+	}
+	/*
+	 * Compressed pages get a mapping so that fscrypt_is_bounce_page()
+	 * doesn't take them for bounce pages, it's cleared before freeing.
+	 */
+	for (i = 0; i < nr_cpages; i++) {
+		SetPagePrivate(cpages[i]);
+		set_page_private(cpages[i], (unsigned long)cic);
+		cpages[i]->mapping = inode->i_mapping;
+	}
+
+	for (i = 0; i < nr_cpages; i++) {
+		dn.ofs_in_node = ofs + i + 1;
+		dn.data_blkaddr = datablock_addr(dn.inode, dn.node_page,
+							dn.ofs_in_node);
+		fio.old_blkaddr = dn.data_blkaddr;
+		fio.compressed_page = cpages[i];
+		f2fs_outplace_write_data(&dn, &fio);
+		cpages[i] = NULL;
+	}
+
+	f2fs_release_cluster_blocks(&dn, ofs, nr_cpages + 1);
+	f2fs_put_dnode(&dn);
+
+	f2fs_i_compr_blocks_update(inode,
+			(s64)(cluster_size - 1 - nr_cpages) - old_nulls);
+	atomic64_add(nr_cpages, &sbi->compr_written_block);
+	atomic64_add(cluster_size - 1 - nr_cpages, &sbi->compr_saved_block);
+
+	set_inode_flag(inode, FI_APPEND_WRITE);
+	if (start == 0)
+		set_inode_flag(inode, FI_FIRST_BLOCK_WRITTEN);
+	down_write(&F2FS_I(inode)->i_sem);
+	if (F2FS_I(inode)->last_disk_size < psize)
+		F2FS_I(inode)->last_disk_size = psize;
+	up_write(&F2FS_I(inode)->i_sem);
+	return 0;
+
+out_put_dnode:
+	f2fs_put_dnode(&dn);
+out_free:
+	kfree(cic->rpages);
+	kfree(cic);
+	return err;
+}
+
+/* Store a compressed cluster raw: every page below EOF gets its own block. */
+static int f2fs_decompress_cluster_blocks(struct inode *inode, pgoff_t start,
+						unsigned int nr_pages)
+{
+	struct dnode_of_data dn;
+	unsigned int old_nulls, ofs;
+	int err;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = f2fs_get_dnode_of_data(&dn, start, LOOKUP_NODE);
+	if (err)
+		return err;
+
+	if (dn.data_blkaddr != COMPRESS_ADDR)
+		goto out;
+	ofs = dn.ofs_in_node;
+
+	old_nulls = f2fs_count_cluster_nulls(&dn, ofs, 1,
+					F2FS_I(inode)->i_cluster_size);
+	err = f2fs_reserve_cluster_blocks(&dn, ofs, 1, nr_pages);
+	if (err < 0)
+		goto out;
+	err = 0;
+
+	f2fs_set_cluster_blkaddr(&dn, ofs, 0, NEW_ADDR);
+	f2fs_release_cluster_blocks(&dn, ofs, nr_pages);
+	f2fs_i_compr_blocks_update(inode, -(s64)old_nulls);
+out:
+	f2fs_put_dnode(&dn);
+	return err;
+}
+
+/**
+ * f2fs_write_cluster - write back the cluster holding a dirty page
+ * @inode: a compressed file
+ * @index: index of the dirty page, which must not be locked by the caller
+ * @submitted: set if any I/O was issued
+ * @wbc: writeback control
+ * @io_type: I/O type for iostat
+ * @nr_written: returns the number of pages written
+ *
+ * A full cluster is compressed if that saves at least one block; otherwise
+ * its dirty pages are written one by one.  Returns -EAGAIN if the cluster
+ * should be retried later.
+ */
+int f2fs_write_cluster(struct inode *inode, pgoff_t index, bool *submitted,
+			struct writeback_control *wbc,
+			enum iostat_type io_type, int *nr_written)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct address_space *mapping = inode->i_mapping;
+	unsigned int cluster_size = F2FS_I(inode)->i_cluster_size;
+	pgoff_t start = round_down(index, cluster_size);
+	loff_t i_size = i_size_read(inode);
+	pgoff_t end_index = DIV_ROUND_UP(i_size, PAGE_SIZE);
+	unsigned int nr_pages = 0, i;
+	struct page **rpages, **cpages = NULL;
+	bool dirty = false, compressed;
+	int nr_cpages = 0;
+	int ret;
+
+	*nr_written = 0;
+
+	rpages = kcalloc(cluster_size, sizeof(struct page *), GFP_NOFS);
+	if (!rpages)
+		return -ENOMEM;
+
+	if (end_index > start)
+		nr_pages = min_t(pgoff_t, cluster_size, end_index - start);
+
+	/* lock the whole cluster, in index order like everybody else */
+	for (i = 0; i < cluster_size; i++) {
+		struct page *page;
+
+		if (i < nr_pages) {
+			page = f2fs_grab_cache_page(mapping, start + i, true);
+			if (!page) {
+				ret = -ENOMEM;
+				goto out_unlock;
+			}
+		} else {
+			page = find_lock_page(mapping, start + i);
+			if (!page)
+				continue;
+		}
+		f2fs_wait_on_page_writeback(page, DATA, true, true);
+		if (PageDirty(page))
+			dirty = true;
+		rpages[i] = page;
+	}
+	ret = 0;
+	if (!dirty)
+		goto out_unlock;
+
+	if (unlikely(f2fs_cp_error(sbi) ||
+			is_sbi_flag_set(sbi, SBI_POR_DOING)))
+		goto write_dirty;
+
+	ret = f2fs_lookup_cluster(inode, start, NULL);
+	if (ret < 0)
+		goto out_unlock;
+	compressed = ret;
+
+	/* a raw cluster that can't be compressed needs no more care */
+	if (!compressed && nr_pages < cluster_size)
+		goto write_dirty;
+
+	ret = f2fs_read_cluster_pages(inode, rpages, nr_pages);
+	if (ret)
+		goto out_unlock;
+
+	if (nr_pages == cluster_size) {
+		unsigned int offset = i_size & (PAGE_SIZE - 1);
+
+		/* the tail of the last page past EOF is compressed too */
+		if (offset)
+			zero_user_segment(rpages[nr_pages - 1], offset,
+								PAGE_SIZE);
+
+		cpages = kcalloc(cluster_size, sizeof(struct page *),
+								GFP_NOFS);
+		if (!cpages) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+		nr_cpages = f2fs_compress_pages(inode, rpages, cpages);
+		if (nr_cpages < 0) {
+			ret = nr_cpages;
+			goto out_unlock;
+		}
+	}
+
+	/* Deadlock due to between page->lock and f2fs_lock_op */
+	if (!f2fs_trylock_op(sbi)) {
+		ret = -EAGAIN;
+		goto out_unlock;
+	}
+
+	if (nr_cpages) {
+		ret = f2fs_write_compressed_pages(inode, start, rpages, cpages,
+					nr_cpages, wbc, io_type, nr_written);
+		if (!ret) {
+			*submitted = true;
+			for (i = 0; i < cluster_size; i++)
+				if (rpages[i])
+					unlock_page(rpages[i]);
+			goto out_unlock_op;
+		}
+		if (ret != -ENOSPC)
+			goto out_unlock_op_pages;
+	}
+
+	if (compressed) {
+		ret = f2fs_decompress_cluster_blocks(inode, start, nr_pages);
+		if (ret)
+			goto out_unlock_op_pages;
+	}
+	ret = f2fs_write_raw_pages(inode, rpages, cluster_size, compressed,
+				submitted, wbc, io_type, true, nr_written);
+out_unlock_op:
+	f2fs_unlock_op(sbi);
+	if (!IS_NOQUOTA(inode) && !F2FS_I(inode)->cp_task)
+		f2fs_balance_fs(sbi, !wbc->for_reclaim);
+	goto out_put;
+
+out_unlock_op_pages:
+	f2fs_unlock_op(sbi);
+	goto out_unlock;
+
+write_dirty:
+	ret = f2fs_write_raw_pages(inode, rpages, cluster_size, false,
+				submitted, wbc, io_type, false, nr_written);
+	goto out_put;
+
+out_unlock:
+	for (i = 0; i < cluster_size; i++)
+		if (rpages[i])
+			unlock_page(rpages[i]);
+out_put:
+	for (i = 0; i < cluster_size; i++)
+		if (rpages[i])
+			put_page(rpages[i]);
+	if (cpages) {
+		for (i = 0; i < cluster_size; i++)
+			if (cpages[i])
+				__free_page(cpages[i]);
+		kfree(cpages);
+	}
+	kfree(rpages);
+	return ret;
+}
+
+bool f2fs_is_compressed_page(struct page *page)
+{
+	struct compress_io_ctx *cic;
+
+	/* pagecache pages may carry a private flag with no context */
+	if (!PagePrivate(page) || !page_private(page) ||
+			IS_ATOMIC_WRITTEN_PAGE(page) ||
+			IS_DUMMY_WRITTEN_PAGE(page))
+		return false;
+	/* or, with F2FS_IO_TRACE, the pid of their writer */
+	if (IS_ENABLED(CONFIG_F2FS_IO_TRACE) &&
+			page_private(page) < PID_MAX_LIMIT)
+		return false;
+
+	cic = (struct compress_io_ctx *)page_private(page);
+	return cic->magic == F2FS_COMPRESSED_PAGE_MAGIC;
+}
+
+struct page *f2fs_compress_control_page(struct page *page)
+{
+	struct compress_io_ctx *cic =
+			(struct compress_io_ctx *)page_private(page);
+
+	return cic->rpages[0];
+}
+
+bool f2fs_compressed_page_covers(struct page *cpage, struct page *page)
+{
+	struct compress_io_ctx *cic =
+			(struct compress_io_ctx *)page_private(cpage);
+	unsigned int i;
+
+	for (i = 0; i < cic->nr_rpages; i++)
+		if (cic->rpages[i] == page)
+			return true;
+	return false;
+}
+
+void f2fs_compress_write_end_io(struct bio *bio, struct page *page)
+{
+	struct compress_io_ctx *cic =
+			(struct compress_io_ctx *)page_private(page);
+	struct f2fs_sb_info *sbi = F2FS_I_SB(cic->inode);
+	unsigned int i;
+
+	if (unlikely(bio->bi_status))
+		mapping_set_error(cic->inode->i_mapping, -EIO);
+
+	dec_page_count(sbi, F2FS_WB_DATA);
+	set_page_private(page, 0);
+	ClearPagePrivate(page);
+	page->mapping = NULL;
+	__free_page(page);
+
+	if (atomic_dec_return(&cic->pending_pages))
+		return;
+
+	for (i = 0; i < cic->nr_rpages; i++) {
+		clear_cold_data(cic->rpages[i]);
+		end_page_writeback(cic->rpages[i]);
+		put_page(cic->rpages[i]);
+	}
+	kfree(cic->rpages);
+	kfree(cic);
+}
+
+bool f2fs_may_compress(struct inode *inode)
+{
+	struct f2fs_inode *ri;
+
+	if (!f2fs_sb_has_compression(F2FS_I_SB(inode)))
+		return false;
+	if (!S_ISREG(inode->i_mode) || IS_ENCRYPTED(inode) ||
+			IS_VERITY(inode) || IS_SWAPFILE(inode))
+		return false;
+	if (f2fs_is_atomic_file(inode) || f2fs_is_volatile_file(inode) ||
+			f2fs_is_pinned_file(inode))
+		return false;
+	return f2fs_has_extra_attr(inode) &&
+		F2FS_FITS_IN_INODE(ri, F2FS_I(inode)->i_extra_isize,
+							i_log_cluster_size);
+}
+
+void f2fs_set_compress_context(struct inode *inode)
+{
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	fi->i_compress_algorithm = F2FS_OPTION(sbi).compress_algorithm;
+	fi->i_log_cluster_size = F2FS_OPTION(sbi).compress_log_size;
+	fi->i_cluster_size = 1 << fi->i_log_cluster_size;
+	fi->i_flags |= F2FS_COMPR_FL;
+	f2fs_mark_inode_dirty_sync(inode, true);
+}
+
+int __init f2fs_init_compress(void)
+{
+	int i;
+
+	for (i = 0; i < COMPRESS_MAX; i++) {
+		spin_lock_init(&f2fs_comp_pools[i].lock);
+		INIT_LIST_HEAD(&f2fs_comp_pools[i].idle_strm);
+		init_waitqueue_head(&f2fs_comp_pools[i].strm_wait);
+	}
+	return 0;
+}
+
+void f2fs_destroy_compress(void)
+{
+	struct f2fs_comp_strm *strm, *tmp;
+	int i;
+
+	for (i = 0; i < COMPRESS_MAX; i++) {
+		list_for_each_entry_safe(strm, tmp,
+				&f2fs_comp_pools[i].idle_strm, list) {
+			list_del(&strm->list);
+			f2fs_comp_strm_free(strm);
+		}
+		f2fs_comp_pools[i].avail_strm = 0;
+	}
+}
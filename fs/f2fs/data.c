@@ -40,6 +40,10 @@ static bool __is_cp_guaranteed(struct page *page)
 	if (!mapping)
 		return false;
 
+	/* accounted as F2FS_WB_DATA by f2fs_compress_write_end_io() */
+	if (f2fs_is_compressed_page(page))
+		return false;
+
 	inode = mapping->host;
 	sbi = F2FS_I_SB(inode);
 
@@ -212,6 +216,11 @@ static void f2fs_write_end_io(struct bio *bio)
 
 		fscrypt_finalize_bounce_page(&page);
 
+		if (f2fs_is_compressed_page(page)) {
+			f2fs_compress_write_end_io(bio, page);
+			continue;
+		}
+
 		if (unlikely(bio->bi_status)) {
 			mapping_set_error(page->mapping, -EIO);
 			if (type == F2FS_WB_CP_DATA)
@@ -392,6 +401,11 @@ static bool __has_merged_page(struct bio *bio, struct inode *inode,
 		target = bvec->bv_page;
 		if (fscrypt_is_bounce_page(target))
 			target = fscrypt_pagecache_page(target);
+		if (f2fs_is_compressed_page(target)) {
+			if (page && f2fs_compressed_page_covers(target, page))
+				return true;
+			target = f2fs_compress_control_page(target);
+		}
 
 		if (inode && inode == target->mapping->host)
 			return true;
@@ -622,7 +636,12 @@ void f2fs_submit_page_write(struct f2fs_io_info *fio)
 
 	verify_fio_blkaddr(fio);
 
-	bio_page = fio->encrypted_page ? fio->encrypted_page : fio->page;
+	if (fio->encrypted_page)
+		bio_page = fio->encrypted_page;
+	else if (fio->compressed_page)
+		bio_page = fio->compressed_page;
+	else
+		bio_page = fio->page;
 
 	/* set submitted = true as a return value */
 	fio->submitted = true;
@@ -855,6 +874,20 @@ struct page *f2fs_get_read_data_page(struct inode *inode, pgoff_t index,
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 
+	if (f2fs_compressed_file(inode)) {
+		if (PageUptodate(page)) {
+			unlock_page(page);
+			return page;
+		}
+		err = f2fs_read_compressed_single_page(inode, page);
+		if (!err) {
+			unlock_page(page);
+			return page;
+		}
+		if (err != -EAGAIN)
+			goto put_err;
+	}
+
 	if (f2fs_lookup_extent_cache(inode, index, &ei)) {
 		dn.data_blkaddr = ei.blk + index - ei.fofs;
 		if (!f2fs_is_valid_blkaddr(F2FS_I_SB(inode), dn.data_blkaddr,
@@ -1256,8 +1289,10 @@ int f2fs_map_blocks(struct inode *inode, struct f2fs_map_blocks *map,
 			}
 			if (flag == F2FS_GET_BLOCK_PRECACHE)
 				goto sync_out;
+			/* a compressed cluster has no per-page block */
 			if (flag == F2FS_GET_BLOCK_FIEMAP &&
-						blkaddr == NULL_ADDR) {
+					(blkaddr == NULL_ADDR ||
+					 blkaddr == COMPRESS_ADDR)) {
 				if (map->m_next_pgofs)
 					*map->m_next_pgofs = pgofs + 1;
 				goto sync_out;
@@ -1770,8 +1805,11 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 	sector_t last_block_in_bio = 0;
 	struct inode *inode = mapping->host;
 	struct f2fs_map_blocks map;
+	struct compress_ctx cc;
 	int ret = 0;
 
+	f2fs_init_compress_ctx(&cc, inode);
+
 	map.m_pblk = 0;
 	map.m_lblk = 0;
 	map.m_len = 0;
@@ -1793,9 +1831,20 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 				goto next_page;
 		}
 
+		if (f2fs_compressed_file(inode)) {
+			ret = f2fs_read_compressed_page(&cc, page);
+			if (!ret) {
+				unlock_page(page);
+				goto next_page;
+			}
+			if (ret != -EAGAIN)
+				goto set_error_page;
+		}
+
 		ret = f2fs_read_single_page(inode, page, nr_pages, &map, &bio,
 					&last_block_in_bio, is_readahead);
 		if (ret) {
+set_error_page:
 			SetPageError(page);
 			zero_user_segment(page, 0, PAGE_SIZE);
 			unlock_page(page);
@@ -1807,6 +1856,7 @@ static int f2fs_mpage_readpages(struct address_space *mapping,
 	BUG_ON(pages && !list_empty(pages));
 	if (bio)
 		__submit_bio(F2FS_I_SB(inode), bio, DATA);
+	f2fs_destroy_compress_ctx(&cc);
 	return pages ? 0 : ret;
 }
 
@@ -1941,6 +1991,8 @@ bool f2fs_should_update_outplace(struct inode *inode, struct f2fs_io_info *fio)
 		return true;
 	if (f2fs_is_atomic_file(inode))
 		return true;
+	if (f2fs_compressed_file(inode))
+		return true;
 	if (fio) {
 		if (is_cold_data(fio->page))
 			return true;
@@ -2074,11 +2126,15 @@ int f2fs_do_write_data_page(struct f2fs_io_info *fio)
 	return err;
 }
 
-static int __write_data_page(struct page *page, bool *submitted,
+/*
+ * Write one locked dirty page.  @op_locked is set by callers that already
+ * hold f2fs_lock_op(), which then also do the f2fs_balance_fs() themselves.
+ */
+int f2fs_write_single_data_page(struct page *page, bool *submitted,
 				struct bio **bio,
 				sector_t *last_block,
 				struct writeback_control *wbc,
-				enum iostat_type io_type)
+				enum iostat_type io_type, bool op_locked)
 {
 	struct inode *inode = page->mapping->host;
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
@@ -2099,7 +2155,7 @@ static int __write_data_page(struct page *page, bool *submitted,
 		.page = page,
 		.encrypted_page = NULL,
 		.submitted = false,
-		.need_lock = LOCK_RETRY,
+		.need_lock = op_locked ? LOCK_DONE : LOCK_RETRY,
 		.io_type = io_type,
 		.io_wbc = wbc,
 		.bio = bio,
@@ -2202,7 +2258,7 @@ static int __write_data_page(struct page *page, bool *submitted,
 
 	unlock_page(page);
 	if (!S_ISDIR(inode->i_mode) && !IS_NOQUOTA(inode) &&
-					!F2FS_I(inode)->cp_task) {
+					!F2FS_I(inode)->cp_task && !op_locked) {
 		f2fs_submit_ipu_bio(sbi, bio, page);
 		f2fs_balance_fs(sbi, need_balance_fs);
 	}
@@ -2235,7 +2291,16 @@ static int __write_data_page(struct page *page, bool *submitted,
 static int f2fs_write_data_page(struct page *page,
 					struct writeback_control *wbc)
 {
-	return __write_data_page(page, NULL, NULL, NULL, wbc, FS_DATA_IO);
+	struct inode *inode = page->mapping->host;
+
+	/* compressed clusters are only written as a whole by ->writepages */
+	if (f2fs_compressed_file(inode)) {
+		redirty_page_for_writepage(wbc, page);
+		return AOP_WRITEPAGE_ACTIVATE;
+	}
+
+	return f2fs_write_single_data_page(page, NULL, NULL, NULL, wbc,
+						FS_DATA_IO, false);
 }
 
 /*
@@ -2250,6 +2315,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 	int ret = 0;
 	int done = 0;
 	struct pagevec pvec;
+	struct inode *inode = mapping->host;
 	struct f2fs_sb_info *sbi = F2FS_M_SB(mapping);
 	struct bio *bio = NULL;
 	sector_t last_block;
@@ -2258,6 +2324,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 	pgoff_t index;
 	pgoff_t end;		/* Inclusive */
 	pgoff_t done_index;
+	pgoff_t next_cluster = 0;
 	int cycled;
 	int range_whole = 0;
 	xa_mark_t tag;
@@ -2294,6 +2361,7 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 	if (wbc->sync_mode == WB_SYNC_ALL || wbc->tagged_writepages)
 		tag_pages_for_writeback(mapping, index, end);
 	done_index = index;
+	next_cluster = 0;
 	while (!done && (index <= end)) {
 		int i;
 
@@ -2314,6 +2382,43 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 			}
 
 			done_index = page->index;
+
+			if (f2fs_compressed_file(inode)) {
+				int nr_written;
+
+				/* the rest of this cluster went with it */
+				if (page->index < next_cluster)
+					continue;
+				next_cluster = round_up(page->index + 1,
+						F2FS_I(inode)->i_cluster_size);
+retry_cluster:
+				ret = f2fs_write_cluster(inode, page->index,
+						&submitted, wbc, io_type,
+						&nr_written);
+				if (ret == -EAGAIN || ret == -ENOMEM) {
+					ret = 0;
+					if (wbc->sync_mode == WB_SYNC_ALL) {
+						cond_resched();
+						congestion_wait(BLK_RW_ASYNC,
+									HZ/50);
+						goto retry_cluster;
+					}
+					continue;
+				} else if (ret) {
+					done_index = page->index + 1;
+					done = 1;
+					break;
+				}
+				if (submitted)
+					nwritten++;
+				wbc->nr_to_write -= nr_written;
+				if (wbc->nr_to_write <= 0 &&
+					wbc->sync_mode == WB_SYNC_NONE) {
+					done = 1;
+					break;
+				}
+				continue;
+			}
 retry_write:
 			lock_page(page);
 
@@ -2341,8 +2446,8 @@ static int f2fs_write_cache_pages(struct address_space *mapping,
 			if (!clear_page_dirty_for_io(page))
 				goto continue_unlock;
 
-			ret = __write_data_page(page, &submitted, &bio,
-					&last_block, wbc, io_type);
+			ret = f2fs_write_single_data_page(page, &submitted,
+					&bio, &last_block, wbc, io_type, false);
 			if (unlikely(ret)) {
 				/*
 				 * keep nr_to_write, since vfs uses this to
@@ -2531,9 +2636,20 @@ static int prepare_write_begin(struct f2fs_sb_info *sbi,
 	 */
 	if (!f2fs_has_inline_data(inode) && len == PAGE_SIZE &&
 	    !is_inode_flag_set(inode, FI_NO_PREALLOC) &&
-	    !f2fs_verity_in_progress(inode))
+	    !f2fs_verity_in_progress(inode) && !f2fs_compressed_file(inode))
 		return 0;
 
+	/* the slots of a compressed cluster don't map its pages */
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_prepare_compress_overwrite(inode, index);
+		if (err < 0)
+			return err;
+		if (err) {
+			*blk_addr = COMPRESS_ADDR;
+			return 0;
+		}
+	}
+
 	/* f2fs_lock_op avoids race between write CP and convert_inline_page */
 	if (f2fs_has_inline_data(inode) && pos + len > MAX_INLINE_DATA(inode))
 		flag = F2FS_GET_BLOCK_DEFAULT;
@@ -2677,7 +2793,11 @@ static int f2fs_write_begin(struct file *file, struct address_space *mapping,
 		return 0;
 	}
 
-	if (blkaddr == NEW_ADDR) {
+	if (blkaddr == COMPRESS_ADDR) {
+		err = f2fs_read_compressed_single_page(inode, page);
+		if (err)
+			goto fail;
+	} else if (blkaddr == NEW_ADDR) {
 		zero_user_segment(page, 0, PAGE_SIZE);
 		SetPageUptodate(page);
 	} else {
@@ -2962,7 +3082,7 @@ static sector_t f2fs_bmap(struct address_space *mapping, sector_t block)
 {
 	struct inode *inode = mapping->host;
 
-	if (f2fs_has_inline_data(inode))
+	if (f2fs_has_inline_data(inode) || f2fs_compressed_file(inode))
 		return 0;
 
 	/* make sure allocating whole blocks */
@@ -3128,7 +3248,7 @@ static int f2fs_swap_activate(struct swap_info_struct *sis, struct file *file,
 	struct inode *inode = file_inode(file);
 	int ret;
 
-	if (!S_ISREG(inode->i_mode))
+	if (!S_ISREG(inode->i_mode) || f2fs_compressed_file(inode))
 		return -EINVAL;
 
 	if (f2fs_readonly(F2FS_I_SB(inode)->sb))
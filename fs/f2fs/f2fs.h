@@ -117,6 +117,8 @@ typedef u32 block_t;	/*
 			 */
 typedef u32 nid_t;
 
+#define COMPRESS_EXT_NUM		16
+
 struct f2fs_mount_info {
 	unsigned int opt;
 	int write_io_size_bits;		/* Write IO size bits */
@@ -141,6 +143,13 @@ struct f2fs_mount_info {
 	block_t unusable_cap;		/* Amount of space allowed to be
 					 * unusable when disabling checkpoint
 					 */
+
+	/* For compression */
+	unsigned char compress_algorithm;	/* algorithm type */
+	unsigned char compress_log_size;	/* cluster log size */
+	unsigned char compress_ext_cnt;		/* extension count */
+	unsigned char extensions[COMPRESS_EXT_NUM][F2FS_EXTENSION_LEN];
+						/* extensions to compress */
 };
 
 #define F2FS_FEATURE_ENCRYPT		0x0001
@@ -156,6 +165,7 @@ struct f2fs_mount_info {
 #define F2FS_FEATURE_VERITY		0x0400
 #define F2FS_FEATURE_SB_CHKSUM		0x0800
 #define F2FS_FEATURE_CASEFOLD		0x1000
+#define F2FS_FEATURE_COMPRESSION	0x2000
 
 #define __F2FS_HAS_FEATURE(raw_super, mask)				\
 	((raw_super->feature & cpu_to_le32(mask)) != 0)
@@ -419,6 +429,7 @@ static inline bool __has_cursum_space(struct f2fs_journal *journal,
 #define F2FS_IOC_GET_PIN_FILE		_IOR(F2FS_IOCTL_MAGIC, 14, __u32)
 #define F2FS_IOC_PRECACHE_EXTENTS	_IO(F2FS_IOCTL_MAGIC, 15)
 #define F2FS_IOC_RESIZE_FS		_IOW(F2FS_IOCTL_MAGIC, 16, __u64)
+#define F2FS_IOC_GET_COMPRESS_BLOCKS	_IOR(F2FS_IOCTL_MAGIC, 17, __u64)
 
 #define F2FS_IOC_GET_VOLUME_NAME	FS_IOC_GETFSLABEL
 #define F2FS_IOC_SET_VOLUME_NAME	FS_IOC_SETFSLABEL
@@ -713,6 +724,12 @@ struct f2fs_inode_info {
 	int i_inline_xattr_size;	/* inline xattr size */
 	struct timespec64 i_crtime;	/* inode creation time */
 	struct timespec64 i_disk_time[4];/* inode disk times */
+
+	/* for file compress */
+	u64 i_compr_blocks;			/* # of blocks saved by compression */
+	unsigned char i_compress_algorithm;	/* algorithm type */
+	unsigned char i_log_cluster_size;	/* log of cluster size */
+	unsigned int i_cluster_size;		/* cluster size */
 };
 
 static inline void get_extent_info(struct extent_info *ext,
@@ -1056,6 +1073,7 @@ struct f2fs_io_info {
 	block_t old_blkaddr;	/* old block address before Cow */
 	struct page *page;	/* page to be written */
 	struct page *encrypted_page;	/* encrypted page */
+	struct page *compressed_page;	/* compressed page */
 	struct list_head list;		/* serialize IOs */
 	bool submitted;		/* indicate IO submission */
 	int need_lock;		/* indicate we need to lock cp_rwsem */
@@ -1143,6 +1161,7 @@ enum {
 	GC_IDLE_CB,
 	GC_IDLE_GREEDY,
 	GC_URGENT,
+	GC_IDLE_AT,
 };
 
 enum {
@@ -1297,6 +1316,10 @@ struct f2fs_sb_info {
 	/* threshold for gc trials on pinned files */
 	u64 gc_pin_file_threshold;
 
+	/* for age-threshold GC */
+	unsigned int gc_age_threshold;		/* min. age of victims, in sec */
+	unsigned int gc_age_weight;		/* weight of age in GC_AT cost */
+
 	/* maximum # of trials to find a victim segment for SSR and GC */
 	unsigned int max_victim_search;
 	/* migration granularity of garbage collection, unit: segment */
@@ -1357,6 +1380,16 @@ struct f2fs_sb_info {
 
 	/* Precomputed FS UUID checksum for seeding other checksums */
 	__u32 s_chksum_seed;
+
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	/* For compression statistics */
+	atomic64_t compr_written_block;		/* # of compressed blocks written */
+	atomic64_t compr_saved_block;		/* # of blocks saved on write */
+	atomic64_t compress_count;		/* # of compressed clusters */
+	atomic64_t compress_ns;			/* time spent compressing */
+	atomic64_t decompress_count;		/* # of decompressed clusters */
+	atomic64_t decompress_ns;		/* time spent decompressing */
+#endif
 };
 
 struct f2fs_private_dio {
@@ -2368,6 +2401,7 @@ static inline void f2fs_change_bit(unsigned int nr, char *addr)
 /*
  * On-disk inode flags (f2fs_inode::i_flags)
  */
+#define F2FS_COMPR_FL			0x00000004 /* Compress file */
 #define F2FS_SYNC_FL			0x00000008 /* Synchronous updates */
 #define F2FS_IMMUTABLE_FL		0x00000010 /* Immutable file */
 #define F2FS_APPEND_FL			0x00000020 /* writes to file may only append */
@@ -2381,7 +2415,7 @@ static inline void f2fs_change_bit(unsigned int nr, char *addr)
 /* Flags that should be inherited by new inodes from their parent. */
 #define F2FS_FL_INHERITED (F2FS_SYNC_FL | F2FS_NODUMP_FL | F2FS_NOATIME_FL | \
 			   F2FS_DIRSYNC_FL | F2FS_PROJINHERIT_FL | \
-			   F2FS_CASEFOLD_FL)
+			   F2FS_CASEFOLD_FL | F2FS_COMPR_FL)
 
 /* Flags that are appropriate for regular files (all but dir-specific ones). */
 #define F2FS_REG_FLMASK		(~(F2FS_DIRSYNC_FL | F2FS_PROJINHERIT_FL | \
@@ -2604,16 +2638,32 @@ static inline int f2fs_has_inline_xattr(struct inode *inode)
 	return is_inode_flag_set(inode, FI_INLINE_XATTR);
 }
 
+static inline bool f2fs_compressed_file(struct inode *inode)
+{
+	return IS_ENABLED(CONFIG_F2FS_FS_COMPRESSION) &&
+		S_ISREG(inode->i_mode) &&
+		(F2FS_I(inode)->i_flags & F2FS_COMPR_FL);
+}
+
+/*
+ * A cluster never straddles two node blocks, so compressed files leave the
+ * tail of each node block that cannot hold a whole cluster unused.
+ */
 static inline unsigned int addrs_per_inode(struct inode *inode)
 {
 	unsigned int addrs = CUR_ADDRS_PER_INODE(inode) -
 				get_inline_xattr_addrs(inode);
-	return ALIGN_DOWN(addrs, 1);
+
+	if (!f2fs_compressed_file(inode))
+		return addrs;
+	return ALIGN_DOWN(addrs, F2FS_I(inode)->i_cluster_size);
 }
 
 static inline unsigned int addrs_per_block(struct inode *inode)
 {
-	return ALIGN_DOWN(DEF_ADDRS_PER_BLOCK, 1);
+	if (!f2fs_compressed_file(inode))
+		return DEF_ADDRS_PER_BLOCK;
+	return ALIGN_DOWN(DEF_ADDRS_PER_BLOCK, F2FS_I(inode)->i_cluster_size);
 }
 
 static inline void *inline_xattr_addr(struct inode *inode, struct page *page)
@@ -2773,7 +2823,8 @@ static inline bool f2fs_may_extent_tree(struct inode *inode)
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
 
 	if (!test_opt(sbi, EXTENT_CACHE) ||
-			is_inode_flag_set(inode, FI_NO_EXTENT))
+			is_inode_flag_set(inode, FI_NO_EXTENT) ||
+			f2fs_compressed_file(inode))
 		return false;
 
 	/*
@@ -2893,7 +2944,8 @@ static inline void verify_blkaddr(struct f2fs_sb_info *sbi,
 
 static inline bool __is_valid_data_blkaddr(block_t blkaddr)
 {
-	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR)
+	if (blkaddr == NEW_ADDR || blkaddr == NULL_ADDR ||
+			blkaddr == COMPRESS_ADDR)
 		return false;
 	return true;
 }
@@ -3223,6 +3275,10 @@ struct page *f2fs_get_lock_data_page(struct inode *inode, pgoff_t index,
 struct page *f2fs_get_new_data_page(struct inode *inode,
 			struct page *ipage, pgoff_t index, bool new_i_size);
 int f2fs_do_write_data_page(struct f2fs_io_info *fio);
+int f2fs_write_single_data_page(struct page *page, bool *submitted,
+			struct bio **bio, sector_t *last_block,
+			struct writeback_control *wbc,
+			enum iostat_type io_type, bool op_locked);
 void __do_map_lock(struct f2fs_sb_info *sbi, int flag, bool lock);
 int f2fs_map_blocks(struct inode *inode, struct f2fs_map_blocks *map,
 			int create, int flag);
@@ -3566,6 +3622,118 @@ void f2fs_unregister_sysfs(struct f2fs_sb_info *sbi);
 /* verity.c */
 extern const struct fsverity_operations f2fs_verityops;
 
+/*
+ * compress.c
+ */
+enum compress_algorithm_type {
+	COMPRESS_LZO,
+	COMPRESS_LZ4,
+	COMPRESS_ZSTD,
+	COMPRESS_MAX,
+};
+
+#define MIN_COMPRESS_LOG_SIZE		2
+#define MAX_COMPRESS_LOG_SIZE		8
+#define NULL_CLUSTER			((pgoff_t)-1)
+
+/* read-side state, so a cluster is decompressed once for all its pages */
+struct compress_ctx {
+	struct inode *inode;		/* inode being read */
+	pgoff_t cluster_idx;		/* cluster decompressed in rbuf */
+	block_t cblkaddr;		/* first compressed block of that cluster */
+	block_t *blkaddr;		/* compressed blocks of a cluster */
+	void *rbuf;			/* decompressed data of cluster_idx */
+};
+
+static inline void f2fs_init_compress_ctx(struct compress_ctx *cc,
+						struct inode *inode)
+{
+	cc->inode = inode;
+	cc->cluster_idx = NULL_CLUSTER;
+	cc->cblkaddr = NULL_ADDR;
+	cc->blkaddr = NULL;
+	cc->rbuf = NULL;
+}
+
+static inline void f2fs_i_compr_blocks_update(struct inode *inode, s64 diff)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	if (!diff)
+		return;
+	if (diff < 0 && fi->i_compr_blocks < -diff)
+		fi->i_compr_blocks = 0;
+	else
+		fi->i_compr_blocks += diff;
+	f2fs_mark_inode_dirty_sync(inode, true);
+}
+
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+bool f2fs_may_compress(struct inode *inode);
+void f2fs_set_compress_context(struct inode *inode);
+int f2fs_read_compressed_page(struct compress_ctx *cc, struct page *page);
+int f2fs_read_compressed_single_page(struct inode *inode, struct page *page);
+void f2fs_destroy_compress_ctx(struct compress_ctx *cc);
+int f2fs_prepare_compress_overwrite(struct inode *inode, pgoff_t index);
+int f2fs_write_cluster(struct inode *inode, pgoff_t index, bool *submitted,
+			struct writeback_control *wbc,
+			enum iostat_type io_type, int *nr_written);
+int f2fs_truncate_partial_cluster(struct inode *inode, u64 from);
+bool f2fs_is_compressed_page(struct page *page);
+struct page *f2fs_compress_control_page(struct page *page);
+bool f2fs_compressed_page_covers(struct page *cpage, struct page *page);
+void f2fs_compress_write_end_io(struct bio *bio, struct page *page);
+int __init f2fs_init_compress(void);
+void f2fs_destroy_compress(void);
+#else
+static inline bool f2fs_may_compress(struct inode *inode) { return false; }
+static inline void f2fs_set_compress_context(struct inode *inode) { }
+static inline int f2fs_read_compressed_page(struct compress_ctx *cc,
+							struct page *page)
+{
+	return -EAGAIN;
+}
+static inline int f2fs_read_compressed_single_page(struct inode *inode,
+							struct page *page)
+{
+	return -EAGAIN;
+}
+static inline void f2fs_destroy_compress_ctx(struct compress_ctx *cc) { }
+static inline int f2fs_prepare_compress_overwrite(struct inode *inode,
+							pgoff_t index)
+{
+	return 0;
+}
+static inline int f2fs_write_cluster(struct inode *inode, pgoff_t index,
+			bool *submitted, struct writeback_control *wbc,
+			enum iostat_type io_type, int *nr_written)
+{
+	return -EOPNOTSUPP;
+}
+static inline int f2fs_truncate_partial_cluster(struct inode *inode, u64 from)
+{
+	return 0;
+}
+static inline bool f2fs_is_compressed_page(struct page *page) { return false; }
+static inline struct page *f2fs_compress_control_page(struct page *page)
+{
+	WARN_ON_ONCE(1);
+	return ERR_PTR(-EINVAL);
+}
+static inline bool f2fs_compressed_page_covers(struct page *cpage,
+							struct page *page)
+{
+	return false;
+}
+static inline void f2fs_compress_write_end_io(struct bio *bio,
+							struct page *page)
+{
+	WARN_ON_ONCE(1);
+}
+static inline int f2fs_init_compress(void) { return 0; }
+static inline void f2fs_destroy_compress(void) { }
+#endif
+
 /*
  * crypto support
  */
@@ -3584,11 +3752,13 @@ static inline void f2fs_set_encrypted_inode(struct inode *inode)
 
 /*
  * Returns true if the reads of the inode's data need to undergo some
- * postprocessing step, like decryption or authenticity verification.
+ * postprocessing step, like decryption, decompression or authenticity
+ * verification.
  */
 static inline bool f2fs_post_read_required(struct inode *inode)
 {
-	return f2fs_encrypted_file(inode) || fsverity_active(inode);
+	return f2fs_encrypted_file(inode) || fsverity_active(inode) ||
+		f2fs_compressed_file(inode);
 }
 
 #define F2FS_FEATURE_FUNCS(name, flagname) \
@@ -3609,6 +3779,7 @@ F2FS_FEATURE_FUNCS(lost_found, LOST_FOUND);
 F2FS_FEATURE_FUNCS(verity, VERITY);
 F2FS_FEATURE_FUNCS(sb_chksum, SB_CHKSUM);
 F2FS_FEATURE_FUNCS(casefold, CASEFOLD);
+F2FS_FEATURE_FUNCS(compression, COMPRESSION);
 
 #ifdef CONFIG_BLK_DEV_ZONED
 static inline bool f2fs_blkz_is_seq(struct f2fs_sb_info *sbi, int devi,
@@ -81,13 +81,20 @@ static vm_fault_t f2fs_vm_page_mkwrite(struct vm_fault *vmf)
 		goto out_sem;
 	}
 
+	/* a compressed cluster gets all its blocks back at once */
+	err = 0;
+	if (f2fs_compressed_file(inode))
+		err = f2fs_prepare_compress_overwrite(inode, page->index);
+
 	/* block allocation */
-	__do_map_lock(sbi, F2FS_GET_BLOCK_PRE_AIO, true);
-	set_new_dnode(&dn, inode, NULL, NULL, 0);
-	err = f2fs_get_block(&dn, page->index);
-	f2fs_put_dnode(&dn);
-	__do_map_lock(sbi, F2FS_GET_BLOCK_PRE_AIO, false);
-	if (err) {
+	if (!err) {
+		__do_map_lock(sbi, F2FS_GET_BLOCK_PRE_AIO, true);
+		set_new_dnode(&dn, inode, NULL, NULL, 0);
+		err = f2fs_get_block(&dn, page->index);
+		f2fs_put_dnode(&dn);
+		__do_map_lock(sbi, F2FS_GET_BLOCK_PRE_AIO, false);
+	}
+	if (err < 0) {
 		unlock_page(page);
 		goto out_sem;
 	}
@@ -96,7 +103,9 @@ static vm_fault_t f2fs_vm_page_mkwrite(struct vm_fault *vmf)
 	f2fs_wait_on_page_writeback(page, DATA, false, true);
 
 	/* wait for GCed page writeback via META_MAPPING */
-	f2fs_wait_on_block_writeback(inode, dn.data_blkaddr);
+	if (!err)
+		f2fs_wait_on_block_writeback(inode, dn.data_blkaddr);
+	err = 0;
 
 	/*
 	 * check to see if the page is mapped already (no holes)
@@ -472,6 +481,10 @@ static loff_t f2fs_llseek(struct file *file, loff_t offset, int whence)
 	case SEEK_HOLE:
 		if (offset < 0)
 			return -ENXIO;
+		/* block addresses of compressed clusters don't map to data */
+		if (f2fs_compressed_file(inode))
+			return generic_file_llseek_size(file, offset, whence,
+						maxbytes, i_size_read(inode));
 		return f2fs_seek_block(file, offset, whence);
 	}
 
@@ -519,6 +532,7 @@ void f2fs_truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 	int nr_free = 0, ofs = dn->ofs_in_node, len = count;
 	__le32 *addr;
 	int base = 0;
+	int nr_compr = 0;
 
 	if (IS_INODE(dn->node_page) && f2fs_has_extra_attr(dn->inode))
 		base = get_extra_isize(dn->inode);
@@ -532,6 +546,16 @@ void f2fs_truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 		if (blkaddr == NULL_ADDR)
 			continue;
 
+		if (blkaddr == COMPRESS_ADDR) {
+			int i;
+
+			/* the NULL_ADDR slots are what compression saved */
+			for (i = 1; i < count &&
+				i < F2FS_I(dn->inode)->i_cluster_size; i++)
+				if (le32_to_cpu(addr[i]) == NULL_ADDR)
+					nr_compr++;
+		}
+
 		dn->data_blkaddr = NULL_ADDR;
 		f2fs_set_data_blkaddr(dn);
 
@@ -558,6 +582,7 @@ void f2fs_truncate_data_blocks_range(struct dnode_of_data *dn, int count)
 		dec_valid_block_count(sbi, dn->inode, nr_free);
 	}
 	dn->ofs_in_node = ofs;
+	f2fs_i_compr_blocks_update(dn->inode, -nr_compr);
 
 	f2fs_update_time(sbi, REQ_TIME);
 	trace_f2fs_truncate_data_blocks_range(dn->inode, dn->nid,
@@ -612,6 +637,13 @@ int f2fs_truncate_blocks(struct inode *inode, u64 from, bool lock)
 	struct page *ipage;
 	bool truncate_page = false;
 
+	/* must be done before taking f2fs_lock_op(), as it writes data */
+	if (f2fs_compressed_file(inode)) {
+		err = f2fs_truncate_partial_cluster(inode, from);
+		if (err)
+			return err;
+	}
+
 	trace_f2fs_truncate_blocks_enter(inode, from);
 
 	free_from = (pgoff_t)F2FS_BLK_ALIGN(from);
@@ -721,6 +753,8 @@ int f2fs_getattr(const struct path *path, struct kstat *stat,
 	flags = fi->i_flags;
 	if (flags & F2FS_APPEND_FL)
 		stat->attributes |= STATX_ATTR_APPEND;
+	if (f2fs_compressed_file(inode))
+		stat->attributes |= STATX_ATTR_COMPRESSED;
 	if (IS_ENCRYPTED(inode))
 		stat->attributes |= STATX_ATTR_ENCRYPTED;
 	if (flags & F2FS_IMMUTABLE_FL)
@@ -729,6 +763,7 @@ int f2fs_getattr(const struct path *path, struct kstat *stat,
 		stat->attributes |= STATX_ATTR_NODUMP;
 
 	stat->attributes_mask |= (STATX_ATTR_APPEND |
+				  STATX_ATTR_COMPRESSED |
 				  STATX_ATTR_ENCRYPTED |
 				  STATX_ATTR_IMMUTABLE |
 				  STATX_ATTR_NODUMP);
@@ -1590,6 +1625,10 @@ static long f2fs_fallocate(struct file *file, int mode,
 		(mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE)))
 		return -EOPNOTSUPP;
 
+	/* blocks of compressed files are only allocated by writeback */
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE |
 			FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_ZERO_RANGE |
 			FALLOC_FL_INSERT_RANGE))
@@ -1679,6 +1718,26 @@ static int f2fs_setflags_common(struct inode *inode, u32 iflags, u32 mask)
 			return -ENOTEMPTY;
 	}
 
+	if ((iflags ^ fi->i_flags) & F2FS_COMPR_FL) {
+		if (!f2fs_sb_has_compression(F2FS_I_SB(inode)))
+			return -EOPNOTSUPP;
+		if (S_ISREG(inode->i_mode)) {
+			int err;
+
+			/* the block layout of a file can't change under it */
+			err = f2fs_convert_inline_inode(inode);
+			if (err)
+				return err;
+			if (i_size_read(inode) || F2FS_HAS_BLOCKS(inode))
+				return -EINVAL;
+			if (iflags & F2FS_COMPR_FL) {
+				if (!f2fs_may_compress(inode))
+					return -EINVAL;
+				f2fs_set_compress_context(inode);
+			}
+		}
+	}
+
 	fi->i_flags = iflags | (fi->i_flags & ~mask);
 
 	if (fi->i_flags & F2FS_PROJINHERIT_FL)
@@ -1714,6 +1773,7 @@ static const struct {
 	{ F2FS_DIRSYNC_FL,	FS_DIRSYNC_FL },
 	{ F2FS_PROJINHERIT_FL,	FS_PROJINHERIT_FL },
 	{ F2FS_CASEFOLD_FL,	FS_CASEFOLD_FL },
+	{ F2FS_COMPR_FL,	FS_COMPR_FL },
 };
 
 #define F2FS_GETTABLE_FS_FL (		\
@@ -1729,7 +1789,8 @@ static const struct {
 		FS_INLINE_DATA_FL |	\
 		FS_NOCOW_FL |		\
 		FS_VERITY_FL |		\
-		FS_CASEFOLD_FL)
+		FS_CASEFOLD_FL |	\
+		FS_COMPR_FL)
 
 #define F2FS_SETTABLE_FS_FL (		\
 		FS_SYNC_FL |		\
@@ -1739,7 +1800,8 @@ static const struct {
 		FS_NOATIME_FL |		\
 		FS_DIRSYNC_FL |		\
 		FS_PROJINHERIT_FL |	\
-		FS_CASEFOLD_FL)
+		FS_CASEFOLD_FL |	\
+		FS_COMPR_FL)
 
 /* Convert f2fs on-disk i_flags to FS_IOC_{GET,SET}FLAGS flags */
 static inline u32 f2fs_iflags_to_fsflags(u32 iflags)
@@ -1848,6 +1910,9 @@ static int f2fs_ioc_start_atomic_write(struct file *filp)
 	if (!S_ISREG(inode->i_mode))
 		return -EINVAL;
 
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	if (filp->f_flags & O_DIRECT)
 		return -EINVAL;
 
@@ -1956,6 +2021,9 @@ static int f2fs_ioc_start_volatile_write(struct file *filp)
 	if (!S_ISREG(inode->i_mode))
 		return -EINVAL;
 
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	ret = mnt_want_write_file(filp);
 	if (ret)
 		return ret;
@@ -2171,6 +2239,9 @@ static int f2fs_ioc_set_encryption_policy(struct file *filp, unsigned long arg)
 	if (!f2fs_sb_has_encrypt(F2FS_I_SB(inode)))
 		return -EOPNOTSUPP;
 
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	f2fs_update_time(F2FS_I_SB(inode), REQ_TIME);
 
 	return fscrypt_ioctl_set_policy(filp, (const void __user *)arg);
@@ -2532,6 +2603,9 @@ static int f2fs_ioc_defragment(struct file *filp, unsigned long arg)
 	if (!S_ISREG(inode->i_mode) || f2fs_is_atomic_file(inode))
 		return -EINVAL;
 
+	if (f2fs_compressed_file(inode))
+		return -EOPNOTSUPP;
+
 	if (f2fs_readonly(sbi->sb))
 		return -EROFS;
 
@@ -2588,6 +2662,9 @@ static int f2fs_move_file_range(struct file *file_in, loff_t pos_in,
 	if (IS_ENCRYPTED(src) || IS_ENCRYPTED(dst))
 		return -EOPNOTSUPP;
 
+	if (f2fs_compressed_file(src) || f2fs_compressed_file(dst))
+		return -EOPNOTSUPP;
+
 	if (src == dst) {
 		if (pos_in == pos_out)
 			return 0;
@@ -2769,6 +2846,7 @@ static int f2fs_ioc_flush_device(struct file *filp, unsigned long arg)
 		}
 		sm->last_victim[GC_CB] = end_segno + 1;
 		sm->last_victim[GC_GREEDY] = end_segno + 1;
+		sm->last_victim[GC_AT] = end_segno + 1;
 		sm->last_victim[ALLOC_NEXT] = end_segno + 1;
 		ret = f2fs_gc(sbi, true, true, start_segno);
 		if (ret == -EAGAIN)
@@ -3141,6 +3219,21 @@ static int f2fs_ioc_resize_fs(struct file *filp, unsigned long arg)
 	return ret;
 }
 
+static int f2fs_ioc_get_compress_blocks(struct file *filp, unsigned long arg)
+{
+	struct inode *inode = file_inode(filp);
+	__u64 blocks;
+
+	if (!f2fs_sb_has_compression(F2FS_I_SB(inode)))
+		return -EOPNOTSUPP;
+
+	if (!f2fs_compressed_file(inode))
+		return -EINVAL;
+
+	blocks = F2FS_I(inode)->i_compr_blocks;
+	return put_user(blocks, (u64 __user *)arg);
+}
+
 static int f2fs_ioc_enable_verity(struct file *filp, unsigned long arg)
 {
 	struct inode *inode = file_inode(filp);
@@ -3297,6 +3390,8 @@ long f2fs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		return f2fs_ioc_precache_extents(filp, arg);
 	case F2FS_IOC_RESIZE_FS:
 		return f2fs_ioc_resize_fs(filp, arg);
+	case F2FS_IOC_GET_COMPRESS_BLOCKS:
+		return f2fs_ioc_get_compress_blocks(filp, arg);
 	case FS_IOC_ENABLE_VERITY:
 		return f2fs_ioc_enable_verity(filp, arg);
 	case FS_IOC_MEASURE_VERITY:
@@ -3352,7 +3447,9 @@ static ssize_t f2fs_file_write_iter(struct kiocb *iocb, struct iov_iter *from)
 			goto write;
 		}
 
-		if (is_inode_flag_set(inode, FI_NO_PREALLOC))
+		/* compressed clusters get their blocks at writeback */
+		if (is_inode_flag_set(inode, FI_NO_PREALLOC) ||
+				f2fs_compressed_file(inode))
 			goto write;
 
 		if (iocb->ki_flags & IOCB_DIRECT) {
@@ -3443,6 +3540,7 @@ long f2fs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case F2FS_IOC_SET_PIN_FILE:
 	case F2FS_IOC_PRECACHE_EXTENTS:
 	case F2FS_IOC_RESIZE_FS:
+	case F2FS_IOC_GET_COMPRESS_BLOCKS:
 	case FS_IOC_ENABLE_VERITY:
 	case FS_IOC_MEASURE_VERITY:
 	case F2FS_IOC_GET_VOLUME_NAME:
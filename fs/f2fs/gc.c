@@ -136,12 +136,22 @@ int f2fs_start_gc_thread(struct f2fs_sb_info *sbi)
 
 	gc_th->gc_wake= 0;
 
+	gc_th->workers = DEF_GC_THREAD_WORKERS;
+	gc_th->gc_wq = alloc_workqueue("f2fs_gc_wq-%u:%u", WQ_UNBOUND,
+			MAX_GC_THREAD_WORKERS, MAJOR(dev), MINOR(dev));
+	if (!gc_th->gc_wq) {
+		err = -ENOMEM;
+		kvfree(gc_th);
+		goto out;
+	}
+
 	sbi->gc_thread = gc_th;
 	init_waitqueue_head(&sbi->gc_thread->gc_wait_queue_head);
 	sbi->gc_thread->f2fs_gc_task = kthread_run(gc_thread_func, sbi,
 			"f2fs_gc-%u:%u", MAJOR(dev), MINOR(dev));
 	if (IS_ERR(gc_th->f2fs_gc_task)) {
 		err = PTR_ERR(gc_th->f2fs_gc_task);
+		destroy_workqueue(gc_th->gc_wq);
 		kvfree(gc_th);
 		sbi->gc_thread = NULL;
 	}
@@ -155,8 +165,14 @@ void f2fs_stop_gc_thread(struct f2fs_sb_info *sbi)
 	if (!gc_th)
 		return;
 	kthread_stop(gc_th->f2fs_gc_task);
-	kvfree(gc_th);
+
+	/* f2fs_gc() from ioctl may still be using gc_wq */
+	mutex_lock(&sbi->gc_mutex);
 	sbi->gc_thread = NULL;
+	mutex_unlock(&sbi->gc_mutex);
+
+	destroy_workqueue(gc_th->gc_wq);
+	kvfree(gc_th);
 }
 
 static int select_gc_type(struct f2fs_sb_info *sbi, int gc_type)
@@ -171,6 +187,11 @@ static int select_gc_type(struct f2fs_sb_info *sbi, int gc_type)
 	case GC_URGENT:
 		gc_mode = GC_GREEDY;
 		break;
+	case GC_IDLE_AT:
+		/* FG_GC needs free space now, whatever the age of victims is */
+		if (gc_type == BG_GC)
+			gc_mode = GC_AT;
+		break;
 	}
 	return gc_mode;
 }
@@ -214,7 +235,7 @@ static unsigned int get_max_cost(struct f2fs_sb_info *sbi,
 		return sbi->blocks_per_seg;
 	if (p->gc_mode == GC_GREEDY)
 		return 2 * sbi->blocks_per_seg * p->ofs_unit;
-	else if (p->gc_mode == GC_CB)
+	else if (p->gc_mode == GC_CB || p->gc_mode == GC_AT)
 		return UINT_MAX;
 	else /* No other gc_mode */
 		return 0;
@@ -239,38 +260,80 @@ static unsigned int check_bg_victims(struct f2fs_sb_info *sbi)
 	return NULL_SEGNO;
 }
 
-static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
+static unsigned long long get_section_mtime(struct f2fs_sb_info *sbi,
+						unsigned int segno)
 {
-	struct sit_info *sit_i = SIT_I(sbi);
-	unsigned int secno = GET_SEC_FROM_SEG(sbi, segno);
-	unsigned int start = GET_SEG_FROM_SEC(sbi, secno);
+	unsigned int start = GET_SEG_FROM_SEC(sbi,
+					GET_SEC_FROM_SEG(sbi, segno));
 	unsigned long long mtime = 0;
-	unsigned int vblocks;
-	unsigned char age = 0;
-	unsigned char u;
 	unsigned int i;
 
 	for (i = 0; i < sbi->segs_per_sec; i++)
 		mtime += get_seg_entry(sbi, start + i)->mtime;
-	vblocks = get_valid_blocks(sbi, segno, true);
 
-	mtime = div_u64(mtime, sbi->segs_per_sec);
-	vblocks = div_u64(vblocks, sbi->segs_per_sec);
+	return div_u64(mtime, sbi->segs_per_sec);
+}
 
-	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
+/* age of @mtime relative to all segments, from 0 (youngest) to 100 */
+static unsigned char get_relative_age(struct f2fs_sb_info *sbi,
+						unsigned long long mtime)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
 
 	/* Handle if the system time has changed by the user */
 	if (mtime < sit_i->min_mtime)
 		sit_i->min_mtime = mtime;
 	if (mtime > sit_i->max_mtime)
 		sit_i->max_mtime = mtime;
-	if (sit_i->max_mtime != sit_i->min_mtime)
-		age = 100 - div64_u64(100 * (mtime - sit_i->min_mtime),
+	if (sit_i->max_mtime == sit_i->min_mtime)
+		return 0;
+	return 100 - div64_u64(100 * (mtime - sit_i->min_mtime),
 				sit_i->max_mtime - sit_i->min_mtime);
+}
+
+static unsigned int get_cb_cost(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	unsigned long long mtime;
+	unsigned int vblocks;
+	unsigned char age;
+	unsigned char u;
+
+	mtime = get_section_mtime(sbi, segno);
+	vblocks = get_valid_blocks(sbi, segno, true);
+	vblocks = div_u64(vblocks, sbi->segs_per_sec);
+
+	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
+	age = get_relative_age(sbi, mtime);
 
 	return UINT_MAX - ((100 * (100 - u) * age) / (100 + u));
 }
 
+/*
+ * Sections younger than gc_age_threshold are left alone, as their blocks are
+ * likely to be invalidated by the user soon.  Among the others, old and
+ * sparse sections are preferred, weighted by gc_age_weight.
+ */
+static unsigned int get_at_cost(struct f2fs_sb_info *sbi, unsigned int segno)
+{
+	unsigned int weight = sbi->gc_age_weight;
+	unsigned long long mtime;
+	unsigned int vblocks;
+	unsigned char age;
+	unsigned char u;
+
+	mtime = get_section_mtime(sbi, segno);
+	if (mtime + sbi->gc_age_threshold > get_mtime(sbi, false))
+		return UINT_MAX;
+
+	vblocks = get_valid_blocks(sbi, segno, true);
+	vblocks = div_u64(vblocks, sbi->segs_per_sec);
+
+	u = (vblocks * 100) >> sbi->log_blocks_per_seg;
+	age = get_relative_age(sbi, mtime);
+
+	return UINT_MAX - (weight * age + (100 - weight) * (100 - u));
+}
+
 static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 			unsigned int segno, struct victim_sel_policy *p)
 {
@@ -280,6 +343,8 @@ static inline unsigned int get_gc_cost(struct f2fs_sb_info *sbi,
 	/* alloc_mode == LFS */
 	if (p->gc_mode == GC_GREEDY)
 		return get_valid_blocks(sbi, segno, true);
+	else if (p->gc_mode == GC_AT)
+		return get_at_cost(sbi, segno);
 	else
 		return get_cb_cost(sbi, segno);
 }
@@ -484,6 +549,22 @@ static void put_gc_inode(struct gc_inode_list *gc_list)
 	}
 }
 
+/*
+ * Hand the inodes in @from over to @to, so that they are put once gc_mutex
+ * is released.  Duplicates are dropped, @to still holds a reference to them.
+ */
+static void move_gc_inode(struct gc_inode_list *from,
+					struct gc_inode_list *to)
+{
+	struct inode_entry *ie, *next_ie;
+	list_for_each_entry_safe(ie, next_ie, &from->ilist, list) {
+		radix_tree_delete(&from->iroot, ie->inode->i_ino);
+		list_del(&ie->list);
+		add_gc_inode(to, ie->inode);
+		kmem_cache_free(f2fs_inode_entry_slab, ie);
+	}
+}
+
 static int check_valid_map(struct f2fs_sb_info *sbi,
 				unsigned int segno, int offset)
 {
@@ -504,7 +585,8 @@ static int check_valid_map(struct f2fs_sb_info *sbi,
  * ignore that.
  */
 static int gc_node_segment(struct f2fs_sb_info *sbi,
-		struct f2fs_summary *sum, unsigned int segno, int gc_type)
+		struct f2fs_summary *sum, unsigned int segno, int gc_type,
+		unsigned int *moved)
 {
 	struct f2fs_summary *entry;
 	block_t start_addr;
@@ -567,8 +649,11 @@ static int gc_node_segment(struct f2fs_sb_info *sbi,
 		}
 
 		err = f2fs_move_node_page(node_page, gc_type);
-		if (!err && gc_type == FG_GC)
-			submitted++;
+		if (!err) {
+			if (gc_type == FG_GC)
+				submitted++;
+			(*moved)++;
+		}
 		stat_inc_node_blk_count(sbi, 1, gc_type);
 	}
 
@@ -990,7 +1075,8 @@ static int move_data_page(struct inode *inode, block_t bidx, int gc_type,
  * the victim data block is ignored.
  */
 static int gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
-		struct gc_inode_list *gc_list, unsigned int segno, int gc_type)
+		struct gc_inode_list *gc_list, unsigned int segno, int gc_type,
+		unsigned int *moved)
 {
 	struct super_block *sb = sbi->sb;
 	struct f2fs_summary *entry;
@@ -1115,6 +1201,8 @@ static int gc_data_segment(struct f2fs_sb_info *sbi, struct f2fs_summary *sum,
 			if (!err && (gc_type == FG_GC ||
 					f2fs_post_read_required(inode)))
 				submitted++;
+			if (!err)
+				(*moved)++;
 
 			if (locked) {
 				up_write(&fi->i_gc_rwsem[WRITE]);
@@ -1146,7 +1234,8 @@ static int __get_victim(struct f2fs_sb_info *sbi, unsigned int *victim,
 
 static int do_garbage_collect(struct f2fs_sb_info *sbi,
 				unsigned int start_segno,
-				struct gc_inode_list *gc_list, int gc_type)
+				struct gc_inode_list *gc_list, int gc_type,
+				unsigned int *moved)
 {
 	struct page *sum_page;
 	struct f2fs_summary_block *sum;
@@ -1157,6 +1246,8 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 	unsigned char type = IS_DATASEG(get_seg_entry(sbi, segno)->type) ?
 						SUM_TYPE_DATA : SUM_TYPE_NODE;
 	int submitted = 0;
+	unsigned int nr_moved = 0;
+	u64 start_time = ktime_get_ns();
 
 	if (__is_large_section(sbi))
 		end_segno = rounddown(end_segno, sbi->segs_per_sec);
@@ -1219,10 +1310,10 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 		 */
 		if (type == SUM_TYPE_NODE)
 			submitted += gc_node_segment(sbi, sum->entries, segno,
-								gc_type);
+							gc_type, &nr_moved);
 		else
 			submitted += gc_data_segment(sbi, sum->entries, gc_list,
-							segno, gc_type);
+						segno, gc_type, &nr_moved);
 
 		stat_inc_seg_count(sbi, type, gc_type);
 
@@ -1246,6 +1337,69 @@ static int do_garbage_collect(struct f2fs_sb_info *sbi,
 
 	stat_inc_call_count(sbi->stat_info);
 
+	trace_f2fs_gc_section(sbi->sb, start_segno, gc_type, type, nr_moved,
+					ktime_get_ns() - start_time);
+	if (moved)
+		*moved += nr_moved;
+
+	return seg_freed;
+}
+
+static void gc_work_func(struct work_struct *work)
+{
+	struct gc_work *gw = container_of(work, struct gc_work, work);
+
+	gw->seg_freed = do_garbage_collect(gw->sbi, gw->segno, &gw->gc_list,
+							BG_GC, &gw->moved);
+}
+
+/*
+ * Background GC only dirties (or, for post-read files, rewrites) the valid
+ * blocks of a victim, so victims can be collected independently of each
+ * other.  Take up to gc_workers - 1 more victims and hand them to gc_wq,
+ * while the caller collects @segno itself.  victim_secmap keeps the victims
+ * distinct; large sections are collected serially, as they are migrated
+ * piecewise through next_victim_seg.
+ */
+static int do_garbage_collect_parallel(struct f2fs_sb_info *sbi,
+				unsigned int segno,
+				struct gc_inode_list *gc_list,
+				unsigned int *moved, unsigned int *nr_secs)
+{
+	struct f2fs_gc_kthread *gc_th = sbi->gc_thread;
+	unsigned int workers = READ_ONCE(gc_th->workers);
+	struct gc_work *works;
+	unsigned int nr_works = 0, i;
+	int seg_freed;
+
+	works = f2fs_kzalloc(sbi, array_size(workers - 1, sizeof(*works)),
+								GFP_NOFS);
+	for (i = 0; works && i < workers - 1; i++) {
+		struct gc_work *gw = &works[nr_works];
+
+		gw->segno = NULL_SEGNO;
+		if (!__get_victim(sbi, &gw->segno, BG_GC))
+			break;
+
+		gw->sbi = sbi;
+		INIT_LIST_HEAD(&gw->gc_list.ilist);
+		INIT_RADIX_TREE(&gw->gc_list.iroot, GFP_NOFS);
+		INIT_WORK(&gw->work, gc_work_func);
+		queue_work(gc_th->gc_wq, &gw->work);
+		nr_works++;
+	}
+
+	seg_freed = do_garbage_collect(sbi, segno, gc_list, BG_GC, moved);
+
+	for (i = 0; i < nr_works; i++) {
+		flush_work(&works[i].work);
+		seg_freed += works[i].seg_freed;
+		*moved += works[i].moved;
+		move_gc_inode(&works[i].gc_list, gc_list);
+	}
+	kfree(works);
+
+	*nr_secs += nr_works + 1;
 	return seg_freed;
 }
 
@@ -1264,6 +1418,8 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 	unsigned long long last_skipped = sbi->skipped_atomic_files[FG_GC];
 	unsigned long long first_skipped;
 	unsigned int skipped_round = 0, round = 0;
+	unsigned int nr_secs = 0, moved = 0;
+	u64 start_time = ktime_get_ns();
 
 	trace_f2fs_gc_begin(sbi->sb, sync, background,
 				get_pages(sbi, F2FS_DIRTY_NODES),
@@ -1313,7 +1469,16 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 		goto stop;
 	}
 
-	seg_freed = do_garbage_collect(sbi, segno, &gc_list, gc_type);
+	if (gc_type == BG_GC && init_segno == NULL_SEGNO &&
+			sbi->gc_thread && sbi->gc_thread->workers > 1 &&
+			!__is_large_section(sbi)) {
+		seg_freed = do_garbage_collect_parallel(sbi, segno, &gc_list,
+							&moved, &nr_secs);
+	} else {
+		seg_freed = do_garbage_collect(sbi, segno, &gc_list, gc_type,
+								&moved);
+		nr_secs++;
+	}
 	if (gc_type == FG_GC && seg_freed == sbi->segs_per_sec)
 		sec_freed++;
 	total_freed += seg_freed;
@@ -1361,6 +1526,8 @@ int f2fs_gc(struct f2fs_sb_info *sbi, bool sync,
 				free_segments(sbi),
 				reserved_segments(sbi),
 				prefree_segments(sbi));
+	trace_f2fs_gc_cycle(sbi->sb, gc_type, nr_secs, moved,
+					ktime_get_ns() - start_time);
 
 	mutex_unlock(&sbi->gc_mutex);
 
@@ -1376,6 +1543,8 @@ void f2fs_build_gc_manager(struct f2fs_sb_info *sbi)
 	DIRTY_I(sbi)->v_ops = &default_v_ops;
 
 	sbi->gc_pin_file_threshold = DEF_GC_FAILED_PINNED_FILES;
+	sbi->gc_age_threshold = DEF_GC_AGE_THRESHOLD;
+	sbi->gc_age_weight = DEF_GC_AGE_WEIGHT;
 
 	/* give warm/cold data area from slower device */
 	if (f2fs_is_multi_device(sbi) && !__is_large_section(sbi))
@@ -1402,7 +1571,7 @@ static int free_segment_range(struct f2fs_sb_info *sbi, unsigned int start,
 		};
 
 		mutex_lock(&sbi->gc_mutex);
-		do_garbage_collect(sbi, segno, &gc_list, FG_GC);
+		do_garbage_collect(sbi, segno, &gc_list, FG_GC, NULL);
 		mutex_unlock(&sbi->gc_mutex);
 		put_gc_inode(&gc_list);
 
@@ -19,6 +19,12 @@
 
 #define DEF_GC_FAILED_PINNED_FILES	2048
 
+#define DEF_GC_AGE_THRESHOLD	(60 * 60 * 24 * 7)	/* 7 days, in sec */
+#define DEF_GC_AGE_WEIGHT	60	/* percentage of age in GC_AT cost */
+
+#define DEF_GC_THREAD_WORKERS	1	/* sections collected in parallel */
+#define MAX_GC_THREAD_WORKERS	8
+
 /* Search max. number of dirty segments to select a victim segment */
 #define DEF_MAX_VICTIM_SEARCH 4096 /* covers 8GB */
 
@@ -34,6 +40,10 @@ struct f2fs_gc_kthread {
 
 	/* for changing gc mode */
 	unsigned int gc_wake;
+
+	/* for parallel background gc */
+	unsigned int workers;
+	struct workqueue_struct *gc_wq;
 };
 
 struct gc_inode_list {
@@ -41,6 +51,16 @@ struct gc_inode_list {
 	struct radix_tree_root iroot;
 };
 
+/* a victim section collected by the gc workqueue */
+struct gc_work {
+	struct work_struct work;
+	struct f2fs_sb_info *sbi;
+	unsigned int segno;
+	int seg_freed;
+	unsigned int moved;
+	struct gc_inode_list gc_list;
+};
+
 /*
  * inline functions
  */
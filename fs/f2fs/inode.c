@@ -286,6 +286,21 @@ static bool sanity_check_inode(struct inode *inode, struct page *node_page)
 		return false;
 	}
 
+	if (f2fs_compressed_file(inode) &&
+		(!f2fs_sb_has_compression(sbi) ||
+		!f2fs_has_extra_attr(inode) ||
+		!F2FS_FITS_IN_INODE(F2FS_INODE(node_page), fi->i_extra_isize,
+							i_log_cluster_size) ||
+		fi->i_compress_algorithm >= COMPRESS_MAX ||
+		fi->i_log_cluster_size < MIN_COMPRESS_LOG_SIZE ||
+		fi->i_log_cluster_size > MAX_COMPRESS_LOG_SIZE)) {
+		set_sbi_flag(sbi, SBI_NEED_FSCK);
+		f2fs_warn(sbi, "%s: inode (ino=%lx) has corrupted compression info, algorithm: %u, log_cluster_size: %u, run fsck to fix",
+			  __func__, inode->i_ino, fi->i_compress_algorithm,
+			  fi->i_log_cluster_size);
+		return false;
+	}
+
 	return true;
 }
 
@@ -360,11 +375,22 @@ static int do_read_inode(struct inode *inode)
 		fi->i_inline_xattr_size = 0;
 	}
 
+	if (f2fs_has_extra_attr(inode) && f2fs_sb_has_compression(sbi) &&
+			F2FS_FITS_IN_INODE(ri, fi->i_extra_isize,
+						i_log_cluster_size)) {
+		fi->i_compr_blocks = le64_to_cpu(ri->i_compr_blocks);
+		fi->i_compress_algorithm = ri->i_compress_algorithm;
+		fi->i_log_cluster_size = ri->i_log_cluster_size;
+	}
+
 	if (!sanity_check_inode(inode, node_page)) {
 		f2fs_put_page(node_page, 1);
 		return -EFSCORRUPTED;
 	}
 
+	if (f2fs_compressed_file(inode))
+		fi->i_cluster_size = 1 << fi->i_log_cluster_size;
+
 	/* check data exist */
 	if (f2fs_has_inline_data(inode) && !f2fs_exist_data(inode))
 		__recover_inline_status(inode, node_page);
@@ -569,6 +595,17 @@ void f2fs_update_inode(struct inode *inode, struct page *node_page)
 			ri->i_crtime_nsec =
 				cpu_to_le32(F2FS_I(inode)->i_crtime.tv_nsec);
 		}
+
+		if (f2fs_sb_has_compression(F2FS_I_SB(inode)) &&
+			F2FS_FITS_IN_INODE(ri, F2FS_I(inode)->i_extra_isize,
+							i_log_cluster_size)) {
+			ri->i_compr_blocks =
+				cpu_to_le64(F2FS_I(inode)->i_compr_blocks);
+			ri->i_compress_algorithm =
+				F2FS_I(inode)->i_compress_algorithm;
+			ri->i_log_cluster_size =
+				F2FS_I(inode)->i_log_cluster_size;
+		}
 	}
 
 	__set_inode_rdev(inode, ri);
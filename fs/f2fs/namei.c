@@ -22,6 +22,27 @@
 #include "acl.h"
 #include <trace/events/f2fs.h>
 
+/*
+ * Make a new regular file compressed with the mount's algorithm and cluster
+ * size if it may be; compressed files keep no inline data.
+ */
+static void set_compress_inode(struct f2fs_sb_info *sbi, struct inode *inode)
+{
+	struct f2fs_inode_info *fi = F2FS_I(inode);
+
+	fi->i_flags &= ~F2FS_COMPR_FL;
+	if (!f2fs_may_compress(inode))
+		return;
+
+	fi->i_compress_algorithm = F2FS_OPTION(sbi).compress_algorithm;
+	fi->i_log_cluster_size = F2FS_OPTION(sbi).compress_log_size;
+	fi->i_cluster_size = 1 << fi->i_log_cluster_size;
+	fi->i_flags |= F2FS_COMPR_FL;
+
+	stat_dec_inline_inode(inode);
+	clear_inode_flag(inode, FI_INLINE_DATA);
+}
+
 static struct inode *f2fs_new_inode(struct inode *dir, umode_t mode)
 {
 	struct f2fs_sb_info *sbi = F2FS_I_SB(dir);
@@ -116,6 +137,10 @@ static struct inode *f2fs_new_inode(struct inode *dir, umode_t mode)
 	if (S_ISDIR(inode->i_mode))
 		F2FS_I(inode)->i_flags |= F2FS_INDEX_FL;
 
+	if (S_ISREG(inode->i_mode) &&
+			(F2FS_I(inode)->i_flags & F2FS_COMPR_FL))
+		set_compress_inode(sbi, inode);
+
 	if (F2FS_I(inode)->i_flags & F2FS_PROJINHERIT_FL)
 		set_inode_flag(inode, FI_PROJ_INHERIT);
 
@@ -196,6 +221,22 @@ static inline void set_file_temperature(struct f2fs_sb_info *sbi, struct inode *
 		file_set_hot(inode);
 }
 
+/*
+ * Compress files with an extension given by the compress_extension mount
+ * option
+ */
+static bool is_compress_extension(struct f2fs_sb_info *sbi,
+						const unsigned char *name)
+{
+	unsigned char (*ext)[F2FS_EXTENSION_LEN] = F2FS_OPTION(sbi).extensions;
+	int i;
+
+	for (i = 0; i < F2FS_OPTION(sbi).compress_ext_cnt; i++)
+		if (is_extension_exist(name, ext[i]))
+			return true;
+	return false;
+}
+
 int f2fs_update_extension_list(struct f2fs_sb_info *sbi, const char *name,
 							bool hot, bool set)
 {
@@ -286,6 +327,10 @@ static int f2fs_create(struct inode *dir, struct dentry *dentry, umode_t mode,
 	if (!test_opt(sbi, DISABLE_EXT_IDENTIFY))
 		set_file_temperature(sbi, inode, dentry->d_name.name);
 
+	if (f2fs_sb_has_compression(sbi) && !f2fs_compressed_file(inode) &&
+			is_compress_extension(sbi, dentry->d_name.name))
+		set_compress_inode(sbi, inode);
+
 	inode->i_op = &f2fs_file_inode_operations;
 	inode->i_fop = &f2fs_file_operations;
 	inode->i_mapping->a_ops = &f2fs_dblock_aops;
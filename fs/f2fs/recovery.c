@@ -266,6 +266,19 @@ static int recover_inode(struct inode *inode, struct page *page)
 				F2FS_I(inode)->i_projid = kprojid;
 			}
 		}
+
+		if (f2fs_sb_has_compression(F2FS_I_SB(inode)) &&
+			F2FS_FITS_IN_INODE(raw, le16_to_cpu(raw->i_extra_isize),
+							i_log_cluster_size)) {
+			F2FS_I(inode)->i_compr_blocks =
+					le64_to_cpu(raw->i_compr_blocks);
+			F2FS_I(inode)->i_compress_algorithm =
+					raw->i_compress_algorithm;
+			F2FS_I(inode)->i_log_cluster_size =
+					raw->i_log_cluster_size;
+			F2FS_I(inode)->i_cluster_size =
+					1 << raw->i_log_cluster_size;
+		}
 	}
 
 	f2fs_i_size_write(inode, le64_to_cpu(raw->i_size));
@@ -600,6 +613,20 @@ static int do_recover_data(struct f2fs_sb_info *sbi, struct inode *inode,
 			continue;
 		}
 
+		/* the head of a compressed cluster owns a block too */
+		if (dest == COMPRESS_ADDR) {
+			if (src != NULL_ADDR)
+				f2fs_truncate_data_blocks_range(&dn, 1);
+			err = f2fs_reserve_new_block(&dn);
+			/* We should not get -ENOSPC */
+			f2fs_bug_on(sbi, err);
+			if (err)
+				goto err;
+			dn.data_blkaddr = COMPRESS_ADDR;
+			f2fs_set_data_blkaddr(&dn);
+			continue;
+		}
+
 		/* dest is valid block, try to recover from src to dest */
 		if (f2fs_is_valid_blkaddr(sbi, dest, META_POR)) {
 
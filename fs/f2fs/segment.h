@@ -139,15 +139,17 @@ enum {
 };
 
 /*
- * In the victim_sel_policy->gc_mode, there are two gc, aka cleaning, modes.
+ * In the victim_sel_policy->gc_mode, there are three gc, aka cleaning, modes.
  * GC_CB is based on cost-benefit algorithm.
  * GC_GREEDY is based on greedy algorithm.
+ * GC_AT is based on age-threshold algorithm.
  */
 enum {
 	GC_CB = 0,
 	GC_GREEDY,
 	ALLOC_NEXT,
 	FLUSH_DEVICE,
+	GC_AT,
 	MAX_GC_POLICY,
 };
 
@@ -165,7 +167,7 @@ enum {
 /* for a function parameter to select a victim segment */
 struct victim_sel_policy {
 	int alloc_mode;			/* LFS or SSR */
-	int gc_mode;			/* GC_CB or GC_GREEDY */
+	int gc_mode;			/* GC_CB, GC_GREEDY or GC_AT */
 	unsigned long *dirty_segmap;	/* dirty segment bitmap */
 	unsigned int max_search;	/* maximum # of segments to search */
 	unsigned int offset;		/* last scanned bitmap offset */
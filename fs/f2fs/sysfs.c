@@ -109,6 +109,25 @@ static ssize_t lifetime_write_kbytes_show(struct f2fs_attr *a,
 			BD_PART_WRITTEN(sbi)));
 }
 
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+#define F2FS_COMPR_STAT_SHOW(name)					\
+static ssize_t name##_show(struct f2fs_attr *a,				\
+		struct f2fs_sb_info *sbi, char *buf)			\
+{									\
+	return snprintf(buf, PAGE_SIZE, "%llu\n",			\
+		(unsigned long long)atomic64_read(&sbi->name));		\
+}
+
+/* ratio is compr_saved_block / (compr_written_block + compr_saved_block) */
+F2FS_COMPR_STAT_SHOW(compr_written_block);
+F2FS_COMPR_STAT_SHOW(compr_saved_block);
+/* CPU cost, as total nanoseconds over number of clusters */
+F2FS_COMPR_STAT_SHOW(compress_count);
+F2FS_COMPR_STAT_SHOW(compress_ns);
+F2FS_COMPR_STAT_SHOW(decompress_count);
+F2FS_COMPR_STAT_SHOW(decompress_ns);
+#endif
+
 static ssize_t features_show(struct f2fs_attr *a,
 		struct f2fs_sb_info *sbi, char *buf)
 {
@@ -154,6 +173,9 @@ static ssize_t features_show(struct f2fs_attr *a,
 	if (f2fs_sb_has_casefold(sbi))
 		len += snprintf(buf + len, PAGE_SIZE - len, "%s%s",
 				len ? ", " : "", "casefold");
+	if (f2fs_sb_has_compression(sbi))
+		len += snprintf(buf + len, PAGE_SIZE - len, "%s%s",
+				len ? ", " : "", "compression");
 	len += snprintf(buf + len, PAGE_SIZE - len, "\n");
 	return len;
 }
@@ -290,6 +312,16 @@ static ssize_t __sbi_store(struct f2fs_attr *a,
 	if (!strcmp(a->attr.name, "trim_sections"))
 		return -EINVAL;
 
+	if (!strcmp(a->attr.name, "gc_workers")) {
+		if (t == 0 || t > MAX_GC_THREAD_WORKERS)
+			return -EINVAL;
+	}
+
+	if (!strcmp(a->attr.name, "gc_age_weight")) {
+		if (t > 100)
+			return -EINVAL;
+	}
+
 	if (!strcmp(a->attr.name, "gc_urgent")) {
 		if (t >= 1) {
 			sbi->gc_mode = GC_URGENT;
@@ -309,6 +341,8 @@ static ssize_t __sbi_store(struct f2fs_attr *a,
 			sbi->gc_mode = GC_IDLE_CB;
 		else if (t == GC_IDLE_GREEDY)
 			sbi->gc_mode = GC_IDLE_GREEDY;
+		else if (t == GC_IDLE_AT)
+			sbi->gc_mode = GC_IDLE_AT;
 		else
 			sbi->gc_mode = GC_NORMAL;
 		return count;
@@ -387,6 +421,7 @@ enum feat_id {
 	FEAT_VERITY,
 	FEAT_SB_CHECKSUM,
 	FEAT_CASEFOLD,
+	FEAT_COMPRESSION,
 };
 
 static ssize_t f2fs_feature_show(struct f2fs_attr *a,
@@ -406,6 +441,7 @@ static ssize_t f2fs_feature_show(struct f2fs_attr *a,
 	case FEAT_VERITY:
 	case FEAT_SB_CHECKSUM:
 	case FEAT_CASEFOLD:
+	case FEAT_COMPRESSION:
 		return snprintf(buf, PAGE_SIZE, "supported\n");
 	}
 	return 0;
@@ -440,6 +476,7 @@ F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_urgent_sleep_time,
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_min_sleep_time, min_sleep_time);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_max_sleep_time, max_sleep_time);
 F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_no_gc_sleep_time, no_gc_sleep_time);
+F2FS_RW_ATTR(GC_THREAD, f2fs_gc_kthread, gc_workers, workers);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_idle, gc_mode);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_urgent, gc_mode);
 F2FS_RW_ATTR(SM_INFO, f2fs_sm_info, reclaim_segments, rec_prefree_segments);
@@ -469,6 +506,8 @@ F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info,
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, iostat_enable, iostat_enable);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, readdir_ra, readdir_ra);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_pin_file_thresh, gc_pin_file_threshold);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_age_threshold, gc_age_threshold);
+F2FS_RW_ATTR(F2FS_SBI, f2fs_sb_info, gc_age_weight, gc_age_weight);
 F2FS_RW_ATTR(F2FS_SBI, f2fs_super_block, extension_list, extension_list);
 #ifdef CONFIG_F2FS_FAULT_INJECTION
 F2FS_RW_ATTR(FAULT_INFO_RATE, f2fs_fault_info, inject_rate, inject_rate);
@@ -480,6 +519,14 @@ F2FS_GENERAL_RO_ATTR(features);
 F2FS_GENERAL_RO_ATTR(current_reserved_blocks);
 F2FS_GENERAL_RO_ATTR(unusable);
 F2FS_GENERAL_RO_ATTR(encoding);
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+F2FS_GENERAL_RO_ATTR(compr_written_block);
+F2FS_GENERAL_RO_ATTR(compr_saved_block);
+F2FS_GENERAL_RO_ATTR(compress_count);
+F2FS_GENERAL_RO_ATTR(compress_ns);
+F2FS_GENERAL_RO_ATTR(decompress_count);
+F2FS_GENERAL_RO_ATTR(decompress_ns);
+#endif
 
 #ifdef CONFIG_FS_ENCRYPTION
 F2FS_FEATURE_RO_ATTR(encryption, FEAT_CRYPTO);
@@ -500,6 +547,9 @@ F2FS_FEATURE_RO_ATTR(verity, FEAT_VERITY);
 #endif
 F2FS_FEATURE_RO_ATTR(sb_checksum, FEAT_SB_CHECKSUM);
 F2FS_FEATURE_RO_ATTR(casefold, FEAT_CASEFOLD);
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+F2FS_FEATURE_RO_ATTR(compression, FEAT_COMPRESSION);
+#endif
 
 #define ATTR_LIST(name) (&f2fs_attr_##name.attr)
 static struct attribute *f2fs_attrs[] = {
@@ -507,6 +557,7 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(gc_min_sleep_time),
 	ATTR_LIST(gc_max_sleep_time),
 	ATTR_LIST(gc_no_gc_sleep_time),
+	ATTR_LIST(gc_workers),
 	ATTR_LIST(gc_idle),
 	ATTR_LIST(gc_urgent),
 	ATTR_LIST(reclaim_segments),
@@ -533,6 +584,8 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(iostat_enable),
 	ATTR_LIST(readdir_ra),
 	ATTR_LIST(gc_pin_file_thresh),
+	ATTR_LIST(gc_age_threshold),
+	ATTR_LIST(gc_age_weight),
 	ATTR_LIST(extension_list),
 #ifdef CONFIG_F2FS_FAULT_INJECTION
 	ATTR_LIST(inject_rate),
@@ -545,6 +598,14 @@ static struct attribute *f2fs_attrs[] = {
 	ATTR_LIST(reserved_blocks),
 	ATTR_LIST(current_reserved_blocks),
 	ATTR_LIST(encoding),
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	ATTR_LIST(compr_written_block),
+	ATTR_LIST(compr_saved_block),
+	ATTR_LIST(compress_count),
+	ATTR_LIST(compress_ns),
+	ATTR_LIST(decompress_count),
+	ATTR_LIST(decompress_ns),
+#endif
 	NULL,
 };
 ATTRIBUTE_GROUPS(f2fs);
@@ -569,6 +630,9 @@ static struct attribute *f2fs_feat_attrs[] = {
 #endif
 	ATTR_LIST(sb_checksum),
 	ATTR_LIST(casefold),
+#ifdef CONFIG_F2FS_FS_COMPRESSION
+	ATTR_LIST(compression),
+#endif
 	NULL,
 };
 ATTRIBUTE_GROUPS(f2fs_feat);
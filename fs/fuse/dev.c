@@ -21,6 +21,10 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/bvec.h>
+
+#include <asm/shmparam.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -40,6 +44,14 @@ static struct fuse_dev *fuse_get_dev(struct file *file)
 	return READ_ONCE(file->private_data);
 }
 
+/* The input queue this device reads requests from */
+static struct fuse_iqueue *fuse_dev_fiq(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *fiq = READ_ONCE(fud->fiq);
+
+	return fiq ? fiq : &fud->fc->iq;
+}
+
 static void fuse_request_init(struct fuse_req *req)
 {
 	INIT_LIST_HEAD(&req->list);
@@ -225,10 +237,51 @@ __releases(fiq->lock)
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		fuse_len_args(req->args->in_numargs,
 			      (struct fuse_arg *) req->args->in_args);
+	req->fiq = fiq;
 	list_add_tail(&req->list, &fiq->pending);
 	fiq->ops->wake_pending_and_unlock(fiq);
 }
 
+/*
+ * Pick and lock the input queue for a new request: the queue of the current
+ * CPU if a device is bound to it, fc->iq otherwise.
+ */
+static struct fuse_iqueue *fuse_lock_iqueue(struct fuse_conn *fc)
+__acquires(fiq->lock)
+{
+	struct fuse_iqueue *mq = READ_ONCE(fc->mq);
+	struct fuse_iqueue *fiq;
+
+	if (mq) {
+		fiq = &mq[raw_smp_processor_id()];
+		if (READ_ONCE(fiq->connected)) {
+			spin_lock(&fiq->lock);
+			if (fiq->connected)
+				return fiq;
+			spin_unlock(&fiq->lock);
+		}
+	}
+
+	fiq = &fc->iq;
+	spin_lock(&fiq->lock);
+	return fiq;
+}
+
+/* Lock the input queue @req is pending on, it may move on unbind */
+static struct fuse_iqueue *fuse_req_lock_iqueue(struct fuse_req *req)
+__acquires(fiq->lock)
+{
+	struct fuse_iqueue *fiq;
+
+	for (;;) {
+		fiq = READ_ONCE(req->fiq);
+		spin_lock(&fiq->lock);
+		if (likely(req->fiq == fiq))
+			return fiq;
+		spin_unlock(&fiq->lock);
+	}
+}
+
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
@@ -250,16 +303,15 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 
 static void flush_bg_queue(struct fuse_conn *fc)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
-
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_iqueue *fiq;
 		struct fuse_req *req;
 
 		req = list_first_entry(&fc->bg_queue, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		spin_lock(&fiq->lock);
+		fiq = fuse_lock_iqueue(fc);
 		req->in.h.unique = fuse_get_unique(fiq);
 		queue_request_and_unlock(fiq, req);
 	}
@@ -383,7 +435,7 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 		if (!err)
 			return;
 
-		spin_lock(&fiq->lock);
+		fiq = fuse_req_lock_iqueue(req);
 		/* Request is not yet in userspace, bail out */
 		if (test_bit(FR_PENDING, &req->flags)) {
 			list_del(&req->list);
@@ -404,10 +456,10 @@ static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
 
 static void __fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq;
 
 	BUG_ON(test_bit(FR_BACKGROUND, &req->flags));
-	spin_lock(&fiq->lock);
+	fiq = fuse_lock_iqueue(fc);
 	if (!fiq->connected) {
 		spin_unlock(&fiq->lock);
 		req->out.h.error = -ENOTCONN;
@@ -1173,12 +1225,12 @@ __releases(fiq->lock)
  * fuse_request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, bool nonblock,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	ssize_t err;
 	struct fuse_conn *fc = fud->fc;
-	struct fuse_iqueue *fiq = &fc->iq;
+	struct fuse_iqueue *fiq = fuse_dev_fiq(fud);
 	struct fuse_pqueue *fpq = &fud->pq;
 	struct fuse_req *req;
 	struct fuse_args *args;
@@ -1210,7 +1262,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 			break;
 		spin_unlock(&fiq->lock);
 
-		if (file->f_flags & O_NONBLOCK)
+		if (nonblock)
 			return -EAGAIN;
 		err = wait_event_interruptible_exclusive(fiq->waitq,
 				!fiq->connected || request_pending(fiq));
@@ -1285,7 +1337,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 	/* matches barrier in request_wait_answer() */
 	smp_mb__after_atomic();
 	if (test_bit(FR_INTERRUPTED, &req->flags))
-		queue_interrupt(fiq, req);
+		queue_interrupt(&fc->iq, req);
 	fuse_put_request(fc, req);
 
 	return reqsize;
@@ -1327,7 +1379,8 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, struct iov_iter *to)
 
 	fuse_copy_init(&cs, 1, to);
 
-	return fuse_dev_do_read(fud, file, &cs, iov_iter_count(to));
+	return fuse_dev_do_read(fud, file->f_flags & O_NONBLOCK, &cs,
+				iov_iter_count(to));
 }
 
 static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
@@ -1351,7 +1404,7 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	fuse_copy_init(&cs, 1, NULL);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fud, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in->f_flags & O_NONBLOCK, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -2026,7 +2079,7 @@ static __poll_t fuse_dev_poll(struct file *file, poll_table *wait)
 	if (!fud)
 		return EPOLLERR;
 
-	fiq = &fud->fc->iq;
+	fiq = fuse_dev_fiq(fud);
 	poll_wait(file, &fiq->waitq, wait);
 
 	spin_lock(&fiq->lock);
@@ -2067,6 +2120,28 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Disconnect the per-CPU input queues and move their pending requests to
+ * @to_end.  New binds fail once fc->iq is disconnected.
+ */
+static void fuse_abort_mq(struct fuse_conn *fc, struct list_head *to_end)
+{
+	struct fuse_req *req;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *fiq = &fc->mq[cpu];
+
+		spin_lock(&fiq->lock);
+		fiq->connected = 0;
+		list_for_each_entry(req, &fiq->pending, list)
+			clear_bit(FR_PENDING, &req->flags);
+		list_splice_tail_init(&fiq->pending, to_end);
+		wake_up_all(&fiq->waitq);
+		spin_unlock(&fiq->lock);
+	}
+}
+
 /*
  * Abort all requests.
  *
@@ -2139,6 +2214,8 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		wake_up_all(&fiq->waitq);
 		spin_unlock(&fiq->lock);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
+		if (fc->mq)
+			fuse_abort_mq(fc, &to_end);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -2157,6 +2234,78 @@ void fuse_wait_aborted(struct fuse_conn *fc)
 	wait_event(fc->blocked_waitq, atomic_read(&fc->num_waiting) == 0);
 }
 
+/*
+ * Drop @fud from its per-CPU queue.  When the last device leaves, requests
+ * still pending there are handed to the readers of fc->iq.
+ */
+static void fuse_dev_unbind_queue(struct fuse_dev *fud)
+{
+	struct fuse_iqueue *iq = &fud->fc->iq;
+	struct fuse_iqueue *fiq = fud->fiq;
+	struct fuse_req *req;
+
+	spin_lock(&iq->lock);
+	spin_lock_nested(&fiq->lock, SINGLE_DEPTH_NESTING);
+	if (!--fiq->readers) {
+		fiq->connected = 0;
+		list_for_each_entry(req, &fiq->pending, list)
+			req->fiq = iq;
+		list_splice_tail_init(&fiq->pending, &iq->pending);
+	}
+	spin_unlock(&fiq->lock);
+	fuse_dev_wake_and_unlock(iq);
+}
+
+static int fuse_dev_bind_queue(struct fuse_dev *fud, u32 cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *mq, *fiq;
+	unsigned int i;
+	int err;
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return -EINVAL;
+
+	/* Only requests read through /dev/fuse can be spread over queues */
+	if (fc->iq.ops != &fuse_dev_fiq_ops)
+		return -EINVAL;
+
+	mq = READ_ONCE(fc->mq);
+	if (!mq) {
+		mq = kcalloc(nr_cpu_ids, sizeof(*mq), GFP_KERNEL);
+		if (!mq)
+			return -ENOMEM;
+
+		for_each_possible_cpu(i) {
+			fuse_iqueue_init(&mq[i], &fuse_dev_fiq_ops, NULL);
+			mq[i].connected = 0;
+			mq[i].reqctr = (u64)(i + 1) << FUSE_MQ_REQ_ID_SHIFT;
+		}
+		if (cmpxchg(&fc->mq, NULL, mq)) {
+			kfree(mq);
+			mq = fc->mq;
+		}
+	}
+	fiq = &mq[cpu];
+
+	spin_lock(&fc->iq.lock);
+	if (!fc->iq.connected) {
+		err = -ENODEV;
+	} else if (fud->fiq) {
+		err = -EBUSY;
+	} else {
+		spin_lock_nested(&fiq->lock, SINGLE_DEPTH_NESTING);
+		fiq->readers++;
+		fiq->connected = 1;
+		spin_unlock(&fiq->lock);
+		WRITE_ONCE(fud->fiq, fiq);
+		err = 0;
+	}
+	spin_unlock(&fc->iq.lock);
+
+	return err;
+}
+
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
 	struct fuse_dev *fud = fuse_get_dev(file);
@@ -2167,6 +2316,11 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		LIST_HEAD(to_end);
 		unsigned int i;
 
+		if (fud->fiq)
+			fuse_dev_unbind_queue(fud);
+		if (fud->ring)
+			fuse_ring_free(fc, fud->ring);
+
 		spin_lock(&fpq->lock);
 		WARN_ON(!list_empty(&fpq->io));
 		for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
@@ -2197,6 +2351,278 @@ static int fuse_dev_fasync(int fd, struct file *file, int on)
 	return fasync_helper(fd, file, on, &fud->fc->iq.fasync);
 }
 
+/*
+ * Shared-memory ring transport, see the comment above struct fuse_ring_setup.
+ *
+ * A slot is read and written with the same fuse_dev_do_read() and
+ * fuse_dev_do_write() as read(2) and write(2), through a bvec iterator over
+ * the slot's pages instead of a user iovec.
+ */
+#define FUSE_RING_MAX_ENTRIES	1024
+#define FUSE_RING_MAX_SIZE	(16 << 20)
+/* Limit of all the rings of a connection, one per cloned device */
+#define FUSE_RING_MAX_TOTAL	(64 << 20)
+
+struct fuse_ring {
+	/** Serializes FUSE_DEV_IOC_RING_ENTER */
+	struct mutex lock;
+
+	/** Shared memory: control block, index arrays and slots */
+	void *base;
+	struct fuse_ring_ctl *ctl;
+	u32 *req_ring;
+	u32 *rep_ring;
+
+	unsigned int entries;
+	unsigned int slot_size;
+	unsigned int slots_off;
+	size_t size;
+
+	/** Private copies of the indices only the kernel advances */
+	u32 req_tail;
+	u32 rep_head;
+
+	/** Slots published to the daemon and not yet returned */
+	unsigned long *busy;
+
+	/** Stack of free slots */
+	u32 *free;
+	unsigned int nr_free;
+
+	/** Pages of all slots */
+	struct bio_vec *bvec;
+};
+
+static void fuse_ring_free(struct fuse_conn *fc, struct fuse_ring *ring)
+{
+	kvfree(ring->bvec);
+	kfree(ring->free);
+	bitmap_free(ring->busy);
+	vfree(ring->base);
+	atomic_long_sub(ring->size, &fc->ring_bytes);
+	kfree(ring);
+}
+
+static int fuse_ring_setup(struct fuse_dev *fud, struct fuse_ring_setup *rs)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_ring *ring;
+	unsigned int i, entries = rs->entries, slot_pages, rep_off, slots_off;
+	u64 size;
+
+	if (rs->flags || !is_power_of_2(entries) ||
+	    entries > FUSE_RING_MAX_ENTRIES ||
+	    !PAGE_ALIGNED(rs->slot_size) || rs->slot_size > FUSE_RING_MAX_SIZE)
+		return -EINVAL;
+
+	/* max_write is only known once INIT has been answered */
+	if (!fc->initialized)
+		return -EAGAIN;
+	/* Matches smp_wmb() in fuse_set_initialized() */
+	smp_rmb();
+
+	/* A slot must take any request, see fuse_dev_do_read() */
+	if (rs->slot_size < max_t(size_t, FUSE_MIN_READ_BUFFER,
+				  sizeof(struct fuse_in_header) +
+				  sizeof(struct fuse_write_in) +
+				  fc->max_write))
+		return -EINVAL;
+
+	rep_off = sizeof(struct fuse_ring_ctl) + entries * sizeof(u32);
+	slots_off = PAGE_ALIGN(rep_off + entries * sizeof(u32));
+	size = slots_off + (u64)entries * rs->slot_size;
+	if (size > FUSE_RING_MAX_SIZE)
+		return -EINVAL;
+	slot_pages = rs->slot_size >> PAGE_SHIFT;
+
+	if (atomic_long_add_return(size, &fc->ring_bytes) >
+	    FUSE_RING_MAX_TOTAL) {
+		atomic_long_sub(size, &fc->ring_bytes);
+		return -ENOSPC;
+	}
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL_ACCOUNT);
+	if (!ring) {
+		atomic_long_sub(size, &fc->ring_bytes);
+		return -ENOMEM;
+	}
+	ring->size = size;
+
+	/* Like vmalloc_user(), but charged to the daemon's memcg */
+	mutex_init(&ring->lock);
+	ring->base = __vmalloc_node_range(size, SHMLBA, VMALLOC_START,
+					  VMALLOC_END,
+					  GFP_KERNEL_ACCOUNT | __GFP_ZERO,
+					  PAGE_KERNEL, VM_USERMAP, NUMA_NO_NODE,
+					  __builtin_return_address(0));
+	ring->busy = bitmap_zalloc(entries, GFP_KERNEL_ACCOUNT);
+	ring->free = kcalloc(entries, sizeof(u32), GFP_KERNEL_ACCOUNT);
+	ring->bvec = kvcalloc(entries * slot_pages, sizeof(struct bio_vec),
+			      GFP_KERNEL_ACCOUNT);
+	if (!ring->base || !ring->busy || !ring->free || !ring->bvec) {
+		fuse_ring_free(fc, ring);
+		return -ENOMEM;
+	}
+
+	ring->ctl = ring->base;
+	ring->req_ring = ring->base + sizeof(struct fuse_ring_ctl);
+	ring->rep_ring = ring->base + rep_off;
+	ring->entries = entries;
+	ring->slot_size = rs->slot_size;
+	ring->slots_off = slots_off;
+
+	ring->ctl->entries = entries;
+	ring->ctl->slot_size = rs->slot_size;
+	ring->ctl->req_off = sizeof(struct fuse_ring_ctl);
+	ring->ctl->rep_off = rep_off;
+
+	for (i = 0; i < entries; i++)
+		ring->free[i] = entries - 1 - i;
+	ring->nr_free = entries;
+
+	for (i = 0; i < entries * slot_pages; i++) {
+		void *addr = ring->base + slots_off + ((size_t)i << PAGE_SHIFT);
+
+		ring->bvec[i].bv_page = vmalloc_to_page(addr);
+		ring->bvec[i].bv_len = PAGE_SIZE;
+		ring->bvec[i].bv_offset = 0;
+	}
+
+	if (cmpxchg(&fud->ring, NULL, ring)) {
+		fuse_ring_free(fc, ring);
+		return -EBUSY;
+	}
+
+	rs->slots_off = slots_off;
+	rs->ring_size = size;
+	return 0;
+}
+
+static void fuse_ring_slot_iter(struct fuse_ring *ring, struct iov_iter *iter,
+				unsigned int direction, u32 slot, size_t count)
+{
+	unsigned int slot_pages = ring->slot_size >> PAGE_SHIFT;
+
+	iov_iter_bvec(iter, direction, ring->bvec + slot * slot_pages,
+		      slot_pages, count);
+}
+
+/* Complete the requests whose replies the daemon queued since last time */
+static ssize_t fuse_ring_reap_replies(struct fuse_dev *fud,
+				      struct fuse_ring *ring)
+{
+	u32 head = ring->rep_head;
+	/* Pairs with the daemon's release store of rep_tail */
+	u32 tail = smp_load_acquire(&ring->ctl->rep_tail);
+	ssize_t err = 0;
+
+	while (head != tail) {
+		struct fuse_copy_state cs;
+		struct fuse_out_header *oh;
+		struct iov_iter iter;
+		u32 slot, len;
+
+		slot = READ_ONCE(ring->rep_ring[head++ & (ring->entries - 1)]);
+		if (slot >= ring->entries ||
+		    !test_and_clear_bit(slot, ring->busy)) {
+			err = -EINVAL;
+			break;
+		}
+
+		oh = ring->base + ring->slots_off + slot * ring->slot_size;
+		len = READ_ONCE(oh->len);
+		if (len > ring->slot_size) {
+			err = -EINVAL;
+		} else if (len) {
+			/* fuse_dev_do_write() checks len against the copy */
+			fuse_ring_slot_iter(ring, &iter, WRITE, slot, len);
+			fuse_copy_init(&cs, 0, &iter);
+			err = fuse_dev_do_write(fud, &cs, len);
+		}
+		ring->free[ring->nr_free++] = slot;
+		/* -ENOENT: aborted or interrupted meanwhile, as for write(2) */
+		if (err < 0 && err != -ENOENT)
+			break;
+		err = 0;
+	}
+
+	/* Done reading the reply array up to the new head */
+	ring->rep_head = head;
+	smp_store_release(&ring->ctl->rep_head, head);
+
+	return err;
+}
+
+/*
+ * Publish pending requests in free slots.  With @min_requests set, wait for
+ * the first one; the others are only taken if already pending, so the call
+ * sleeps at most once.
+ */
+static ssize_t fuse_ring_fill_requests(struct fuse_dev *fud,
+				       struct fuse_ring *ring, u32 min_requests)
+{
+	u32 tail = ring->req_tail;
+	ssize_t posted = 0, err = 0;
+
+	while (ring->nr_free) {
+		struct fuse_copy_state cs;
+		struct iov_iter iter;
+		u32 slot = ring->free[ring->nr_free - 1];
+
+		fuse_ring_slot_iter(ring, &iter, READ, slot, ring->slot_size);
+		fuse_copy_init(&cs, 1, &iter);
+		err = fuse_dev_do_read(fud, posted || !min_requests, &cs,
+				       ring->slot_size);
+		if (err < 0)
+			break;
+
+		ring->nr_free--;
+		set_bit(slot, ring->busy);
+		WRITE_ONCE(ring->req_ring[tail++ & (ring->entries - 1)], slot);
+		posted++;
+	}
+
+	/* Slot contents and indices before the new tail */
+	ring->req_tail = tail;
+	smp_store_release(&ring->ctl->req_tail, tail);
+
+	if (posted || err == -EAGAIN)
+		return posted;
+	return err;
+}
+
+static long fuse_ring_enter(struct fuse_dev *fud, struct fuse_ring_enter *re)
+{
+	struct fuse_ring *ring = READ_ONCE(fud->ring);
+	ssize_t ret;
+
+	if (!ring || re->flags)
+		return -EINVAL;
+
+	mutex_lock(&ring->lock);
+	ret = fuse_ring_reap_replies(fud, ring);
+	if (!ret)
+		ret = fuse_ring_fill_requests(fud, ring, re->min_requests);
+	mutex_unlock(&ring->lock);
+
+	return ret;
+}
+
+static int fuse_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_ring *ring;
+
+	if (!fud)
+		return -EPERM;
+
+	ring = READ_ONCE(fud->ring);
+	if (!ring)
+		return -ENODEV;
+
+	return remap_vmalloc_range(vma, ring->base, vma->vm_pgoff);
+}
+
 static int fuse_device_clone(struct fuse_conn *fc, struct file *new)
 {
 	struct fuse_dev *fud;
@@ -2219,7 +2645,54 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 {
 	int err = -ENOTTY;
 
-	if (cmd == FUSE_DEV_IOC_CLONE) {
+	if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN) {
+		struct fuse_passthrough_out pto;
+		struct fuse_dev *fud;
+
+		err = -EFAULT;
+		if (copy_from_user(&pto, (void __user *) arg, sizeof(pto)))
+			return err;
+
+		err = -EINVAL;
+		fud = fuse_get_dev(file);
+		if (fud && !pto.flags)
+			err = fuse_passthrough_open(fud, pto.fd);
+	} else if (cmd == FUSE_DEV_IOC_BIND_QUEUE) {
+		u32 cpu;
+
+		err = -EFAULT;
+		if (!get_user(cpu, (__u32 __user *) arg)) {
+			struct fuse_dev *fud = fuse_get_dev(file);
+
+			err = -EINVAL;
+			if (fud)
+				err = fuse_dev_bind_queue(fud, cpu);
+		}
+	} else if (cmd == FUSE_DEV_IOC_RING_SETUP) {
+		struct fuse_ring_setup rs;
+		struct fuse_dev *fud = fuse_get_dev(file);
+
+		err = -EFAULT;
+		if (copy_from_user(&rs, (void __user *) arg, sizeof(rs)))
+			return err;
+
+		err = -EINVAL;
+		if (fud)
+			err = fuse_ring_setup(fud, &rs);
+		if (!err && copy_to_user((void __user *) arg, &rs, sizeof(rs)))
+			err = -EFAULT;
+	} else if (cmd == FUSE_DEV_IOC_RING_ENTER) {
+		struct fuse_ring_enter re;
+		struct fuse_dev *fud = fuse_get_dev(file);
+
+		err = -EFAULT;
+		if (copy_from_user(&re, (void __user *) arg, sizeof(re)))
+			return err;
+
+		err = -EINVAL;
+		if (fud)
+			err = fuse_ring_enter(fud, &re);
+	} else if (cmd == FUSE_DEV_IOC_CLONE) {
 		int oldfd;
 
 		err = -EFAULT;
@@ -2259,6 +2732,7 @@ const struct file_operations fuse_dev_operations = {
 	.write_iter	= fuse_dev_write,
 	.splice_write	= fuse_dev_splice_write,
 	.poll		= fuse_dev_poll,
+	.mmap		= fuse_dev_mmap,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
 	.unlocked_ioctl = fuse_dev_ioctl,
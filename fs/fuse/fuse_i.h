@@ -30,6 +30,7 @@
 #include <linux/xattr.h>
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
+#include <linux/idr.h>
 #include <linux/user_namespace.h>
 
 /** Default max number of pages that can be used in a single read request */
@@ -63,6 +64,15 @@ struct fuse_forget_link {
 	struct fuse_forget_link *next;
 };
 
+/** Backing file of a passthrough open, see passthrough.c */
+struct fuse_passthrough {
+	/** File to pass read/write/mmap through to */
+	struct file *filp;
+
+	/** Credentials of the daemon that registered @filp */
+	const struct cred *cred;
+};
+
 /** FUSE inode */
 struct fuse_inode {
 	/** Inode data */
@@ -214,6 +224,9 @@ struct fuse_file {
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
 
+	/** Backing file, if I/O is passed through */
+	struct fuse_passthrough passthrough;
+
 	/** Has flock been performed on this file? */
 	bool flock:1;
 };
@@ -355,6 +368,9 @@ struct fuse_req {
 	/** Used to wake up the task waiting for completion of request*/
 	wait_queue_head_t waitq;
 
+	/** Input queue the request was queued on */
+	struct fuse_iqueue *fiq;
+
 #if IS_ENABLED(CONFIG_VIRTIO_FS)
 	/** virtio-fs's physically contiguous buffer for in and out args */
 	void *argbuf;
@@ -433,8 +449,17 @@ struct fuse_iqueue {
 
 	/** Device-specific state */
 	void *priv;
+
+	/** Number of devices bound to this queue (per-CPU queues only) */
+	unsigned int readers;
 };
 
+/**
+ * Request ids of per-CPU queue N start at (N + 1) << FUSE_MQ_REQ_ID_SHIFT,
+ * so ids stay unique across the queues of a connection
+ */
+#define FUSE_MQ_REQ_ID_SHIFT 48
+
 #define FUSE_PQ_HASH_BITS 8
 #define FUSE_PQ_HASH_SIZE (1 << FUSE_PQ_HASH_BITS)
 
@@ -462,6 +487,12 @@ struct fuse_dev {
 	/** Processing queue */
 	struct fuse_pqueue pq;
 
+	/** Per-CPU input queue this device is bound to, or NULL for fc->iq */
+	struct fuse_iqueue *fiq;
+
+	/** Shared-memory ring, if set up with FUSE_DEV_IOC_RING_SETUP */
+	struct fuse_ring *ring;
+
 	/** list entry on fc->devices */
 	struct list_head entry;
 };
@@ -507,6 +538,9 @@ struct fuse_conn {
 	/** Number of fuse_dev's */
 	atomic_t dev_count;
 
+	/** Bytes of shared memory in rings of all fuse_dev's */
+	atomic_long_t ring_bytes;
+
 	struct rcu_head rcu;
 
 	/** The user id for this mount */
@@ -533,6 +567,14 @@ struct fuse_conn {
 	/** Input queue */
 	struct fuse_iqueue iq;
 
+	/**
+	 * Per-CPU input queues, indexed by CPU, allocated when the first
+	 * device is bound with FUSE_DEV_IOC_BIND_QUEUE.  Requests issued on a
+	 * CPU whose queue has bound devices go there instead of to iq;
+	 * interrupts and forgets always go to iq.
+	 */
+	struct fuse_iqueue *mq;
+
 	/** The next unique kernel file handle */
 	atomic64_t khctr;
 
@@ -609,6 +651,9 @@ struct fuse_conn {
 	/** cache READLINK responses in page cache */
 	unsigned cache_symlinks:1;
 
+	/** Pass file I/O through to backing files registered by the daemon */
+	unsigned passthrough:1;
+
 	/*
 	 * The following bitfields are only for optimization purposes
 	 * and hence races in setting them will not cause malfunction
@@ -754,6 +799,9 @@ struct fuse_conn {
 
 	/** List of device instances belonging to this connection */
 	struct list_head devices;
+
+	/** Registered passthrough backing files not yet used by an open */
+	struct idr passthrough_req;
 };
 
 static inline struct fuse_conn *get_fuse_conn_super(struct super_block *sb)
@@ -1092,4 +1140,17 @@ unsigned int fuse_len_args(unsigned int numargs, struct fuse_arg *args);
 u64 fuse_get_unique(struct fuse_iqueue *fiq);
 void fuse_free_conn(struct fuse_conn *fc);
 
+void fuse_iqueue_init(struct fuse_iqueue *fiq,
+		      const struct fuse_iqueue_ops *ops, void *priv);
+
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_dev *fud, u32 fd);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+void fuse_passthrough_free_reqs(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
@@ -574,9 +574,8 @@ static int fuse_show_options(struct seq_file *m, struct dentry *root)
 	return 0;
 }
 
-static void fuse_iqueue_init(struct fuse_iqueue *fiq,
-			     const struct fuse_iqueue_ops *ops,
-			     void *priv)
+void fuse_iqueue_init(struct fuse_iqueue *fiq,
+		      const struct fuse_iqueue_ops *ops, void *priv)
 {
 	memset(fiq, 0, sizeof(struct fuse_iqueue));
 	spin_lock_init(&fiq->lock);
@@ -614,6 +613,7 @@ void fuse_conn_init(struct fuse_conn *fc, struct user_namespace *user_ns,
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	INIT_LIST_HEAD(&fc->devices);
+	idr_init(&fc->passthrough_req);
 	atomic_set(&fc->num_waiting, 0);
 	fc->max_background = FUSE_DEFAULT_MAX_BACKGROUND;
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
@@ -637,6 +637,8 @@ void fuse_conn_put(struct fuse_conn *fc)
 
 		if (fiq->ops->release)
 			fiq->ops->release(fiq);
+		fuse_passthrough_free_reqs(fc);
+		kfree(fc->mq);
 		put_pid_ns(fc->pid_ns);
 		put_user_ns(fc->user_ns);
 		fc->release(fc);
@@ -946,6 +948,16 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_args *args,
 				fc->cache_symlinks = 1;
 			if (arg->flags & FUSE_ABORT_ERROR)
 				fc->abort_err = 1;
+			if ((arg->flags & FUSE_INIT_EXT) &&
+			    (arg->flags2 & (FUSE_PASSTHROUGH >> 32))) {
+				fc->passthrough = 1;
+				/*
+				 * Backing files may be on any filesystem, so
+				 * nothing may stack on top of this one.
+				 */
+				fc->sb->s_stack_depth =
+					FILESYSTEM_MAX_STACK_DEPTH;
+			}
 			if (arg->flags & FUSE_MAX_PAGES) {
 				fc->max_pages =
 					min_t(unsigned int, FUSE_MAX_MAX_PAGES,
@@ -988,7 +1000,9 @@ void fuse_send_init(struct fuse_conn *fc)
 		FUSE_WRITEBACK_CACHE | FUSE_NO_OPEN_SUPPORT |
 		FUSE_PARALLEL_DIROPS | FUSE_HANDLE_KILLPRIV | FUSE_POSIX_ACL |
 		FUSE_ABORT_ERROR | FUSE_MAX_PAGES | FUSE_CACHE_SYMLINKS |
-		FUSE_NO_OPENDIR_SUPPORT | FUSE_EXPLICIT_INVAL_DATA;
+		FUSE_NO_OPENDIR_SUPPORT | FUSE_EXPLICIT_INVAL_DATA |
+		FUSE_INIT_EXT;
+	ia->in.flags2 = FUSE_PASSTHROUGH >> 32;
 	ia->args.opcode = FUSE_INIT;
 	ia->args.in_numargs = 1;
 	ia->args.in_args[0].size = sizeof(ia->in);
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * FUSE passthrough: read/write/mmap straight to a backing file
+ *
+ * The daemon registers a file it has open with FUSE_DEV_IOC_PASSTHROUGH_OPEN
+ * and gets back an id, which it returns in the FUSE_OPEN (or FUSE_CREATE)
+ * reply.  From then on data I/O on the FUSE file is done on the backing file
+ * directly, with the daemon's credentials, while everything else (lookup,
+ * getattr, setattr, flush, fsync, release, ...) still goes to userspace.
+ *
+ * The FUSE page cache is not used for such files, so mixing passthrough and
+ * regular opens of the same inode is only coherent if the daemon invalidates
+ * the cache itself.
+ */
+
+#include "fuse_i.h"
+
+#include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+
+static rwf_t fuse_iocb_to_rwf(struct kiocb *iocb)
+{
+	int ifl = iocb->ki_flags;
+	rwf_t flags = 0;
+
+	if (ifl & IOCB_NOWAIT)
+		flags |= RWF_NOWAIT;
+	if (ifl & IOCB_HIPRI)
+		flags |= RWF_HIPRI;
+	if (ifl & IOCB_DSYNC)
+		flags |= RWF_DSYNC;
+	if (ifl & IOCB_SYNC)
+		flags |= RWF_SYNC;
+	if (ifl & IOCB_APPEND)
+		flags |= RWF_APPEND;
+
+	return flags;
+}
+
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(to))
+		return 0;
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = vfs_iter_read(ff->passthrough.filp, to, &iocb->ki_pos,
+			    fuse_iocb_to_rwf(iocb));
+	revert_creds(old_cred);
+
+	fuse_invalidate_atime(file_inode(file));
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file_inode(file);
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	ssize_t ret;
+
+	if (!iov_iter_count(from))
+		return 0;
+
+	inode_lock(inode);
+	old_cred = override_creds(ff->passthrough.cred);
+	file_start_write(backing);
+	ret = vfs_iter_write(backing, from, &iocb->ki_pos,
+			     fuse_iocb_to_rwf(iocb));
+	file_end_write(backing);
+	revert_creds(old_cred);
+
+	/* Size is known here, times and mode are refetched from userspace */
+	if (ret > 0)
+		fuse_write_update_size(inode, iocb->ki_pos);
+	fuse_invalidate_attr(inode);
+	inode_unlock(inode);
+
+	return ret;
+}
+
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct fuse_file *ff = file->private_data;
+	struct file *backing = ff->passthrough.filp;
+	const struct cred *old_cred;
+	int ret;
+
+	if (!backing->f_op->mmap)
+		return -ENODEV;
+
+	if (WARN_ON(file != vma->vm_file))
+		return -EIO;
+
+	vma->vm_file = get_file(backing);
+
+	old_cred = override_creds(ff->passthrough.cred);
+	ret = call_mmap(vma->vm_file, vma);
+	revert_creds(old_cred);
+
+	if (ret) {
+		/* Drop reference count from new vm_file value */
+		fput(backing);
+	} else {
+		/* Drop reference count from previous vm_file value */
+		fput(file);
+	}
+
+	fuse_invalidate_atime(file_inode(file));
+
+	return ret;
+}
+
+/**
+ * fuse_passthrough_open - register a backing file for a later open
+ * @fud: device the daemon issued FUSE_DEV_IOC_PASSTHROUGH_OPEN on
+ * @fd: descriptor of the backing file in the calling process
+ *
+ * Returns the id to put in fuse_open_out.passthrough_fh, or a negative errno.
+ */
+int fuse_passthrough_open(struct fuse_dev *fud, u32 fd)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_passthrough *passthrough;
+	struct file *backing;
+	int res;
+
+	if (!fc->passthrough)
+		return -EPERM;
+
+	backing = fget(fd);
+	if (!backing)
+		return -EBADF;
+
+	res = -EINVAL;
+	if (!backing->f_op->read_iter || !backing->f_op->write_iter)
+		goto out_fput;
+
+	/*
+	 * A passthrough FUSE mount counts as fully stacked, so this also
+	 * refuses backing files on FUSE passthrough mounts (this one included)
+	 * and bounds the recursion through ->read_iter()/->write_iter().
+	 */
+	if (file_inode(backing)->i_sb->s_stack_depth >=
+	    FILESYSTEM_MAX_STACK_DEPTH)
+		goto out_fput;
+
+	res = -ENOMEM;
+	passthrough = kmalloc(sizeof(*passthrough), GFP_KERNEL);
+	if (!passthrough)
+		goto out_fput;
+
+	passthrough->filp = backing;
+	passthrough->cred = prepare_creds();
+	if (!passthrough->cred)
+		goto out_free;
+
+	idr_preload(GFP_KERNEL);
+	spin_lock(&fc->lock);
+	res = idr_alloc(&fc->passthrough_req, passthrough, 1, 0, GFP_ATOMIC);
+	spin_unlock(&fc->lock);
+	idr_preload_end();
+	if (res > 0)
+		return res;
+
+	put_cred(passthrough->cred);
+out_free:
+	kfree(passthrough);
+out_fput:
+	fput(backing);
+	return res;
+}
+
+/**
+ * fuse_passthrough_setup - attach a registered backing file to an open file
+ * @fc: the connection
+ * @ff: the file being opened
+ * @openarg: the FUSE_OPEN/FUSE_CREATE reply
+ *
+ * Consumes the id in @openarg.  If the id is unknown the file silently uses
+ * regular FUSE I/O, as it would have with an older kernel.
+ */
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *openarg)
+{
+	struct fuse_passthrough *passthrough;
+
+	if (!fc->passthrough || !openarg->passthrough_fh)
+		return;
+
+	spin_lock(&fc->lock);
+	passthrough = idr_remove(&fc->passthrough_req, openarg->passthrough_fh);
+	spin_unlock(&fc->lock);
+	if (!passthrough) {
+		pr_warn_ratelimited("unknown passthrough_fh %u in open reply\n",
+				    openarg->passthrough_fh);
+		return;
+	}
+
+	ff->passthrough = *passthrough;
+	kfree(passthrough);
+}
+
+void fuse_passthrough_release(struct fuse_passthrough *passthrough)
+{
+	if (passthrough->filp) {
+		fput(passthrough->filp);
+		passthrough->filp = NULL;
+	}
+	if (passthrough->cred) {
+		put_cred(passthrough->cred);
+		passthrough->cred = NULL;
+	}
+}
+
+static int fuse_passthrough_free_req(int id, void *p, void *data)
+{
+	struct fuse_passthrough *passthrough = p;
+
+	fuse_passthrough_release(passthrough);
+	kfree(passthrough);
+	return 0;
+}
+
+/* Drop backing files that were registered but never used by an open */
+void fuse_passthrough_free_reqs(struct fuse_conn *fc)
+{
+	idr_for_each(&fc->passthrough_req, fuse_passthrough_free_req, NULL);
+	idr_destroy(&fc->passthrough_req);
+}
@@ -59,6 +59,7 @@ MODULE_PARM_DESC(jbd2_debug, "Debugging level for jbd2");
 EXPORT_SYMBOL(jbd2_journal_extend);
 EXPORT_SYMBOL(jbd2_journal_stop);
 EXPORT_SYMBOL(jbd2_journal_lock_updates);
+EXPORT_SYMBOL(jbd2_journal_trylock_updates);
 EXPORT_SYMBOL(jbd2_journal_unlock_updates);
 EXPORT_SYMBOL(jbd2_journal_get_write_access);
 EXPORT_SYMBOL(jbd2_journal_get_create_access);
@@ -95,6 +96,11 @@ EXPORT_SYMBOL(jbd2_journal_init_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_release_jbd_inode);
 EXPORT_SYMBOL(jbd2_journal_begin_ordered_truncate);
 EXPORT_SYMBOL(jbd2_inode_cache);
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+EXPORT_SYMBOL(jbd2_fc_wait_bufs);
+EXPORT_SYMBOL(jbd2_fc_release_bufs);
 
 static void __journal_abort_soft (journal_t *journal, int errno);
 static int jbd2_journal_create_slab(size_t slab_size);
@@ -763,6 +769,157 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid)
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Fast commits: the filesystem logs its own compact description of the
+ * changes made by the running transaction into the fast commit area, at the
+ * end of the journal.  A fast commit and a full commit never run at the same
+ * time, and the area is reused from its start after every full commit.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit of a transaction
+ * @journal: Journal to act on.
+ * @tid: Transaction to commit.
+ *
+ * Waits for a fast or full commit in progress to finish first.  Returns 0
+ * when the caller owns the fast commit area, -EALREADY if @tid has been
+ * committed in the meantime, or -EINVAL if the journal has no fast commit
+ * area.  On success, jbd2_fc_end_commit() must be called when done.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	if (!journal->j_fc_wbuf)
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	while (journal->j_flags & (JBD2_FAST_COMMIT_ONGOING |
+				   JBD2_FULL_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	if (tid_geq(journal->j_commit_sequence, tid)) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	/*
+	 * Recovery ignores the fast commit area of an empty journal, so make
+	 * sure the superblock describes a live log, as the first full commit
+	 * after a flush would do.
+	 */
+	if (journal->j_flags & JBD2_FLUSHED) {
+		mutex_lock_io(&journal->j_checkpoint_mutex);
+		jbd2_journal_update_sb_log_tail(journal,
+						journal->j_tail_sequence,
+						journal->j_tail, REQ_SYNC);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+	}
+	return 0;
+}
+
+/**
+ * void jbd2_fc_end_commit() - finish a fast commit
+ * @journal: Journal to act on.
+ *
+ * Lets full commits and other fast commits proceed.
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * int jbd2_fc_get_buf() - get the next block of the fast commit area
+ * @journal: Journal to act on.
+ * @bh_out: Returns the buffer, not locked and not read.
+ *
+ * Returns -ENOSPC once the area is full, after which the caller should fall
+ * back to a full commit.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	unsigned long fc_off;
+	int ret;
+
+	*bh_out = NULL;
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+
+	fc_off = journal->j_fc_off;
+	ret = jbd2_journal_bmap(journal, journal->j_fc_first + fc_off, &pblock);
+	if (ret)
+		return ret;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	journal->j_fc_wbuf[fc_off] = bh;
+	journal->j_fc_off++;
+	*bh_out = bh;
+	return 0;
+}
+
+/**
+ * int jbd2_fc_wait_bufs() - wait for fast commit blocks to be written
+ * @journal: Journal to act on.
+ * @num_blks: Number of blocks, counting back from the last one obtained
+ *	with jbd2_fc_get_buf().
+ *
+ * Also releases the buffers.  Returns -EIO if any of them failed.
+ */
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks)
+{
+	struct buffer_head *bh;
+	int i, ret = 0;
+
+	for (i = journal->j_fc_off - 1; i >= 0 && num_blks; i--, num_blks--) {
+		bh = journal->j_fc_wbuf[i];
+		if (!bh)
+			continue;
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			ret = -EIO;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+
+	return ret;
+}
+
+/**
+ * void jbd2_fc_release_bufs() - drop the fast commit buffers still held
+ * @journal: Journal to act on.
+ *
+ * For error paths, where the buffers were not all submitted.
+ */
+void jbd2_fc_release_bufs(journal_t *journal)
+{
+	struct buffer_head *bh;
+	int i;
+
+	for (i = journal->j_fc_off - 1; i >= 0; i--) {
+		bh = journal->j_fc_wbuf[i];
+		if (!bh)
+			continue;
+		put_bh(bh);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+}
+
 /*
  * Log buffer allocation routines:
  */
@@ -1127,6 +1284,7 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1182,6 +1340,35 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	return NULL;
 }
 
+/*
+ * The fast commit area takes the last blocks of the journal, so the log
+ * proper ends where it begins.
+ */
+static void journal_set_fc_area(journal_t *journal)
+{
+	if (!jbd2_has_feature_fast_commit(journal))
+		return;
+
+	journal->j_fc_last = journal->j_last;
+	journal->j_last -= jbd2_journal_get_num_fc_blks(journal->j_superblock);
+	journal->j_fc_first = journal->j_last;
+}
+
+static int journal_alloc_fc_wbuf(journal_t *journal)
+{
+	int num_fc_blks = jbd2_journal_get_num_fc_blks(journal->j_superblock);
+
+	if (journal->j_fc_wbuf)
+		return 0;
+
+	journal->j_fc_wbuf = kcalloc(num_fc_blks, sizeof(struct buffer_head *),
+				     GFP_KERNEL);
+	if (!journal->j_fc_wbuf)
+		return -ENOMEM;
+	journal->j_fc_wbufsize = num_fc_blks;
+	return 0;
+}
+
 /* jbd2_journal_init_dev and jbd2_journal_init_inode:
  *
  * Create a journal structure assigned some fixed set of disk blocks to
@@ -1297,10 +1484,11 @@ static int journal_reset(journal_t *journal)
 
 	journal->j_first = first;
 	journal->j_last = last;
+	journal_set_fc_area(journal);
 
 	journal->j_head = first;
 	journal->j_tail = first;
-	journal->j_free = last - first;
+	journal->j_free = journal->j_last - first;
 
 	journal->j_tail_sequence = journal->j_transaction_sequence;
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
@@ -1573,6 +1761,13 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (jbd2_has_feature_fast_commit(journal) &&
+	    be32_to_cpu(sb->s_maxlen) - be32_to_cpu(sb->s_first) <
+	    JBD2_MIN_JOURNAL_BLOCKS + jbd2_journal_get_num_fc_blks(sb)) {
+		printk(KERN_ERR "JBD2: Journal too short for fast commits\n");
+		goto out;
+	}
+
 	/* Load the checksum driver */
 	if (jbd2_journal_has_csum_v2or3_feature(journal)) {
 		journal->j_chksum_driver = crypto_alloc_shash("crc32c", 0, 0);
@@ -1627,6 +1822,7 @@ static int load_superblock(journal_t *journal)
 	journal->j_first = be32_to_cpu(sb->s_first);
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
+	journal_set_fc_area(journal);
 
 	return 0;
 }
@@ -1664,6 +1860,12 @@ int jbd2_journal_load(journal_t *journal)
 		}
 	}
 
+	if (jbd2_has_feature_fast_commit(journal)) {
+		err = journal_alloc_fc_wbuf(journal);
+		if (err)
+			return err;
+	}
+
 	/*
 	 * Create a slab for this blocksize
 	 */
@@ -1772,6 +1974,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal);
 
 	return err;
@@ -1857,6 +2060,41 @@ int jbd2_journal_check_available_features (journal_t *journal, unsigned long com
  *
  */
 
+/*
+ * Take the fast commit area out of the end of a loaded journal.  Only
+ * possible while the log doesn't extend into that area, which is the case
+ * right after the journal has been loaded.
+ */
+static int journal_enable_fast_commit(journal_t *journal)
+{
+	int num_fc_blks = jbd2_journal_get_num_fc_blks(journal->j_superblock);
+	unsigned long last;
+	int err;
+
+	err = journal_alloc_fc_wbuf(journal);
+	if (err)
+		return err;
+
+	write_lock(&journal->j_state_lock);
+	last = journal->j_last - num_fc_blks;
+	if (journal->j_last - journal->j_first <
+	    JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks ||
+	    journal->j_tail > journal->j_head || journal->j_head >= last) {
+		write_unlock(&journal->j_state_lock);
+		printk(KERN_ERR "JBD2: Cannot set up fast commit area\n");
+		kfree(journal->j_fc_wbuf);
+		journal->j_fc_wbuf = NULL;
+		return -EINVAL;
+	}
+	journal->j_fc_last = journal->j_last;
+	journal->j_fc_first = last;
+	journal->j_fc_off = 0;
+	journal->j_last = last;
+	journal->j_free -= num_fc_blks;
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+
 int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 			  unsigned long ro, unsigned long incompat)
 {
@@ -1865,6 +2103,7 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 #define COMPAT_FEATURE_ON(f) \
 		((compat & (f)) && !(sb->s_feature_compat & cpu_to_be32(f)))
 	journal_superblock_t *sb;
+	bool fc_on;
 
 	if (jbd2_journal_check_used_features(journal, compat, ro, incompat))
 		return 1;
@@ -1902,6 +2141,10 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 						   sizeof(sb->s_uuid));
 	}
 
+	fc_on = INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+	if (fc_on && journal_enable_fast_commit(journal))
+		return 0;
+
 	lock_buffer(journal->j_sb_buffer);
 
 	/* If enabling v3 checksums, update superblock */
@@ -1922,6 +2165,16 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 	sb->s_feature_incompat  |= cpu_to_be32(incompat);
 	unlock_buffer(journal->j_sb_buffer);
 
+	/* Recovery has to know about the fast commit area before it's used */
+	if (fc_on) {
+		mutex_lock_io(&journal->j_checkpoint_mutex);
+		jbd2_journal_update_sb_log_tail(journal,
+						journal->j_tail_sequence,
+						journal->j_tail,
+						REQ_SYNC | REQ_FUA);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+	}
+
 	return 1;
 #undef COMPAT_FEATURE_ON
 #undef INCOMPAT_FEATURE_ON
@@ -229,6 +229,44 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Hand the fast commit area to the filesystem, one block at a time, until it
+ * has found the end of the fast commits of @expected_tid, the transaction
+ * that was running when the journal was last written to.
+ */
+static int fc_do_one_pass(journal_t *journal, tid_t expected_tid)
+{
+	unsigned long next_fc_block;
+	struct buffer_head *bh;
+	int err = 0;
+
+	if (!jbd2_has_feature_fast_commit(journal) ||
+	    !journal->j_fc_replay_callback)
+		return 0;
+
+	next_fc_block = journal->j_fc_first;
+	while (next_fc_block < journal->j_fc_last) {
+		jbd_debug(3, "Fast commit replay: next block %ld\n",
+			  next_fc_block);
+		err = jread(&bh, journal, next_fc_block);
+		if (err)
+			break;
+
+		err = journal->j_fc_replay_callback(journal, bh,
+				next_fc_block - journal->j_fc_first,
+				expected_tid);
+		brelse(bh);
+		if (err <= 0)
+			break;
+		next_fc_block++;
+	}
+
+	if (err < 0)
+		printk(KERN_ERR "JBD2: Fast commit replay failed, error %d\n",
+		       err);
+	return err < 0 ? err : 0;
+}
+
 /**
  * jbd2_journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -239,7 +277,8 @@ do {									\
  * Recovery is done in three passes.  In the first pass, we look for the
  * end of the log.  In the second, we assemble the list of revoke
  * blocks.  In the third and final pass, we replay any un-revoked blocks
- * in the log.
+ * in the log.  The fast commit area, if any, is then handed to the
+ * filesystem.
  */
 int jbd2_journal_recover(journal_t *journal)
 {
@@ -269,6 +308,8 @@ int jbd2_journal_recover(journal_t *journal)
 		err = do_one_pass(journal, &info, PASS_REVOKE);
 	if (!err)
 		err = do_one_pass(journal, &info, PASS_REPLAY);
+	if (!err)
+		err = fc_do_one_pass(journal, info.end_transaction);
 
 	jbd_debug(1, "JBD2: recovery, exit status %d, "
 		  "recovered transactions %u to %u\n",
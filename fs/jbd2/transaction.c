@@ -733,22 +733,14 @@ int jbd2_journal_restart(handle_t *handle, int nblocks)
 }
 EXPORT_SYMBOL(jbd2_journal_restart);
 
-/**
- * void jbd2_journal_lock_updates () - establish a transaction barrier.
- * @journal:  Journal to establish a barrier on.
- *
- * This locks out any further updates from being started, and blocks
- * until all existing updates have completed, returning only once the
- * journal is in a quiescent state with no updates running.
- *
- * The journal lock should not be held on entry.
+/*
+ * Lock out new updates and wait for the running ones to complete, the
+ * first half of establishing a transaction barrier.
  */
-void jbd2_journal_lock_updates(journal_t *journal)
+static void __jbd2_journal_lock_updates(journal_t *journal)
 {
 	DEFINE_WAIT(wait);
 
-	jbd2_might_wait_for_commit(journal);
-
 	write_lock(&journal->j_state_lock);
 	++journal->j_barrier_count;
 
@@ -782,6 +774,23 @@ void jbd2_journal_lock_updates(journal_t *journal)
 		write_lock(&journal->j_state_lock);
 	}
 	write_unlock(&journal->j_state_lock);
+}
+
+/**
+ * void jbd2_journal_lock_updates () - establish a transaction barrier.
+ * @journal:  Journal to establish a barrier on.
+ *
+ * This locks out any further updates from being started, and blocks
+ * until all existing updates have completed, returning only once the
+ * journal is in a quiescent state with no updates running.
+ *
+ * The journal lock should not be held on entry.
+ */
+void jbd2_journal_lock_updates(journal_t *journal)
+{
+	jbd2_might_wait_for_commit(journal);
+
+	__jbd2_journal_lock_updates(journal);
 
 	/*
 	 * We have now established a barrier against other normal updates, but
@@ -792,6 +801,25 @@ void jbd2_journal_lock_updates(journal_t *journal)
 	mutex_lock(&journal->j_barrier);
 }
 
+/**
+ * int jbd2_journal_trylock_updates() - establish a barrier unless one is held
+ * @journal:  Journal to establish a barrier on.
+ *
+ * Like jbd2_journal_lock_updates(), but fails with -EBUSY instead of waiting
+ * for another holder of the barrier.  Such a holder may be waiting for a
+ * commit in jbd2_journal_flush(), so this is what a fast commit, which holds
+ * up full commits, has to use.  On success, the barrier is released with
+ * jbd2_journal_unlock_updates().
+ */
+int jbd2_journal_trylock_updates(journal_t *journal)
+{
+	if (!mutex_trylock(&journal->j_barrier))
+		return -EBUSY;
+
+	__jbd2_journal_lock_updates(journal);
+	return 0;
+}
+
 /**
  * void jbd2_journal_unlock_updates (journal_t* journal) - release barrier
  * @journal:  Journal to release the barrier on.
@@ -12,6 +12,7 @@
 #ifdef CONFIG_BLOCK
 /* struct bio, bio_vec and BIO_* flags are defined in blk_types.h */
 #include <linux/blk_types.h>
+#include <linux/blk-crypto.h>
 
 #define BIO_DEBUG
 
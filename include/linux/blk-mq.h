@@ -8,6 +8,7 @@
 
 struct blk_mq_tags;
 struct blk_flush_queue;
+struct blk_mq_poll_hist;
 
 /**
  * struct blk_mq_hw_ctx - State for a hardware queue facing the hardware block device
@@ -64,6 +65,7 @@ struct blk_mq_hw_ctx {
 	unsigned long		poll_considered;
 	unsigned long		poll_invoked;
 	unsigned long		poll_success;
+	struct blk_mq_poll_hist	*poll_hist;
 
 #ifdef CONFIG_BLK_DEBUG_FS
 	struct dentry		*debugfs_dir;
@@ -88,6 +88,10 @@ struct cpuidle_device {
 	int			last_state_idx;
 	int			last_residency;
 	u64			poll_limit_ns;
+	/* Totals since the current governor was enabled for this CPU */
+	unsigned long long	gov_usage;
+	unsigned long long	gov_above;
+	unsigned long long	gov_below;
 	struct cpuidle_state_usage	states_usage[CPUIDLE_STATE_MAX];
 	struct cpuidle_state_kobj *kobjs[CPUIDLE_STATE_MAX];
 	struct cpuidle_driver_kobj *kobj_driver;
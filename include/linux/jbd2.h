@@ -67,6 +67,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -262,7 +263,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+	__u32	s_padding[41];
+/* 0x00F8 */
+	__be32	s_fc_blocks;		/* Number of fast commit blocks */
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -288,6 +291,12 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+/*
+ * The fast commit area format is not the one of mainline's fast_commit
+ * feature, so it deliberately uses a different bit (and s_fc_blocks
+ * instead of mainline's field at offset 0x54).
+ */
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000080
 
 /* See "journal feature predicate functions" below */
 
@@ -298,7 +307,8 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
 
 #ifdef __KERNEL__
 
@@ -1106,6 +1116,69 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/**
+	 * @j_fc_first:
+	 *
+	 * The block number of the first fast commit block in the journal.
+	 * The fast commit area follows the log, so this is also the new
+	 * value of @j_last.
+	 */
+	unsigned long		j_fc_first;
+
+	/**
+	 * @j_fc_last:
+	 *
+	 * The block number one beyond the last fast commit block in the
+	 * journal.
+	 */
+	unsigned long		j_fc_last;
+
+	/**
+	 * @j_fc_off:
+	 *
+	 * Number of fast commit blocks used since the last full commit
+	 * [j_state_lock for resetting, fast commit owner otherwise].
+	 */
+	unsigned long		j_fc_off;
+
+	/**
+	 * @j_fc_wbuf: Array of fast commit buffers being written.
+	 */
+	struct buffer_head	**j_fc_wbuf;
+
+	/**
+	 * @j_fc_wbufsize: Size of the fast commit area, in blocks.
+	 */
+	int			j_fc_wbufsize;
+
+	/**
+	 * @j_fc_wait:
+	 *
+	 * Wait queue for fast commits and full commits to wait for each
+	 * other.
+	 */
+	wait_queue_head_t	j_fc_wait;
+
+	/**
+	 * @j_fc_cleanup_callback:
+	 *
+	 * Called at the end of a full commit, so that the filesystem can
+	 * forget what it tracked for fast commits of that transaction.
+	 */
+	void			(*j_fc_cleanup_callback)(journal_t *, tid_t);
+
+	/**
+	 * @j_fc_replay_callback:
+	 *
+	 * Called during recovery for each block of the fast commit area, in
+	 * order, with the ID of the first transaction that has not been
+	 * committed.  Returns JBD2_FC_REPLAY_CONTINUE to get the next block,
+	 * JBD2_FC_REPLAY_STOP when done, or a negative error.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *,
+							struct buffer_head *,
+							int, tid_t);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1235,6 +1308,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1249,6 +1323,12 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* Fast commit is ongoing */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* Full commit is ongoing */
+
+/* Return values of j_fc_replay_callback */
+#define JBD2_FC_REPLAY_STOP	0
+#define JBD2_FC_REPLAY_CONTINUE	1
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1379,6 +1459,7 @@ extern int	 jbd2_journal_try_to_free_buffers(journal_t *, struct page *, gfp_t);
 extern int	 jbd2_journal_stop(handle_t *);
 extern int	 jbd2_journal_flush (journal_t *);
 extern void	 jbd2_journal_lock_updates (journal_t *);
+extern int	 jbd2_journal_trylock_updates(journal_t *);
 extern void	 jbd2_journal_unlock_updates (journal_t *);
 
 extern journal_t * jbd2_journal_init_dev(struct block_device *bdev,
@@ -1421,6 +1502,21 @@ extern int	   jbd2_journal_begin_ordered_truncate(journal_t *journal,
 extern void	   jbd2_journal_init_jbd_inode(struct jbd2_inode *jinode, struct inode *inode);
 extern void	   jbd2_journal_release_jbd_inode(journal_t *journal, struct jbd2_inode *jinode);
 
+/* Fast commit */
+extern int	   jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+extern void	   jbd2_fc_end_commit(journal_t *journal);
+extern int	   jbd2_fc_get_buf(journal_t *journal,
+				   struct buffer_head **bh_out);
+extern int	   jbd2_fc_wait_bufs(journal_t *journal, int num_blks);
+extern void	   jbd2_fc_release_bufs(journal_t *journal);
+
+static inline int jbd2_journal_get_num_fc_blks(journal_superblock_t *jsb)
+{
+	int num_fc_blocks = be32_to_cpu(jsb->s_fc_blocks);
+
+	return num_fc_blocks ? num_fc_blocks : JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+}
+
 /*
  * journal_head management
  */
@@ -27,7 +27,8 @@ enum psi_res {
 	PSI_IO,
 	PSI_MEM,
 	PSI_CPU,
-	NR_PSI_RESOURCES = 3,
+	PSI_IRQ,
+	NR_PSI_RESOURCES = 4,
 };
 
 /*
@@ -35,6 +36,10 @@ enum psi_res {
  *
  * SOME: Stalled tasks & working tasks
  * FULL: Stalled tasks & no working tasks
+ *
+ * IRQ pressure has no task state: time spent in hard and soft
+ * interrupts is charged as FULL to the groups of the task it stole
+ * the CPU from.
  */
 enum psi_states {
 	PSI_IO_SOME,
@@ -42,9 +47,10 @@ enum psi_states {
 	PSI_MEM_SOME,
 	PSI_MEM_FULL,
 	PSI_CPU_SOME,
+	PSI_IRQ_FULL,
 	/* Only per-CPU, to weigh the CPU in the global average: */
 	PSI_NONIDLE,
-	NR_PSI_STATES = 6,
+	NR_PSI_STATES = 7,
 };
 
 enum psi_aggregators {
@@ -126,6 +132,15 @@ struct psi_trigger {
 };
 
 struct psi_group {
+	/* Parent group to propagate task state changes to, NULL for root */
+	struct psi_group *parent;
+
+	/*
+	 * Disabled groups only keep their per-cpu task counts current so
+	 * they can be re-enabled; no stall times are recorded for them.
+	 */
+	bool enabled;
+
 	/* Protects data used by the aggregator */
 	struct mutex avgs_lock;
 
@@ -456,6 +456,9 @@ struct sched_entity {
 
 	u64				nr_migrations;
 
+	/* Wakeup preemption offset derived from the latency nice hint [ns]: */
+	long				latency_offset;
+
 	struct sched_statistics		statistics;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -671,6 +674,7 @@ struct task_struct {
 	int				static_prio;
 	int				normal_prio;
 	unsigned int			rt_priority;
+	int				latency_nice;
 
 	const struct sched_class	*sched_class;
 	struct sched_entity		se;
@@ -318,6 +318,29 @@ DEFINE_EVENT(cache_set, bcache_gc_end,
 	TP_ARGS(c)
 );
 
+TRACE_EVENT(bcache_gc_slice,
+	TP_PROTO(struct cache_set *c, size_t nodes, u64 duration, int ret),
+	TP_ARGS(c, nodes, duration, ret),
+
+	TP_STRUCT__entry(
+		__array(char,		uuid,	16 )
+		__field(size_t,		nodes			)
+		__field(u64,		duration		)
+		__field(int,		ret			)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->uuid, c->sb.set_uuid, 16);
+		__entry->nodes		= nodes;
+		__entry->duration	= div_u64(duration, NSEC_PER_USEC);
+		__entry->ret		= ret;
+	),
+
+	TP_printk("%pU %zu nodes in %llu us ret %d", __entry->uuid,
+		  __entry->nodes, __entry->duration,
+		  __entry->ret)
+);
+
 DEFINE_EVENT(bkey, bcache_gc_copy,
 	TP_PROTO(struct bkey *k),
 	TP_ARGS(k)
@@ -498,6 +521,57 @@ DEFINE_EVENT(bkey, bcache_writeback_collision,
 	TP_ARGS(k)
 );
 
+TRACE_EVENT(bcache_writeback_batch,
+	TP_PROTO(struct bkey *k, unsigned lane, unsigned nr_keys,
+		 unsigned sectors),
+	TP_ARGS(k, lane, nr_keys, sectors),
+
+	TP_STRUCT__entry(
+		__field(u32,		inode			)
+		__field(u64,		offset			)
+		__field(unsigned,	lane			)
+		__field(unsigned,	nr_keys			)
+		__field(unsigned,	sectors			)
+	),
+
+	TP_fast_assign(
+		__entry->inode		= KEY_INODE(k);
+		__entry->offset		= KEY_START(k);
+		__entry->lane		= lane;
+		__entry->nr_keys	= nr_keys;
+		__entry->sectors	= sectors;
+	),
+
+	TP_printk("%u:%llu lane %u keys %u sectors %u", __entry->inode,
+		  __entry->offset, __entry->lane, __entry->nr_keys,
+		  __entry->sectors)
+);
+
+TRACE_EVENT(bcache_writeback_done,
+	TP_PROTO(struct bkey *k, u64 wait, u64 write),
+	TP_ARGS(k, wait, write),
+
+	TP_STRUCT__entry(
+		__field(u32,	inode				)
+		__field(u64,	offset				)
+		__field(u32,	size				)
+		__field(u64,	wait				)
+		__field(u64,	write				)
+	),
+
+	TP_fast_assign(
+		__entry->inode	= KEY_INODE(k);
+		__entry->offset	= KEY_OFFSET(k);
+		__entry->size	= KEY_SIZE(k);
+		__entry->wait	= div_u64(wait, NSEC_PER_USEC);
+		__entry->write	= div_u64(write, NSEC_PER_USEC);
+	),
+
+	TP_printk("%u:%llu len %u read+wait %llu us write+update %llu us",
+		  __entry->inode, __entry->offset, __entry->size,
+		  __entry->wait, __entry->write)
+);
+
 #endif /* _TRACE_BCACHE_H */
 
 /* This part must be outside protection */
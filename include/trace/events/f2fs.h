@@ -32,6 +32,7 @@ TRACE_DEFINE_ENUM(CURSEG_COLD_NODE);
 TRACE_DEFINE_ENUM(NO_CHECK_TYPE);
 TRACE_DEFINE_ENUM(GC_GREEDY);
 TRACE_DEFINE_ENUM(GC_CB);
+TRACE_DEFINE_ENUM(GC_AT);
 TRACE_DEFINE_ENUM(FG_GC);
 TRACE_DEFINE_ENUM(BG_GC);
 TRACE_DEFINE_ENUM(LFS);
@@ -115,7 +116,8 @@ TRACE_DEFINE_ENUM(CP_TRIMMED);
 #define show_victim_policy(type)					\
 	__print_symbolic(type,						\
 		{ GC_GREEDY,	"Greedy" },				\
-		{ GC_CB,	"Cost-Benefit" })
+		{ GC_CB,	"Cost-Benefit" },			\
+		{ GC_AT,	"Age-Threshold" })
 
 #define show_cpreason(type)						\
 	__print_flags(type, "|",					\
@@ -732,6 +734,73 @@ TRACE_EVENT(f2fs_gc_end,
 		__entry->prefree_seg)
 );
 
+TRACE_EVENT(f2fs_gc_section,
+
+	TP_PROTO(struct super_block *sb, unsigned int segno, int gc_type,
+			unsigned char type, unsigned int moved, u64 latency),
+
+	TP_ARGS(sb, segno, gc_type, type, moved, latency),
+
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(unsigned int,	segno)
+		__field(int,		gc_type)
+		__field(unsigned char,	type)
+		__field(unsigned int,	moved)
+		__field(u64,		latency)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->segno		= segno;
+		__entry->gc_type	= gc_type;
+		__entry->type		= type;
+		__entry->moved		= moved;
+		__entry->latency	= latency;
+	),
+
+	TP_printk("dev = (%d,%d), segno = %u, %s, %s, moved = %u, "
+		"latency = %llu ns",
+		show_dev(__entry->dev),
+		__entry->segno,
+		show_gc_type(__entry->gc_type),
+		__entry->type == SUM_TYPE_NODE ? "node" : "data",
+		__entry->moved,
+		__entry->latency)
+);
+
+TRACE_EVENT(f2fs_gc_cycle,
+
+	TP_PROTO(struct super_block *sb, int gc_type, unsigned int nr_secs,
+			unsigned int moved, u64 latency),
+
+	TP_ARGS(sb, gc_type, nr_secs, moved, latency),
+
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(int,		gc_type)
+		__field(unsigned int,	nr_secs)
+		__field(unsigned int,	moved)
+		__field(u64,		latency)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->gc_type	= gc_type;
+		__entry->nr_secs	= nr_secs;
+		__entry->moved		= moved;
+		__entry->latency	= latency;
+	),
+
+	TP_printk("dev = (%d,%d), %s, sections = %u, moved = %u, "
+		"latency = %llu ns",
+		show_dev(__entry->dev),
+		show_gc_type(__entry->gc_type),
+		__entry->nr_secs,
+		__entry->moved,
+		__entry->latency)
+);
+
 TRACE_EVENT(f2fs_get_victim,
 
 	TP_PROTO(struct super_block *sb, int type, int gc_type,
@@ -172,6 +172,40 @@ TRACE_EVENT(iocost_ioc_vrate_adj,
 	)
 );
 
+TRACE_EVENT(iocost_ioc_calib,
+
+	TP_PROTO(struct ioc *ioc, int rw, u64 bps, u64 seqiops, u64 randiops,
+		u64 nr_seq, u64 nr_rand),
+
+	TP_ARGS(ioc, rw, bps, seqiops, randiops, nr_seq, nr_rand),
+
+	TP_STRUCT__entry (
+		__string(devname, ioc_name(ioc))
+		__field(int, rw)
+		__field(u64, bps)
+		__field(u64, seqiops)
+		__field(u64, randiops)
+		__field(u64, nr_seq)
+		__field(u64, nr_rand)
+	),
+
+	TP_fast_assign(
+		__assign_str(devname, ioc_name(ioc));
+		__entry->rw = rw;
+		__entry->bps = bps;
+		__entry->seqiops = seqiops;
+		__entry->randiops = randiops;
+		__entry->nr_seq = nr_seq;
+		__entry->nr_rand = nr_rand;
+	),
+
+	TP_printk("[%s] %s bps=%llu seqiops=%llu randiops=%llu samples=%llu:%llu",
+		__get_str(devname), __entry->rw == READ ? "read" : "write",
+		__entry->bps, __entry->seqiops, __entry->randiops,
+		__entry->nr_seq, __entry->nr_rand
+	)
+);
+
 #endif /* _TRACE_BLK_IOCOST_H */
 
 /* This part must be outside protection */
@@ -172,6 +172,15 @@
  *  - add FUSE_WRITE_KILL_PRIV flag
  *  - add FUSE_SETUPMAPPING and FUSE_REMOVEMAPPING
  *  - add map_alignment to fuse_init_out, add FUSE_MAP_ALIGNMENT flag
+ *
+ *  7.32
+ *  - add FUSE_INIT_EXT, flags2 to fuse_init_in and fuse_init_out
+ *  - add FUSE_PASSTHROUGH flag (in flags2), FUSE_DEV_IOC_PASSTHROUGH_OPEN and
+ *    struct fuse_passthrough_out
+ *  - add passthrough_fh to fuse_open_out
+ *  - add FUSE_DEV_IOC_BIND_QUEUE
+ *  - add shared-memory ring: FUSE_DEV_IOC_RING_SETUP, FUSE_DEV_IOC_RING_ENTER,
+ *    struct fuse_ring_setup, struct fuse_ring_ctl and struct fuse_ring_enter
  */
 
 #ifndef _LINUX_FUSE_H
@@ -207,7 +216,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 31
+#define FUSE_KERNEL_MINOR_VERSION 32
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -314,6 +323,9 @@ struct fuse_file_lock {
  * FUSE_NO_OPENDIR_SUPPORT: kernel supports zero-message opendir
  * FUSE_EXPLICIT_INVAL_DATA: only invalidate cached pages on explicit request
  * FUSE_MAP_ALIGNMENT: map_alignment field is valid
+ * FUSE_INIT_EXT: extended fuse_init_in/out, flags2 holds bits 32 and up
+ * FUSE_PASSTHROUGH: read/write/mmap of opened files may be passed through to
+ *		     a backing file registered with FUSE_DEV_IOC_PASSTHROUGH_OPEN
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -342,6 +354,17 @@ struct fuse_file_lock {
 #define FUSE_NO_OPENDIR_SUPPORT (1 << 24)
 #define FUSE_EXPLICIT_INVAL_DATA (1 << 25)
 #define FUSE_MAP_ALIGNMENT	(1 << 26)
+#define FUSE_INIT_EXT		(1 << 30)
+
+/*
+ * Bits 27 to 29 are used upstream for features not found here.  Flags from
+ * bit 32 up are passed in flags2, which is only valid with FUSE_INIT_EXT.
+ *
+ * FUSE_PASSTHROUGH is not upstream's flag of that name, whose protocol is
+ * different: it deliberately takes the top bit, away from the bits upstream
+ * assigns from 32 up, so that the two can never be negotiated for each other.
+ */
+#define FUSE_PASSTHROUGH	(1ULL << 63)
 
 /**
  * CUSE INIT request/reply flags
@@ -591,7 +614,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	uint32_t	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -684,6 +707,8 @@ struct fuse_init_in {
 	uint32_t	minor;
 	uint32_t	max_readahead;
 	uint32_t	flags;
+	uint32_t	flags2;
+	uint32_t	unused[11];
 };
 
 #define FUSE_COMPAT_INIT_OUT_SIZE 8
@@ -700,7 +725,8 @@ struct fuse_init_out {
 	uint32_t	time_gran;
 	uint16_t	max_pages;
 	uint16_t	map_alignment;
-	uint32_t	unused[8];
+	uint32_t	flags2;
+	uint32_t	unused[7];
 };
 
 #define CUSE_INIT_INFO_MAX 4096
@@ -868,8 +894,83 @@ struct fuse_notify_retrieve_in {
 	uint64_t	dummy4;
 };
 
+/**
+ * Argument of FUSE_DEV_IOC_PASSTHROUGH_OPEN
+ *
+ * @fd: file descriptor of the backing file, open in the daemon
+ * @flags: must be zero
+ *
+ * The ioctl returns a positive id which the reply to the next FUSE_OPEN or
+ * FUSE_CREATE of the file may pass back in fuse_open_out.passthrough_fh.
+ * Each id can be used by one open only.
+ */
+struct fuse_passthrough_out {
+	uint32_t	fd;
+	uint32_t	flags;
+};
+
+/*
+ * FUSE_DEV_IOC_BIND_QUEUE binds a (cloned) device to the input queue of the
+ * given CPU: reads on it then only return requests issued on that CPU.
+ * Requests from CPUs without a bound device, FORGETs and INTERRUPTs are
+ * still read from unbound devices, so the daemon must keep reading one.
+ */
+
+/**
+ * Shared-memory ring transport
+ *
+ * FUSE_DEV_IOC_RING_SETUP creates a ring of @entries slots of @slot_size
+ * bytes on a /dev/fuse device, which the daemon then mmaps at offset 0.  The
+ * mapping starts with struct fuse_ring_ctl, followed by the request and reply
+ * index arrays (at req_off and rep_off) and the slots (at slots_off).  Setup
+ * fails with EAGAIN until INIT has been answered, since every slot must hold
+ * a request of max_write bytes.
+ *
+ * A slot holds one message in the format read(2) and write(2) on the device
+ * use.  FUSE_DEV_IOC_RING_ENTER first consumes the replies queued by the
+ * daemon, then fills free slots with pending requests, publishing their slot
+ * numbers in the request array, and returns how many it published.  If
+ * @min_requests is not zero, it waits until at least one request is pending;
+ * after that it only takes requests that are already queued, so it sleeps at
+ * most once.
+ *
+ * The daemon owns a slot from the time it is published until it is queued
+ * back in the reply array.  Requests that have no reply (FORGET, a failed
+ * INTERRUPT...) are returned with a zero out header len.
+ *
+ * The kernel writes req_tail and rep_head, the daemon writes req_head and
+ * rep_tail; all are free running and wrap at 2^32.
+ */
+struct fuse_ring_setup {
+	uint32_t	entries;
+	uint32_t	slot_size;
+	uint32_t	flags;
+	uint32_t	slots_off;
+	uint64_t	ring_size;
+};
+
+struct fuse_ring_ctl {
+	uint32_t	req_head;
+	uint32_t	req_tail;
+	uint32_t	rep_head;
+	uint32_t	rep_tail;
+	uint32_t	entries;
+	uint32_t	slot_size;
+	uint32_t	req_off;
+	uint32_t	rep_off;
+};
+
+struct fuse_ring_enter {
+	uint32_t	min_requests;
+	uint32_t	flags;
+};
+
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(229, 1, struct fuse_passthrough_out)
+#define FUSE_DEV_IOC_BIND_QUEUE	_IOW(229, 2, uint32_t)
+#define FUSE_DEV_IOC_RING_SETUP	_IOWR(229, 3, struct fuse_ring_setup)
+#define FUSE_DEV_IOC_RING_ENTER	_IOW(229, 4, struct fuse_ring_enter)
 
 struct fuse_lseek_in {
 	uint64_t	fh;
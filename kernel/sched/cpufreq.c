@@ -11,6 +11,9 @@
 
 DEFINE_PER_CPU(struct update_util_data __rcu *, cpufreq_update_util_data);
 
+/* Enabled while a governor wants to be told about wakeups */
+DEFINE_STATIC_KEY_DEFERRED_FALSE(sched_cpufreq_wakeup, HZ);
+
 /**
  * cpufreq_add_update_util_hook - Populate the CPU's update_util_data pointer.
  * @cpu: The CPU to set the pointer for.
@@ -18,6 +18,7 @@
 struct sugov_tunables {
 	struct gov_attr_set	attr_set;
 	unsigned int		rate_limit_us;
+	bool			predict_wakeup;
 };
 
 struct sugov_policy {
@@ -42,6 +43,13 @@ struct sugov_policy {
 
 	bool			limits_changed;
 	bool			need_freq_update;
+
+	/* Wakeup prediction, protected like next_freq: */
+	u64			boost_start;
+	unsigned int		boost_freq;
+	u64			boost_count;
+	u64			boost_missed;
+	u64			boost_latency_ns;
 };
 
 struct sugov_cpu {
@@ -53,6 +61,8 @@ struct sugov_cpu {
 	unsigned int		iowait_boost;
 	u64			last_update;
 
+	unsigned long		predicted_util;
+
 	unsigned long		bw_dl;
 	unsigned long		max;
 
@@ -102,6 +112,18 @@ static bool sugov_should_update_freq(struct sugov_policy *sg_policy, u64 time)
 static bool sugov_update_next_freq(struct sugov_policy *sg_policy, u64 time,
 				   unsigned int next_freq)
 {
+	/*
+	 * The first request after a boosted wakeup tells whether the wakeup
+	 * got the frequency it was predicted to need, and how late.
+	 */
+	if (sg_policy->boost_start) {
+		if (next_freq >= sg_policy->boost_freq)
+			sg_policy->boost_latency_ns += time - sg_policy->boost_start;
+		else
+			sg_policy->boost_missed++;
+		sg_policy->boost_start = 0;
+	}
+
 	if (sg_policy->next_freq == next_freq)
 		return false;
 
@@ -301,6 +323,88 @@ static unsigned long sugov_get_util(struct sugov_cpu *sg_cpu)
 	return schedutil_cpu_util(sg_cpu->cpu, util, max, FREQUENCY_UTIL, NULL);
 }
 
+/**
+ * sugov_predict_util() - Utilization expected on a CPU after a wakeup.
+ * @sg_cpu: the sugov data for the CPU the task woke up on
+ *
+ * PELT only catches up with a task that starts running after it has run for
+ * a while, and the regular updates are then still subject to the rate limit.
+ * The estimated utilization (util_est) of a task is its utilization at the
+ * end of its recent activations, so the sum of it over the enqueued tasks is
+ * what the CPU can be expected to need for the burst that is just starting.
+ * Only valid with the UTIL_EST scheduler feature, which keeps it up to date.
+ */
+static unsigned long sugov_predict_util(struct sugov_cpu *sg_cpu)
+{
+	struct rq *rq = cpu_rq(sg_cpu->cpu);
+	unsigned long max = arch_scale_cpu_capacity(sg_cpu->cpu);
+	unsigned long util;
+
+	util = max_t(unsigned long, READ_ONCE(rq->cfs.avg.util_avg),
+		     READ_ONCE(rq->cfs.avg.util_est.enqueued));
+
+	return schedutil_cpu_util(sg_cpu->cpu, min(util, max), max,
+				  FREQUENCY_UTIL, NULL);
+}
+
+/**
+ * sugov_wakeup_boost() - Check whether a wakeup needs a higher frequency.
+ * @sg_cpu: the sugov data for the CPU the task woke up on
+ * @time: the update time from the caller
+ * @flags: SCHED_CPUFREQ_WAKEUP if a task has just been woken up
+ *
+ * With predict_wakeup set, a wakeup whose predicted utilization maps to a
+ * frequency above the current one is allowed to bypass the rate limit, and
+ * the predicted utilization is used for the next frequency selection.
+ *
+ * Return: true if the frequency should be updated right away.
+ */
+static bool sugov_wakeup_boost(struct sugov_cpu *sg_cpu, u64 time,
+			       unsigned int flags)
+{
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned long util, max;
+	unsigned int freq;
+
+	if (!(flags & SCHED_CPUFREQ_WAKEUP) ||
+	    !sg_policy->tunables->predict_wakeup || !sched_feat(UTIL_EST))
+		return false;
+
+	if (sg_policy->next_freq >= policy->max)
+		return false;
+
+	util = sugov_predict_util(sg_cpu);
+	max = arch_scale_cpu_capacity(sg_cpu->cpu);
+	freq = arch_scale_freq_invariant() ?
+			policy->cpuinfo.max_freq : policy->cur;
+	freq = map_util_freq(util, freq, max);
+	if (freq <= sg_policy->next_freq)
+		return false;
+
+	if (!sg_policy->boost_start) {
+		sg_policy->boost_count++;
+		sg_policy->boost_start = time;
+		sg_policy->boost_freq = min(freq, policy->max);
+	}
+
+	/* See sugov_should_update_freq() */
+	if (!cpufreq_this_cpu_can_update(policy))
+		return false;
+
+	sg_cpu->predicted_util = util;
+	return true;
+}
+
+static unsigned long sugov_predict_apply(struct sugov_cpu *sg_cpu,
+					 unsigned long util)
+{
+	util = max(util, sg_cpu->predicted_util);
+	sg_cpu->predicted_util = 0;
+
+	return util;
+}
+
 /**
  * sugov_iowait_reset() - Reset the IO boost status of a CPU.
  * @sg_cpu: the sugov data for the CPU to boost
@@ -454,14 +558,15 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
 	unsigned long util, max;
 	unsigned int next_f;
-	bool busy;
+	bool busy, boost;
 
 	sugov_iowait_boost(sg_cpu, time, flags);
 	sg_cpu->last_update = time;
 
 	ignore_dl_rate_limit(sg_cpu, sg_policy);
 
-	if (!sugov_should_update_freq(sg_policy, time))
+	boost = sugov_wakeup_boost(sg_cpu, time, flags);
+	if (!sugov_should_update_freq(sg_policy, time) && !boost)
 		return;
 
 	/* Limits may have changed, don't skip frequency update */
@@ -469,6 +574,7 @@ static void sugov_update_single(struct update_util_data *hook, u64 time,
 
 	util = sugov_get_util(sg_cpu);
 	max = sg_cpu->max;
+	util = sugov_predict_apply(sg_cpu, util);
 	util = sugov_iowait_apply(sg_cpu, time, util, max);
 	next_f = get_next_freq(sg_policy, util, max);
 	/*
@@ -509,6 +615,7 @@ static unsigned int sugov_next_freq_shared(struct sugov_cpu *sg_cpu, u64 time)
 
 		j_util = sugov_get_util(j_sg_cpu);
 		j_max = j_sg_cpu->max;
+		j_util = sugov_predict_apply(j_sg_cpu, j_util);
 		j_util = sugov_iowait_apply(j_sg_cpu, time, j_util, j_max);
 
 		if (j_util * max > j_max * util) {
@@ -526,6 +633,7 @@ sugov_update_shared(struct update_util_data *hook, u64 time, unsigned int flags)
 	struct sugov_cpu *sg_cpu = container_of(hook, struct sugov_cpu, update_util);
 	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
 	unsigned int next_f;
+	bool boost;
 
 	raw_spin_lock(&sg_policy->update_lock);
 
@@ -534,7 +642,8 @@ sugov_update_shared(struct update_util_data *hook, u64 time, unsigned int flags)
 
 	ignore_dl_rate_limit(sg_cpu, sg_policy);
 
-	if (sugov_should_update_freq(sg_policy, time)) {
+	boost = sugov_wakeup_boost(sg_cpu, time, flags);
+	if (sugov_should_update_freq(sg_policy, time) || boost) {
 		next_f = sugov_next_freq_shared(sg_cpu, time);
 
 		if (sg_policy->policy->fast_switch_enabled)
@@ -618,8 +727,95 @@ rate_limit_us_store(struct gov_attr_set *attr_set, const char *buf, size_t count
 
 static struct governor_attr rate_limit_us = __ATTR_RW(rate_limit_us);
 
+/*
+ * Number of tunables with predict_wakeup set, which sched_cpufreq_wakeup
+ * follows from a work item: static_branch_inc() takes the CPU hotplug lock,
+ * which must not nest inside attr_set->update_lock as CPU offline takes the
+ * two the other way around, through sugov_exit().
+ */
+static atomic_t sugov_wakeup_users = ATOMIC_INIT(0);
+
+static void sugov_wakeup_key_workfn(struct work_struct *work)
+{
+	/* Only touched here, and the work never runs concurrently with itself */
+	static int key_users;
+	int users = atomic_read(&sugov_wakeup_users);
+
+	for (; key_users < users; key_users++)
+		static_branch_inc(&sched_cpufreq_wakeup.key);
+	for (; key_users > users; key_users--)
+		static_branch_slow_dec_deferred(&sched_cpufreq_wakeup);
+}
+
+static DECLARE_WORK(sugov_wakeup_key_work, sugov_wakeup_key_workfn);
+
+static void sugov_wakeup_users_add(int delta)
+{
+	atomic_add(delta, &sugov_wakeup_users);
+	schedule_work(&sugov_wakeup_key_work);
+}
+
+static ssize_t predict_wakeup_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+
+	return sprintf(buf, "%u\n", tunables->predict_wakeup);
+}
+
+static ssize_t
+predict_wakeup_store(struct gov_attr_set *attr_set, const char *buf, size_t count)
+{
+	struct sugov_tunables *tunables = to_sugov_tunables(attr_set);
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	if (enable == tunables->predict_wakeup)
+		return count;
+
+	/* Only then does the fair class report wakeups */
+	sugov_wakeup_users_add(enable ? 1 : -1);
+	tunables->predict_wakeup = enable;
+
+	return count;
+}
+
+static struct governor_attr predict_wakeup = __ATTR_RW(predict_wakeup);
+
+/*
+ * Wakeup prediction statistics, summed over the policies sharing the
+ * tunables:
+ *
+ * boosts:	wakeups that needed a higher frequency than the current one
+ * missed:	boosts for which the next frequency request still fell short
+ *		of the predicted frequency
+ * latency_us:	total time from a boost until schedutil requested the
+ *		predicted frequency, for the boosts that were not missed
+ */
+static ssize_t predict_stats_show(struct gov_attr_set *attr_set, char *buf)
+{
+	struct sugov_policy *sg_policy;
+	u64 boosts = 0, missed = 0, latency = 0;
+
+	mutex_lock(&attr_set->update_lock);
+	list_for_each_entry(sg_policy, &attr_set->policy_list, tunables_hook) {
+		boosts += READ_ONCE(sg_policy->boost_count);
+		missed += READ_ONCE(sg_policy->boost_missed);
+		latency += READ_ONCE(sg_policy->boost_latency_ns);
+	}
+	mutex_unlock(&attr_set->update_lock);
+
+	return sprintf(buf, "boosts %llu\nmissed %llu\nlatency_us %llu\n",
+		       boosts, missed, div_u64(latency, NSEC_PER_USEC));
+}
+
+static struct governor_attr predict_stats = __ATTR_RO(predict_stats);
+
 static struct attribute *sugov_attrs[] = {
 	&rate_limit_us.attr,
+	&predict_wakeup.attr,
+	&predict_stats.attr,
 	NULL
 };
 ATTRIBUTE_GROUPS(sugov);
@@ -731,6 +927,9 @@ static void sugov_tunables_free(struct sugov_tunables *tunables)
 	if (!have_governor_per_policy())
 		global_tunables = NULL;
 
+	if (tunables->predict_wakeup)
+		sugov_wakeup_users_add(-1);
+
 	kfree(tunables);
 }
 
@@ -842,6 +1041,7 @@ static int sugov_start(struct cpufreq_policy *policy)
 	sg_policy->limits_changed		= false;
 	sg_policy->need_freq_update		= false;
 	sg_policy->cached_raw_freq		= 0;
+	sg_policy->boost_start			= 0;
 
 	for_each_cpu(cpu, policy->cpus) {
 		struct sugov_cpu *sg_cpu = &per_cpu(sugov_cpu, cpu);
@@ -5221,10 +5221,20 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	/*
 	 * If in_iowait is set, the code below may not trigger any cpufreq
 	 * utilization updates, so do it here explicitly with the IOWAIT flag
-	 * passed.
+	 * passed. Same for wakeups if the governor asked for them, so that it
+	 * gets a chance to act on the task's estimated utilization right away.
 	 */
-	if (p->in_iowait)
-		cpufreq_update_util(rq, SCHED_CPUFREQ_IOWAIT);
+	if (p->in_iowait || cpufreq_wants_wakeups()) {
+		unsigned int cpufreq_flags = 0;
+
+		if (p->in_iowait)
+			cpufreq_flags |= SCHED_CPUFREQ_IOWAIT;
+		/* The wakeup prediction is based on util_est */
+		if ((flags & ENQUEUE_WAKEUP) && sched_feat(UTIL_EST))
+			cpufreq_flags |= SCHED_CPUFREQ_WAKEUP;
+		if (cpufreq_flags)
+			cpufreq_update_util(rq, cpufreq_flags);
+	}
 
 	for_each_sched_entity(se) {
 		if (se->on_rq)
@@ -5944,6 +5954,22 @@ static inline int select_idle_smt(struct task_struct *p, int target)
 
 #endif /* CONFIG_SCHED_SMT */
 
+/*
+ * Scale the idle CPU search depth by the latency nice hint of the task being
+ * placed: latency sensitive tasks may scan up to the whole LLC while latency
+ * tolerant tasks give up proportionally earlier. The default hint leaves
+ * @nr untouched.
+ */
+static inline int sis_latency_scan_depth(int nr, int span, int latency_nice)
+{
+	if (latency_nice < 0 && nr < span)
+		nr += (span - nr) * latency_nice / MIN_LATENCY_NICE;
+	else if (latency_nice > 0)
+		nr -= nr * latency_nice / (MAX_LATENCY_NICE + 1);
+
+	return max(nr, 2);
+}
+
 /*
  * Scan the LLC domain for idle CPUs; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
@@ -5970,7 +5996,9 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	avg_idle = this_rq()->avg_idle / 512;
 	avg_cost = this_sd->avg_scan_cost + 1;
 
-	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost)
+	/* Latency sensitive tasks always get a (bounded) scan: */
+	if (sched_feat(SIS_AVG_CPU) && avg_idle < avg_cost &&
+	    p->latency_nice >= 0)
 		return -1;
 
 	if (sched_feat(SIS_PROP)) {
@@ -5979,6 +6007,8 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 			nr = div_u64(span_avg, avg_cost);
 		else
 			nr = 4;
+
+		nr = sis_latency_scan_depth(nr, sd->span_weight, p->latency_nice);
 	}
 
 	time = cpu_clock(this);
@@ -6002,29 +6032,64 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, int t
 	return cpu;
 }
 
+/*
+ * Scan the cluster (CPUs sharing e.g. an L2 below the LLC) of the target for
+ * an idle CPU. Clusters are small, so the whole span is scanned.
+ */
+static int select_idle_cluster(struct task_struct *p, struct sched_domain *sd,
+			       int target)
+{
+	int cpu, si_cpu = -1;
+
+	for_each_cpu_wrap(cpu, sched_domain_span(sd), target) {
+		if (!cpumask_test_cpu(cpu, p->cpus_ptr))
+			continue;
+		if (available_idle_cpu(cpu))
+			return cpu;
+		if (si_cpu == -1 && sched_idle_cpu(cpu))
+			si_cpu = cpu;
+	}
+
+	return si_cpu;
+}
+
+static inline bool cpus_share_cluster(int this_cpu, int that_cpu)
+{
+	return per_cpu(sd_cluster_id, this_cpu) == per_cpu(sd_cluster_id, that_cpu);
+}
+
 /*
  * Try and locate an idle core/thread in the LLC cache domain.
  */
 static int select_idle_sibling(struct task_struct *p, int prev, int target)
 {
-	struct sched_domain *sd;
-	int i, recent_used_cpu;
+	struct sched_domain *sd, *sd_cluster;
+	int i, recent_used_cpu, prev_aff = -1;
 
 	if (available_idle_cpu(target) || sched_idle_cpu(target))
 		return target;
 
+	sd_cluster = rcu_dereference(per_cpu(sd_cluster, target));
+
 	/*
-	 * If the previous CPU is cache affine and idle, don't be stupid:
+	 * If the previous CPU is cache affine and idle, don't be stupid.
+	 * When the LLC is split into clusters, an idle previous CPU outside
+	 * the target's cluster is only used if the cluster has no idle CPU.
 	 */
 	if (prev != target && cpus_share_cache(prev, target) &&
-	    (available_idle_cpu(prev) || sched_idle_cpu(prev)))
-		return prev;
+	    (available_idle_cpu(prev) || sched_idle_cpu(prev))) {
+		if (!sd_cluster || cpus_share_cluster(prev, target))
+			return prev;
+
+		prev_aff = prev;
+	}
 
 	/* Check a recently used CPU as a potential idle candidate: */
 	recent_used_cpu = p->recent_used_cpu;
 	if (recent_used_cpu != prev &&
 	    recent_used_cpu != target &&
 	    cpus_share_cache(recent_used_cpu, target) &&
+	    (!sd_cluster || cpus_share_cluster(recent_used_cpu, target)) &&
 	    (available_idle_cpu(recent_used_cpu) || sched_idle_cpu(recent_used_cpu)) &&
 	    cpumask_test_cpu(p->recent_used_cpu, p->cpus_ptr)) {
 		/*
@@ -6043,6 +6108,15 @@ static int select_idle_sibling(struct task_struct *p, int prev, int target)
 	if ((unsigned)i < nr_cpumask_bits)
 		return i;
 
+	if (sd_cluster) {
+		i = select_idle_cluster(p, sd_cluster, target);
+		if ((unsigned)i < nr_cpumask_bits)
+			return i;
+	}
+
+	if ((unsigned)prev_aff < nr_cpumask_bits)
+		return prev_aff;
+
 	i = select_idle_cpu(p, sd, target);
 	if ((unsigned)i < nr_cpumask_bits)
 		return i;
@@ -6621,6 +6695,23 @@ static unsigned long wakeup_gran(struct sched_entity *se)
 	return calc_delta_fair(gran, se);
 }
 
+/*
+ * Latency nice hints shift the point at which 'se' is allowed to preempt
+ * 'curr'. A negative offset on either side means that a latency requirement
+ * has to be weighed against the other entity; otherwise 'se' only tells how
+ * much additional scheduling delay it is willing to accept.
+ */
+static long wakeup_latency_gran(struct sched_entity *curr, struct sched_entity *se)
+{
+	long latency_offset = READ_ONCE(se->latency_offset);
+	long curr_offset = READ_ONCE(curr->latency_offset);
+
+	if (latency_offset < 0 || curr_offset < 0)
+		latency_offset -= curr_offset;
+
+	return min_t(long, latency_offset, sysctl_sched_latency);
+}
+
 /*
  * Should 'se' preempt 'curr'.
  *
@@ -6640,6 +6731,9 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 {
 	s64 gran, vdiff = curr->vruntime - se->vruntime;
 
+	/* Take the latency nice hints into account: */
+	vdiff -= wakeup_latency_gran(curr, se);
+
 	if (vdiff <= 0)
 		return -1;
 
@@ -10283,6 +10377,7 @@ int alloc_fair_sched_group(struct task_group *tg, struct task_group *parent)
 		goto err;
 
 	tg->shares = NICE_0_LOAD;
+	tg->latency_nice = DEFAULT_LATENCY_NICE;
 
 	init_cfs_bandwidth(tg_cfs_bandwidth(tg));
 
@@ -10418,6 +10513,31 @@ int sched_group_set_shares(struct task_group *tg, unsigned long shares)
 		rq_unlock_irqrestore(rq, &rf);
 	}
 
+done:
+	mutex_unlock(&shares_mutex);
+	return 0;
+}
+
+int sched_group_set_latency(struct task_group *tg, int latency_nice)
+{
+	long latency_offset;
+	int i;
+
+	/*
+	 * We can't change the latency hint of the root cgroup.
+	 */
+	if (!tg->se[0])
+		return -EINVAL;
+
+	mutex_lock(&shares_mutex);
+	if (tg->latency_nice == latency_nice)
+		goto done;
+
+	tg->latency_nice = latency_nice;
+	latency_offset = latency_nice_to_offset(latency_nice);
+	for_each_possible_cpu(i)
+		WRITE_ONCE(tg->se[i]->latency_offset, latency_offset);
+
 done:
 	mutex_unlock(&shares_mutex);
 	return 0;
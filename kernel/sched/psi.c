@@ -1,5 +1,5 @@
 /*
- * Pressure stall information for CPU, memory and IO
+ * Pressure stall information for CPU, memory, IO and IRQ
  *
  * Copyright (c) 2018 Facebook, Inc.
  * Author: Johannes Weiner <hannes@cmpxchg.org>
@@ -125,6 +125,14 @@
  * This gives us an approximation of pressure that is practical
  * cost-wise, yet way more sensitive and accurate than periodic
  * sampling of the aggregate task states would be.
+ *
+ * Because SOME and FULL are not additive, the states of a cgroup
+ * cannot be derived from those of its children after the fact; every
+ * task change has to be applied to each ancestor group. For deep
+ * hierarchies, levels whose pressure nobody looks at can be switched
+ * off through cgroup.pressure. Disabled groups keep their task counts
+ * (so they can be turned back on) but skip the state and time
+ * accounting and never wake the aggregators.
  */
 
 #include "../workqueue_internal.h"
@@ -175,6 +183,7 @@ static u64 psi_period __read_mostly;
 static DEFINE_PER_CPU(struct psi_group_cpu, system_group_pcpu);
 struct psi_group psi_system = {
 	.pcpu = &system_group_pcpu,
+	.enabled = true,
 };
 
 static void psi_avgs_work(struct work_struct *work);
@@ -183,6 +192,7 @@ static void group_init(struct psi_group *group)
 {
 	int cpu;
 
+	group->enabled = true;
 	for_each_possible_cpu(cpu)
 		seqcount_init(&per_cpu_ptr(group->pcpu, cpu)->seq);
 	group->avg_last_update = sched_clock();
@@ -673,6 +683,7 @@ static u32 psi_group_change(struct psi_group *group, int cpu,
 			    unsigned int clear, unsigned int set)
 {
 	struct psi_group_cpu *groupc;
+	bool enabled = READ_ONCE(group->enabled);
 	unsigned int t, m;
 	enum psi_states s;
 	u32 state_mask = 0;
@@ -689,7 +700,14 @@ static u32 psi_group_change(struct psi_group *group, int cpu,
 	 */
 	write_seqcount_begin(&groupc->seq);
 
-	record_times(groupc, cpu, false);
+	/*
+	 * The first change after the group was disabled still concludes
+	 * the states it was in: the aggregator may already have sampled
+	 * their live time, and dropping it would make the times go
+	 * backwards once the group is enabled again.
+	 */
+	if (enabled || groupc->state_mask)
+		record_times(groupc, cpu, false);
 
 	for (t = 0, m = clear; m; m &= ~(1 << t), t++) {
 		if (!(m & (1 << t)))
@@ -708,6 +726,12 @@ static u32 psi_group_change(struct psi_group *group, int cpu,
 		if (set & (1 << t))
 			groupc->tasks[t]++;
 
+	if (!enabled) {
+		groupc->state_mask = 0;
+		write_seqcount_end(&groupc->seq);
+		return 0;
+	}
+
 	/* Calculate state mask representing active states */
 	for (s = 0; s < NR_PSI_STATES; s++) {
 		if (test_state(groupc->tasks, s))
@@ -720,27 +744,14 @@ static u32 psi_group_change(struct psi_group *group, int cpu,
 	return state_mask;
 }
 
-static struct psi_group *iterate_groups(struct task_struct *task, void **iter)
+static struct psi_group *task_psi_group(struct task_struct *task)
 {
 #ifdef CONFIG_CGROUPS
-	struct cgroup *cgroup = NULL;
+	struct cgroup *cgroup = task->cgroups->dfl_cgrp;
 
-	if (!*iter)
-		cgroup = task->cgroups->dfl_cgrp;
-	else if (*iter == &psi_system)
-		return NULL;
-	else
-		cgroup = cgroup_parent(*iter);
-
-	if (cgroup && cgroup_parent(cgroup)) {
-		*iter = cgroup;
+	if (cgroup_parent(cgroup))
 		return cgroup_psi(cgroup);
-	}
-#else
-	if (*iter)
-		return NULL;
 #endif
-	*iter = &psi_system;
 	return &psi_system;
 }
 
@@ -749,7 +760,6 @@ void psi_task_change(struct task_struct *task, int clear, int set)
 	int cpu = task_cpu(task);
 	struct psi_group *group;
 	bool wake_clock = true;
-	void *iter = NULL;
 
 	if (!task->pid)
 		return;
@@ -777,30 +787,63 @@ void psi_task_change(struct task_struct *task, int clear, int set)
 		     wq_worker_last_func(task) == psi_avgs_work))
 		wake_clock = false;
 
-	while ((group = iterate_groups(task, &iter))) {
+	group = task_psi_group(task);
+	do {
 		u32 state_mask = psi_group_change(group, cpu, clear, set);
 
+		if (!group->enabled)
+			continue;
+
 		if (state_mask & group->poll_states)
 			psi_schedule_poll_work(group, 1);
 
 		if (wake_clock && !delayed_work_pending(&group->avgs_work))
 			schedule_delayed_work(&group->avgs_work, PSI_FREQ);
-	}
+	} while ((group = group->parent));
 }
 
 void psi_memstall_tick(struct task_struct *task, int cpu)
 {
-	struct psi_group *group;
-	void *iter = NULL;
+	struct psi_group *group = task_psi_group(task);
 
-	while ((group = iterate_groups(task, &iter))) {
+	do {
 		struct psi_group_cpu *groupc;
 
+		if (!group->enabled)
+			continue;
+
 		groupc = per_cpu_ptr(group->pcpu, cpu);
 		write_seqcount_begin(&groupc->seq);
 		record_times(groupc, cpu, true);
 		write_seqcount_end(&groupc->seq);
-	}
+	} while ((group = group->parent));
+}
+
+/*
+ * Charge time spent in hard and soft interrupts while @task was running
+ * as IRQ pressure to the groups of @task. Called with the rq lock held
+ * from the rq clock update, @delta has been taken out of the task's
+ * clock already.
+ */
+void psi_account_irqtime(struct task_struct *task, int cpu, u32 delta)
+{
+	struct psi_group *group = task_psi_group(task);
+
+	do {
+		struct psi_group_cpu *groupc;
+
+		if (!group->enabled)
+			continue;
+
+		groupc = per_cpu_ptr(group->pcpu, cpu);
+		write_seqcount_begin(&groupc->seq);
+		record_times(groupc, cpu, false);
+		groupc->times[PSI_IRQ_FULL] += delta;
+		write_seqcount_end(&groupc->seq);
+
+		if (group->poll_states & (1 << PSI_IRQ_FULL))
+			psi_schedule_poll_work(group, 1);
+	} while ((group = group->parent));
 }
 
 /**
@@ -866,6 +909,8 @@ void psi_memstall_leave(unsigned long *flags)
 #ifdef CONFIG_CGROUPS
 int psi_cgroup_alloc(struct cgroup *cgroup)
 {
+	struct cgroup *parent;
+
 	if (static_branch_likely(&psi_disabled))
 		return 0;
 
@@ -873,6 +918,13 @@ int psi_cgroup_alloc(struct cgroup *cgroup)
 	if (!cgroup->psi.pcpu)
 		return -ENOMEM;
 	group_init(&cgroup->psi);
+
+	/* Top-level cgroups report to the system-wide group */
+	parent = cgroup_parent(cgroup);
+	if (parent && cgroup_parent(parent))
+		cgroup->psi.parent = cgroup_psi(parent);
+	else
+		cgroup->psi.parent = &psi_system;
 	return 0;
 }
 
@@ -935,14 +987,55 @@ void cgroup_move_task(struct task_struct *task, struct css_set *to)
 
 	task_rq_unlock(rq, task, &rf);
 }
+
+/**
+ * psi_cgroup_restart - sync the per-cpu state after group->enabled changed
+ * @group: the group that was just enabled or disabled
+ *
+ * While disabled, only the per-cpu task counts of @group are kept up to
+ * date. On disable, conclude the times of the states each CPU was in
+ * and clear the state masks. On enable, recompute the state masks from
+ * the task counts and restart the state clocks from now, so no time is
+ * attributed to the period the group was disabled.
+ *
+ * A state change of @group on a CPU happens under that CPU's rq lock,
+ * so taking it here orders the toggle against all of them.
+ */
+void psi_cgroup_restart(struct psi_group *group)
+{
+	int cpu;
+
+	if (static_branch_likely(&psi_disabled))
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		struct rq_flags rf;
+
+		rq_lock_irq(rq, &rf);
+		psi_group_change(group, cpu, 0, 0);
+		rq_unlock_irq(rq, &rf);
+	}
+}
 #endif /* CONFIG_CGROUPS */
 
+/*
+ * The SOME and FULL states reported for each resource. The CPU has no
+ * FULL state, and interrupts only ever stall the whole CPU.
+ */
+static const int psi_res_states[NR_PSI_RESOURCES][2] = {
+	[PSI_IO]	= { PSI_IO_SOME,	PSI_IO_FULL },
+	[PSI_MEM]	= { PSI_MEM_SOME,	PSI_MEM_FULL },
+	[PSI_CPU]	= { PSI_CPU_SOME,	-1 },
+	[PSI_IRQ]	= { -1,			PSI_IRQ_FULL },
+};
+
 int psi_show(struct seq_file *m, struct psi_group *group, enum psi_res res)
 {
 	int full;
 	u64 now;
 
-	if (static_branch_likely(&psi_disabled))
+	if (static_branch_likely(&psi_disabled) || !group->enabled)
 		return -EOPNOTSUPP;
 
 	/* Update averages before reporting them */
@@ -953,15 +1046,18 @@ int psi_show(struct seq_file *m, struct psi_group *group, enum psi_res res)
 		group->avg_next_update = update_averages(group, now);
 	mutex_unlock(&group->avgs_lock);
 
-	for (full = 0; full < 2 - (res == PSI_CPU); full++) {
+	for (full = 0; full < 2; full++) {
+		int state = psi_res_states[res][full];
 		unsigned long avg[3];
 		u64 total;
 		int w;
 
+		if (state < 0)
+			continue;
+
 		for (w = 0; w < 3; w++)
-			avg[w] = group->avg[res * 2 + full][w];
-		total = div_u64(group->total[PSI_AVGS][res * 2 + full],
-				NSEC_PER_USEC);
+			avg[w] = group->avg[state][w];
+		total = div_u64(group->total[PSI_AVGS][state], NSEC_PER_USEC);
 
 		seq_printf(m, "%s avg10=%lu.%02lu avg60=%lu.%02lu avg300=%lu.%02lu total=%llu\n",
 			   full ? "full" : "some",
@@ -989,6 +1085,11 @@ static int psi_cpu_show(struct seq_file *m, void *v)
 	return psi_show(m, &psi_system, PSI_CPU);
 }
 
+static int psi_irq_show(struct seq_file *m, void *v)
+{
+	return psi_show(m, &psi_system, PSI_IRQ);
+}
+
 static int psi_io_open(struct inode *inode, struct file *file)
 {
 	return single_open(file, psi_io_show, NULL);
@@ -1004,25 +1105,30 @@ static int psi_cpu_open(struct inode *inode, struct file *file)
 	return single_open(file, psi_cpu_show, NULL);
 }
 
+static int psi_irq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, psi_irq_show, NULL);
+}
+
 struct psi_trigger *psi_trigger_create(struct psi_group *group,
 			char *buf, size_t nbytes, enum psi_res res)
 {
 	struct psi_trigger *t;
-	enum psi_states state;
+	int state;
 	u32 threshold_us;
 	u32 window_us;
 
-	if (static_branch_likely(&psi_disabled))
+	if (static_branch_likely(&psi_disabled) || !group->enabled)
 		return ERR_PTR(-EOPNOTSUPP);
 
 	if (sscanf(buf, "some %u %u", &threshold_us, &window_us) == 2)
-		state = PSI_IO_SOME + res * 2;
+		state = psi_res_states[res][0];
 	else if (sscanf(buf, "full %u %u", &threshold_us, &window_us) == 2)
-		state = PSI_IO_FULL + res * 2;
+		state = psi_res_states[res][1];
 	else
 		return ERR_PTR(-EINVAL);
 
-	if (state >= PSI_NONIDLE)
+	if (state < 0)
 		return ERR_PTR(-EINVAL);
 
 	if (window_us < WINDOW_MIN_US ||
@@ -1239,6 +1345,12 @@ static ssize_t psi_cpu_write(struct file *file, const char __user *user_buf,
 	return psi_write(file, user_buf, nbytes, PSI_CPU);
 }
 
+static ssize_t psi_irq_write(struct file *file, const char __user *user_buf,
+			     size_t nbytes, loff_t *ppos)
+{
+	return psi_write(file, user_buf, nbytes, PSI_IRQ);
+}
+
 static __poll_t psi_fop_poll(struct file *file, poll_table *wait)
 {
 	struct seq_file *seq = file->private_data;
@@ -1281,12 +1393,24 @@ static const struct file_operations psi_cpu_fops = {
 	.release        = psi_fop_release,
 };
 
+static const struct file_operations __maybe_unused psi_irq_fops = {
+	.open           = psi_irq_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.write          = psi_irq_write,
+	.poll           = psi_fop_poll,
+	.release        = psi_fop_release,
+};
+
 static int __init psi_proc_init(void)
 {
 	proc_mkdir("pressure", NULL);
 	proc_create("pressure/io", 0, NULL, &psi_io_fops);
 	proc_create("pressure/memory", 0, NULL, &psi_memory_fops);
 	proc_create("pressure/cpu", 0, NULL, &psi_cpu_fops);
+#ifdef CONFIG_IRQ_TIME_ACCOUNTING
+	proc_create("pressure/irq", 0, NULL, &psi_irq_fops);
+#endif
 	return 0;
 }
 module_init(psi_proc_init);
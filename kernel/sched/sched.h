@@ -47,6 +47,7 @@
 #include <linux/delayacct.h>
 #include <linux/energy_model.h>
 #include <linux/init_task.h>
+#include <linux/jump_label_ratelimit.h>
 #include <linux/kprobes.h>
 #include <linux/kthread.h>
 #include <linux/membarrier.h>
@@ -367,6 +368,8 @@ struct task_group {
 	/* runqueue "owned" by this group on each CPU */
 	struct cfs_rq		**cfs_rq;
 	unsigned long		shares;
+	/* latency nice hint applied to the group entities */
+	int			latency_nice;
 
 #ifdef	CONFIG_SMP
 	/*
@@ -476,6 +479,7 @@ extern void sched_move_task(struct task_struct *tsk);
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern int sched_group_set_latency(struct task_group *tg, int latency_nice);
 
 #ifdef CONFIG_SMP
 extern void set_task_rq_fair(struct sched_entity *se,
@@ -1383,6 +1387,8 @@ DECLARE_PER_CPU(struct sched_domain __rcu *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
 DECLARE_PER_CPU(struct sched_domain_shared __rcu *, sd_llc_shared);
+DECLARE_PER_CPU(struct sched_domain __rcu *, sd_cluster);
+DECLARE_PER_CPU(int, sd_cluster_id);
 DECLARE_PER_CPU(struct sched_domain __rcu *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain __rcu *, sd_asym_packing);
 DECLARE_PER_CPU(struct sched_domain __rcu *, sd_asym_cpucapacity);
@@ -1666,6 +1672,17 @@ static inline int task_on_rq_migrating(struct task_struct *p)
 extern const int		sched_prio_to_weight[40];
 extern const u32		sched_prio_to_wmult[40];
 
+/*
+ * Convert a latency nice value into the offset, relative to
+ * sysctl_sched_latency, that is applied to the vruntime lag when checking
+ * wakeup preemption: -20 maps to -sched_latency and 19 maps to just below
+ * +sched_latency.
+ */
+static inline long latency_nice_to_offset(int latency_nice)
+{
+	return (long)sysctl_sched_latency * latency_nice / (MAX_LATENCY_NICE + 1);
+}
+
 /*
  * {de,en}queue flags:
  *
@@ -2278,6 +2295,13 @@ static inline u64 irq_time_read(int cpu)
 
 #ifdef CONFIG_CPU_FREQ
 DECLARE_PER_CPU(struct update_util_data __rcu *, cpufreq_update_util_data);
+extern struct static_key_false_deferred sched_cpufreq_wakeup;
+
+/* Does a cpufreq governor want SCHED_CPUFREQ_WAKEUP updates? */
+static inline bool cpufreq_wants_wakeups(void)
+{
+	return static_branch_unlikely(&sched_cpufreq_wakeup.key);
+}
 
 /**
  * cpufreq_update_util - Take a note about CPU utilization changes.
@@ -2312,6 +2336,7 @@ static inline void cpufreq_update_util(struct rq *rq, unsigned int flags)
 }
 #else
 static inline void cpufreq_update_util(struct rq *rq, unsigned int flags) {}
+static inline bool cpufreq_wants_wakeups(void) { return false; }
 #endif /* CONFIG_CPU_FREQ */
 
 #ifdef CONFIG_UCLAMP_TASK
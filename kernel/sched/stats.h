@@ -134,11 +134,21 @@ static inline void psi_task_tick(struct rq *rq)
 	if (unlikely(rq->curr->flags & PF_MEMSTALL))
 		psi_memstall_tick(rq->curr, cpu_of(rq));
 }
+
+static inline void psi_irqtime(struct rq *rq, s64 irq_delta)
+{
+	if (static_branch_likely(&psi_disabled))
+		return;
+
+	if (irq_delta && rq->curr->pid)
+		psi_account_irqtime(rq->curr, cpu_of(rq), irq_delta);
+}
 #else /* CONFIG_PSI */
 static inline void psi_enqueue(struct task_struct *p, bool wakeup) {}
 static inline void psi_dequeue(struct task_struct *p, bool sleep) {}
 static inline void psi_ttwu_dequeue(struct task_struct *p) {}
 static inline void psi_task_tick(struct rq *rq) {}
+static inline void psi_irqtime(struct rq *rq, s64 irq_delta) {}
 #endif /* CONFIG_PSI */
 
 #ifdef CONFIG_SCHED_INFO
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sched-latency.c
+ *
+ * latency: Benchmark for wakeup latency under CPU contention
+ *
+ * Worker threads sleep on a pipe and are woken periodically by a waker
+ * thread each, while batch threads keep every CPU busy.  The time from the
+ * waker's write to the worker running again is the wakeup latency; the
+ * worker then acks on a second pipe before the waker sleeps again.  The
+ * latency_nice hint of the workers (--latency-nice) and of the batch
+ * threads (--batch-latency-nice) should move that latency.
+ */
+#include <subcmd/parse-options.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/time64.h>
+#include "bench.h"
+
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#ifndef SCHED_FLAG_KEEP_POLICY
+#define SCHED_FLAG_KEEP_POLICY		0x08
+#define SCHED_FLAG_KEEP_PARAMS		0x10
+#endif
+#ifndef SCHED_FLAG_LATENCY_NICE
+#define SCHED_FLAG_LATENCY_NICE		0x80
+#endif
+
+/* struct sched_attr up to SCHED_ATTR_SIZE_VER2, libc may lack it */
+struct bench_sched_attr {
+	u32 size;
+	u32 sched_policy;
+	u64 sched_flags;
+	s32 sched_nice;
+	u32 sched_priority;
+	u64 sched_runtime;
+	u64 sched_deadline;
+	u64 sched_period;
+	u32 sched_util_min;
+	u32 sched_util_max;
+	s32 sched_latency_nice;
+};
+
+struct thread_data {
+	int			nr;
+	int			pipe[2];
+	int			pipe_ack[2];
+	u64			wake_ns;
+	u64			*lat_ns;
+	pthread_t		worker;
+	pthread_t		waker;
+};
+
+static unsigned int	nr_workers = 4;
+static unsigned int	nr_batch;
+static unsigned int	loops = 10000;
+static unsigned int	period_us = 1000;
+static int		latency_nice;
+static int		batch_latency_nice;
+
+static volatile bool	done;
+
+static const struct option options[] = {
+	OPT_UINTEGER('w', "workers",	&nr_workers,	"Specify number of latency sensitive threads"),
+	OPT_UINTEGER('b', "batch",	&nr_batch,	"Specify number of CPU bound threads (default: number of CPUs)"),
+	OPT_UINTEGER('l', "loop",	&loops,		"Specify number of wakeups per worker"),
+	OPT_UINTEGER('p', "period",	&period_us,	"Specify usecs between wakeups"),
+	OPT_INTEGER('L', "latency-nice", &latency_nice, "Specify latency_nice of the workers"),
+	OPT_INTEGER('B', "batch-latency-nice", &batch_latency_nice, "Specify latency_nice of the CPU bound threads"),
+	OPT_END()
+};
+
+static const char * const bench_sched_latency_usage[] = {
+	"perf bench sched latency <options>",
+	NULL
+};
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* Set the calling thread's latency_nice, leaving its policy and nice alone */
+static void set_latency_nice(int nice)
+{
+	struct bench_sched_attr attr = {
+		.size			= sizeof(attr),
+		.sched_flags		= SCHED_FLAG_KEEP_POLICY |
+					  SCHED_FLAG_KEEP_PARAMS |
+					  SCHED_FLAG_LATENCY_NICE,
+		.sched_latency_nice	= nice,
+	};
+
+	if (!nice)
+		return;
+
+	if (syscall(__NR_sched_setattr, 0, &attr, 0))
+		err(EXIT_FAILURE, "sched_setattr(latency_nice=%d)", nice);
+}
+
+static void *worker_thread(void *__tdata)
+{
+	struct thread_data *td = __tdata;
+	unsigned int i;
+	char c;
+	int ret;
+
+	set_latency_nice(latency_nice);
+
+	for (i = 0; i < loops; i++) {
+		ret = read(td->pipe[0], &c, 1);
+		BUG_ON(ret != 1);
+		td->lat_ns[i] = now_ns() - td->wake_ns;
+		ret = write(td->pipe_ack[1], &c, 1);
+		BUG_ON(ret != 1);
+	}
+
+	return NULL;
+}
+
+static void *waker_thread(void *__tdata)
+{
+	struct thread_data *td = __tdata;
+	struct timespec period = {
+		.tv_sec		= period_us / USEC_PER_SEC,
+		.tv_nsec	= (period_us % USEC_PER_SEC) * NSEC_PER_USEC,
+	};
+	unsigned int i;
+	char c = 0;
+	int ret;
+
+	for (i = 0; i < loops; i++) {
+		nanosleep(&period, NULL);
+		/* The pipe orders this before the worker's read */
+		td->wake_ns = now_ns();
+		ret = write(td->pipe[1], &c, 1);
+		BUG_ON(ret != 1);
+		ret = read(td->pipe_ack[0], &c, 1);
+		BUG_ON(ret != 1);
+	}
+
+	return NULL;
+}
+
+static void *batch_thread(void *arg __maybe_unused)
+{
+	set_latency_nice(batch_latency_nice);
+
+	while (!done)
+		;
+
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int bench_sched_latency(int argc, const char **argv)
+{
+	struct thread_data *threads, *td;
+	pthread_t *batch;
+	u64 *lat_ns, sum = 0, nr_samples, i;
+	unsigned int t;
+	int ret;
+
+	nr_batch = sysconf(_SC_NPROCESSORS_ONLN);
+	argc = parse_options(argc, argv, options, bench_sched_latency_usage, 0);
+	if (!nr_workers || !loops)
+		usage_with_options(bench_sched_latency_usage, options);
+
+	nr_samples = (u64)nr_workers * loops;
+	threads = calloc(nr_workers, sizeof(*threads));
+	batch = calloc(nr_batch, sizeof(*batch));
+	lat_ns = calloc(nr_samples, sizeof(*lat_ns));
+	if (!threads || (nr_batch && !batch) || !lat_ns)
+		err(EXIT_FAILURE, "calloc");
+
+	for (t = 0; t < nr_batch; t++) {
+		ret = pthread_create(&batch[t], NULL, batch_thread, NULL);
+		BUG_ON(ret);
+	}
+
+	for (t = 0; t < nr_workers; t++) {
+		td = threads + t;
+		td->nr = t;
+		td->lat_ns = lat_ns + (u64)t * loops;
+		BUG_ON(pipe(td->pipe));
+		BUG_ON(pipe(td->pipe_ack));
+
+		ret = pthread_create(&td->worker, NULL, worker_thread, td);
+		BUG_ON(ret);
+		ret = pthread_create(&td->waker, NULL, waker_thread, td);
+		BUG_ON(ret);
+	}
+
+	for (t = 0; t < nr_workers; t++) {
+		td = threads + t;
+
+		ret = pthread_join(td->waker, NULL);
+		BUG_ON(ret);
+		ret = pthread_join(td->worker, NULL);
+		BUG_ON(ret);
+		close(td->pipe[0]);
+		close(td->pipe[1]);
+		close(td->pipe_ack[0]);
+		close(td->pipe_ack[1]);
+	}
+
+	done = true;
+	for (t = 0; t < nr_batch; t++) {
+		ret = pthread_join(batch[t], NULL);
+		BUG_ON(ret);
+	}
+
+	qsort(lat_ns, nr_samples, sizeof(*lat_ns), cmp_u64);
+	for (i = 0; i < nr_samples; i++)
+		sum += lat_ns[i];
+
+#define PCT(p)	((double)lat_ns[(nr_samples - 1) * (p) / 100] / NSEC_PER_USEC)
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u workers (latency_nice %d) woken every %u usecs, "
+		       "%u batch threads (latency_nice %d)\n\n",
+		       nr_workers, latency_nice, period_us,
+		       nr_batch, batch_latency_nice);
+
+		printf(" %14s: %llu\n", "Wakeups",
+		       (unsigned long long)nr_samples);
+		printf(" %14s: %.3f [usec]\n", "Average",
+		       (double)sum / nr_samples / NSEC_PER_USEC);
+		printf(" %14s: %.3f [usec]\n", "50th", PCT(50));
+		printf(" %14s: %.3f [usec]\n", "90th", PCT(90));
+		printf(" %14s: %.3f [usec]\n", "99th", PCT(99));
+		printf(" %14s: %.3f [usec]\n", "Max", PCT(100));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.3f\n", PCT(99));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(lat_ns);
+	free(batch);
+	free(threads);
+	return 0;
+}
@@ -0,0 +1,102 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Plug merging of small bios on null_blk.
+#
+# A memoryless null_blk device with one hardware queue, no scheduler and
+# instant completions is created through configfs, so that the cost of
+# submission, and of looking up merges in the plug, dominates.  fio then
+# submits 4k writes in batches of BATCH through io_submit(), which plugs
+# each batch:
+#  - seq: adjacent writes, every bio merges into a plugged request;
+#  - gaps: writes with a 4k hole between them, no bio can merge, so every
+#    lookup misses with the plug full of requests.
+# Each run prints the fio IOPS and submission latency, and the number of
+# write merges the device accounted.
+#
+# Environment: RUNTIME (seconds, default 30), BATCH (default 128),
+# SIZE (MiB, default 4096).
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+RUNTIME=${RUNTIME:-30}
+BATCH=${BATCH:-128}
+SIZE=${SIZE:-4096}
+
+NULLB=/sys/kernel/config/nullb/plug_merge
+INDEX=42
+DEV=nullb$INDEX
+
+cleanup()
+{
+	if [ -d $NULLB ]; then
+		echo 0 > $NULLB/power
+		rmdir $NULLB
+	fi
+}
+
+check_test_requirements()
+{
+	if [ $(id -u) -ne 0 ]; then
+		echo "$0: Must be run as root"
+		exit $ksft_skip
+	fi
+
+	if ! which fio > /dev/null 2>&1; then
+		echo "$0: You need fio installed"
+		exit $ksft_skip
+	fi
+
+	modprobe null_blk nr_devices=0 > /dev/null 2>&1
+	if [ ! -d /sys/kernel/config/nullb ]; then
+		echo "$0: null_blk with configfs is not available"
+		exit $ksft_skip
+	fi
+}
+
+setup_nullb()
+{
+	mkdir $NULLB || return 1
+	echo $INDEX > $NULLB/index
+	echo $SIZE > $NULLB/size
+	echo 2 > $NULLB/queue_mode
+	echo 0 > $NULLB/irqmode
+	echo 0 > $NULLB/completion_nsec
+	echo 1 > $NULLB/submit_queues
+	echo 1024 > $NULLB/hw_queue_depth
+	echo 1 > $NULLB/power || return 1
+
+	echo none > /sys/block/$DEV/queue/scheduler
+	echo 0 > /sys/block/$DEV/queue/nomerges
+}
+
+# write_merges: the "write merges" field of the device's stat file
+write_merges()
+{
+	awk '{ print $6 }' /sys/block/$DEV/stat
+}
+
+# run_fio <name> <rw>
+run_fio()
+{
+	local merges=$(write_merges)
+
+	fio --name=$1 --filename=/dev/$DEV --ioengine=libaio --direct=1 \
+	    --rw=$2 --bs=4k --iodepth=$BATCH --iodepth_batch_submit=$BATCH \
+	    --iodepth_batch_complete_min=$BATCH --time_based \
+	    --runtime=$RUNTIME > /tmp/$1.$$ || return 1
+
+	echo "$1: write $(sed -n 's/.*write: \(IOPS=[^,]*\),.*/\1/p' \
+		/tmp/$1.$$), $(($(write_merges) - merges)) merges"
+	grep -m1 '^ *slat' /tmp/$1.$$
+	rm -f /tmp/$1.$$
+}
+
+check_test_requirements
+trap cleanup EXIT
+
+setup_nullb || exit 1
+run_fio seq write || exit 1
+run_fio gaps write:4k || exit 1
+exit 0
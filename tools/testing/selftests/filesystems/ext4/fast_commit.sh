@@ -0,0 +1,91 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# fsync-heavy fio run on ext4 without and with fast commits.
+#
+# A scratch filesystem on a loop device is used twice: with plain jbd2
+# commits, then with the fast_commit feature (compat bit 15, set with
+# debugfs since mke2fs does not know this format).  Each run prints the
+# fio write IOPS and completion latency; the fast commit run must actually
+# have done fast commits according to /proc/fs/ext4/<dev>/fc_info.
+#
+# Environment: IMG_SIZE (default 2G), RUNTIME (seconds, default 30),
+# NUMJOBS (default 4), BS (default 4k).
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+IMG_SIZE=${IMG_SIZE:-2G}
+RUNTIME=${RUNTIME:-30}
+NUMJOBS=${NUMJOBS:-4}
+BS=${BS:-4k}
+
+TMP=$(mktemp -d)
+IMG=$TMP/ext4.img
+MNT=$TMP/mnt
+DEV=
+
+cleanup()
+{
+	umount $MNT 2> /dev/null
+	[ -n "$DEV" ] && losetup -d $DEV
+	rm -rf $TMP
+}
+
+check_test_requirements()
+{
+	if [ $(id -u) -ne 0 ]; then
+		echo "$0: Must be run as root"
+		exit $ksft_skip
+	fi
+
+	for tool in mkfs.ext4 debugfs losetup fio; do
+		if ! which $tool > /dev/null 2>&1; then
+			echo "$0: You need $tool installed"
+			exit $ksft_skip
+		fi
+	done
+}
+
+# run_fio <name>: fsync after every write, from $NUMJOBS jobs
+run_fio()
+{
+	fio --name=$1 --directory=$MNT --ioengine=sync --rw=randwrite \
+	    --bs=$BS --size=64m --fsync=1 --numjobs=$NUMJOBS \
+	    --time_based --runtime=$RUNTIME --group_reporting \
+	    > $TMP/$1.out || return 1
+
+	echo "$1: write $(sed -n 's/.*write: \(IOPS=[^,]*\),.*/\1/p' \
+		$TMP/$1.out)"
+	grep -m1 '^ *clat' $TMP/$1.out
+}
+
+check_test_requirements
+trap cleanup EXIT
+
+mkdir $MNT
+truncate -s $IMG_SIZE $IMG
+DEV=$(losetup -f --show $IMG) || exit 1
+mkfs.ext4 -q -F -J size=128 $DEV || exit 1
+
+mount -t ext4 $DEV $MNT || exit 1
+run_fio full_commit || exit 1
+umount $MNT
+
+debugfs -w -R "feature FEATURE_C15" $DEV > /dev/null || exit 1
+mount -t ext4 $DEV $MNT || exit 1
+FC_INFO=/proc/fs/ext4/$(basename $DEV)/fc_info
+if [ ! -f $FC_INFO ]; then
+	echo "$0: kernel does not support fast commits"
+	exit $ksft_skip
+fi
+run_fio fast_commit || exit 1
+cat $FC_INFO
+
+commits=$(sed -n 's/^ *\([0-9]*\) commits$/\1/p' $FC_INFO)
+if [ "${commits:-0}" -eq 0 ]; then
+	echo "FAIL: no fast commits were done"
+	exit 1
+fi
+echo "PASS"
+exit 0
@@ -0,0 +1,99 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Parallel block allocation on a fragmented ext4, with mb_optimize_scan=0
+# and mb_optimize_scan=1.
+#
+# For each setting a scratch filesystem on a loop device is filled to
+# FILL percent with small files, every other one of which is then deleted
+# to leave holes in all groups.  It is remounted so that no group is
+# initialized, then NUMJOBS fio jobs fallocate files in BS pieces at the
+# same time.  Each run prints the fio allocation rate and completion
+# latency, and /proc/fs/ext4/<dev>/mb_stats.
+#
+# Environment: IMG_SIZE (default 16G), FILL (percent, default 80),
+# NUMJOBS (default 16), BS (default 64k), JOB_SIZE (default 256m).
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+IMG_SIZE=${IMG_SIZE:-16G}
+FILL=${FILL:-80}
+NUMJOBS=${NUMJOBS:-16}
+BS=${BS:-64k}
+JOB_SIZE=${JOB_SIZE:-256m}
+
+TMP=$(mktemp -d)
+IMG=$TMP/ext4.img
+MNT=$TMP/mnt
+DEV=
+
+cleanup()
+{
+	umount $MNT 2> /dev/null
+	[ -n "$DEV" ] && losetup -d $DEV
+	rm -rf $TMP
+}
+
+check_test_requirements()
+{
+	if [ $(id -u) -ne 0 ]; then
+		echo "$0: Must be run as root"
+		exit $ksft_skip
+	fi
+
+	for tool in mkfs.ext4 losetup fio; do
+		if ! which $tool > /dev/null 2>&1; then
+			echo "$0: You need $tool installed"
+			exit $ksft_skip
+		fi
+	done
+}
+
+# fragment: fill to $FILL% with 256k files, then free every other one
+fragment()
+{
+	local size=$(($(stat -f -c '%b * %S' $MNT) * FILL / 100))
+
+	mkdir $MNT/fill
+	fio --name=fill --directory=$MNT/fill --rw=write --bs=256k \
+	    --filesize=256k --nrfiles=$((size / 262144)) \
+	    --size=$size --openfiles=64 --fallocate=none \
+	    > /dev/null || return 1
+	find $MNT/fill -name '*[02468]' -delete
+}
+
+# run <mb_optimize_scan>
+run()
+{
+	local name=mb_optimize_scan=$1 opts="-o mb_optimize_scan=$1"
+
+	mkfs.ext4 -q -F $DEV || return 1
+	mount -t ext4 $opts $DEV $MNT || return 1
+	fragment || return 1
+	umount $MNT
+	mount -t ext4 $opts $DEV $MNT || return 1
+
+	echo 1 > /sys/fs/ext4/$(basename $DEV)/mb_stats
+	mkdir $MNT/alloc
+	fio --name=alloc --directory=$MNT/alloc --ioengine=falloc \
+	    --rw=write --bs=$BS --size=$JOB_SIZE --numjobs=$NUMJOBS \
+	    --group_reporting > $TMP/$1.out || return 1
+
+	echo "$name: $(sed -n 's/.*write: \(IOPS=[^,]*\),.*/\1/p' \
+		$TMP/$1.out)"
+	grep -m1 '^ *clat' $TMP/$1.out
+	cat /proc/fs/ext4/$(basename $DEV)/mb_stats
+	umount $MNT
+}
+
+check_test_requirements
+trap cleanup EXIT
+
+mkdir $MNT
+truncate -s $IMG_SIZE $IMG
+DEV=$(losetup -f --show $IMG) || exit 1
+
+run 0 || exit 1
+run 1 || exit 1
+exit 0
@@ -0,0 +1,118 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# fio over FUSE with the read(2)/write(2) transport and with the ring.
+#
+# fuse_ring_test serves one file in daemon mode, over /dev/fuse reads and
+# writes, then over the ring (-r); every I/O reaches the daemon as it opens
+# with FOPEN_DIRECT_IO.  If PASSTHROUGH_LL points to libfuse's passthrough_ll
+# example, it is run as well, with cache=never, over a file of the same size:
+# it does not know the ring, so it is a reference for the read/write
+# transport of a real daemon, not a third transport.
+#
+# Each run prints the fio IOPS and completion latency, for 4k random reads
+# and writes by default.
+#
+# Environment: SIZE (MiB, default 1024), RUNTIME (seconds, default 30),
+# NUMJOBS (default 4), BS (default 4k), PASSTHROUGH_LL (path, unset).
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+SIZE=${SIZE:-1024}
+RUNTIME=${RUNTIME:-30}
+NUMJOBS=${NUMJOBS:-4}
+BS=${BS:-4k}
+
+TMP=$(mktemp -d)
+MNT=$TMP/mnt
+SRC=$TMP/src
+DAEMON=
+
+cleanup()
+{
+	umount $MNT 2> /dev/null
+	[ -n "$DAEMON" ] && wait $DAEMON
+	rm -rf $TMP
+}
+
+check_test_requirements()
+{
+	if [ $(id -u) -ne 0 ]; then
+		echo "$0: Must be run as root"
+		exit $ksft_skip
+	fi
+
+	if [ ! -c /dev/fuse ]; then
+		echo "$0: /dev/fuse is not available"
+		exit $ksft_skip
+	fi
+
+	if ! which fio > /dev/null 2>&1; then
+		echo "$0: You need fio installed"
+		exit $ksft_skip
+	fi
+
+	if [ ! -x ./fuse_ring_test ]; then
+		echo "$0: fuse_ring_test is not built"
+		exit $ksft_skip
+	fi
+}
+
+# wait_mounted: the daemons mount from the background
+wait_mounted()
+{
+	local i
+
+	for i in $(seq 50); do
+		mountpoint -q $MNT && return 0
+		sleep 0.1
+	done
+	echo "$0: $MNT did not get mounted"
+	return 1
+}
+
+# run_fio <name> <rw>
+run_fio()
+{
+	fio --name=$1-$2 --filename=$MNT/file --ioengine=psync --rw=$2 \
+	    --bs=$BS --size=${SIZE}m --numjobs=$NUMJOBS \
+	    --time_based --runtime=$RUNTIME --group_reporting \
+	    > $TMP/$1-$2.out || return 1
+
+	echo "$1 $2: $(sed -n 's/.*\(IOPS=[^,]*\),.*/\1/p' $TMP/$1-$2.out)"
+	grep -m1 '^ *clat' $TMP/$1-$2.out
+}
+
+# run <name> <daemon command...>
+run()
+{
+	local name=$1 ret=0
+
+	shift
+	"$@" &
+	DAEMON=$!
+	wait_mounted || return 1
+
+	run_fio $name randread && run_fio $name randwrite || ret=1
+
+	umount $MNT
+	wait $DAEMON || ret=1
+	DAEMON=
+	return $ret
+}
+
+check_test_requirements
+trap cleanup EXIT
+mkdir $MNT $SRC
+
+run read-write ./fuse_ring_test -m $MNT -s $SIZE || exit 1
+run ring ./fuse_ring_test -m $MNT -s $SIZE -r || exit 1
+
+if [ -n "$PASSTHROUGH_LL" ]; then
+	truncate -s ${SIZE}m $SRC/file
+	run passthrough_ll $PASSTHROUGH_LL -f -o source=$SRC,cache=never \
+		$MNT || exit 1
+fi
+
+exit 0
@@ -0,0 +1,504 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * FUSE shared-memory ring test
+ *
+ * A minimal FUSE daemon serving a single file, "file", whose byte at offset
+ * o is o % 251.  It talks to /dev/fuse either with read(2)/write(2) or with
+ * the ring set up by FUSE_DEV_IOC_RING_SETUP and driven by
+ * FUSE_DEV_IOC_RING_ENTER.
+ *
+ * Without arguments it runs the self test: ring setup must fail before INIT
+ * and a second setup on the same device must fail, then the file is read and
+ * written through the ring and the daemon checks the written data.
+ *
+ * "fuse_ring_test -m <mountpoint> [-r] [-s <MiB>]" instead serves the file
+ * until unmounted, over the ring with -r, for fuse_ring_bench.sh.  Opens then
+ * use FOPEN_DIRECT_IO so that every read and write reaches the daemon, and
+ * written data is not checked.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../kselftest.h"
+
+#define ROOT_INO	1
+#define FILE_INO	2
+#define FILE_NAME	"file"
+#define MAX_WRITE	(128 * 1024)
+#define RING_ENTRIES	16
+#define PATTERN_LEN	251
+
+static unsigned char pattern[PATTERN_LEN + MAX_WRITE];
+static uint64_t file_size = 8 << 20;
+static uint32_t slot_size;
+static int direct_io, verify;
+
+static void fill(unsigned char *buf, uint64_t off, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (off + i) % PATTERN_LEN;
+}
+
+static void fill_attr(struct fuse_attr *attr, uint64_t ino)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = ino;
+	attr->blksize = 4096;
+	if (ino == ROOT_INO) {
+		attr->mode = S_IFDIR | 0755;
+		attr->nlink = 2;
+	} else {
+		attr->mode = S_IFREG | 0644;
+		attr->nlink = 1;
+		attr->size = file_size;
+		attr->blocks = file_size / 512;
+	}
+}
+
+/*
+ * Build the reply to the request at @in at @out, which may be the same
+ * buffer: everything needed from the request is read before the reply is
+ * written.  Returns the length of the reply, 0 if the request has none.
+ */
+static size_t handle(const void *in, void *out)
+{
+	struct fuse_in_header ih = *(const struct fuse_in_header *)in;
+	const char *arg = (const char *)in + sizeof(ih);
+	struct fuse_out_header *oh = out;
+	char *res = (char *)(oh + 1);
+	size_t len = 0;
+	int err = 0;
+
+	switch (ih.opcode) {
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+	case FUSE_INTERRUPT:
+		return 0;
+	case FUSE_INIT: {
+		struct fuse_init_in ii;
+		struct fuse_init_out io;
+
+		memcpy(&ii, arg, sizeof(ii));
+		if (ii.major != FUSE_KERNEL_VERSION) {
+			err = -EPROTO;
+			break;
+		}
+		memset(&io, 0, sizeof(io));
+		io.major = FUSE_KERNEL_VERSION;
+		io.minor = FUSE_KERNEL_MINOR_VERSION;
+		io.max_readahead = ii.max_readahead;
+		io.flags = ii.flags & (FUSE_ASYNC_READ | FUSE_BIG_WRITES);
+		io.max_background = 64;
+		io.congestion_threshold = 48;
+		io.max_write = MAX_WRITE;
+		memcpy(res, &io, sizeof(io));
+		len = sizeof(io);
+		break;
+	}
+	case FUSE_LOOKUP: {
+		struct fuse_entry_out eo;
+
+		if (ih.nodeid != ROOT_INO || strcmp(arg, FILE_NAME)) {
+			err = -ENOENT;
+			break;
+		}
+		memset(&eo, 0, sizeof(eo));
+		eo.nodeid = FILE_INO;
+		eo.entry_valid = 3600;
+		eo.attr_valid = 3600;
+		fill_attr(&eo.attr, FILE_INO);
+		memcpy(res, &eo, sizeof(eo));
+		len = sizeof(eo);
+		break;
+	}
+	case FUSE_GETATTR:
+	case FUSE_SETATTR: {
+		struct fuse_attr_out ao;
+
+		if (ih.nodeid != ROOT_INO && ih.nodeid != FILE_INO) {
+			err = -ENOENT;
+			break;
+		}
+		memset(&ao, 0, sizeof(ao));
+		ao.attr_valid = 3600;
+		fill_attr(&ao.attr, ih.nodeid);
+		memcpy(res, &ao, sizeof(ao));
+		len = sizeof(ao);
+		break;
+	}
+	case FUSE_OPEN: {
+		struct fuse_open_out oo;
+
+		memset(&oo, 0, sizeof(oo));
+		if (direct_io)
+			oo.open_flags = FOPEN_DIRECT_IO;
+		memcpy(res, &oo, sizeof(oo));
+		len = sizeof(oo);
+		break;
+	}
+	case FUSE_READ: {
+		struct fuse_read_in ri;
+
+		memcpy(&ri, arg, sizeof(ri));
+		if (ri.offset < file_size)
+			len = file_size - ri.offset;
+		if (len > ri.size)
+			len = ri.size;
+		if (len > MAX_WRITE) {
+			err = -EIO;
+			break;
+		}
+		memcpy(res, pattern + ri.offset % PATTERN_LEN, len);
+		break;
+	}
+	case FUSE_WRITE: {
+		struct fuse_write_in wi;
+		struct fuse_write_out wo;
+
+		memcpy(&wi, arg, sizeof(wi));
+		if (wi.size > MAX_WRITE ||
+		    (verify && memcmp(arg + sizeof(wi),
+				      pattern + wi.offset % PATTERN_LEN,
+				      wi.size))) {
+			err = -EIO;
+			break;
+		}
+		memset(&wo, 0, sizeof(wo));
+		wo.size = wi.size;
+		memcpy(res, &wo, sizeof(wo));
+		len = sizeof(wo);
+		break;
+	}
+	case FUSE_FLUSH:
+	case FUSE_RELEASE:
+	case FUSE_FSYNC:
+	case FUSE_DESTROY:
+		break;
+	default:
+		err = -ENOSYS;
+		break;
+	}
+
+	oh->unique = ih.unique;
+	oh->error = err;
+	oh->len = sizeof(*oh) + (err ? 0 : len);
+	return oh->len;
+}
+
+/* Serve requests with read(2) and write(2), only INIT if @init_only */
+static int serve_rw(int fd, int init_only)
+{
+	char *in = malloc(slot_size), *out = malloc(slot_size);
+	int ret = 0;
+
+	if (!in || !out) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (;;) {
+		ssize_t n = read(fd, in, slot_size);
+		size_t len;
+		int opcode;
+
+		if (n < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			if (errno != ENODEV)
+				ret = -errno;
+			break;
+		}
+
+		opcode = ((struct fuse_in_header *)in)->opcode;
+		len = handle(in, out);
+		if (len && write(fd, out, len) < 0 && errno != ENOENT) {
+			if (errno != ENODEV)
+				ret = -errno;
+			break;
+		}
+		if (init_only && opcode == FUSE_INIT)
+			break;
+	}
+out:
+	free(in);
+	free(out);
+	return ret;
+}
+
+/* Serve requests over the ring until the connection goes away */
+static int serve_ring(int fd)
+{
+	struct fuse_ring_setup rs = {
+		.entries = RING_ENTRIES,
+		.slot_size = slot_size,
+	};
+	struct fuse_ring_enter re = { .min_requests = 1 };
+	struct fuse_ring_ctl *ctl;
+	uint32_t *req, *rep, mask, head, tail, rep_tail;
+	char *base, *slots;
+	int err = 0;
+
+	if (ioctl(fd, FUSE_DEV_IOC_RING_SETUP, &rs)) {
+		err = -errno;
+		ksft_print_msg("ring setup: %s\n", strerror(-err));
+		return err;
+	}
+	if (ioctl(fd, FUSE_DEV_IOC_RING_SETUP, &rs) != -1 || errno != EBUSY) {
+		ksft_print_msg("second ring setup did not fail with EBUSY\n");
+		return -EINVAL;
+	}
+
+	base = mmap(NULL, rs.ring_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	if (base == MAP_FAILED) {
+		err = -errno;
+		ksft_print_msg("ring mmap: %s\n", strerror(-err));
+		return err;
+	}
+	ctl = (struct fuse_ring_ctl *)base;
+	req = (uint32_t *)(base + ctl->req_off);
+	rep = (uint32_t *)(base + ctl->rep_off);
+	slots = base + rs.slots_off;
+	mask = ctl->entries - 1;
+
+	for (;;) {
+		if (ioctl(fd, FUSE_DEV_IOC_RING_ENTER, &re) < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENODEV || errno == ECONNABORTED)
+				break;
+			err = -errno;
+			ksft_print_msg("ring enter: %s\n", strerror(-err));
+			break;
+		}
+
+		/* Replies are picked up by the next FUSE_DEV_IOC_RING_ENTER */
+		head = ctl->req_head;
+		tail = __atomic_load_n(&ctl->req_tail, __ATOMIC_ACQUIRE);
+		rep_tail = ctl->rep_tail;
+		while (head != tail) {
+			uint32_t slot = req[head++ & mask];
+			char *msg = slots + (size_t)slot * ctl->slot_size;
+
+			if (!handle(msg, msg))
+				((struct fuse_out_header *)msg)->len = 0;
+			rep[rep_tail++ & mask] = slot;
+		}
+		ctl->req_head = head;
+		__atomic_store_n(&ctl->rep_tail, rep_tail, __ATOMIC_RELEASE);
+	}
+
+	munmap(base, rs.ring_size);
+	return err;
+}
+
+static int mount_fuse(const char *mnt)
+{
+	char opts[128];
+	int fd;
+
+	fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=%u,group_id=%u,max_read=%u",
+		 fd, getuid(), getgid(), MAX_WRITE);
+	if (mount("fuse_ring_test", mnt, "fuse", MS_NOSUID | MS_NODEV, opts)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Read the whole file back, then write it in odd-sized pieces */
+static int check_io(const char *mnt)
+{
+	size_t chunk = 1 << 20, piece = 100003;
+	unsigned char *buf, *exp;
+	char path[256];
+	uint64_t off;
+	ssize_t n;
+	int fd, ret = -1;
+
+	snprintf(path, sizeof(path), "%s/%s", mnt, FILE_NAME);
+	buf = malloc(chunk);
+	exp = malloc(chunk);
+	fd = open(path, O_RDWR);
+	if (!buf || !exp || fd < 0) {
+		ksft_print_msg("open %s: %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	for (off = 0; (n = pread(fd, buf, chunk, off)) > 0; off += n) {
+		fill(exp, off, n);
+		if (memcmp(buf, exp, n)) {
+			ksft_print_msg("bad data at %" PRIu64 "\n", off);
+			goto out;
+		}
+	}
+	if (n < 0 || off != file_size) {
+		ksft_print_msg("read %" PRIu64 " bytes: %s\n", off,
+			       n < 0 ? strerror(errno) : "short read");
+		goto out;
+	}
+
+	for (off = 12345; off + piece <= file_size; off += piece) {
+		fill(buf, off, piece);
+		if (pwrite(fd, buf, piece, off) != (ssize_t)piece) {
+			ksft_print_msg("write at %" PRIu64 ": %s\n", off,
+				       strerror(errno));
+			goto out;
+		}
+	}
+	if (fsync(fd) && errno != ENOSYS) {
+		ksft_print_msg("fsync: %s\n", strerror(errno));
+		goto out;
+	}
+	ret = 0;
+out:
+	if (fd >= 0 && close(fd)) {
+		ksft_print_msg("close: %s\n", strerror(errno));
+		ret = -1;
+	}
+	free(buf);
+	free(exp);
+	return ret;
+}
+
+static int self_test(void)
+{
+	char mnt[] = "/tmp/fuse_ring_test.XXXXXX";
+	struct fuse_ring_setup rs = {
+		.entries = RING_ENTRIES,
+		.slot_size = slot_size,
+	};
+	int fd, status;
+	pid_t pid;
+
+	ksft_print_header();
+	ksft_set_plan(3);
+
+	if (getuid())
+		ksft_exit_skip("Must be run as root\n");
+	if (!mkdtemp(mnt))
+		ksft_exit_fail_msg("mkdtemp: %s\n", strerror(errno));
+
+	fd = mount_fuse(mnt);
+	if (fd < 0) {
+		int err = errno;
+
+		rmdir(mnt);
+		if (err == ENOENT || err == ENODEV)
+			ksft_exit_skip("FUSE is not available\n");
+		ksft_exit_fail_msg("mount: %s\n", strerror(err));
+	}
+
+	if (ioctl(fd, FUSE_DEV_IOC_RING_SETUP, &rs) == 0 || errno != EAGAIN) {
+		int err = errno;
+
+		umount(mnt);
+		rmdir(mnt);
+		if (err == ENOTTY)
+			ksft_exit_skip("FUSE rings are not supported\n");
+		ksft_exit_fail_msg("ring setup before INIT: %s\n",
+				   strerror(err));
+	}
+	ksft_test_result_pass("ring setup before INIT\n");
+
+	pid = fork();
+	if (pid < 0)
+		ksft_exit_fail_msg("fork: %s\n", strerror(errno));
+	if (!pid) {
+		verify = 1;
+		_exit(serve_rw(fd, 1) || serve_ring(fd) ? 1 : 0);
+	}
+	close(fd);
+
+	if (check_io(mnt))
+		ksft_test_result_fail("I/O over the ring\n");
+	else
+		ksft_test_result_pass("I/O over the ring\n");
+
+	if (umount(mnt))
+		umount2(mnt, MNT_DETACH);
+	rmdir(mnt);
+
+	if (waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+	    !WEXITSTATUS(status))
+		ksft_test_result_pass("daemon exit\n");
+	else
+		ksft_test_result_fail("daemon exit\n");
+
+	ksft_print_cnts();
+	return ksft_get_fail_cnt() ? ksft_exit_fail() : ksft_exit_pass();
+}
+
+static int serve(const char *mnt, int ring)
+{
+	int fd, err;
+
+	direct_io = 1;
+	fd = mount_fuse(mnt);
+	if (fd < 0) {
+		perror("mount");
+		return 1;
+	}
+
+	err = serve_rw(fd, ring);
+	if (!err && ring)
+		err = serve_ring(fd);
+	if (err)
+		fprintf(stderr, "%s\n", strerror(-err));
+	return err ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *mnt = NULL;
+	long page = sysconf(_SC_PAGESIZE);
+	int opt, ring = 0;
+
+	while ((opt = getopt(argc, argv, "m:rs:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mnt = optarg;
+			break;
+		case 'r':
+			ring = 1;
+			break;
+		case 's':
+			file_size = strtoull(optarg, NULL, 0) << 20;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-m mountpoint [-r] [-s MiB]]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	fill(pattern, 0, sizeof(pattern));
+	/* Room for the largest WRITE request, as the kernel requires */
+	slot_size = sizeof(struct fuse_in_header) +
+		    sizeof(struct fuse_write_in) + MAX_WRITE;
+	slot_size = (slot_size + page - 1) / page * page;
+
+	return mnt ? serve(mnt, ring) : self_test();
+}